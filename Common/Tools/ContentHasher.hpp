@@ -0,0 +1,377 @@
+//
+//  ContentHasher.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef ContentHasher_hpp
+#define ContentHasher_hpp
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Digest.hpp"
+#include "ThreadPool.hpp"
+
+// Version of a file as far as the metadata tells, two events with the same version are about
+// the same contents
+struct FileVersion {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t mtime = 0;          // nanoseconds
+    uint64_t size = 0;
+
+    bool operator==(const FileVersion &other) const
+    {
+        return device == other.device && inode == other.inode && mtime == other.mtime && size == other.size;
+    }
+    bool operator!=(const FileVersion &other) const { return !(*this == other); }
+
+    static FileVersion of(const struct stat &st)
+    {
+        FileVersion version;
+        version.device = static_cast<uint64_t>(st.st_dev);
+        version.inode = static_cast<uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+        version.mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        version.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        version.size = static_cast<uint64_t>(st.st_size);
+        return version;
+    }
+};
+
+struct ContentDigest {
+    std::string path;
+    FileVersion version;                // of the hashed contents
+    uint8_t sha256[Sha256::kSize] = {};
+    uint64_t xxh64 = 0;
+    int error = 0;                      // errno if the file could not be hashed
+};
+
+struct ContentHasherConfig {
+    std::size_t inFlight = 0;           // files hashed at once, 0 for the size of the pool
+    std::size_t queue = 4096;           // files waiting or hashed but not drained yet
+    std::size_t remembered = 1 << 16;   // versions kept to skip files hashed already
+    std::size_t readSize = 1 << 20;     // one read() of a file
+};
+
+// Hashes the files reported as modified (es_event_close_t.modified, FSE_CONTENT_MODIFIED) on a
+// thread pool, SHA-256 and XXH64 in one pass over the data.
+//
+// submit() never blocks the event loop: a file whose version (device, inode, mtime, size) was
+// hashed already is skipped, a file which is queued already gets the newer path and version,
+// and once the queue is full the file is refused so the caller can count it as dropped (and
+// rescan later). At most inFlight files are on the pool at once, the pool stays available to
+// other work. The digests are collected on the event loop by drain(); the digests which were
+// not drained count against the queue, a consumer which falls behind slows the intake down.
+//
+// The files are read with large reads into an aligned buffer of every worker rather than
+// mapped: a writer truncating a mapped file would raise SIGBUS in the reader. A file which
+// changes while it is read is read again once, then reported with EAGAIN (its next event
+// brings it back).
+class ContentHasher
+{
+public:
+    using Config = ContentHasherConfig;
+
+    enum class Queued : uint8_t {
+        Queued,
+        Coalesced,      // merged with the queued request of the same file
+        Duplicate,      // this version was hashed already, or is being hashed
+        Full,           // refused, the queue is full
+        Error,          // the file could not be stat'ed
+    };
+
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t hashed = 0;
+        uint64_t bytes = 0;
+        uint64_t duplicates = 0;
+        uint64_t coalesced = 0;
+        uint64_t dropped = 0;
+        uint64_t errors = 0;
+    };
+
+    explicit ContentHasher(ThreadPool &pool, Config config = Config())
+        : m_pool(pool), m_config(config)
+    {
+        if (m_config.inFlight == 0)
+            m_config.inFlight = pool.size();
+        if (m_config.readSize < 4096)
+            m_config.readSize = 4096;
+    }
+
+    ContentHasher(const ContentHasher&) = delete;
+    ContentHasher &operator=(const ContentHasher&) = delete;
+
+    // The tasks on the pool refer to the hasher, they are waited for
+    ~ContentHasher()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_waiting.clear();
+        m_idle.wait(lock, [this] { return m_running == 0; });
+    }
+
+    Queued submit(const std::string &path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.submitted;
+            ++m_stats.errors;
+            return Queued::Error;
+        }
+        return submit(path, FileVersion::of(st));
+    }
+
+    // The version comes with the event (es_file_t.stat), no syscall is needed then
+    Queued submit(const std::string &path, const FileVersion &version)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.submitted;
+        const Key key {version.device, version.inode};
+        const auto pending = m_pending.find(key);
+        if (pending != m_pending.end()) {
+            Request &request = pending->second;
+            if (request.version == version) {
+                ++m_stats.duplicates;
+                return Queued::Duplicate;
+            }
+            // A running request is queued once more when it is done
+            request.path = path;
+            request.version = version;
+            request.again = request.running;
+            ++m_stats.coalesced;
+            return Queued::Coalesced;
+        }
+        const auto last = m_hashed.find(key);
+        if (last != m_hashed.end() && last->second == version) {
+            ++m_stats.duplicates;
+            return Queued::Duplicate;
+        }
+        if (m_waiting.size() + m_done.size() >= m_config.queue) {
+            ++m_stats.dropped;
+            return Queued::Full;
+        }
+        m_pending.emplace(key, Request {path, version, false, false});
+        m_waiting.push_back(key);
+        dispatch();
+        return Queued::Queued;
+    }
+
+    // Passes the finished digests to f(const ContentDigest &), returns their number
+    template <typename F>
+    std::size_t drain(F &&f)
+    {
+        std::vector<ContentDigest> done;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            done.swap(m_done);
+        }
+        for (const ContentDigest &digest : done)
+            f(digest);
+        return done.size();
+    }
+
+    // Blocks until the queued files are hashed. Must not be called from a task of the pool.
+    void finish()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_running == 0 && m_waiting.empty(); });
+    }
+
+    std::size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pending.size();
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    struct Key {
+        uint64_t device;
+        uint64_t inode;
+        bool operator==(const Key &other) const { return device == other.device && inode == other.inode; }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key &key) const
+        {
+            return static_cast<std::size_t>((key.inode * 0x9e3779b97f4a7c15ull) ^ key.device);
+        }
+    };
+
+    struct Request {
+        std::string path;
+        FileVersion version;
+        bool running;
+        bool again;             // changed while it was being hashed
+    };
+
+    struct BufferDeleter {
+        void operator()(void *p) const { std::free(p); }
+    };
+
+    ThreadPool &m_pool;
+    Config m_config;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::unordered_map<Key, Request, KeyHash> m_pending;    // waiting or running
+    std::deque<Key> m_waiting;
+    std::vector<ContentDigest> m_done;
+    std::unordered_map<Key, FileVersion, KeyHash> m_hashed; // last hashed version of a file
+    std::size_t m_running = 0;
+    Stats m_stats;
+
+    // Moves waiting requests to the pool while there is room, the lock is held
+    void dispatch()
+    {
+        while (m_running < m_config.inFlight && !m_waiting.empty()) {
+            const Key key = m_waiting.front();
+            m_waiting.pop_front();
+            const auto pending = m_pending.find(key);
+            if (pending == m_pending.end())
+                continue;
+            pending->second.running = true;
+            ++m_running;
+            m_pool.submit([this, key, path = pending->second.path] { run(key, path); });
+        }
+    }
+
+    void run(const Key &key, const std::string &path)
+    {
+        ContentDigest digest;
+        digest.path = path;
+        uint64_t bytes = 0;
+        digest.error = hash(path, digest, bytes);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const bool hashed = digest.error == 0;
+        const FileVersion version = digest.version;
+        if (hashed) {
+            ++m_stats.hashed;
+            m_stats.bytes += bytes;
+            // Forgets all at once, the dedup only has to cover a burst of events
+            if (m_hashed.size() >= m_config.remembered)
+                m_hashed.clear();
+            m_hashed[key] = digest.version;
+        } else {
+            ++m_stats.errors;
+        }
+        m_done.push_back(std::move(digest));
+
+        const auto pending = m_pending.find(key);
+        if (pending != m_pending.end()) {
+            Request &request = pending->second;
+            if (request.again && (!hashed || request.version != version)) {
+                request.running = request.again = false;
+                m_waiting.push_back(key);
+            } else {
+                m_pending.erase(pending);
+            }
+        }
+        --m_running;
+        dispatch();
+        if (m_running == 0 && m_waiting.empty())
+            m_idle.notify_all();
+    }
+
+    // Hashes the file into the digest, returns 0 or errno
+    int hash(const std::string &path, ContentDigest &digest, uint64_t &bytes)
+    {
+        thread_local std::unique_ptr<void, BufferDeleter> buffer;
+        thread_local std::size_t bufferSize = 0;
+        if (bufferSize != m_config.readSize) {
+            void *p = nullptr;
+            if (posix_memalign(&p, 4096, m_config.readSize) != 0)
+                return ENOMEM;
+            buffer.reset(p);
+            bufferSize = m_config.readSize;
+        }
+        char *data = static_cast<char *>(buffer.get());
+
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return errno;
+#if defined(__APPLE__)
+        fcntl(fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        int error = EAGAIN;
+        for (int attempt = 0; attempt < 2 && error == EAGAIN; ++attempt) {
+            struct stat before, after;
+            if (fstat(fd, &before) != 0) {
+                error = errno;
+                break;
+            }
+            if (!S_ISREG(before.st_mode)) {
+                error = EINVAL;
+                break;
+            }
+            Sha256 sha;
+            XXH64 xxh;
+            bytes = 0;
+            error = 0;
+            for (off_t offset = 0; ; ) {
+                const ssize_t n = pread(fd, data, bufferSize, offset);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    error = errno;
+                    break;
+                }
+                if (n == 0)
+                    break;
+                // Both hashes over a slice while it is in the cache
+                for (ssize_t at = 0; at < n; at += kSlice) {
+                    const std::size_t size = static_cast<std::size_t>((n - at < kSlice) ? n - at : kSlice);
+                    sha.update(data + at, size);
+                    xxh.update(data + at, size);
+                }
+                offset += n;
+                bytes += static_cast<uint64_t>(n);
+            }
+            if (error != 0)
+                break;
+            if (fstat(fd, &after) != 0) {
+                error = errno;
+                break;
+            }
+            digest.version = FileVersion::of(after);
+            if (FileVersion::of(before) != digest.version || bytes != digest.version.size) {
+                error = EAGAIN;
+                continue;
+            }
+            sha.finish(digest.sha256);
+            digest.xxh64 = xxh.finish();
+        }
+        close(fd);
+        return error;
+    }
+
+    static constexpr ssize_t kSlice = 64 * 1024;
+};
+
+#endif /* ContentHasher_hpp */
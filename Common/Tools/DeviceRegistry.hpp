@@ -0,0 +1,489 @@
+//
+//  DeviceRegistry.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef DeviceRegistry_hpp
+#define DeviceRegistry_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Identity and description of a device (IOKit service, DiskArbitration disk)
+struct DeviceInfo {
+    uint64_t registryId = 0;            // IORegistryEntryGetRegistryEntryID(), never 0
+    std::string bsdName;                // "disk4s1", empty if the device has none
+    std::string name;
+
+    bool operator==(const DeviceInfo &other) const
+    {
+        return registryId == other.registryId && bsdName == other.bsdName && name == other.name;
+    }
+    bool operator!=(const DeviceInfo &other) const { return !(*this == other); }
+};
+
+// Devices sorted by registry ID
+using DeviceSnapshot = std::vector<DeviceInfo>;
+
+// Devices reported by the callbacks of a storm (a hub or a dock attached at once), applied to the
+// registry together. The last event of a device wins.
+class DeviceBatch
+{
+public:
+    void add(DeviceInfo info) { m_events.push_back({true, std::move(info)}); }
+
+    void remove(uint64_t registryId)
+    {
+        DeviceInfo info;
+        info.registryId = registryId;
+        m_events.push_back({false, std::move(info)});
+    }
+
+    bool empty() const { return m_events.empty(); }
+    std::size_t size() const { return m_events.size(); }
+    void clear() { m_events.clear(); }
+
+private:
+    template <typename> friend class DeviceRegistry;
+
+    struct Event {
+        bool present;
+        DeviceInfo info;
+    };
+    std::vector<Event> m_events;
+};
+
+// Handle of a registered device, it does not match a later device which reuses the slot
+struct DeviceHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    explicit operator bool() const { return index != UINT32_MAX; }
+    bool operator==(const DeviceHandle &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const DeviceHandle &other) const { return !(*this == other); }
+};
+
+struct DeviceNoData {};
+
+// Devices known to a monitor with the monitor's data of every device (i.e. the io_object_t of an
+// interest notification), so no allocation is owned by a callback context.
+//
+// The entries live in a slot map: a vector of slots reused through a free list, every slot with
+// a generation which is bumped when the slot is released. The registry IDs and BSD names are
+// indexed by two open addressing tables of slot indexes, the keys are only stored in the slots.
+// The registry is used from one thread (the run loop of the monitor).
+//
+// Storms are applied in one pass: apply() takes a DeviceBatch (the events collected meanwhile)
+// or a full DeviceSnapshot (a resync, everything not in it is removed) and reports the net
+// changes, a device which came and went within the batch is not reported at all.
+template <typename Data = DeviceNoData>
+class DeviceRegistry
+{
+public:
+    enum class Change : uint8_t {
+        Added,
+        Removed,        // reported before the entry is released, its data can be cleaned up
+        Changed,        // the BSD name or the name differ
+    };
+
+    struct Entry {
+        DeviceInfo info;
+        Data data {};
+    };
+
+    struct Stats {
+        std::size_t added = 0;
+        std::size_t removed = 0;
+        std::size_t changed = 0;
+    };
+
+    // Registers the device, or updates the entry with the same registry ID
+    DeviceHandle add(DeviceInfo info, Data data = Data())
+    {
+        DeviceHandle handle = find(info.registryId);
+        if (!handle) {
+            handle = allocate();
+            m_slots[handle.index].entry.info.registryId = info.registryId;
+            m_byRegistryId.insert(hashId(info.registryId), handle.index);
+        }
+        Entry &entry = m_slots[handle.index].entry;
+        rename(handle.index, info.bsdName);
+        entry.info = std::move(info);
+        entry.data = std::move(data);
+        return handle;
+    }
+
+    bool remove(DeviceHandle handle)
+    {
+        if (!get(handle))
+            return false;
+        release(handle.index);
+        return true;
+    }
+
+    // nullptr if the device is gone
+    Entry *get(DeviceHandle handle)
+    {
+        if (handle.index >= m_slots.size() || !m_slots[handle.index].used || m_slots[handle.index].generation != handle.generation)
+            return nullptr;
+        return &m_slots[handle.index].entry;
+    }
+
+    const Entry *get(DeviceHandle handle) const { return const_cast<DeviceRegistry *>(this)->get(handle); }
+
+    DeviceHandle find(uint64_t registryId) const
+    {
+        const uint32_t index = m_byRegistryId.find(hashId(registryId), [&](uint32_t i) {
+            return m_slots[i].entry.info.registryId == registryId;
+        });
+        return (index == kNone) ? DeviceHandle() : handleOf(index);
+    }
+
+    DeviceHandle findBSDName(const std::string &bsdName) const
+    {
+        const uint32_t index = findName(bsdName);
+        return (index == kNone) ? DeviceHandle() : handleOf(index);
+    }
+
+    std::size_t size() const { return m_byRegistryId.size(); }
+
+    // Calls f(DeviceHandle, Entry &) for every device
+    template <typename F>
+    void forEach(F &&f)
+    {
+        for (uint32_t i = 0; i < m_slots.size(); ++i)
+            if (m_slots[i].used)
+                f(handleOf(i), m_slots[i].entry);
+    }
+
+    DeviceSnapshot snapshot() const
+    {
+        DeviceSnapshot devices;
+        devices.reserve(size());
+        for (const Slot &slot : m_slots)
+            if (slot.used)
+                devices.push_back(slot.entry.info);
+        sort(devices);
+        return devices;
+    }
+
+    static void sort(DeviceSnapshot &devices) { std::sort(devices.begin(), devices.end(), lessId); }
+
+    // Passes the differences of two snapshots to f(Change, const DeviceInfo &) by a merge, the
+    // new info for Added and Changed, the old one for Removed
+    template <typename F>
+    static Stats diff(const DeviceSnapshot &before, const DeviceSnapshot &after, F &&f)
+    {
+        Stats stats;
+        std::size_t i = 0, j = 0;
+        while (i < before.size() || j < after.size()) {
+            if (j == after.size() || (i < before.size() && before[i].registryId < after[j].registryId)) {
+                f(Change::Removed, before[i++]);
+                ++stats.removed;
+            } else if (i == before.size() || after[j].registryId < before[i].registryId) {
+                f(Change::Added, after[j++]);
+                ++stats.added;
+            } else {
+                if (before[i] != after[j]) {
+                    f(Change::Changed, after[j]);
+                    ++stats.changed;
+                }
+                ++i;
+                ++j;
+            }
+        }
+        return stats;
+    }
+
+    // Brings the registry to the snapshot (sorted by registry ID), calls
+    // f(Change, DeviceHandle, Entry &) for every difference
+    template <typename F>
+    Stats apply(const DeviceSnapshot &current, F &&f)
+    {
+        Stats stats;
+        for (uint32_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].used && !std::binary_search(current.begin(), current.end(), m_slots[i].entry.info, lessId))
+                removeReported(i, f, stats);
+        }
+        reserve(current.size());
+        for (const DeviceInfo &info : current)
+            addReported(info, f, stats);
+        return stats;
+    }
+
+    // Applies the events of the batch as their net effect and clears it
+    template <typename F>
+    Stats apply(DeviceBatch &batch, F &&f)
+    {
+        // The last event of every device, in the order of the first ones
+        std::vector<std::pair<uint64_t, uint32_t>> &events = m_scratch;
+        events.clear();
+        for (uint32_t i = 0; i < batch.m_events.size(); ++i)
+            events.emplace_back(batch.m_events[i].info.registryId, i);
+        std::sort(events.begin(), events.end());
+        std::size_t devices = 0;
+        for (std::size_t i = 0; i < events.size(); ) {
+            std::size_t j = i;
+            while (j + 1 < events.size() && events[j + 1].first == events[i].first)
+                ++j;
+            events[devices++] = {events[i].second, events[j].second};
+            i = j + 1;
+        }
+        events.resize(devices);
+        std::sort(events.begin(), events.end());
+
+        reserve(size() + devices);
+        Stats stats;
+        for (const auto &device : events) {
+            DeviceBatch::Event &event = batch.m_events[device.second];
+            if (event.present) {
+                addReported(std::move(event.info), f, stats);
+            } else {
+                const DeviceHandle handle = find(event.info.registryId);
+                if (handle)
+                    removeReported(handle.index, f, stats);
+            }
+        }
+        batch.clear();
+        return stats;
+    }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Slot {
+        uint32_t generation = 0;
+        bool used = false;
+        bool named = false;             // holds its BSD name in the index
+        Entry entry;
+    };
+
+    // Open addressing table of slot indexes with linear probing and backward shift deletion. The
+    // hash is kept with the index, a probe reads a slot only when the hashes match. It doubles
+    // at half load.
+    class Table
+    {
+    public:
+        Table() { m_slots.assign(16, Cell {0, kNone}); }
+
+        template <typename Equal>
+        uint32_t find(uint32_t hash, Equal &&equal) const
+        {
+            for (std::size_t i = hash & mask(); ; i = (i + 1) & mask()) {
+                const Cell &cell = m_slots[i];
+                if (cell.index == kNone)
+                    return kNone;
+                if (cell.hash == hash && equal(cell.index))
+                    return cell.index;
+            }
+        }
+
+        void insert(uint32_t hash, uint32_t index)
+        {
+            if (2 * (m_size + 1) > m_slots.size())
+                rehash(2 * m_slots.size());
+            place(hash, index);
+            ++m_size;
+        }
+
+        void erase(uint32_t hash, uint32_t index)
+        {
+            std::size_t i = hash & mask();
+            while (m_slots[i].index != index) {
+                if (m_slots[i].index == kNone)
+                    return;
+                i = (i + 1) & mask();
+            }
+            // Moves the following slots of the probe sequence into the hole
+            for (std::size_t j = i; ; ) {
+                j = (j + 1) & mask();
+                if (m_slots[j].index == kNone)
+                    break;
+                const std::size_t home = m_slots[j].hash & mask();
+                if (((j - home) & mask()) >= ((j - i) & mask())) {
+                    m_slots[i] = m_slots[j];
+                    i = j;
+                }
+            }
+            m_slots[i] = Cell {0, kNone};
+            --m_size;
+        }
+
+        void reserve(std::size_t count)
+        {
+            std::size_t size = m_slots.size();
+            while (size < 2 * count)
+                size *= 2;
+            if (size != m_slots.size())
+                rehash(size);
+        }
+
+        std::size_t size() const { return m_size; }
+
+    private:
+        struct Cell {
+            uint32_t hash;
+            uint32_t index;                         // kNone if empty
+        };
+        std::vector<Cell> m_slots;
+        std::size_t m_size = 0;
+
+        std::size_t mask() const { return m_slots.size() - 1; }
+
+        void place(uint32_t hash, uint32_t index)
+        {
+            std::size_t i = hash & mask();
+            while (m_slots[i].index != kNone)
+                i = (i + 1) & mask();
+            m_slots[i] = Cell {hash, index};
+        }
+
+        void rehash(std::size_t size)
+        {
+            std::vector<Cell> cells(size, Cell {0, kNone});
+            cells.swap(m_slots);
+            for (const Cell &cell : cells)
+                if (cell.index != kNone)
+                    place(cell.hash, cell.index);
+        }
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+    Table m_byRegistryId;
+    Table m_byBSDName;                              // the latest device with the name
+    std::vector<std::pair<uint64_t, uint32_t>> m_scratch;
+
+    static bool lessId(const DeviceInfo &a, const DeviceInfo &b) { return a.registryId < b.registryId; }
+
+    static uint32_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return static_cast<uint32_t>(h);
+    }
+
+    static uint32_t hashId(uint64_t registryId) { return mix(registryId); }
+
+    static uint32_t hashName(const std::string &name)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;         // FNV-1a
+        for (unsigned char c : name)
+            h = (h ^ c) * 0x100000001b3ull;
+        return mix(h);
+    }
+
+    uint32_t findName(const std::string &bsdName) const
+    {
+        if (bsdName.empty())
+            return kNone;
+        return m_byBSDName.find(hashName(bsdName), [&](uint32_t i) {
+            return m_slots[i].entry.info.bsdName == bsdName;
+        });
+    }
+
+    DeviceHandle handleOf(uint32_t index) const { return DeviceHandle {index, m_slots[index].generation}; }
+
+    void reserve(std::size_t devices)
+    {
+        if (devices > m_slots.size()) {
+            m_slots.reserve(devices);
+            m_byRegistryId.reserve(devices);
+            m_byBSDName.reserve(devices);
+        }
+    }
+
+    DeviceHandle allocate()
+    {
+        uint32_t index;
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        } else {
+            index = static_cast<uint32_t>(m_slots.size());
+            m_slots.emplace_back();
+        }
+        m_slots[index].used = true;
+        return handleOf(index);
+    }
+
+    // The strings keep their capacity for the next device of the slot
+    void release(uint32_t index)
+    {
+        Slot &slot = m_slots[index];
+        m_byRegistryId.erase(hashId(slot.entry.info.registryId), index);
+        unname(index);
+        slot.entry.info.registryId = 0;
+        slot.entry.info.bsdName.clear();
+        slot.entry.info.name.clear();
+        slot.entry.data = Data();
+        slot.used = false;
+        ++slot.generation;
+        m_free.push_back(index);
+    }
+
+    void unname(uint32_t index)
+    {
+        Slot &slot = m_slots[index];
+        if (slot.named) {
+            m_byBSDName.erase(hashName(slot.entry.info.bsdName), index);
+            slot.named = false;
+        }
+    }
+
+    // Indexes the slot under its new BSD name (before the name is stored), a name held by
+    // another device (a reused one) is taken over
+    void rename(uint32_t index, const std::string &bsdName)
+    {
+        Slot &slot = m_slots[index];
+        if (slot.named && slot.entry.info.bsdName == bsdName)
+            return;
+        unname(index);
+        if (bsdName.empty())
+            return;
+        const uint32_t holder = findName(bsdName);
+        if (holder != kNone)
+            unname(holder);
+        m_byBSDName.insert(hashName(bsdName), index);
+        slot.named = true;
+    }
+
+    // The info is copied or moved only when it differs
+    template <typename Info, typename F>
+    void addReported(Info &&info, F &f, Stats &stats)
+    {
+        const DeviceHandle known = find(info.registryId);
+        if (known) {
+            Entry &entry = m_slots[known.index].entry;
+            if (entry.info == info)
+                return;
+            rename(known.index, info.bsdName);
+            entry.info = std::forward<Info>(info);
+            f(Change::Changed, known, entry);
+            ++stats.changed;
+            return;
+        }
+        const DeviceHandle handle = add(std::forward<Info>(info));
+        f(Change::Added, handle, m_slots[handle.index].entry);
+        ++stats.added;
+    }
+
+    template <typename F>
+    void removeReported(uint32_t index, F &f, Stats &stats)
+    {
+        f(Change::Removed, handleOf(index), m_slots[index].entry);
+        release(index);
+        ++stats.removed;
+    }
+};
+
+#endif /* DeviceRegistry_hpp */
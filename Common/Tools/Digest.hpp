@@ -0,0 +1,276 @@
+//
+//  Digest.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef Digest_hpp
+#define Digest_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__APPLE__)
+#include <CommonCrypto/CommonDigest.h>
+#endif
+
+// Streaming hashes of file contents: SHA-256 (FIPS 180-4) to fingerprint a file, XXH64 as a
+// fast non-cryptographic hash to compare contents. Both take the data in blocks of any size
+// through update() and are read once with finish().
+//
+// On Apple platforms SHA-256 is CommonCrypto (it uses the SHA instructions of the CPU), the
+// portable implementation is the fallback elsewhere. The words are read with memcpy in the
+// byte order of the host, XXH64 assumes a little endian host (x86_64, arm64).
+
+class Sha256
+{
+public:
+    static constexpr std::size_t kSize = 32;
+
+    Sha256() { reset(); }
+
+#if defined(__APPLE__)
+    void reset() { CC_SHA256_Init(&m_context); }
+
+    void update(const void *data, std::size_t size)
+    {
+        // CC_LONG is 32 bits
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        for (; size > 0x40000000; p += 0x40000000, size -= 0x40000000)
+            CC_SHA256_Update(&m_context, p, 0x40000000);
+        CC_SHA256_Update(&m_context, p, static_cast<CC_LONG>(size));
+    }
+
+    void finish(uint8_t digest[kSize]) { CC_SHA256_Final(digest, &m_context); }
+
+private:
+    CC_SHA256_CTX m_context;
+#else
+    void reset()
+    {
+        static const uint32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+        std::memcpy(m_state, initial, sizeof(m_state));
+        m_length = 0;
+        m_used = 0;
+    }
+
+    void update(const void *data, std::size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        m_length += size;
+        if (m_used) {
+            const std::size_t n = (size < 64 - m_used) ? size : 64 - m_used;
+            std::memcpy(m_block + m_used, p, n);
+            m_used += n;
+            p += n;
+            size -= n;
+            if (m_used < 64)
+                return;
+            compress(m_block);
+            m_used = 0;
+        }
+        // Whole blocks straight from the input
+        for (; size >= 64; p += 64, size -= 64)
+            compress(p);
+        std::memcpy(m_block, p, size);
+        m_used = size;
+    }
+
+    void finish(uint8_t digest[kSize])
+    {
+        const uint64_t bits = m_length * 8;
+        const uint8_t pad = 0x80;
+        update(&pad, 1);
+        static const uint8_t zeros[64] = {};
+        update(zeros, (m_used <= 56) ? 56 - m_used : 120 - m_used);
+        uint8_t length[8];
+        for (int i = 0; i < 8; ++i)
+            length[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        update(length, 8);
+        for (int i = 0; i < 8; ++i) {
+            digest[4 * i] = static_cast<uint8_t>(m_state[i] >> 24);
+            digest[4 * i + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+            digest[4 * i + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+            digest[4 * i + 3] = static_cast<uint8_t>(m_state[i]);
+        }
+    }
+
+private:
+    uint32_t m_state[8];
+    uint8_t m_block[64];
+    uint64_t m_length;
+    std::size_t m_used;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const uint8_t *block)
+    {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = uint32_t(block[4 * i]) << 24 | uint32_t(block[4 * i + 1]) << 16 | uint32_t(block[4 * i + 2]) << 8 | block[4 * i + 3];
+        for (int i = 16; i < 64; ++i) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int i = 0; i < 64; ++i) {
+            const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+#endif
+};
+
+class XXH64
+{
+public:
+    explicit XXH64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0)
+    {
+        m_seed = seed;
+        m_acc[0] = seed + kPrime1 + kPrime2;
+        m_acc[1] = seed + kPrime2;
+        m_acc[2] = seed;
+        m_acc[3] = seed - kPrime1;
+        m_length = 0;
+        m_used = 0;
+    }
+
+    void update(const void *data, std::size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        m_length += size;
+        if (m_used) {
+            const std::size_t n = (size < 32 - m_used) ? size : 32 - m_used;
+            std::memcpy(m_buffer + m_used, p, n);
+            m_used += n;
+            p += n;
+            size -= n;
+            if (m_used < 32)
+                return;
+            stripe(m_buffer);
+            m_used = 0;
+        }
+        for (; size >= 32; p += 32, size -= 32)
+            stripe(p);
+        std::memcpy(m_buffer, p, size);
+        m_used = size;
+    }
+
+    uint64_t finish() const
+    {
+        uint64_t h;
+        if (m_length >= 32) {
+            h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+            for (uint64_t acc : m_acc)
+                h = (h ^ round(0, acc)) * kPrime1 + kPrime4;
+        } else {
+            h = m_seed + kPrime5;
+        }
+        h += m_length;
+
+        const uint8_t *p = m_buffer;
+        std::size_t size = m_used;
+        for (; size >= 8; p += 8, size -= 8)
+            h = rotl(h ^ round(0, read64(p)), 27) * kPrime1 + kPrime4;
+        if (size >= 4) {
+            uint32_t word;
+            std::memcpy(&word, p, sizeof(word));
+            h = rotl(h ^ (word * kPrime1), 23) * kPrime2 + kPrime3;
+            p += 4;
+            size -= 4;
+        }
+        for (; size > 0; ++p, --size)
+            h = rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t m_seed;
+    uint64_t m_acc[4];
+    uint64_t m_length;
+    uint8_t m_buffer[32];
+    std::size_t m_used;
+
+    static uint64_t rotl(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+
+    static uint64_t read64(const uint8_t *p)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input)
+    {
+        return rotl(acc + input * kPrime2, 31) * kPrime1;
+    }
+
+    void stripe(const uint8_t *p)
+    {
+        m_acc[0] = round(m_acc[0], read64(p));
+        m_acc[1] = round(m_acc[1], read64(p + 8));
+        m_acc[2] = round(m_acc[2], read64(p + 16));
+        m_acc[3] = round(m_acc[3], read64(p + 24));
+    }
+};
+
+// Lowercase hexadecimal form of a digest
+inline std::string hexDigest(const uint8_t *digest, std::size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(2 * size, '0');
+    for (std::size_t i = 0; i < size; ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    return hex;
+}
+
+#endif /* Digest_hpp */
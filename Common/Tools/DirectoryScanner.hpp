@@ -0,0 +1,331 @@
+//
+//  DirectoryScanner.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef DirectoryScanner_hpp
+#define DirectoryScanner_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "ThreadPool.hpp"
+
+struct DirectoryEntry {
+    std::string name;
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t mtime = 0;          // nanoseconds
+    uint64_t size = 0;
+    bool directory = false;
+};
+
+// Listings of the directories of a tree, keyed by the directory path. The entries of a listing
+// are sorted by name.
+struct DirectorySnapshot {
+    std::unordered_map<std::string, std::vector<DirectoryEntry>> directories;
+
+    std::size_t entries() const
+    {
+        std::size_t count = 0;
+        for (const auto &directory : directories)
+            count += directory.second.size();
+        return count;
+    }
+};
+
+// Rescans a subtree and reports how it differs from the last snapshot, to recover after the
+// events of the subtree were lost (kFSEventStreamEventFlagMustScanSubDirs, UserDropped,
+// KernelDropped, FSE_EVENTS_DROPPED).
+//
+// Every directory is a task on the work-stealing pool: it lists the directory (getdents64 on
+// Linux, readdir elsewhere), stats the entries relative to the directory descriptor, compares
+// the sorted listing with the previous one by a merge and submits its subdirectories. The
+// snapshot is only read while the tasks run; the new listings and the changes are collected
+// and applied on the calling thread once the pool is done, so the callback is not concurrent.
+//
+// The scan stays on the device of the root (mount points are listed, not entered).
+class DirectoryScanner
+{
+public:
+    enum class Change : uint8_t {
+        Created,
+        Deleted,
+        Modified,       // device, inode, mtime or size differ
+    };
+
+    enum class Depth : uint8_t {
+        Subtree,        // the directory and all its subdirectories
+        Directory,      // the directory, and only the subdirectories the snapshot does not know
+    };
+
+    struct Stats {
+        std::size_t directories = 0;
+        std::size_t entries = 0;
+        std::size_t changes = 0;
+        std::size_t errors = 0;         // directories which could not be read, their listing is kept
+    };
+
+    explicit DirectoryScanner(ThreadPool &pool) : m_pool(pool) {}
+
+    // Scans the tree of root, passes the changes to f(Change, const std::string &path,
+    // const DirectoryEntry &) and updates the snapshot. A root the snapshot does not know yet
+    // is a baseline: it is recorded without reporting its entries.
+    template <typename F>
+    Stats scan(const std::string &root, DirectorySnapshot &snapshot, F &&f, Depth depth = Depth::Subtree)
+    {
+        Stats stats;
+        struct stat st;
+        if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            // The whole tree is gone
+            if (snapshot.directories.count(root))
+                release(root, snapshot, f, stats);
+            return stats;
+        }
+
+        Scan scan {snapshot, static_cast<uint64_t>(st.st_dev), depth, {}, {}, {}};
+        const auto previous = snapshot.directories.find(root);
+        const bool report = previous != snapshot.directories.end();
+        m_pool.submit([this, &scan, root, previous, report] {
+            visit(scan, root, report ? &previous->second : nullptr, report);
+        });
+        m_pool.wait();
+
+        // Same order whichever worker finished first
+        std::sort(scan.results.begin(), scan.results.end(),
+                  [](const Result &a, const Result &b) { return a.path < b.path; });
+        for (const std::string &path : scan.removed)
+            release(path, snapshot, f, stats);
+        for (Result &result : scan.results) {
+            ++stats.directories;
+            if (!result.readable) {
+                ++stats.errors;
+                continue;
+            }
+            stats.entries += result.listing.size();
+            for (const ChangeRecord &change : result.changes) {
+                f(change.change, change.path, change.entry);
+                ++stats.changes;
+            }
+            snapshot.directories[result.path] = std::move(result.listing);
+        }
+        return stats;
+    }
+
+private:
+    struct ChangeRecord {
+        Change change;
+        std::string path;
+        DirectoryEntry entry;
+    };
+
+    struct Result {
+        std::string path;
+        std::vector<DirectoryEntry> listing;
+        std::vector<ChangeRecord> changes;
+        bool readable = true;
+    };
+
+    struct Scan {
+        const DirectorySnapshot &snapshot;
+        uint64_t device;
+        Depth depth;
+        std::mutex mutex;                   // guards results and removed
+        std::vector<Result> results;
+        std::vector<std::string> removed;   // directories gone with their subtree
+    };
+
+    ThreadPool &m_pool;
+
+    static int64_t nanoseconds(const struct timespec &ts)
+    {
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static bool same(const DirectoryEntry &a, const DirectoryEntry &b)
+    {
+        return a.device == b.device && a.inode == b.inode && a.mtime == b.mtime && a.size == b.size;
+    }
+
+    static std::string join(const std::string &directory, const std::string &name)
+    {
+        std::string path;
+        path.reserve(directory.size() + 1 + name.size());
+        path += directory;
+        if (path.empty() || path.back() != '/')
+            path += '/';
+        path += name;
+        return path;
+    }
+
+    // Entry names of the directory, false if it can not be read
+    static bool list(int fd, std::vector<std::string> &names)
+    {
+#if defined(__linux__)
+        // linux_dirent64: d_ino at 0, d_off at 8, d_reclen at 16, d_type at 18, d_name at 19
+        static thread_local std::vector<char> buffer(64 * 1024);
+        for (;;) {
+            const long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (n < 0)
+                return false;
+            if (n == 0)
+                return true;
+            for (long offset = 0; offset < n; ) {
+                unsigned short length;
+                std::memcpy(&length, buffer.data() + offset + 16, sizeof(length));
+                const char *name = buffer.data() + offset + 19;
+                if (!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))))
+                    names.emplace_back(name);
+                offset += length;
+            }
+        }
+#else
+        const int dup = ::dup(fd);
+        DIR *dir = (dup < 0) ? nullptr : fdopendir(dup);
+        if (dir == nullptr) {
+            if (dup >= 0)
+                close(dup);
+            return false;
+        }
+        while (const struct dirent *entry = readdir(dir)) {
+            const char *name = entry->d_name;
+            if (!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))))
+                names.emplace_back(name);
+        }
+        closedir(dir);
+        return true;
+#endif
+    }
+
+    template <typename F>
+    static void release(const std::string &directory, DirectorySnapshot &snapshot, F &f, Stats &stats)
+    {
+        const auto it = snapshot.directories.find(directory);
+        if (it == snapshot.directories.end())
+            return;
+        std::vector<DirectoryEntry> listing = std::move(it->second);
+        snapshot.directories.erase(it);
+        for (const DirectoryEntry &entry : listing) {
+            const std::string path = join(directory, entry.name);
+            if (entry.directory)
+                release(path, snapshot, f, stats);
+            f(Change::Deleted, path, entry);
+            ++stats.changes;
+        }
+    }
+
+    void visit(Scan &scan, const std::string &path, const std::vector<DirectoryEntry> *previous, bool report)
+    {
+        Result result;
+        result.path = path;
+
+        const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        std::vector<std::string> names;
+        if (fd < 0 || !list(fd, names)) {
+            if (fd >= 0)
+                close(fd);
+            result.readable = false;
+            std::lock_guard<std::mutex> lock(scan.mutex);
+            scan.results.push_back(std::move(result));
+            return;
+        }
+
+        std::sort(names.begin(), names.end());
+        result.listing.reserve(names.size());
+        for (std::string &name : names) {
+            struct stat st;
+            // Removed since it was listed
+            if (fstatat(fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            DirectoryEntry entry;
+            entry.name = std::move(name);
+            entry.device = static_cast<uint64_t>(st.st_dev);
+            entry.inode = static_cast<uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+            entry.mtime = nanoseconds(st.st_mtimespec);
+#else
+            entry.mtime = nanoseconds(st.st_mtim);
+#endif
+            entry.size = static_cast<uint64_t>(st.st_size);
+            entry.directory = S_ISDIR(st.st_mode);
+            result.listing.push_back(std::move(entry));
+        }
+        close(fd);
+
+        // Both listings are sorted, a merge finds the differences
+        static const std::vector<DirectoryEntry> empty;
+        const std::vector<DirectoryEntry> &old = previous ? *previous : empty;
+        std::vector<std::string> removed;
+        const auto created = [&](const DirectoryEntry &entry) {
+            if (report)
+                result.changes.push_back({Change::Created, join(path, entry.name), entry});
+        };
+        const auto deleted = [&](const DirectoryEntry &entry) {
+            // The entries of a removed directory are reported from its previous listing
+            if (entry.directory)
+                removed.push_back(join(path, entry.name));
+            if (report)
+                result.changes.push_back({Change::Deleted, join(path, entry.name), entry});
+        };
+        std::size_t i = 0, j = 0;
+        while (i < result.listing.size() || j < old.size()) {
+            const int order = (i == result.listing.size()) ? 1
+                            : (j == old.size()) ? -1
+                            : result.listing[i].name.compare(old[j].name);
+            if (order < 0) {
+                created(result.listing[i++]);
+            } else if (order > 0) {
+                deleted(old[j++]);
+            } else {
+                if (result.listing[i].directory != old[j].directory) {
+                    deleted(old[j]);
+                    created(result.listing[i]);
+                } else if (report && !same(result.listing[i], old[j])) {
+                    result.changes.push_back({Change::Modified, join(path, result.listing[i].name), result.listing[i]});
+                }
+                ++i;
+                ++j;
+            }
+        }
+
+        // Subdirectories are tasks of their own, compared with their previous listing if any
+        for (const DirectoryEntry &entry : result.listing) {
+            if (!entry.directory || entry.device != scan.device)
+                continue;
+            std::string child = join(path, entry.name);
+            const auto it = scan.snapshot.directories.find(child);
+            const std::vector<DirectoryEntry> *childPrevious = (it != scan.snapshot.directories.end()) ? &it->second : nullptr;
+            if (childPrevious && scan.depth == Depth::Directory)
+                continue;
+            // A new directory did not exist at the last scan, all its entries are reported
+            m_pool.submit([this, &scan, child = std::move(child), childPrevious, report] {
+                visit(scan, child, childPrevious, report);
+            });
+        }
+
+        std::lock_guard<std::mutex> lock(scan.mutex);
+        scan.results.push_back(std::move(result));
+        scan.removed.insert(scan.removed.end(), std::make_move_iterator(removed.begin()), std::make_move_iterator(removed.end()));
+    }
+};
+
+#endif /* DirectoryScanner_hpp */
@@ -0,0 +1,261 @@
+//
+//  EventRecord.h
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef EventRecord_h
+#define EventRecord_h
+
+// Versioned binary format of normalized events shared by all the demos (C99, so kdebug can use it).
+//
+// File layout (little-endian, the native byte order of all the supported machines):
+//   evrec_file_header_t
+//   record, record, ...
+//
+// Record layout (every record starts at an 8-byte aligned offset):
+//   evrec_header_t (file_header.record_header_size bytes, newer versions may append fields)
+//   path_count x { uint16_t length; char path[length]; char '\0'; }
+//   padding to 8 bytes
+//
+// evrec_header_t.size covers the whole record including padding, so readers can skip records
+// (and fields) they do not understand. Records can be addressed by their file offset which is
+// returned by evrec_write().
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EVREC_MAGIC         0x43525645u     // "EVRC"
+#define EVREC_VERSION       1
+#define EVREC_MAX_PATHS     4
+#define EVREC_ALIGNMENT     8
+#define EVREC_BUFFER_SIZE   (1024 * 1024)
+
+// Source of the event, it defines the meaning of type and flags
+typedef enum evrec_source {
+    EVREC_SOURCE_UNKNOWN  = 0,
+    EVREC_SOURCE_ESF      = 1,  // type: es_event_type_t,     flags: fflag of AUTH_OPEN
+    EVREC_SOURCE_FSEVENTS = 2,  // type: FSE_* event type,    flags: FSE_ARG_MODE
+    EVREC_SOURCE_BSM      = 3,  // type: BSM event number,    flags: return token status
+    EVREC_SOURCE_KDEBUG   = 4,  // type: kdebug debugid,      flags: kdebug arg1
+} evrec_source_t;
+
+typedef struct evrec_file_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;           // sizeof(evrec_file_header_t), the first record follows
+    uint32_t record_header_size;    // sizeof(evrec_header_t) of the writer
+    uint32_t reserved;
+} evrec_file_header_t;
+
+typedef struct evrec_header {
+    uint32_t size;          // size of the whole record including paths and padding
+    uint16_t version;
+    uint8_t  source;        // evrec_source_t
+    uint8_t  path_count;
+    uint32_t type;
+    int32_t  pid;           // -1 if unknown
+    uint64_t tid;           // thread ID, 0 if unknown
+    uint64_t time_ns;       // wall clock time in nanoseconds since the epoch, 0 if unknown
+    uint64_t mach_time;     // source timestamp (mach_absolute_time units), 0 if unknown
+    uint64_t flags;
+} evrec_header_t;
+
+// Event as seen by the writer, paths are referenced, not owned
+typedef struct evrec_event {
+    evrec_source_t source;
+    uint32_t type;
+    int32_t  pid;
+    uint64_t tid;
+    uint64_t time_ns;
+    uint64_t mach_time;
+    uint64_t flags;
+    size_t   path_count;
+    const char *paths[EVREC_MAX_PATHS];
+    size_t   path_lengths[EVREC_MAX_PATHS];
+} evrec_event_t;
+
+typedef struct evrec_writer {
+    int      fd;
+    uint8_t *buffer;
+    size_t   size;          // bytes used in the buffer
+    size_t   capacity;
+    uint64_t offset;        // file offset of the first byte in the buffer
+} evrec_writer_t;
+
+// Closed writer, evrec_writer_open() has to be called before writing
+#define EVREC_WRITER_INIT { -1, NULL, 0, 0, 0 }
+
+static inline uint64_t evrec_timespec_ns(const struct timespec *ts)
+{
+    return (uint64_t) ts->tv_sec * 1000000000ull + (uint64_t) ts->tv_nsec;
+}
+
+static inline uint64_t evrec_now_ns(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) != 0)
+        return 0;
+    return evrec_timespec_ns(&ts);
+}
+
+// Adds a path to the event, paths over EVREC_MAX_PATHS are ignored
+static inline void evrec_event_add_path(evrec_event_t *ev, const char *path, size_t length)
+{
+    if (ev->path_count >= EVREC_MAX_PATHS || path == NULL)
+        return;
+    ev->paths[ev->path_count] = path;
+    ev->path_lengths[ev->path_count] = (length > UINT16_MAX) ? UINT16_MAX : length;
+    ev->path_count++;
+}
+
+static inline size_t evrec_record_size(const evrec_event_t *ev)
+{
+    size_t size = sizeof(evrec_header_t);
+    for (size_t i = 0; i < ev->path_count; i++)
+        size += sizeof(uint16_t) + ev->path_lengths[i] + 1;
+    return (size + EVREC_ALIGNMENT - 1) & ~(size_t) (EVREC_ALIGNMENT - 1);
+}
+
+static inline int evrec_write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += written;
+        size -= (size_t) written;
+    }
+    return 0;
+}
+
+// Writes the buffered records to the file. Returns 0 on success, -1 and errno otherwise.
+static inline int evrec_writer_flush(evrec_writer_t *w)
+{
+    if (evrec_write_all(w->fd, w->buffer, w->size) != 0)
+        return -1;
+    w->offset += w->size;
+    w->size = 0;
+    return 0;
+}
+
+// Creates (truncates) the file and writes the file header. Returns 0 on success, -1 and errno otherwise.
+static inline int evrec_writer_open(evrec_writer_t *w, const char *path)
+{
+    evrec_file_header_t header;
+
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->buffer = (uint8_t *) malloc(EVREC_BUFFER_SIZE);
+    if (w->buffer == NULL)
+        return -1;
+    w->capacity = EVREC_BUFFER_SIZE;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        free(w->buffer);
+        w->buffer = NULL;
+        w->capacity = 0;
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = EVREC_MAGIC;
+    header.version = EVREC_VERSION;
+    header.header_size = sizeof(evrec_file_header_t);
+    header.record_header_size = sizeof(evrec_header_t);
+    memcpy(w->buffer, &header, sizeof(header));
+    w->size = sizeof(header);
+    return 0;
+}
+
+// Flushes the buffered records and closes the file. Returns 0 on success, -1 and errno otherwise.
+static inline int evrec_writer_close(evrec_writer_t *w)
+{
+    int res = 0;
+    if (w->fd >= 0) {
+        res = evrec_writer_flush(w);
+        if (close(w->fd) != 0)
+            res = -1;
+    }
+    free(w->buffer);
+    w->buffer = NULL;
+    w->capacity = 0;
+    w->size = 0;
+    w->fd = -1;
+    return res;
+}
+
+// Appends the event, the record is written to the file once the buffer is full.
+// Returns the file offset of the record or -1 and errno.
+static inline int64_t evrec_write(evrec_writer_t *w, const evrec_event_t *ev)
+{
+    const size_t size = evrec_record_size(ev);
+    evrec_header_t header;
+    uint8_t *dp;
+    int64_t offset;
+
+    if (w->fd < 0) {
+        errno = EBADF;          // closed (or never opened)
+        return -1;
+    }
+    if (size > UINT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    if (w->size + size > w->capacity) {
+        if (evrec_writer_flush(w) != 0)
+            return -1;
+        // Larger than the whole buffer, grow it instead of a separate code path
+        if (size > w->capacity) {
+            uint8_t *buffer = (uint8_t *) realloc(w->buffer, size);
+            if (buffer == NULL)
+                return -1;
+            w->buffer = buffer;
+            w->capacity = size;
+        }
+    }
+
+    offset = (int64_t) (w->offset + w->size);
+    dp = w->buffer + w->size;
+
+    memset(&header, 0, sizeof(header));
+    header.size = (uint32_t) size;
+    header.version = EVREC_VERSION;
+    header.source = (uint8_t) ev->source;
+    header.path_count = (uint8_t) ev->path_count;
+    header.type = ev->type;
+    header.pid = ev->pid;
+    header.tid = ev->tid;
+    header.time_ns = ev->time_ns;
+    header.mach_time = ev->mach_time;
+    header.flags = ev->flags;
+    memcpy(dp, &header, sizeof(header));
+    dp += sizeof(header);
+
+    for (size_t i = 0; i < ev->path_count; i++) {
+        const uint16_t length = (uint16_t) ev->path_lengths[i];
+        memcpy(dp, &length, sizeof(length));
+        dp += sizeof(length);
+        memcpy(dp, ev->paths[i], length);
+        dp += length;
+        *dp++ = '\0';
+    }
+
+    // Zero the padding so the files are reproducible
+    memset(dp, 0, (size_t) (w->buffer + w->size + size - dp));
+    w->size += size;
+    return offset;
+}
+
+#endif /* EventRecord_h */
@@ -0,0 +1,161 @@
+//
+//  EventRecordReader.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef EventRecordReader_hpp
+#define EventRecordReader_hpp
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+#include "EventRecord.h"
+
+// Zero-copy reader of the files created by evrec_writer_t. The file is mapped read-only and
+// records are returned as views into the mapping, they are valid until the reader is closed.
+// Records are validated on access, a corrupted record ends the iteration instead of crashing.
+class EventRecordReader
+{
+public:
+    struct Record {
+        const evrec_header_t *header = nullptr;
+        uint64_t offset = 0;
+        std::array<std::string_view, EVREC_MAX_PATHS> paths {};
+
+        std::size_t pathCount() const { return header->path_count; }
+    };
+
+    EventRecordReader() = default;
+    EventRecordReader(const EventRecordReader&) = delete;
+    EventRecordReader &operator=(const EventRecordReader&) = delete;
+    ~EventRecordReader() { close(); }
+
+    // Returns false and sets errno if the file can't be mapped or it is not a record file.
+    bool open(const char *path)
+    {
+        close();
+
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(evrec_file_header_t)) {
+            const int err = errno ? errno : EINVAL;
+            ::close(fd);
+            errno = err;
+            return false;
+        }
+
+        void *data = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+
+        m_data = static_cast<const uint8_t *>(data);
+        m_size = static_cast<std::size_t>(st.st_size);
+
+        std::memcpy(&m_header, m_data, sizeof(m_header));
+        if (m_header.magic != EVREC_MAGIC || m_header.version > EVREC_VERSION
+            || m_header.header_size < sizeof(evrec_file_header_t) || m_header.header_size > m_size
+            || m_header.record_header_size < sizeof(evrec_header_t)) {
+            close();
+            errno = EINVAL;
+            return false;
+        }
+
+        // Sequential scans are the common case
+        madvise(const_cast<uint8_t *>(m_data), m_size, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data)
+            munmap(const_cast<uint8_t *>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool isOpen() const { return m_data != nullptr; }
+    std::size_t fileSize() const { return m_size; }
+    const evrec_file_header_t &fileHeader() const { return m_header; }
+
+    // Offset of the first record
+    uint64_t firstOffset() const { return m_header.header_size; }
+
+    // Random access by the offset returned by evrec_write(). Returns nullopt for invalid offsets.
+    std::optional<Record> at(uint64_t offset) const
+    {
+        if (m_data == nullptr || offset % EVREC_ALIGNMENT || offset < m_header.header_size
+            || offset + m_header.record_header_size > m_size)
+            return std::nullopt;
+
+        Record record;
+        record.offset = offset;
+        record.header = reinterpret_cast<const evrec_header_t *>(m_data + offset);
+
+        const uint32_t size = record.header->size;
+        if (size < m_header.record_header_size || size % EVREC_ALIGNMENT || offset + size > m_size
+            || record.header->path_count > EVREC_MAX_PATHS)
+            return std::nullopt;
+
+        const uint8_t *dp = m_data + offset + m_header.record_header_size;
+        const uint8_t * const end = m_data + offset + size;
+        for (std::size_t i = 0; i < record.header->path_count; ++i) {
+            uint16_t length;
+            if (end - dp < static_cast<std::ptrdiff_t>(sizeof(length)))
+                return std::nullopt;
+            std::memcpy(&length, dp, sizeof(length));
+            dp += sizeof(length);
+            if (end - dp < static_cast<std::ptrdiff_t>(length) + 1)
+                return std::nullopt;
+            record.paths[i] = std::string_view(reinterpret_cast<const char *>(dp), length);
+            dp += length + 1;
+        }
+        return record;
+    }
+
+    // Offset of the record following the one at offset (it may be the end of the file)
+    static uint64_t next(const Record &record)
+    {
+        return record.offset + record.header->size;
+    }
+
+    // Calls f(const Record&) for all the valid records, stops at the first corrupted one
+    // or when f returns false. Returns the number of visited records.
+    template <typename F>
+    std::size_t forEach(F &&f) const
+    {
+        std::size_t count = 0;
+        for (auto record = at(firstOffset()); record; record = at(next(*record))) {
+            ++count;
+            if constexpr (std::is_same_v<decltype(f(*record)), bool>) {
+                if (!f(*record))
+                    break;
+            } else {
+                f(*record);
+            }
+        }
+        return count;
+    }
+
+private:
+    const uint8_t *m_data = nullptr;
+    std::size_t m_size = 0;
+    evrec_file_header_t m_header {};
+};
+
+#endif /* EventRecordReader_hpp */
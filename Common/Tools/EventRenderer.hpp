@@ -0,0 +1,375 @@
+//
+//  EventRenderer.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef EventRenderer_hpp
+#define EventRenderer_hpp
+
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <unistd.h>
+
+// Renders events into a growable char buffer, numbers are formatted with std::to_chars.
+// Nothing is written to the output until flush() which issues a single write() for the whole
+// batch (instead of a flush per line caused by std::endl).
+//
+// Two backends are supported:
+//  - Text:   "key: value" lines, nested objects are indented by two spaces
+//  - NDJSON: one JSON object per record terminated by a newline
+class EventRenderer
+{
+public:
+    enum class Format { Text, NDJSON };
+
+    explicit EventRenderer(Format format = Format::Text, std::size_t capacity = 64 * 1024)
+        : m_format(format)
+    {
+        grow(capacity);
+    }
+
+    EventRenderer(const EventRenderer&) = delete;
+    EventRenderer &operator=(const EventRenderer&) = delete;
+
+    Format format() const { return m_format; }
+    const char *data() const { return m_data.get(); }
+    std::size_t size() const { return m_size; }
+    void clear() { m_size = 0; }
+
+    // MARK: Structure
+    void beginRecord()
+    {
+        m_depth = 0;
+        m_first[0] = true;
+        if (m_format == Format::NDJSON)
+            put('{');
+    }
+
+    void endRecord()
+    {
+        if (m_format == Format::NDJSON)
+            put('}');
+        put('\n');
+    }
+
+    void beginObject(std::string_view key)
+    {
+        if (m_format == Format::NDJSON) {
+            jsonKey(key);
+            put('{');
+        } else {
+            indent();
+            put(key);
+            put(":\n");
+        }
+        push();
+    }
+
+    // Object as an array element
+    void beginObject()
+    {
+        if (m_format == Format::NDJSON) {
+            separator();
+            put('{');
+        } else {
+            indent();
+            put("-\n");
+        }
+        push();
+    }
+
+    void endObject()
+    {
+        pop();
+        if (m_format == Format::NDJSON)
+            put('}');
+    }
+
+    void beginArray(std::string_view key)
+    {
+        if (m_format == Format::NDJSON) {
+            jsonKey(key);
+            put('[');
+        } else {
+            indent();
+            put(key);
+            put(":\n");
+        }
+        push();
+    }
+
+    void endArray()
+    {
+        pop();
+        if (m_format == Format::NDJSON)
+            put(']');
+    }
+
+    // Array element
+    void element(std::string_view value)
+    {
+        if (m_format == Format::NDJSON) {
+            separator();
+            jsonString(value);
+        } else {
+            indent();
+            put("- ");
+            put(value);
+            put('\n');
+        }
+    }
+
+    // MARK: Fields
+    template <typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    void field(std::string_view key, T value)
+    {
+        key_(key);
+        number(value, 10);
+        lineEnd();
+    }
+
+    void field(std::string_view key, bool value)
+    {
+        key_(key);
+        put(value ? "true" : "false");
+        lineEnd();
+    }
+
+    void field(std::string_view key, std::string_view value)
+    {
+        key_(key);
+        if (m_format == Format::NDJSON)
+            jsonString(value);
+        else
+            put(value);
+        lineEnd();
+    }
+
+    void field(std::string_view key, const char *value)
+    {
+        if (value == nullptr)
+            null(key);
+        else
+            field(key, std::string_view(value));
+    }
+
+    // Hexadecimal in the text backend ("0x1f"), JSON has no hex literals so a number is used
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    void hex(std::string_view key, T value)
+    {
+        key_(key);
+        if (m_format == Format::NDJSON) {
+            number(value, 10);
+        } else {
+            put("0x");
+            number(static_cast<std::make_unsigned_t<T>>(value), 16);
+        }
+        lineEnd();
+    }
+
+    // Bytes as a hexadecimal string (i.e. cdhash)
+    void hexBytes(std::string_view key, const uint8_t *bytes, std::size_t len)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        key_(key);
+        if (m_format == Format::NDJSON)
+            put('"');
+        char *dp = reserve(len * 2);
+        for (std::size_t i = 0; i < len; ++i) {
+            *dp++ = digits[bytes[i] >> 4];
+            *dp++ = digits[bytes[i] & 0x0f];
+        }
+        m_size += len * 2;
+        if (m_format == Format::NDJSON)
+            put('"');
+        lineEnd();
+    }
+
+    // Seconds and nanoseconds as a decimal number ("1589800000.000123456")
+    void timestamp(std::string_view key, int64_t sec, long nsec)
+    {
+        key_(key);
+        number(sec, 10);
+        put('.');
+        char frac[9];
+        long n = nsec;
+        for (int i = 8; i >= 0; --i, n /= 10)
+            frac[i] = static_cast<char>('0' + n % 10);
+        put(std::string_view(frac, sizeof(frac)));
+        lineEnd();
+    }
+
+    void null(std::string_view key)
+    {
+        key_(key);
+        put(m_format == Format::NDJSON ? "null" : "(null)");
+        lineEnd();
+    }
+
+    // MARK: Output
+    // Writes the whole buffer with as few write() calls as possible and clears it.
+    bool flush(int fd)
+    {
+        const char *p = m_data.get();
+        std::size_t left = m_size;
+        while (left) {
+            const ssize_t written = ::write(fd, p, left);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += written;
+            left -= static_cast<std::size_t>(written);
+        }
+        m_size = 0;
+        return true;
+    }
+
+    // Raw access for the backends of other formats
+    void put(char c)
+    {
+        *reserve(1) = c;
+        ++m_size;
+    }
+
+    void put(std::string_view str)
+    {
+        std::memcpy(reserve(str.size()), str.data(), str.size());
+        m_size += str.size();
+    }
+
+private:
+    static constexpr int kMaxDepth = 16;
+
+    Format m_format;
+    std::unique_ptr<char[]> m_data;
+    std::size_t m_size = 0;
+    std::size_t m_capacity = 0;
+    int m_depth = 0;
+    bool m_first[kMaxDepth] = {true};
+
+    char *reserve(std::size_t len)
+    {
+        if (m_size + len > m_capacity)
+            grow(m_size + len);
+        return m_data.get() + m_size;
+    }
+
+    void grow(std::size_t required)
+    {
+        std::size_t capacity = m_capacity ? m_capacity : 4096;
+        while (capacity < required)
+            capacity *= 2;
+        if (capacity == m_capacity)
+            return;
+        std::unique_ptr<char[]> data(new char[capacity]);
+        if (m_size)
+            std::memcpy(data.get(), m_data.get(), m_size);
+        m_data = std::move(data);
+        m_capacity = capacity;
+    }
+
+    template <typename T>
+    void number(T value, int base)
+    {
+        // 64 binary digits and a sign is the longest possible output
+        char *dp = reserve(66);
+        const auto res = std::to_chars(dp, dp + 66, value, base);
+        m_size += static_cast<std::size_t>(res.ptr - dp);
+    }
+
+    void push()
+    {
+        if (m_depth + 1 < kMaxDepth)
+            ++m_depth;
+        m_first[m_depth] = true;
+    }
+
+    void pop()
+    {
+        if (m_depth > 0)
+            --m_depth;
+        m_first[m_depth] = false;
+    }
+
+    void separator()
+    {
+        if (!m_first[m_depth])
+            put(',');
+        m_first[m_depth] = false;
+    }
+
+    void indent()
+    {
+        for (int i = 0; i < m_depth; ++i)
+            put("  ");
+    }
+
+    void key_(std::string_view key)
+    {
+        if (m_format == Format::NDJSON)
+            jsonKey(key);
+        else
+            textKey(key);
+    }
+
+    void lineEnd()
+    {
+        if (m_format == Format::Text)
+            put('\n');
+    }
+
+    void textKey(std::string_view key)
+    {
+        indent();
+        put(key);
+        put(": ");
+    }
+
+    void jsonKey(std::string_view key)
+    {
+        separator();
+        jsonString(key);
+        put(':');
+    }
+
+    void jsonString(std::string_view str)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        // Worst case every character is escaped as \u00XX
+        char *dp = reserve(str.size() * 6 + 2);
+        char * const start = dp;
+        *dp++ = '"';
+        for (unsigned char c : str) {
+            if (c == '"' || c == '\\') {
+                *dp++ = '\\';
+                *dp++ = static_cast<char>(c);
+            } else if (c == '\n') {
+                *dp++ = '\\';
+                *dp++ = 'n';
+            } else if (c < 0x20) {
+                *dp++ = '\\';
+                *dp++ = 'u';
+                *dp++ = '0';
+                *dp++ = '0';
+                *dp++ = digits[c >> 4];
+                *dp++ = digits[c & 0x0f];
+            } else {
+                *dp++ = static_cast<char>(c);
+            }
+        }
+        *dp++ = '"';
+        m_size += static_cast<std::size_t>(dp - start);
+    }
+};
+
+#endif /* EventRenderer_hpp */
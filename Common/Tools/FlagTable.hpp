@@ -0,0 +1,177 @@
+//
+//  FlagTable.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef FlagTable_hpp
+#define FlagTable_hpp
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+template <typename T>
+struct FlagName {
+    T flag;
+    std::string_view name;
+};
+
+// Table driven bitmask formatter (replacement of the hand-rolled *flagstostr functions).
+// Only the set bits are visited (bit scan), names are printed in the table order and the
+// first entry covering a bit wins, so aliases (FNDELAY == FNONBLOCK) are printed only once.
+// Nothing is allocated unless the std::string overload has to grow the string.
+template <typename T, std::size_t N>
+class FlagTable
+{
+    static_assert(std::is_unsigned_v<T>, "Flags must be an unsigned type");
+    static_assert(N <= 64, "Matched entries are tracked in a 64-bit mask");
+    static constexpr unsigned kBits = sizeof(T) * 8;
+    static constexpr uint8_t kNoEntry = 0xff;
+
+    std::array<FlagName<T>, N> m_entries {};
+    std::array<uint8_t, kBits> m_bitToEntry {};
+    std::string_view m_separator;
+    std::string_view m_zeroName;    // printed when no flag is set (i.e. F_OK)
+    bool m_appendUnknown;           // print bits missing in the table as a hex number
+    T m_known = 0;
+
+    static constexpr unsigned ctz(uint64_t x)
+    {
+        return static_cast<unsigned>(__builtin_ctzll(x));
+    }
+
+    constexpr uint64_t matchedEntries(T flags) const
+    {
+        uint64_t entries = 0;
+        for (T rest = flags & m_known; rest; rest &= rest - 1)
+            entries |= uint64_t(1) << m_bitToEntry[ctz(rest)];
+        return entries;
+    }
+
+public:
+    constexpr FlagTable(const FlagName<T> (&entries)[N],
+                        std::string_view separator = ",",
+                        std::string_view zeroName = {},
+                        bool appendUnknown = false)
+        : m_separator(separator), m_zeroName(zeroName), m_appendUnknown(appendUnknown)
+    {
+        for (auto &e : m_bitToEntry)
+            e = kNoEntry;
+
+        for (std::size_t i = 0; i < N; ++i) {
+            m_entries[i] = entries[i];
+            for (T rest = entries[i].flag; rest; rest &= rest - 1) {
+                const unsigned bit = ctz(rest);
+                if (m_bitToEntry[bit] == kNoEntry)
+                    m_bitToEntry[bit] = static_cast<uint8_t>(i);
+            }
+            m_known |= entries[i].flag;
+        }
+    }
+
+    // Exact length of the formatted string (without the terminating null character).
+    constexpr std::size_t length(T flags) const
+    {
+        return length(flags, matchedEntries(flags));
+    }
+
+    // Upper bound of length() over all the possible flag combinations.
+    constexpr std::size_t maxLength() const
+    {
+        const std::size_t all = length(static_cast<T>(~T(0)));
+        return all > m_zeroName.size() ? all : m_zeroName.size();
+    }
+
+    // Writes the formatted flags to the caller's buffer and returns length(flags).
+    // The buffer is modified only if the whole string including the null character fits,
+    // otherwise an empty string is stored (if size allows), similarly to snprintf().
+    std::size_t format(T flags, char *buf, std::size_t size) const
+    {
+        const uint64_t entries = matchedEntries(flags);
+        const std::size_t len = length(flags, entries);
+        if (buf == nullptr || size == 0)
+            return len;
+        if (len >= size) {
+            buf[0] = '\0';
+            return len;
+        }
+
+        write(flags, entries, buf);
+        buf[len] = '\0';
+        return len;
+    }
+
+    // Appends the formatted flags to the string.
+    void format(T flags, std::string &str) const
+    {
+        const uint64_t entries = matchedEntries(flags);
+        const std::size_t offset = str.size();
+        str.resize(offset + length(flags, entries));
+        write(flags, entries, &str[offset]);
+    }
+
+    std::string to_string(T flags) const
+    {
+        std::string str;
+        format(flags, str);
+        return str;
+    }
+
+private:
+    constexpr std::size_t length(T flags, uint64_t entries) const
+    {
+        if (flags == 0)
+            return m_zeroName.size();
+
+        std::size_t len = 0;
+        std::size_t count = 0;
+        for (uint64_t e = entries; e; e &= e - 1, ++count)
+            len += m_entries[ctz(e)].name.size();
+
+        if (m_appendUnknown && (flags & ~m_known)) {
+            len += 2 + sizeof(T) * 2;
+            ++count;
+        }
+
+        return len + (count ? (count - 1) * m_separator.size() : 0);
+    }
+
+    char *write(T flags, uint64_t entries, char *dp) const
+    {
+        if (flags == 0)
+            return append(dp, m_zeroName);
+
+        const char *start = dp;
+        for (uint64_t e = entries; e; e &= e - 1) {
+            if (dp != start)
+                dp = append(dp, m_separator);
+            dp = append(dp, m_entries[ctz(e)].name);
+        }
+
+        const T unknown = flags & ~m_known;
+        if (m_appendUnknown && unknown) {
+            static constexpr char digits[] = "0123456789abcdef";
+            if (dp != start)
+                dp = append(dp, m_separator);
+            *dp++ = '0';
+            *dp++ = 'x';
+            for (int shift = kBits - 4; shift >= 0; shift -= 4)
+                *dp++ = digits[(unknown >> shift) & 0xf];
+        }
+        return dp;
+    }
+
+    static char *append(char *dp, std::string_view str)
+    {
+        for (char c : str)
+            *dp++ = c;
+        return dp;
+    }
+};
+
+#endif /* FlagTable_hpp */
@@ -0,0 +1,453 @@
+//
+//  InodePathCache.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef InodePathCache_hpp
+#define InodePathCache_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// (device, inode) to path map fed by the file events of several sources (FSEvents-dev, ES), so
+// a path is resolved without a syscall and the sources agree after renames.
+//
+// The paths are not stored as strings: every node holds its name and a link to the node of its
+// parent directory, a path is the names on the way to the root. A rename moves one node, so the
+// paths of all the descendants of a renamed directory change with it in O(1). Directories on a
+// path which were never reported themselves are placeholders without an inode.
+//
+// The number of nodes is bounded: once the capacity is reached, leaves (nodes without children)
+// are evicted in CLOCK order, a resolved node gets a second chance. A removed directory which
+// still has children is kept detached (its descendants do not resolve) until they are gone.
+//
+// Lookups share a reader lock, the updates take it exclusively.
+class InodePathCache
+{
+public:
+    explicit InodePathCache(std::size_t capacity = 1 << 20)
+        : m_capacity(capacity < 2 ? 2 : capacity), m_byInode(m_capacity), m_byName(m_capacity)
+    {
+        // Node 0 is the root directory "/"
+        m_nodes.emplace_back();
+        m_nodes[0].used = true;
+    }
+
+    InodePathCache(const InodePathCache&) = delete;
+    InodePathCache &operator=(const InodePathCache&) = delete;
+
+    // The item at the path is (device, inode): after a create, or whenever an event carries both
+    void insert(uint64_t device, uint64_t inode, std::string_view path)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        const uint32_t known = find(device, inode);
+        if (known != kNone) {
+            move(known, path);
+            return;
+        }
+        const uint32_t node = locate(path, true);
+        if (node != kNone && node != kRoot)
+            key(node, device, inode);
+    }
+
+    // The item (device, inode) at the path from was renamed to the path to. The inode may be
+    // unknown (0), the item is found by its path then.
+    void rename(uint64_t device, uint64_t inode, std::string_view from, std::string_view to)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        uint32_t node = (inode != 0) ? find(device, inode) : kNone;
+        if (node == kNone)
+            node = locate(from, false);
+        if (node == kNone) {
+            // Never seen, the new path is as good as a create
+            node = locate(to, true);
+        } else {
+            node = move(node, to);
+        }
+        if (node != kNone && node != kRoot && inode != 0)
+            key(node, device, inode);
+    }
+
+    // The item was unlinked, the inode may be unknown (0)
+    void remove(uint64_t device, uint64_t inode, std::string_view path)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        uint32_t node = (inode != 0) ? find(device, inode) : kNone;
+        if (node == kNone)
+            node = locate(path, false);
+        if (node != kNone && node != kRoot)
+            kill(node);
+    }
+
+    // Path of (device, inode), false if it is not known
+    bool resolve(uint64_t device, uint64_t inode, std::string &path) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        const uint32_t node = find(device, inode);
+        if (node == kNone || !build(node, path)) {
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_nodes[node].referenced.store(true, std::memory_order_relaxed);
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_nodes.size() - m_free.size();
+    }
+    std::size_t capacity() const { return m_capacity; }
+
+    // Statistics
+    uint64_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+    uint64_t evictions() const { return m_evictions; }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr uint32_t kDetached = UINT32_MAX - 1;  // parent of a removed node with children
+    static constexpr uint32_t kRoot = 0;
+    static constexpr std::size_t kMaxDepth = 1024;
+
+    struct Node {
+        std::string name;
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint32_t parent = kNone;
+        uint32_t children = 0;
+        bool keyed = false;                         // in m_byInode
+        bool used = false;
+        mutable std::atomic<bool> referenced {false};
+    };
+
+    // Open addressing table of node indexes with linear probing and backward shift deletion. The
+    // hash is kept with the index, a probe reads a node only when the hashes match. Sized for the
+    // capacity at half load, it never grows.
+    class Table
+    {
+    public:
+        explicit Table(std::size_t capacity)
+        {
+            std::size_t size = 16;
+            while (size < 2 * capacity)
+                size *= 2;
+            m_slots.assign(size, Slot {0, kNone});
+            m_mask = size - 1;
+        }
+
+        template <typename Equal>
+        uint32_t find(uint32_t hash, Equal &&equal) const
+        {
+            for (std::size_t i = hash & m_mask; ; i = (i + 1) & m_mask) {
+                const Slot &slot = m_slots[i];
+                if (slot.node == kNone)
+                    return kNone;
+                if (slot.hash == hash && equal(slot.node))
+                    return slot.node;
+            }
+        }
+
+        void insert(uint32_t hash, uint32_t node)
+        {
+            std::size_t i = hash & m_mask;
+            while (m_slots[i].node != kNone)
+                i = (i + 1) & m_mask;
+            m_slots[i] = Slot {hash, node};
+        }
+
+        void erase(uint32_t hash, uint32_t node)
+        {
+            std::size_t i = hash & m_mask;
+            while (m_slots[i].node != node) {
+                if (m_slots[i].node == kNone)
+                    return;
+                i = (i + 1) & m_mask;
+            }
+            // Moves the following slots of the probe sequence into the hole
+            for (std::size_t j = i; ; ) {
+                j = (j + 1) & m_mask;
+                if (m_slots[j].node == kNone)
+                    break;
+                const std::size_t home = m_slots[j].hash & m_mask;
+                if (((j - home) & m_mask) >= ((j - i) & m_mask)) {
+                    m_slots[i] = m_slots[j];
+                    i = j;
+                }
+            }
+            m_slots[i] = Slot {0, kNone};
+        }
+
+    private:
+        struct Slot {
+            uint32_t hash;
+            uint32_t node;                          // kNone if empty
+        };
+        std::vector<Slot> m_slots;
+        std::size_t m_mask;
+    };
+
+    static uint32_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return static_cast<uint32_t>(h);
+    }
+
+    static uint32_t hashInode(uint64_t device, uint64_t inode)
+    {
+        return mix(inode * 0x9e3779b97f4a7c15ull + device);
+    }
+
+    static uint32_t hashName(uint32_t parent, std::string_view name)
+    {
+        uint64_t h = 0xcbf29ce484222325ull ^ parent;    // FNV-1a
+        for (unsigned char c : name)
+            h = (h ^ c) * 0x100000001b3ull;
+        return mix(h);
+    }
+
+    const std::size_t m_capacity;
+    mutable std::shared_mutex m_mutex;
+    std::deque<Node> m_nodes;                       // a deque, the names do not move
+    std::vector<uint32_t> m_free;
+    Table m_byInode;                                // keyed nodes by device and inode
+    Table m_byName;                                 // attached nodes by parent and name
+    std::size_t m_hand = 1;                         // CLOCK hand
+    uint64_t m_evictions = 0;
+    mutable std::atomic<uint64_t> m_hits {0};
+    mutable std::atomic<uint64_t> m_misses {0};
+
+    uint32_t find(uint64_t device, uint64_t inode) const
+    {
+        return m_byInode.find(hashInode(device, inode), [&](uint32_t node) {
+            return m_nodes[node].device == device && m_nodes[node].inode == inode;
+        });
+    }
+
+    bool build(uint32_t node, std::string &path) const
+    {
+        uint32_t chain[kMaxDepth];
+        std::size_t depth = 0, length = 0;
+        for (uint32_t n = node; n != kRoot; n = m_nodes[n].parent) {
+            // Under a removed directory, or a loop (a rename into its own subtree)
+            if (n == kDetached || n == kNone || depth == kMaxDepth)
+                return false;
+            chain[depth++] = n;
+            length += m_nodes[n].name.size() + 1;
+        }
+        path.clear();
+        path.reserve(length);
+        while (depth > 0) {
+            path += '/';
+            path += m_nodes[chain[--depth]].name;
+        }
+        if (path.empty())
+            path = "/";
+        return true;
+    }
+
+    uint32_t child(uint32_t parent, std::string_view name) const
+    {
+        return m_byName.find(hashName(parent, name), [&](uint32_t node) {
+            return m_nodes[node].parent == parent && m_nodes[node].name == name;
+        });
+    }
+
+    uint32_t allocate()
+    {
+        if (m_free.empty() && m_nodes.size() >= m_capacity)
+            evict();
+        uint32_t node;
+        if (!m_free.empty()) {
+            node = m_free.back();
+            m_free.pop_back();
+        } else {
+            node = static_cast<uint32_t>(m_nodes.size());
+            m_nodes.emplace_back();
+        }
+        Node &n = m_nodes[node];
+        n.device = n.inode = 0;
+        n.parent = kNone;
+        n.children = 0;
+        n.keyed = false;
+        n.used = true;
+        n.referenced.store(false, std::memory_order_relaxed);
+        return node;
+    }
+
+    // Frees one leaf in CLOCK order
+    void evict()
+    {
+        for (std::size_t steps = 0; steps < 2 * m_nodes.size(); ++steps) {
+            if (m_hand >= m_nodes.size())
+                m_hand = 1;
+            const uint32_t node = static_cast<uint32_t>(m_hand++);
+            Node &n = m_nodes[node];
+            if (!n.used || n.children)
+                continue;
+            if (n.referenced.exchange(false, std::memory_order_relaxed))
+                continue;
+            kill(node);
+            ++m_evictions;
+            return;
+        }
+    }
+
+    void attach(uint32_t node, uint32_t parent, std::string_view name)
+    {
+        Node &n = m_nodes[node];
+        n.name.assign(name.data(), name.size());
+        n.parent = parent;
+        m_nodes[parent].children++;
+        m_byName.insert(hashName(parent, n.name), node);
+    }
+
+    void detach(uint32_t node)
+    {
+        Node &n = m_nodes[node];
+        if (n.parent == kNone || n.parent == kDetached)
+            return;
+        m_byName.erase(hashName(n.parent, n.name), node);
+        release(n.parent);
+        n.parent = kNone;
+    }
+
+    // One child less, frees a removed directory once its last child is gone
+    void release(uint32_t parent)
+    {
+        Node &p = m_nodes[parent];
+        if (--p.children == 0 && p.parent == kDetached)
+            free(parent);
+    }
+
+    void free(uint32_t node)
+    {
+        Node &n = m_nodes[node];
+        n.used = false;
+        n.parent = kNone;
+        n.name.clear();
+        m_free.push_back(node);
+    }
+
+    void key(uint32_t node, uint64_t device, uint64_t inode)
+    {
+        Node &n = m_nodes[node];
+        if (n.keyed && n.device == device && n.inode == inode)
+            return;
+        if (n.keyed)
+            m_byInode.erase(hashInode(n.device, n.inode), node);
+        // The inode moved here without a rename event (a missed event, or reuse of the number)
+        const uint32_t other = find(device, inode);
+        if (other != kNone) {
+            m_nodes[other].keyed = false;
+            m_byInode.erase(hashInode(device, inode), other);
+        }
+        n.device = device;
+        n.inode = inode;
+        n.keyed = true;
+        m_byInode.insert(hashInode(device, inode), node);
+    }
+
+    void kill(uint32_t node)
+    {
+        Node &n = m_nodes[node];
+        if (n.keyed) {
+            m_byInode.erase(hashInode(n.device, n.inode), node);
+            n.keyed = false;
+        }
+        detach(node);
+        if (n.children)
+            n.parent = kDetached;
+        else
+            free(node);
+    }
+
+    // Node of the path, its missing directories are created as placeholders if create is set
+    uint32_t locate(std::string_view path, bool create)
+    {
+        uint32_t node = kRoot;
+        std::size_t at = 0;
+        while (at < path.size()) {
+            while (at < path.size() && path[at] == '/')
+                ++at;
+            if (at == path.size())
+                break;
+            std::size_t end = path.find('/', at);
+            if (end == std::string_view::npos)
+                end = path.size();
+            const std::string_view name = path.substr(at, end - at);
+            at = end;
+
+            uint32_t next = child(node, name);
+            if (next == kNone) {
+                if (!create)
+                    return kNone;
+                // The parent may not be evicted while its child is being made
+                m_nodes[node].children++;
+                next = allocate();
+                m_nodes[node].children--;
+                attach(next, node, name);
+            }
+            node = next;
+        }
+        return node;
+    }
+
+    // Moves the node to the path, an item there is replaced. Returns the node.
+    uint32_t move(uint32_t node, std::string_view path)
+    {
+        std::size_t end = path.size();
+        while (end > 1 && path[end - 1] == '/')
+            --end;
+        const std::size_t slash = path.rfind('/', end - 1);
+        const std::size_t begin = (slash == std::string_view::npos) ? 0 : slash + 1;
+        const std::string_view dir = path.substr(0, begin);
+        const std::string_view name = path.substr(begin, end - begin);
+        if (name.empty())
+            return node;
+
+        const Node &n = m_nodes[node];
+        // The node keeps its parent alive while it is placed
+        m_nodes[node].children++;
+        const uint32_t parent = locate(dir, true);
+        m_nodes[node].children--;
+        if (parent == kNone)
+            return node;
+        if (n.parent == parent && n.name == name)
+            return node;
+
+        const uint32_t existing = child(parent, name);
+        if (existing != kNone && existing != node) {
+            if (!m_nodes[existing].keyed && m_nodes[existing].children && !n.children) {
+                // A placeholder directory which already has children takes over the identity
+                const uint64_t device = n.device, inode = n.inode;
+                const bool keyed = n.keyed;
+                kill(node);
+                if (keyed)
+                    key(existing, device, inode);
+                return existing;
+            }
+            // A replaced item is gone
+            kill(existing);
+        }
+        detach(node);
+        attach(node, parent, name);
+        return node;
+    }
+};
+
+#endif /* InodePathCache_hpp */
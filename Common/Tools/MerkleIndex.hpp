@@ -0,0 +1,504 @@
+//
+//  MerkleIndex.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef MerkleIndex_hpp
+#define MerkleIndex_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "DirectoryScanner.hpp"
+
+// Persistent Merkle index of a watched tree. It is the snapshot of the DirectoryScanner plus a
+// hash per directory, built from the names and metadata (inode, mtime, size) of its entries and
+// the hashes of its subdirectories; the hash of the root covers the whole tree.
+//
+// The index is kept current by the events: update() lists the one directory an event names and
+// rehashes it and its ancestors, O(depth) hashes. Only the hashes on the paths from changed
+// directories to the root are dropped, they are recomputed on demand.
+//
+// After a restart the saved index is loaded together with the last event ID, so the events
+// since then can be replayed into it. When they can not (kFSEventStreamEventFlagEventIdsWrapped,
+// history lost), verify() checks the tree with one stat per directory and lists only the
+// directories whose inode or mtime changed; a file written in place does not change its
+// directory, that needs the events or a full rescan(). diff() compares two indexes and descends
+// only into the subtrees whose hashes differ (a directory created or deleted as a whole is
+// reported as one entry).
+class MerkleIndex
+{
+public:
+    using Change = DirectoryScanner::Change;
+
+    explicit MerkleIndex(ThreadPool &pool) : m_scanner(pool) {}
+
+    const std::string &root() const { return m_root; }
+    const DirectorySnapshot &snapshot() const { return m_snapshot; }
+    uint64_t eventId() const { return m_eventId; }
+    void setEventId(uint64_t eventId) { m_eventId = eventId; }
+
+    // Hash of the directory (0 if it is not indexed), the root hash covers the whole tree
+    uint64_t hash(const std::string &directory)
+    {
+        return m_snapshot.directories.count(directory) ? hashOf(directory) : 0;
+    }
+    uint64_t rootHash() { return hash(m_root); }
+
+    // Indexes the tree of root from scratch. Returns false and sets errno if it can not be read.
+    bool build(const std::string &root)
+    {
+        m_root = root;
+        m_snapshot.directories.clear();
+        m_hashes.clear();
+        if (!statRoot())
+            return false;
+        m_scanner.scan(m_root, m_snapshot, [](Change, const std::string &, const DirectoryEntry &) {});
+        return true;
+    }
+
+    // Rescans the subtree fully, passes the changes to f(Change, const std::string &path,
+    // const DirectoryEntry &)
+    template <typename F>
+    DirectoryScanner::Stats rescan(const std::string &subtree, F &&f)
+    {
+        return scan(subtree, f, DirectoryScanner::Depth::Subtree);
+    }
+
+    // Applies one event: the path (or its directory, if it is not a directory of the index) is
+    // listed again. New subdirectories are indexed with their subtree.
+    template <typename F>
+    DirectoryScanner::Stats update(const std::string &path, F &&f)
+    {
+        std::string directory = path;
+        while (directory.size() > 1 && directory.back() == '/')
+            directory.pop_back();
+        while (!m_snapshot.directories.count(directory) && directory.size() > m_root.size())
+            directory = parent(directory);
+        if (directory.compare(0, m_root.size(), m_root) != 0)
+            return {};
+        return scan(directory, f, DirectoryScanner::Depth::Directory);
+    }
+
+    // Checks the tree against the index with one stat per directory and lists the directories
+    // whose inode or mtime changed. Returns the number of directories listed.
+    template <typename F>
+    std::size_t verify(F &&f)
+    {
+        if (!statRoot()) {
+            // The whole tree is gone
+            rescan(m_root, f);
+            return 0;
+        }
+
+        std::vector<std::string> changed;       // listings to read again
+        std::vector<std::string> replaced;      // subtrees to scan again, the inode changed
+        if (m_rootChanged)
+            changed.push_back(m_root);
+        std::vector<const std::string *> stack {&m_root};
+        while (!stack.empty()) {
+            const std::string &directory = *stack.back();
+            stack.pop_back();
+            const auto it = m_snapshot.directories.find(directory);
+            if (it == m_snapshot.directories.end())
+                continue;
+            for (const DirectoryEntry &entry : it->second) {
+                if (!entry.directory)
+                    continue;
+                const std::string path = join(directory, entry.name);
+                struct stat st;
+                if (lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                    // Gone, the listing of the parent drops it
+                    changed.push_back(directory);
+                    continue;
+                }
+                if (static_cast<uint64_t>(st.st_ino) != entry.inode) {
+                    // The entry of the parent has the old inode
+                    changed.push_back(directory);
+                    replaced.push_back(path);
+                    continue;
+                }
+                if (mtime(st) != entry.mtime)
+                    changed.push_back(path);
+                const auto child = m_snapshot.directories.find(path);
+                if (child != m_snapshot.directories.end())
+                    stack.push_back(&child->first);
+            }
+        }
+
+        // Listed after the walk, the listings reference the snapshot
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        for (const std::string &directory : changed)
+            update(directory, f);
+        for (const std::string &directory : replaced)
+            rescan(directory, f);
+        return changed.size() + replaced.size();
+    }
+
+    // Passes the differences from index a to index b to f(Change, path, entry), descending only
+    // into the directories whose hashes differ
+    template <typename F>
+    static void diff(MerkleIndex &a, MerkleIndex &b, F &&f)
+    {
+        diff(a, b, a.m_root, f);
+    }
+
+    // Writes the index to the file (through a temporary file made by mkstemp next to it and
+    // renamed over it, the file is private to the user). Returns false and sets errno on failure.
+    bool save(const std::string &file)
+    {
+        std::vector<char> out;
+        put(out, kMagic);
+        put(out, kVersion);
+        put(out, m_eventId);
+        put(out, m_rootInode);
+        put(out, m_rootMtime);
+        putString(out, m_root);
+        put(out, static_cast<uint64_t>(m_snapshot.directories.size()));
+        for (const auto &directory : m_snapshot.directories) {
+            putString(out, directory.first);
+            put(out, hashOf(directory.first));
+            put(out, static_cast<uint64_t>(directory.second.size()));
+            for (const DirectoryEntry &entry : directory.second) {
+                putString(out, entry.name);
+                put(out, entry.device);
+                put(out, entry.inode);
+                put(out, entry.mtime);
+                put(out, entry.size);
+                put(out, static_cast<uint8_t>(entry.directory));
+            }
+        }
+
+        std::vector<char> name(file.begin(), file.end());
+        static const char kSuffix[] = ".XXXXXX";
+        name.insert(name.end(), kSuffix, kSuffix + sizeof(kSuffix));
+        const int fd = mkstemp(name.data());
+        if (fd < 0)
+            return false;
+        const std::string temporary(name.data());
+        std::size_t written = 0;
+        while (written < out.size()) {
+            const ssize_t n = write(fd, out.data() + written, out.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                const int error = errno;
+                close(fd);
+                unlink(temporary.c_str());
+                errno = error;
+                return false;
+            }
+            written += static_cast<std::size_t>(n);
+        }
+        if (close(fd) != 0 || rename(temporary.c_str(), file.c_str()) != 0) {
+            const int error = errno;
+            unlink(temporary.c_str());
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
+    // Reads an index written by save(). Returns false and sets errno (EINVAL for a file which is
+    // not a valid index, EPERM for a symlink or a file someone else owns or can write) on
+    // failure, the index is left empty then.
+    bool load(const std::string &file)
+    {
+        m_root.clear();
+        m_snapshot.directories.clear();
+        m_hashes.clear();
+
+        std::vector<char> in;
+        if (!readFile(file, in))
+            return false;
+        Reader reader {in.data(), in.data() + in.size()};
+        uint32_t magic = 0, version = 0;
+        uint64_t directories = 0;
+        bool ok = reader.get(magic) && magic == kMagic && reader.get(version) && version == kVersion
+               && reader.get(m_eventId) && reader.get(m_rootInode) && reader.get(m_rootMtime)
+               && reader.getString(m_root) && reader.get(directories);
+        for (uint64_t i = 0; ok && i < directories; ++i) {
+            std::string path;
+            uint64_t hash = 0, count = 0;
+            ok = reader.getString(path) && reader.get(hash) && reader.get(count)
+              && count <= static_cast<uint64_t>(reader.end - reader.at);
+            if (!ok)
+                break;
+            std::vector<DirectoryEntry> &listing = m_snapshot.directories[path];
+            listing.resize(count);
+            for (DirectoryEntry &entry : listing) {
+                uint8_t directory = 0;
+                ok = ok && reader.getString(entry.name) && reader.get(entry.device) && reader.get(entry.inode)
+                   && reader.get(entry.mtime) && reader.get(entry.size) && reader.get(directory);
+                entry.directory = (directory != 0);
+            }
+            m_hashes[path] = hash;
+        }
+        if (!ok || !m_snapshot.directories.count(m_root)) {
+            m_root.clear();
+            m_snapshot.directories.clear();
+            m_hashes.clear();
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x4c4b524d;  // "MRKL"
+    static constexpr uint32_t kVersion = 1;
+
+    DirectoryScanner m_scanner;
+    DirectorySnapshot m_snapshot;
+    std::unordered_map<std::string, uint64_t> m_hashes;    // missing if the directory changed
+    std::string m_root;
+    uint64_t m_rootInode = 0;
+    int64_t m_rootMtime = 0;
+    bool m_rootChanged = false;
+    uint64_t m_eventId = 0;
+
+    struct Reader {
+        const char *at;
+        const char *end;
+
+        template <typename T>
+        bool get(T &value)
+        {
+            if (static_cast<std::size_t>(end - at) < sizeof(T))
+                return false;
+            std::memcpy(&value, at, sizeof(T));
+            at += sizeof(T);
+            return true;
+        }
+
+        bool getString(std::string &value)
+        {
+            uint32_t length = 0;
+            if (!get(length) || static_cast<std::size_t>(end - at) < length)
+                return false;
+            value.assign(at, length);
+            at += length;
+            return true;
+        }
+    };
+
+    template <typename T>
+    static void put(std::vector<char> &out, const T &value)
+    {
+        const char *bytes = reinterpret_cast<const char *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    static void putString(std::vector<char> &out, const std::string &value)
+    {
+        put(out, static_cast<uint32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    static bool readFile(const std::string &file, std::vector<char> &in)
+    {
+        const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        struct stat st;
+        if (fd < 0) {
+            if (errno == ELOOP)
+                errno = EPERM;
+            return false;
+        }
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        // The index decides what is skipped at startup, only the user's own files are trusted
+        if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+            close(fd);
+            errno = EPERM;
+            return false;
+        }
+        in.resize(static_cast<std::size_t>(st.st_size));
+        std::size_t done = 0;
+        while (done < in.size()) {
+            const ssize_t n = read(fd, in.data() + done, in.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += static_cast<std::size_t>(n);
+        }
+        close(fd);
+        in.resize(done);
+        return true;
+    }
+
+    static int64_t mtime(const struct stat &st)
+    {
+#if defined(__APPLE__)
+        return static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    }
+
+    static std::string join(const std::string &directory, const std::string &name)
+    {
+        return (directory.empty() || directory.back() != '/') ? directory + "/" + name : directory + name;
+    }
+
+    static std::string parent(const std::string &path)
+    {
+        const std::size_t slash = path.find_last_of('/');
+        return (slash == std::string::npos || slash == 0) ? std::string("/") : path.substr(0, slash);
+    }
+
+    // The root has no parent entry, its own stat is kept. Returns false if it is gone.
+    bool statRoot()
+    {
+        struct stat st;
+        if (stat(m_root.c_str(), &st) != 0)
+            return false;
+        if (!S_ISDIR(st.st_mode)) {
+            errno = ENOTDIR;
+            return false;
+        }
+        m_rootChanged = static_cast<uint64_t>(st.st_ino) != m_rootInode || mtime(st) != m_rootMtime;
+        m_rootInode = static_cast<uint64_t>(st.st_ino);
+        m_rootMtime = mtime(st);
+        return true;
+    }
+
+    static uint64_t mix(uint64_t h, uint64_t value)
+    {
+        // Order dependent combination, murmur3 finalizer
+        h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static uint64_t hashName(const std::string &name)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;     // FNV-1a
+        for (unsigned char c : name)
+            h = (h ^ c) * 0x100000001b3ull;
+        return h;
+    }
+
+    // Hash of an indexed directory, recomputed (with the missing hashes below it) if it changed
+    uint64_t hashOf(const std::string &directory)
+    {
+        const auto cached = m_hashes.find(directory);
+        if (cached != m_hashes.end())
+            return cached->second;
+
+        uint64_t h = mix(0, 0x4d524b4c);
+        const auto it = m_snapshot.directories.find(directory);
+        if (it != m_snapshot.directories.end()) {
+            for (const DirectoryEntry &entry : it->second) {
+                h = mix(h, hashName(entry.name));
+                h = mix(h, entry.inode);
+                h = mix(h, static_cast<uint64_t>(entry.mtime));
+                h = mix(h, entry.size);
+                if (entry.directory) {
+                    const std::string path = join(directory, entry.name);
+                    h = mix(h, m_snapshot.directories.count(path) ? hashOf(path) : 1);
+                }
+            }
+        }
+        m_hashes[directory] = h;
+        return h;
+    }
+
+    // Drops the hashes from the directory up to the root. A directory without its hash has
+    // none above it either, so the walk stops at the first one already dropped.
+    void invalidate(std::string directory)
+    {
+        for (;;) {
+            if (m_hashes.erase(directory) == 0 || directory.size() <= m_root.size())
+                return;
+            directory = parent(directory);
+        }
+    }
+
+    template <typename F>
+    DirectoryScanner::Stats scan(const std::string &directory, F &f, DirectoryScanner::Depth depth)
+    {
+        if (directory == m_root)
+            statRoot();
+        const DirectoryScanner::Stats stats = m_scanner.scan(directory, m_snapshot, [this, &f](Change change, const std::string &path, const DirectoryEntry &entry) {
+            if (entry.directory && change == Change::Deleted)
+                m_hashes.erase(path);
+            invalidate(parent(path));
+            f(change, path, entry);
+        }, depth);
+        if (stats.changes && directory != m_root)
+            refresh(directory);
+        return stats;
+    }
+
+    // A changed listing changes the mtime of the directory, which is in the entry of its parent
+    void refresh(const std::string &directory)
+    {
+        const std::string up = parent(directory);
+        const auto it = m_snapshot.directories.find(up);
+        struct stat st;
+        if (it == m_snapshot.directories.end() || lstat(directory.c_str(), &st) != 0)
+            return;
+        const std::string name = directory.substr(up.size() + (up.back() == '/' ? 0 : 1));
+        const auto entry = std::lower_bound(it->second.begin(), it->second.end(), name,
+            [](const DirectoryEntry &e, const std::string &n) { return e.name < n; });
+        if (entry == it->second.end() || entry->name != name)
+            return;
+        entry->inode = static_cast<uint64_t>(st.st_ino);
+        entry->mtime = mtime(st);
+        entry->size = static_cast<uint64_t>(st.st_size);
+        invalidate(up);
+    }
+
+    template <typename F>
+    static void diff(MerkleIndex &a, MerkleIndex &b, const std::string &directory, F &f)
+    {
+        if (a.hash(directory) == b.hash(directory))
+            return;
+        static const std::vector<DirectoryEntry> empty;
+        const auto ia = a.m_snapshot.directories.find(directory);
+        const auto ib = b.m_snapshot.directories.find(directory);
+        const std::vector<DirectoryEntry> &la = (ia != a.m_snapshot.directories.end()) ? ia->second : empty;
+        const std::vector<DirectoryEntry> &lb = (ib != b.m_snapshot.directories.end()) ? ib->second : empty;
+
+        std::size_t i = 0, j = 0;
+        while (i < la.size() || j < lb.size()) {
+            const int order = (i == la.size()) ? 1 : (j == lb.size()) ? -1 : la[i].name.compare(lb[j].name);
+            if (order < 0) {
+                f(Change::Deleted, join(directory, la[i].name), la[i]);
+                ++i;
+            } else if (order > 0) {
+                f(Change::Created, join(directory, lb[j].name), lb[j]);
+                ++j;
+            } else {
+                const DirectoryEntry &ea = la[i++], &eb = lb[j++];
+                if (ea.inode != eb.inode || ea.mtime != eb.mtime || ea.size != eb.size || ea.directory != eb.directory)
+                    f(Change::Modified, join(directory, eb.name), eb);
+                if (ea.directory && eb.directory)
+                    diff(a, b, join(directory, eb.name), f);
+            }
+        }
+    }
+};
+
+#endif /* MerkleIndex_hpp */
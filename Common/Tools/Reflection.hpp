@@ -0,0 +1,169 @@
+//
+//  Reflection.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef Reflection_hpp
+#define Reflection_hpp
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// TODO: demagler
+// https://gcc.gnu.org/onlinedocs/libstdc++/manual/ext_demangling.html
+template <typename T>
+constexpr std::string_view type_name()
+{
+    std::string_view name, prefix, suffix;
+#ifdef __clang__
+    name = __PRETTY_FUNCTION__;
+    prefix = "std::string_view type_name() [T = ";
+    suffix = "]";
+#elif defined(__GNUC__)
+    name = __PRETTY_FUNCTION__;
+    prefix = "constexpr std::string_view type_name() [with T = ";
+    suffix = "; std::string_view = std::basic_string_view<char>]";
+#elif defined(_MSC_VER)
+    name = __FUNCSIG__;
+    prefix = "class std::basic_string_view<char,struct std::char_traits<char> > __cdecl type_name<";
+    suffix = ">(void)";
+#endif
+    name.remove_prefix(prefix.size());
+    name.remove_suffix(suffix.size());
+    return name;
+}
+
+// The same trick as type_name() applied to a value. Returns the enumerator name (without the
+// scope) or an empty string if V is not a named enumerator (compilers print a cast, i.e. "(E)5").
+template <auto V>
+constexpr std::string_view value_name()
+{
+#if defined(__clang__) || defined(__GNUC__)
+    std::string_view name = __PRETTY_FUNCTION__;
+    const std::size_t begin = name.find("V = ");
+    if (begin == std::string_view::npos)
+        return {};
+    name.remove_prefix(begin + 4);
+    name = name.substr(0, name.find_first_of(";]"));
+#elif defined(_MSC_VER)
+    std::string_view name = __FUNCSIG__;
+    name.remove_prefix(name.find("value_name<") + 11);
+    name = name.substr(0, name.find(">(void)"));
+#endif
+    if (name.empty() || name[0] == '(' || name[0] == '-' || (name[0] >= '0' && name[0] <= '9'))
+        return {};
+    if (const std::size_t scope = name.rfind("::"); scope != std::string_view::npos)
+        name.remove_prefix(scope + 2);
+    return name;
+}
+
+template <typename T>
+struct NamedValue {
+    T value;
+    std::string_view name;
+};
+
+// Dense value -> name table for values in [min, min + Size). Lookups are a bounds check and an
+// array access, they never throw and unknown values map to a fallback (the type name by default).
+template <typename T, std::size_t Size>
+class NameTable
+{
+    using Key = long long;
+
+    std::array<std::string_view, Size> m_names {};
+    Key m_min = 0;
+
+    static constexpr Key key(T value)
+    {
+        if constexpr (std::is_enum_v<T>)
+            return static_cast<Key>(static_cast<std::underlying_type_t<T>>(value));
+        else
+            return static_cast<Key>(value);
+    }
+
+public:
+    constexpr NameTable(const std::array<std::string_view, Size> &names, Key min = 0)
+        : m_names(names), m_min(min) {}
+
+    template <std::size_t N>
+    constexpr NameTable(const NamedValue<T> (&values)[N], Key min = 0)
+        : m_min(min)
+    {
+        // Explicit initialization, GCC does not treat value-initialized elements as constant
+        for (auto &n : m_names)
+            n = std::string_view("", 0);
+        for (const auto &v : values) {
+            const Key k = key(v.value) - m_min;
+            if (k >= 0 && static_cast<std::size_t>(k) < Size)
+                m_names[static_cast<std::size_t>(k)] = v.name;
+        }
+    }
+
+    constexpr bool contains(T value) const noexcept
+    {
+        return !lookup(value).empty();
+    }
+
+    constexpr std::string_view name(T value, std::string_view fallback) const noexcept
+    {
+        const std::string_view n = lookup(value);
+        return n.empty() ? fallback : n;
+    }
+
+    constexpr std::string_view name(T value) const noexcept
+    {
+        return name(value, type_name<T>());
+    }
+
+    constexpr std::string_view operator[](T value) const noexcept
+    {
+        return name(value);
+    }
+
+    // Reverse lookup (i.e. for configuration files). Not meant for hot paths.
+    constexpr std::optional<T> parse(std::string_view name) const noexcept
+    {
+        if (name.empty())
+            return std::nullopt;
+        for (std::size_t i = 0; i < Size; ++i)
+            if (m_names[i] == name)
+                return static_cast<T>(static_cast<Key>(i) + m_min);
+        return std::nullopt;
+    }
+
+private:
+    constexpr std::string_view lookup(T value) const noexcept
+    {
+        const Key k = key(value) - m_min;
+        if (k < 0 || static_cast<std::size_t>(k) >= Size)
+            return {};
+        return m_names[static_cast<std::size_t>(k)];
+    }
+};
+
+namespace detail {
+template <typename E, int Min, int... Is>
+constexpr std::array<std::string_view, sizeof...(Is)> enum_names(std::integer_sequence<int, Is...>)
+{
+    return {{ value_name<static_cast<E>(Min + Is)>()... }};
+}
+} // namespace detail
+
+// Builds the name table of enumerators in [Min, Max) at compile time, no manual list needed.
+// Note: the enum must be able to represent the whole range (i.e. it has a fixed underlying type).
+template <typename E, int Min = 0, int Max = 128>
+constexpr NameTable<E, static_cast<std::size_t>(Max - Min)> reflect_enum()
+{
+    static_assert(std::is_enum_v<E>, "reflect_enum() requires an enum type");
+    static_assert(Max > Min, "Empty range");
+    return NameTable<E, static_cast<std::size_t>(Max - Min)>(
+        detail::enum_names<E, Min>(std::make_integer_sequence<int, Max - Min>{}), Min);
+}
+
+#endif /* Reflection_hpp */
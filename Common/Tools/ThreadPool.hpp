@@ -0,0 +1,179 @@
+//
+//  ThreadPool.hpp
+//
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a task queue, it takes tasks from the back of
+// its own queue (the most recent ones, still in the cache) and steals from the front of the
+// other queues once its queue is empty. Tasks submitted from a worker go to its own queue,
+// tasks submitted from other threads are spread round-robin.
+//
+// Tasks are meant to be coarse (i.e. megabytes of input), the queues are guarded by mutexes.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads = 0)
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+
+        for (unsigned i = 0; i < threads; ++i)
+            m_queues.emplace_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < threads; ++i)
+            m_threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_workAvailable.notify_all();
+        for (auto &thread : m_threads)
+            thread.join();
+    }
+
+    std::size_t size() const { return m_threads.size(); }
+
+    void submit(std::function<void()> task)
+    {
+        const std::size_t index = (t_pool == this) ? t_index : m_next++ % m_queues.size();
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            // Counted before it is queued so the counter never drops below zero
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_queued;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        m_workAvailable.notify_one();
+    }
+
+    // Blocks until all the submitted tasks are finished. Rethrows the first exception thrown
+    // by a task. Must not be called from a task.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_allDone.wait(lock, [this] { return m_pending.load(std::memory_order_acquire) == 0; });
+        if (m_exception) {
+            std::exception_ptr exception = m_exception;
+            m_exception = nullptr;
+            std::rethrow_exception(exception);
+        }
+    }
+
+    // Calls f(i) for i in [0, count) on the pool and waits for all of them
+    template <typename F>
+    void parallelFor(std::size_t count, F &&f)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            submit([&f, i] { f(i); });
+        wait();
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;                     // guards m_queued, m_stop and m_exception
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+    std::size_t m_queued = 0;               // tasks waiting in the queues
+    std::atomic<std::size_t> m_pending {0}; // submitted and not finished tasks
+    std::atomic<std::size_t> m_next {0};
+    std::exception_ptr m_exception;
+    bool m_stop = false;
+
+    static inline thread_local const ThreadPool *t_pool = nullptr;
+    static inline thread_local std::size_t t_index = 0;
+
+    bool pop(std::size_t index, std::function<void()> &task)
+    {
+        // Own queue first (LIFO), then steal from the others (FIFO)
+        {
+            Queue &own = *m_queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < m_queues.size(); ++i) {
+            Queue &victim = *m_queues[(index + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker(std::size_t index)
+    {
+        t_pool = this;
+        t_index = index;
+
+        std::function<void()> task;
+        for (;;) {
+            if (!pop(index, task)) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_workAvailable.wait(lock, [this] { return m_stop || m_queued > 0; });
+                if (m_stop && m_queued == 0)
+                    return;
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_queued;
+            }
+
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_exception)
+                    m_exception = std::current_exception();
+            }
+            task = nullptr;
+
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_allDone.notify_all();
+            }
+        }
+    }
+};
+
+#endif /* ThreadPool_hpp */
@@ -11,10 +11,15 @@
 #include <any>
 #include <EndpointSecurity/EndpointSecurity.h>
 #include <Foundation/Foundation.h>
-#include <map>
 
-extern const std::map<es_event_type_t, const std::string> g_eventTypeToStrMap;
-extern const std::map<es_respond_result_t, const std::string> g_respondResultToStrMap;
+#include "EventRenderer.hpp"
+#include "Reflection.hpp"
+
+// O(1) and non-throwing, unknown values are named by their type.
+// Ranges end with the last enumerator, casting outside of them is not a constant expression.
+inline constexpr auto g_eventTypeToStr = reflect_enum<es_event_type_t, 0, ES_EVENT_TYPE_LAST>();
+inline constexpr auto g_respondResultToStr = reflect_enum<es_respond_result_t, 0, ES_RESPOND_RESULT_ERR_EVENT_TYPE + 1>();
+inline constexpr auto g_destinationTypeToStr = reflect_enum<es_destination_type_t, 0, ES_DESTINATION_TYPE_NEW_PATH + 1>();
 
 // MARK: - Custom Casts
 @interface NSString (alternativeConstructorsEs)
@@ -59,4 +64,10 @@ std::ostream & operator << (std::ostream &out, const es_file_t * const file);
 std::ostream & operator << (std::ostream &out, const es_statfs_t * const stats);
 std::ostream & operator << (std::ostream &out, const es_process_t * const proc);
 
+// MARK: - Endpoint Security Rendering
+void render(EventRenderer &r, const es_message_t * const msg);
+void render(EventRenderer &r, std::string_view key, const es_file_t * const file);
+void render(EventRenderer &r, std::string_view key, const es_statfs_t * const stats);
+void render(EventRenderer &r, std::string_view key, const es_process_t * const proc);
+
 #endif /* Tools_ES_hpp */
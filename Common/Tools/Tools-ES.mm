@@ -20,58 +20,6 @@
 #include "Tools-ES.hpp"
 #include "../logger.hpp"
 
-const inline std::map<es_event_type_t, const std::string> g_eventTypeToStrMap = {
-    // Process
-    {ES_EVENT_TYPE_AUTH_EXEC, "ES_EVENT_TYPE_AUTH_EXEC"},
-    {ES_EVENT_TYPE_NOTIFY_EXIT, "ES_EVENT_TYPE_NOTIFY_EXIT"},
-    {ES_EVENT_TYPE_NOTIFY_FORK, "ES_EVENT_TYPE_NOTIFY_FORK"},
-    // File System
-    {ES_EVENT_TYPE_NOTIFY_ACCESS, "ES_EVENT_TYPE_NOTIFY_ACCESS"},
-    {ES_EVENT_TYPE_AUTH_CHDIR, "ES_EVENT_TYPE_AUTH_CHDIR"},
-    {ES_EVENT_TYPE_AUTH_CLONE, "ES_EVENT_TYPE_AUTH_CLONE"},
-    {ES_EVENT_TYPE_NOTIFY_CLOSE, "ES_EVENT_TYPE_NOTIFY_CLOSE"},
-    {ES_EVENT_TYPE_AUTH_CREATE, "ES_EVENT_TYPE_AUTH_CREATE"},
-    {ES_EVENT_TYPE_AUTH_FILE_PROVIDER_MATERIALIZE, "ES_EVENT_TYPE_AUTH_FILE_PROVIDER_MATERIALIZE"},
-    {ES_EVENT_TYPE_AUTH_FILE_PROVIDER_UPDATE, "ES_EVENT_TYPE_AUTH_FILE_PROVIDER_UPDATE"},
-    {ES_EVENT_TYPE_NOTIFY_EXCHANGEDATA, "ES_EVENT_TYPE_NOTIFY_EXCHANGEDATA"},
-    {ES_EVENT_TYPE_AUTH_LINK, "ES_EVENT_TYPE_AUTH_LINK"},
-    {ES_EVENT_TYPE_AUTH_MOUNT, "ES_EVENT_TYPE_AUTH_MOUNT"},
-    {ES_EVENT_TYPE_AUTH_OPEN, "ES_EVENT_TYPE_AUTH_OPEN"},
-    {ES_EVENT_TYPE_AUTH_READDIR, "ES_EVENT_TYPE_AUTH_READDIR"},
-    {ES_EVENT_TYPE_AUTH_READLINK, "ES_EVENT_TYPE_AUTH_READLINK"},
-    {ES_EVENT_TYPE_AUTH_RENAME, "ES_EVENT_TYPE_AUTH_RENAME"},
-    {ES_EVENT_TYPE_AUTH_TRUNCATE, "ES_EVENT_TYPE_AUTH_TRUNCATE"},
-    {ES_EVENT_TYPE_AUTH_UNLINK, "ES_EVENT_TYPE_AUTH_UNLINK"},
-    {ES_EVENT_TYPE_NOTIFY_UNMOUNT, "ES_EVENT_TYPE_NOTIFY_UNMOUNT"},
-    {ES_EVENT_TYPE_NOTIFY_WRITE, "ES_EVENT_TYPE_NOTIFY_WRITE"},
-    // System
-    {ES_EVENT_TYPE_NOTIFY_IOKIT_OPEN, "ES_EVENT_TYPE_NOTIFY_IOKIT_OPEN"},
-    {ES_EVENT_TYPE_NOTIFY_KEXTLOAD, "ES_EVENT_TYPE_NOTIFY_KEXTLOAD"},
-    {ES_EVENT_TYPE_NOTIFY_KEXTUNLOAD, "ES_EVENT_TYPE_NOTIFY_KEXTUNLOAD"},
-    // !!!: Default --> throws an exception
-};
-
-const inline std::map<es_respond_result_t, const std::string> g_respondResultToStrMap = {
-    {ES_RESPOND_RESULT_SUCCESS, "ES_RESPOND_RESULT_SUCCESS"},
-    ///One or more invalid arguments were provided
-    {ES_RESPOND_RESULT_ERR_INVALID_ARGUMENT, "ES_RESPOND_RESULT_ERR_INVALID_ARGUMENT"},
-    ///Communication with the ES subsystem failed
-    {ES_RESPOND_RESULT_ERR_INTERNAL, "ES_RESPOND_RESULT_ERR_INTERNAL"},
-    ///The message being responded to could not be found
-    {ES_RESPOND_RESULT_NOT_FOUND, "ES_RESPOND_RESULT_NOT_FOUND"},
-    ///The provided message has been responded to more than once
-    {ES_RESPOND_RESULT_ERR_DUPLICATE_RESPONSE, "ES_RESPOND_RESULT_ERR_DUPLICATE_RESPONSE"},
-    ///Either an inappropriate response API was used for the event type (ensure using proper
-    ///es_respond_auth_result or es_respond_flags_result function) or the event is notification only.
-    {ES_RESPOND_RESULT_ERR_EVENT_TYPE, "ES_RESPOND_RESULT_ERR_EVENT_TYPE"},
-};
-
-const inline static std::map<es_destination_type_t, const std::string> g_destinationTypeToStrMap = {
-    {ES_DESTINATION_TYPE_EXISTING_FILE, "ES_DESTINATION_TYPE_EXISTING_FILE"},
-    {ES_DESTINATION_TYPE_NEW_PATH, "ES_DESTINATION_TYPE_NEW_PATH"},
-};
-
-
 // MARK: - Custom Casts
 @implementation NSString (alternativeConstructorsEs)
 
@@ -241,7 +189,9 @@ std::ostream & operator << (std::ostream &out, const es_event_fork_t &event)
 // MARK: File System Events
 std::ostream & operator << (std::ostream &out, const es_event_access_t &event)
 {
-    out << "event.access.mode: 0x" << std::hex << event.mode << std::dec << "(" << faflagstostr(event.mode) << ")";
+    std::string mode;
+    faflagstostr(event.mode, mode);
+    out << "event.access.mode: 0x" << std::hex << event.mode << std::dec << "(" << mode << ")";
     out << std::endl << "event.access.target:\n" << event.target;
     return out;
 }
@@ -269,7 +219,7 @@ std::ostream & operator << (std::ostream &out, const es_event_close_t &event)
 
 std::ostream & operator << (std::ostream &out, const es_event_create_t &event)
 {
-    out << "event.create.destination_type: " << g_destinationTypeToStrMap.at(event.destination_type);
+    out << "event.create.destination_type: " << g_destinationTypeToStr[event.destination_type];
     if (event.destination_type == ES_DESTINATION_TYPE_EXISTING_FILE) {
         out << std::endl << "event.create.destination.existing_file:\n" << event.destination.existing_file;
     } else {
@@ -318,12 +268,10 @@ std::ostream & operator << (std::ostream &out, const es_event_mount_t &event)
 
 std::ostream & operator << (std::ostream &out, const es_event_open_t &event)
 {
-    char *flags = esfflagstostr(event.fflag);
+    std::string flags;
+    esfflagstostr(event.fflag, flags);
     out << "event.open.fflag: " << flags << " (0x" << std::hex << event.fflag << std::dec << ")";
     out << std::endl << event.file;
-    
-    free(flags);
-    flags = nullptr;
     return out;
 }
 
@@ -342,7 +290,7 @@ std::ostream & operator << (std::ostream &out, const es_event_readlink_t &event)
 std::ostream & operator << (std::ostream &out, const es_event_rename_t &event)
 {
     out << "event.rename.source:\n" << event.source;
-    out << std::endl << "event.rename.destination_type: " << g_destinationTypeToStrMap.at(event.destination_type);
+    out << std::endl << "event.rename.destination_type: " << g_destinationTypeToStr[event.destination_type];
     if (event.destination_type == ES_DESTINATION_TYPE_EXISTING_FILE) {
         out << std::endl << "event.rename.destination.existing_file:\n" << event.destination.existing_file;
     } else {
@@ -404,7 +352,7 @@ std::ostream & operator << (std::ostream &out, const es_message_t *msg)
         return out;
 
     out << "--- EVENT MESSAGE ----";
-    out << std::endl << "event_type: " << g_eventTypeToStrMap.at(msg->event_type) << " (" << msg->event_type << ")";
+    out << std::endl << "event_type: " << g_eventTypeToStr[msg->event_type] << " (" << msg->event_type << ")";
      // Note: Message structure could change in future versions
     out << std::endl << "version: " << msg->version;
     out << std::endl << "time: " << (long long) msg->time.tv_sec << "." << msg->time.tv_nsec;
@@ -504,7 +452,7 @@ std::ostream & operator << (std::ostream &out, const es_message_t *msg)
             break;
         case ES_EVENT_TYPE_LAST:
         default:
-            out << "Printing not implemented yet: " << g_eventTypeToStrMap.at(msg->event_type);
+            out << "Printing not implemented yet: " << g_eventTypeToStr[msg->event_type];
             break;
     }
     return out;
@@ -523,7 +471,15 @@ std::ostream & operator << (std::ostream &out, const es_file_t *file)
 
     out << "  file.path: " << file->path;
     out << std::endl << "  file.path_truncated: " << file->path_truncated;
-    out << std::endl << "  file.stats: " << "TO BE DONE";
+    out << std::endl << "  file.stat.st_dev: " << file->stat.st_dev;
+    out << std::endl << "  file.stat.st_ino: " << file->stat.st_ino;
+    out << std::endl << "  file.stat.st_mode: 0" << std::oct << file->stat.st_mode << std::dec;
+    out << std::endl << "  file.stat.st_nlink: " << file->stat.st_nlink;
+    out << std::endl << "  file.stat.st_uid: " << file->stat.st_uid;
+    out << std::endl << "  file.stat.st_gid: " << file->stat.st_gid;
+    out << std::endl << "  file.stat.st_size: " << file->stat.st_size;
+    out << std::endl << "  file.stat.st_mtime: " << (long long) file->stat.st_mtimespec.tv_sec << "." << file->stat.st_mtimespec.tv_nsec;
+    out << std::endl << "  file.stat.st_flags: 0x" << std::hex << file->stat.st_flags << std::dec;
     return out;
 }
 
@@ -531,7 +487,15 @@ std::ostream & operator << (std::ostream &out, const es_statfs_t *stats)
 {
     if (stats == nullptr)
         return out;
-    out << "   statfs: " << "TO BE DONE";
+    out << "  statfs.f_mntonname: " << stats->f_mntonname;
+    out << std::endl << "  statfs.f_mntfromname: " << stats->f_mntfromname;
+    out << std::endl << "  statfs.f_fstypename: " << stats->f_fstypename;
+    out << std::endl << "  statfs.f_flags: 0x" << std::hex << stats->f_flags << std::dec;
+    out << std::endl << "  statfs.f_bsize: " << stats->f_bsize;
+    out << std::endl << "  statfs.f_blocks: " << stats->f_blocks;
+    out << std::endl << "  statfs.f_bfree: " << stats->f_bfree;
+    out << std::endl << "  statfs.f_files: " << stats->f_files;
+    out << std::endl << "  statfs.f_owner: " << stats->f_owner;
     return out;
 }
 
@@ -550,10 +514,9 @@ std::ostream & operator << (std::ostream &out, const es_process_t * const proc)
     out << std::endl << "  proc.group_id: " << proc->group_id;
     out << std::endl << "  proc.session_id: " << proc->session_id;
 
-    char *flags = csflagstostr(proc->codesigning_flags);
+    std::string flags;
+    csflagstostr(proc->codesigning_flags, flags);
     out << std::endl << "  proc.codesigning_flags: " << flags << " (0x" << std::hex << proc->codesigning_flags << std::dec << ")";
-    free(flags);
-    flags = nullptr;
 
     out << std::endl << "  proc.is_platform_binary: " << proc->is_platform_binary;
     out << std::endl << "  proc.is_es_client: " << proc->is_es_client;
@@ -567,3 +530,242 @@ std::ostream & operator << (std::ostream &out, const es_process_t * const proc)
 
     return out;
 }
+
+
+// MARK: - Endpoint Security Rendering
+static inline std::string_view to_string_view(const es_string_token_t &esString)
+{
+    if (esString.data == nullptr)
+        return "(null)";
+    return std::string_view(esString.data, esString.length);
+}
+
+void render(EventRenderer &r, std::string_view key, const es_file_t * const file)
+{
+    if (file == nullptr) {
+        r.null(key);
+        return;
+    }
+
+    r.beginObject(key);
+    r.field("path", to_string_view(file->path));
+    r.field("path_truncated", file->path_truncated);
+    r.beginObject("stat");
+    r.field("st_dev", file->stat.st_dev);
+    r.field("st_ino", file->stat.st_ino);
+    r.hex("st_mode", file->stat.st_mode);
+    r.field("st_nlink", file->stat.st_nlink);
+    r.field("st_uid", file->stat.st_uid);
+    r.field("st_gid", file->stat.st_gid);
+    r.field("st_size", file->stat.st_size);
+    r.timestamp("st_mtime", file->stat.st_mtimespec.tv_sec, file->stat.st_mtimespec.tv_nsec);
+    r.timestamp("st_ctime", file->stat.st_ctimespec.tv_sec, file->stat.st_ctimespec.tv_nsec);
+    r.hex("st_flags", file->stat.st_flags);
+    r.endObject();
+    r.endObject();
+}
+
+void render(EventRenderer &r, std::string_view key, const es_statfs_t * const stats)
+{
+    if (stats == nullptr) {
+        r.null(key);
+        return;
+    }
+
+    r.beginObject(key);
+    r.field("f_mntonname", stats->f_mntonname);
+    r.field("f_mntfromname", stats->f_mntfromname);
+    r.field("f_fstypename", stats->f_fstypename);
+    r.hex("f_flags", stats->f_flags);
+    r.field("f_bsize", stats->f_bsize);
+    r.field("f_blocks", stats->f_blocks);
+    r.field("f_bfree", stats->f_bfree);
+    r.field("f_bavail", stats->f_bavail);
+    r.field("f_files", stats->f_files);
+    r.field("f_ffree", stats->f_ffree);
+    r.field("f_owner", stats->f_owner);
+    r.endObject();
+}
+
+void render(EventRenderer &r, std::string_view key, const es_process_t * const proc)
+{
+    if (proc == nullptr) {
+        r.null(key);
+        return;
+    }
+
+    char flags[512];
+    csflagstostr(proc->codesigning_flags, flags, sizeof(flags));
+
+    r.beginObject(key);
+    r.field("pid", audit_token_to_pid(proc->audit_token));
+    r.field("ppid", proc->ppid);
+    r.field("original_ppid", proc->original_ppid);
+    r.field("ruid", audit_token_to_ruid(proc->audit_token));
+    r.field("euid", audit_token_to_euid(proc->audit_token));
+    r.field("rgid", audit_token_to_rgid(proc->audit_token));
+    r.field("egid", audit_token_to_egid(proc->audit_token));
+    r.field("group_id", proc->group_id);
+    r.field("session_id", proc->session_id);
+    r.field("codesigning_flags", std::string_view(flags));
+    r.hex("codesigning_flags_raw", proc->codesigning_flags);
+    r.field("is_platform_binary", proc->is_platform_binary);
+    r.field("is_es_client", proc->is_es_client);
+    r.field("signing_id", to_string_view(proc->signing_id));
+    r.field("team_id", to_string_view(proc->team_id));
+    r.hexBytes("cdhash", proc->cdhash, CS_CDHASH_LEN);
+    render(r, "executable", proc->executable);
+    r.endObject();
+}
+
+static void renderDestination(EventRenderer &r, es_destination_type_t type, const es_file_t *existingFile,
+                              const es_file_t *dir, const es_string_token_t &filename)
+{
+    r.field("destination_type", g_destinationTypeToStr[type]);
+    if (type == ES_DESTINATION_TYPE_EXISTING_FILE) {
+        render(r, "existing_file", existingFile);
+    } else {
+        render(r, "dir", dir);
+        r.field("filename", to_string_view(filename));
+    }
+}
+
+static void renderEvent(EventRenderer &r, const es_message_t * const msg)
+{
+    const es_events_t &event = msg->event;
+    char flags[512];
+
+    switch(msg->event_type) {
+        // Process
+        case ES_EVENT_TYPE_AUTH_EXEC:
+        {
+            render(r, "target", event.exec.target);
+            const uint32_t argc = es_exec_arg_count(&event.exec);
+            r.beginArray("args");
+            for (uint32_t i = 0; i < argc; i++)
+                r.element(to_string_view(es_exec_arg(&event.exec, i)));
+            r.endArray();
+            break;
+        }
+        case ES_EVENT_TYPE_NOTIFY_EXIT:
+            r.field("stat", event.exit.stat);
+            break;
+        case ES_EVENT_TYPE_NOTIFY_FORK:
+            render(r, "child", event.fork.child);
+            break;
+        // File System
+        case ES_EVENT_TYPE_NOTIFY_ACCESS:
+            faflagstostr(event.access.mode, flags, sizeof(flags));
+            r.field("mode", std::string_view(flags));
+            render(r, "target", event.access.target);
+            break;
+        case ES_EVENT_TYPE_AUTH_CLONE:
+            render(r, "source", event.clone.source);
+            render(r, "target_dir", event.clone.target_dir);
+            r.field("target_name", to_string_view(event.clone.target_name));
+            break;
+        case ES_EVENT_TYPE_NOTIFY_CLOSE:
+            r.field("modified", event.close.modified);
+            render(r, "target", event.close.target);
+            break;
+        case ES_EVENT_TYPE_AUTH_CHDIR:
+            render(r, "target", event.chdir.target);
+            break;
+        case ES_EVENT_TYPE_AUTH_CREATE:
+            renderDestination(r, event.create.destination_type, event.create.destination.existing_file,
+                              event.create.destination.new_path.dir, event.create.destination.new_path.filename);
+            break;
+        case ES_EVENT_TYPE_AUTH_FILE_PROVIDER_MATERIALIZE:
+            render(r, "instigator", event.file_provider_materialize.instigator);
+            render(r, "source", event.file_provider_materialize.source);
+            render(r, "target", event.file_provider_materialize.target);
+            break;
+        case ES_EVENT_TYPE_AUTH_FILE_PROVIDER_UPDATE:
+            render(r, "source", event.file_provider_update.source);
+            r.field("target_path", to_string_view(event.file_provider_update.target_path));
+            break;
+        case ES_EVENT_TYPE_NOTIFY_EXCHANGEDATA:
+            render(r, "file1", event.exchangedata.file1);
+            render(r, "file2", event.exchangedata.file2);
+            break;
+        case ES_EVENT_TYPE_AUTH_LINK:
+            render(r, "source", event.link.source);
+            render(r, "target_dir", event.link.target_dir);
+            r.field("target_filename", to_string_view(event.link.target_filename));
+            break;
+        case ES_EVENT_TYPE_AUTH_MOUNT:
+            render(r, "statfs", event.mount.statfs);
+            break;
+        case ES_EVENT_TYPE_AUTH_OPEN:
+            esfflagstostr(event.open.fflag, flags, sizeof(flags));
+            r.field("fflag", std::string_view(flags));
+            r.hex("fflag_raw", event.open.fflag);
+            render(r, "file", event.open.file);
+            break;
+        case ES_EVENT_TYPE_AUTH_READDIR:
+            render(r, "target", event.readdir.target);
+            break;
+        case ES_EVENT_TYPE_AUTH_READLINK:
+            render(r, "source", event.readlink.source);
+            break;
+        case ES_EVENT_TYPE_AUTH_RENAME:
+            render(r, "source", event.rename.source);
+            renderDestination(r, event.rename.destination_type, event.rename.destination.existing_file,
+                              event.rename.destination.new_path.dir, event.rename.destination.new_path.filename);
+            break;
+        case ES_EVENT_TYPE_AUTH_TRUNCATE:
+            render(r, "target", event.truncate.target);
+            break;
+        case ES_EVENT_TYPE_AUTH_UNLINK:
+            render(r, "target", event.unlink.target);
+            render(r, "parent_dir", event.unlink.parent_dir);
+            break;
+        case ES_EVENT_TYPE_NOTIFY_UNMOUNT:
+            render(r, "statfs", event.unmount.statfs);
+            break;
+        case ES_EVENT_TYPE_NOTIFY_WRITE:
+            render(r, "target", event.write.target);
+            break;
+        // System
+        case ES_EVENT_TYPE_NOTIFY_IOKIT_OPEN:
+            r.field("user_client_type", event.iokit_open.user_client_type);
+            r.field("user_client_class", to_string_view(event.iokit_open.user_client_class));
+            break;
+        case ES_EVENT_TYPE_NOTIFY_KEXTLOAD:
+            r.field("identifier", to_string_view(event.kextload.identifier));
+            break;
+        case ES_EVENT_TYPE_NOTIFY_KEXTUNLOAD:
+            r.field("identifier", to_string_view(event.kextunload.identifier));
+            break;
+        case ES_EVENT_TYPE_LAST:
+        default:
+            r.field("not_implemented", true);
+            break;
+    }
+}
+
+void render(EventRenderer &r, const es_message_t * const msg)
+{
+    if (msg == nullptr)
+        return;
+
+    uint64_t deadlineInterval = msg->deadline;
+    if (deadlineInterval > 0)
+        deadlineInterval -= msg->mach_time;
+
+    r.beginRecord();
+    r.field("event_type", g_eventTypeToStr[msg->event_type]);
+    r.field("event_type_id", static_cast<uint32_t>(msg->event_type));
+    r.field("version", msg->version);
+    r.timestamp("time", msg->time.tv_sec, msg->time.tv_nsec);
+    r.field("mach_time", msg->mach_time);
+    r.field("deadline", msg->deadline);
+    r.field("deadline_interval", deadlineInterval);
+    r.field("action_type", (msg->action_type == ES_ACTION_TYPE_AUTH) ? "Auth" : "Notify");
+    r.field("seq_num", msg->seq_num);
+    render(r, "process", msg->process);
+    r.beginObject("event");
+    renderEvent(r, msg);
+    r.endObject();
+    r.endRecord();
+}
@@ -10,8 +10,11 @@
 
 #include <chrono>
 #include <Foundation/Foundation.h>
+#include <string>
 #include <string_view>
 
+#include "Reflection.hpp"
+
 // MARK: - Custom Casts
 @interface NSString (alternativeConstructorsCpp)
 + (NSString*)stringFromCppString:(std::string const &)cppString;
@@ -24,33 +27,13 @@ uint64_t mach_time_to_msecs(uint64_t mach_time);
 uint64_t msecs_to_mach_time(uint64_t ms);
 std::string convert_to_time_and_date(std::chrono::time_point<std::chrono::system_clock> time);
 std::string current_time_and_date();
-char *esfflagstostr(uint32_t flags);
-char *csflagstostr(uint32_t flags);
-std::string faflagstostr(uint32_t flags);
-
-
-// TODO: demagler
-// https://gcc.gnu.org/onlinedocs/libstdc++/manual/ext_demangling.html
-template <typename T>
-constexpr std::string_view type_name()
-{
-    std::string_view name, prefix, suffix;
-#ifdef __clang__
-    name = __PRETTY_FUNCTION__;
-    prefix = "std::string_view type_name() [T = ";
-    suffix = "]";
-#elif defined(__GNUC__)
-    name = __PRETTY_FUNCTION__;
-    prefix = "constexpr std::string_view type_name() [with T = ";
-    suffix = "; std::string_view = std::basic_string_view<char>]";
-#elif defined(_MSC_VER)
-    name = __FUNCSIG__;
-    prefix = "class std::basic_string_view<char,struct std::char_traits<char> > __cdecl type_name<";
-    suffix = ">(void)";
-#endif
-    name.remove_prefix(prefix.size());
-    name.remove_suffix(suffix.size());
-    return name;
-}
+// Return the exact length of the string, buf is written only if the whole string fits
+size_t esfflagstostr(uint32_t flags, char *buf, size_t size);
+void esfflagstostr(uint32_t flags, std::string &str);
+size_t csflagstostr(uint32_t flags, char *buf, size_t size);
+void csflagstostr(uint32_t flags, std::string &str);
+size_t faflagstostr(uint32_t flags, char *buf, size_t size);
+void faflagstostr(uint32_t flags, std::string &str);
+
 
 #endif /* Tools_hpp */
@@ -14,6 +14,7 @@
 #include <sstream>
 #include <string>
 #include <sys/fcntl.h>
+#include "FlagTable.hpp"
 #include "Tools.hpp"
 
 // MARK: - Custom Casts
@@ -73,157 +74,107 @@ std::string current_time_and_date()
 }
 
 
-#define longestesfflaglen    11
-static struct {
-    char name[longestesfflaglen + 1];
-    uint32_t flag;
-} const esmapping[] = {
-    { "FREAD",          FREAD },
-    { "FWRITE",         FWRITE },
-    { "FAPPEND",        FAPPEND },
-    { "FASYNC",         FASYNC },
-    { "FFSYNC",         FFSYNC },
-    { "FFDSYNC",        FFDSYNC },
-    { "FNONBLOCK",      FNONBLOCK },
-    { "FNDELAY",        FNDELAY },
-    { "O_NDELAY",       O_NDELAY },
-    { "O_SHLOCK",       O_SHLOCK },
-    { "O_EXLOCK",       O_EXLOCK },
-    { "O_NOFOLLOW",     O_NOFOLLOW },
-    { "O_CREAT",        O_CREAT },
-    { "O_TRUNC",        O_TRUNC },
-    { "O_EXCL",         O_EXCL },
-    { "O_DIRECTORY",    O_DIRECTORY },
-    { "O_SYMLINK",      O_SYMLINK },
+static constexpr FlagName<uint32_t> esmapping[] = {
+    { FREAD,        "FREAD" },
+    { FWRITE,       "FWRITE" },
+    { FAPPEND,      "FAPPEND" },
+    { FASYNC,       "FASYNC" },
+    { FFSYNC,       "FFSYNC" },
+    { FFDSYNC,      "FFDSYNC" },
+    { FNONBLOCK,    "FNONBLOCK" },
+    { FNDELAY,      "FNDELAY" },
+    { O_NDELAY,     "O_NDELAY" },
+    { O_SHLOCK,     "O_SHLOCK" },
+    { O_EXLOCK,     "O_EXLOCK" },
+    { O_NOFOLLOW,   "O_NOFOLLOW" },
+    { O_CREAT,      "O_CREAT" },
+    { O_TRUNC,      "O_TRUNC" },
+    { O_EXCL,       "O_EXCL" },
+    { O_DIRECTORY,  "O_DIRECTORY" },
+    { O_SYMLINK,    "O_SYMLINK" },
 };
-#define nesmappings    (sizeof(esmapping) / sizeof(esmapping[0]))
+static constexpr FlagTable esflags(esmapping, ",");
 
 // Based on freebsd/lib/libc/gen/strtofflags.c
-char *esfflagstostr(uint32_t flags)
+size_t esfflagstostr(uint32_t flags, char *buf, size_t size)
 {
-    char *string;
-    const char *sp;
-    char *dp;
-    uint32_t setflags;
-    u_int i;
-
-    if ((string = (char *)malloc(nesmappings * (longestesfflaglen + 1))) == NULL)
-        return (NULL);
-
-    setflags = flags;
-    dp = string;
-    for (i = 0; i < nesmappings; i++) {
-        if (setflags & esmapping[i].flag) {
-            if (dp > string)
-                *dp++ = ',';
-            for (sp = esmapping[i].name; *sp; *dp++ = *sp++) ;
-            setflags &= ~esmapping[i].flag;
-        }
-    }
-    *dp = '\0';
-    return (string);
+    return esflags.format(flags, buf, size);
 }
 
-
-#define longestcsflaglen    25
-static struct {
-    char name[longestcsflaglen + 1];
-    uint32_t flag;
-} const csmapping[] = {
-    { "CS_VALID",                   CS_VALID },
-    { "CS_ADHOC",                   CS_ADHOC },
-    { "CS_GET_TASK_ALLOW",          CS_GET_TASK_ALLOW },
-    { "CS_INSTALLER",               CS_INSTALLER },
-    { "CS_FORCED_LV",               CS_FORCED_LV },
-    { "CS_INVALID_ALLOWED",         CS_INVALID_ALLOWED },
-    { "CS_HARD",                    CS_HARD },
-    { "CS_KILL",                    CS_KILL },
-    { "CS_CHECK_EXPIRATION",        CS_CHECK_EXPIRATION },
-    { "CS_RESTRICT",                CS_RESTRICT },
-    { "CS_ENFORCEMENT",             CS_ENFORCEMENT },
-    { "CS_REQUIRE_LV",              CS_REQUIRE_LV },
-    { "CS_ENTITLEMENTS_VALIDATED",  CS_ENTITLEMENTS_VALIDATED },
-    { "CS_NVRAM_UNRESTRICTED",      CS_NVRAM_UNRESTRICTED },
-    { "CS_RUNTIME",                 CS_RUNTIME },
-    { "CS_EXEC_SET_HARD",           CS_EXEC_SET_HARD },
-    { "CS_EXEC_SET_KILL",           CS_EXEC_SET_KILL },
-    { "CS_EXEC_SET_ENFORCEMENT",    CS_EXEC_SET_ENFORCEMENT },
-    { "CS_EXEC_INHERIT_SIP",        CS_EXEC_INHERIT_SIP },
-    { "CS_KILLED",                  CS_KILLED },
-    { "CS_DYLD_PLATFORM",           CS_DYLD_PLATFORM },
-    { "CS_PLATFORM_BINARY",         CS_PLATFORM_BINARY },
-    { "CS_PLATFORM_PATH",           CS_PLATFORM_PATH },
-    { "CS_DEBUGGED",                CS_DEBUGGED },
-    { "CS_SIGNED",                  CS_SIGNED },
-    { "CS_DEV_CODE",                CS_DEV_CODE },
-    { "CS_DATAVAULT_CONTROLLER",    CS_DATAVAULT_CONTROLLER },
-};
-#define ncsmappings    (sizeof(csmapping) / sizeof(csmapping[0]))
-
-char *csflagstostr(uint32_t flags)
+void esfflagstostr(uint32_t flags, std::string &str)
 {
-    char *string;
-    const char *sp;
-    char *dp;
-    uint32_t setflags;
-    u_int i;
-
-    if ((string = (char *)malloc(ncsmappings * (longestcsflaglen + 1))) == NULL)
-        return (NULL);
-
-    setflags = flags;
-    dp = string;
-    for (i = 0; i < ncsmappings; i++) {
-        if (setflags & csmapping[i].flag) {
-            if (dp > string)
-                *dp++ = ',';
-            for (sp = csmapping[i].name; *sp; *dp++ = *sp++) ;
-            setflags &= ~csmapping[i].flag;
-        }
-    }
-    *dp = '\0';
-    return (string);
+    esflags.format(flags, str);
 }
 
 
-static struct {
-    std::string name;
-    uint32_t flag;
-} const famapping[] = {
-    {"F_OK",        F_OK},
-    {"X_OK",        X_OK},
-    {"R_OK",        R_OK},
-    {"_READ_OK",    _READ_OK},
-    {"_WRITE_OK",   _WRITE_OK},
-    {"_EXECUTE_OK", _EXECUTE_OK},
-    {"_DELETE_OK",  _DELETE_OK},
-    {"_APPEND_OK",  _APPEND_OK},
-    {"_RMFILE_OK",  _RMFILE_OK},
-    {"_RATTR_OK",   _RATTR_OK},
-    {"_WATTR_OK",   _WATTR_OK},
-    {"_REXT_OK",    _REXT_OK},
-    {"_WEXT_OK",    _WEXT_OK},
-    {"_RPERM_OK",   _RPERM_OK},
-    {"_WPERM_OK",   _WPERM_OK},
-    {"_CHOWN_OK",   _CHOWN_OK},
+static constexpr FlagName<uint32_t> csmapping[] = {
+    { CS_VALID,                     "CS_VALID" },
+    { CS_ADHOC,                     "CS_ADHOC" },
+    { CS_GET_TASK_ALLOW,            "CS_GET_TASK_ALLOW" },
+    { CS_INSTALLER,                 "CS_INSTALLER" },
+    { CS_FORCED_LV,                 "CS_FORCED_LV" },
+    { CS_INVALID_ALLOWED,           "CS_INVALID_ALLOWED" },
+    { CS_HARD,                      "CS_HARD" },
+    { CS_KILL,                      "CS_KILL" },
+    { CS_CHECK_EXPIRATION,          "CS_CHECK_EXPIRATION" },
+    { CS_RESTRICT,                  "CS_RESTRICT" },
+    { CS_ENFORCEMENT,               "CS_ENFORCEMENT" },
+    { CS_REQUIRE_LV,                "CS_REQUIRE_LV" },
+    { CS_ENTITLEMENTS_VALIDATED,    "CS_ENTITLEMENTS_VALIDATED" },
+    { CS_NVRAM_UNRESTRICTED,        "CS_NVRAM_UNRESTRICTED" },
+    { CS_RUNTIME,                   "CS_RUNTIME" },
+    { CS_EXEC_SET_HARD,             "CS_EXEC_SET_HARD" },
+    { CS_EXEC_SET_KILL,             "CS_EXEC_SET_KILL" },
+    { CS_EXEC_SET_ENFORCEMENT,      "CS_EXEC_SET_ENFORCEMENT" },
+    { CS_EXEC_INHERIT_SIP,          "CS_EXEC_INHERIT_SIP" },
+    { CS_KILLED,                    "CS_KILLED" },
+    { CS_DYLD_PLATFORM,             "CS_DYLD_PLATFORM" },
+    { CS_PLATFORM_BINARY,           "CS_PLATFORM_BINARY" },
+    { CS_PLATFORM_PATH,             "CS_PLATFORM_PATH" },
+    { CS_DEBUGGED,                  "CS_DEBUGGED" },
+    { CS_SIGNED,                    "CS_SIGNED" },
+    { CS_DEV_CODE,                  "CS_DEV_CODE" },
+    { CS_DATAVAULT_CONTROLLER,      "CS_DATAVAULT_CONTROLLER" },
 };
+static constexpr FlagTable csflags(csmapping, ",");
 
-std::string faflagstostr(uint32_t flags)
+size_t csflagstostr(uint32_t flags, char *buf, size_t size)
 {
-    if (flags == F_OK)
-        return "F_OK";
+    return csflags.format(flags, buf, size);
+}
 
-    std::string string;
+void csflagstostr(uint32_t flags, std::string &str)
+{
+    csflags.format(flags, str);
+}
 
-    for (unsigned long i=0; i < sizeof(famapping) || !flags; ++i) {
-        if (famapping[i].flag & flags) {
-            if (!string.empty())
-                string += ",";
 
-            string += famapping[i].name;
-            flags &= ~famapping[i].flag;
-        }
-    }
+static constexpr FlagName<uint32_t> famapping[] = {
+    {F_OK,          "F_OK"},
+    {X_OK,          "X_OK"},
+    {R_OK,          "R_OK"},
+    {_READ_OK,      "_READ_OK"},
+    {_WRITE_OK,     "_WRITE_OK"},
+    {_EXECUTE_OK,   "_EXECUTE_OK"},
+    {_DELETE_OK,    "_DELETE_OK"},
+    {_APPEND_OK,    "_APPEND_OK"},
+    {_RMFILE_OK,    "_RMFILE_OK"},
+    {_RATTR_OK,     "_RATTR_OK"},
+    {_WATTR_OK,     "_WATTR_OK"},
+    {_REXT_OK,      "_REXT_OK"},
+    {_WEXT_OK,      "_WEXT_OK"},
+    {_RPERM_OK,     "_RPERM_OK"},
+    {_WPERM_OK,     "_WPERM_OK"},
+    {_CHOWN_OK,     "_CHOWN_OK"},
+};
+static constexpr FlagTable faflags(famapping, ",", "F_OK");
 
-    return string;
+size_t faflagstostr(uint32_t flags, char *buf, size_t size)
+{
+    return faflags.format(flags, buf, size);
+}
+
+void faflagstostr(uint32_t flags, std::string &str)
+{
+    faflags.format(flags, str);
 }
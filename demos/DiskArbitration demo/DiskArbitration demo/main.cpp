@@ -11,11 +11,27 @@
 #include <iostream>
 #include <DiskArbitration/DiskArbitration.h>
 #include <DiskArbitration/DADisk.h>
+#include <IOKit/IOKitLib.h>
 #include <IOKit/storage/IOStorageProtocolCharacteristics.h>
 #include <sys/param.h>      // MAXPATHLEN
 
 #include "../../../Common/SignalHandler.hpp"
+#include "../../../Common/Tools/DeviceRegistry.hpp"
 
+// Disks seen by the callbacks. A dock or a hub brings or takes its disks at once, the callbacks
+// collect them into a batch which is applied to the registry once the storm settles.
+struct DiskMonitor {
+    DeviceRegistry<> disks;
+    DeviceBatch batch;
+    CFRunLoopTimerRef flush_timer = NULL;
+};
+
+// Delay between the first disk event of a storm and the report of the storm
+static const CFTimeInterval kStormDelay = 0.2;
+// Fire date of the timer while no storm is pending
+static const CFAbsoluteTime kNever = 1.0e12;
+
+void flush_disks(CFRunLoopTimerRef timer, void *context);
 void got_disk(DADiskRef disk, void *context);
 void got_disk_removal(DADiskRef disk, void *context);
 void got_rename(DADiskRef disk, CFArrayRef keys, void *context);
@@ -46,7 +62,14 @@ int main()
             kDADiskDescriptionDeviceProtocolKey,
             CFSTR(kIOPropertyPhysicalInterconnectTypeUSB));
     
-    void *context = NULL;
+    DiskMonitor monitor;
+    CFRunLoopTimerContext timer_context = { 0, &monitor, NULL, NULL, NULL };
+    // Armed by the first event of a storm, the interval only keeps it valid after it fires
+    monitor.flush_timer = CFRunLoopTimerCreate(kCFAllocatorDefault, kNever, 1.0e10, 0, 0,
+                                               flush_disks, &timer_context);
+    CFRunLoopAddTimer(CFRunLoopGetCurrent(), monitor.flush_timer, kCFRunLoopDefaultMode);
+    
+    void *context = &monitor;
     DARegisterDiskAppearedCallback(session,
             kDADiskDescriptionMatchVolumeMountable,
             got_disk,
@@ -95,33 +118,132 @@ int main()
     DASessionUnscheduleFromRunLoop(session,
         CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
     CFRelease(session);
+    
+    CFRunLoopTimerInvalidate(monitor.flush_timer);
+    CFRelease(monitor.flush_timer);
 
     return EXIT_SUCCESS;
 }
 
 
+// Registry ID of the IOMedia of the disk, BSD name and volume name. Returns false for disks
+// without media (i.e. network volumes).
+static bool describe_disk(DADiskRef disk, DeviceInfo &info)
+{
+    io_service_t media = DADiskCopyIOMedia(disk);
+    if (media == 0)
+        return false;
+    const kern_return_t kr = IORegistryEntryGetRegistryEntryID(media, &info.registryId);
+    IOObjectRelease(media);
+    if (kr != KERN_SUCCESS)
+        return false;
+    
+    info.bsdName = DADiskGetBSDName(disk) ? DADiskGetBSDName(disk) : "";
+    CFDictionaryRef dict = DADiskCopyDescription(disk);
+    if (dict) {
+        CFStringRef volume = (CFStringRef)CFDictionaryGetValue(dict, kDADiskDescriptionVolumeNameKey);
+        char buf[MAXPATHLEN];
+        if (volume && CFStringGetCString(volume, buf, sizeof(buf), kCFStringEncodingUTF8))
+            info.name = buf;
+        CFRelease(dict);
+    }
+    return true;
+}
+
+// Queues an event of the storm, the first one arms the timer
+static void queue_disk_event(DiskMonitor &monitor)
+{
+    if (monitor.batch.size() == 1)
+        CFRunLoopTimerSetNextFireDate(monitor.flush_timer, CFAbsoluteTimeGetCurrent() + kStormDelay);
+}
+
+// Registry entry of a known disk by its BSD name, the disks of the pending batch included
+static DeviceHandle find_disk(DiskMonitor &monitor, DADiskRef disk)
+{
+    if (DADiskGetBSDName(disk) == NULL)
+        return DeviceHandle();
+    const std::string bsdName = DADiskGetBSDName(disk);
+    DeviceHandle handle = monitor.disks.findBSDName(bsdName);
+    if (!handle && !monitor.batch.empty()) {
+        flush_disks(monitor.flush_timer, &monitor);
+        handle = monitor.disks.findBSDName(bsdName);
+    }
+    return handle;
+}
+
+void flush_disks(CFRunLoopTimerRef timer, void *context)
+{
+    DiskMonitor &monitor = *static_cast<DiskMonitor *>(context);
+    const auto stats = monitor.disks.apply(monitor.batch, [](DeviceRegistry<>::Change change, DeviceHandle,
+                                                             DeviceRegistry<>::Entry &entry) {
+        switch (change) {
+            case DeviceRegistry<>::Change::Added:
+                std::cout << "New disk appeared >" << entry.info.bsdName << "< " << entry.info.name << std::endl;
+                break;
+            case DeviceRegistry<>::Change::Removed:
+                std::cout << "Disk removed: >" << entry.info.bsdName << "< " << entry.info.name << std::endl;
+                break;
+            case DeviceRegistry<>::Change::Changed:
+                std::cout << "Disk changed: >" << entry.info.bsdName << "< " << entry.info.name << std::endl;
+                break;
+        }
+    });
+    if (stats.added + stats.removed + stats.changed > 1) {
+        std::cout << "(" << stats.added << " added, " << stats.removed << " removed, " << stats.changed
+                  << " changed, " << monitor.disks.size() << " disks)" << std::endl;
+    }
+    CFRunLoopTimerSetNextFireDate(timer, kNever);
+}
+
 void got_disk(DADiskRef disk, void *context)
 {
-    std::cout << "New disk appeared >" << (DADiskGetBSDName(disk) ? DADiskGetBSDName(disk) : "") << "<." << std::endl;
+    DiskMonitor &monitor = *static_cast<DiskMonitor *>(context);
+    DeviceInfo info;
+    if (!describe_disk(disk, info)) {
+        std::cout << "New disk appeared >" << (DADiskGetBSDName(disk) ? DADiskGetBSDName(disk) : "") << "< without media." << std::endl;
+        return;
+    }
+    monitor.batch.add(std::move(info));
+    queue_disk_event(monitor);
 }
 
 void got_disk_removal(DADiskRef disk, void *context)
 {
-    std::cout << "Disk removed: >" << (DADiskGetBSDName(disk) ? DADiskGetBSDName(disk) : "") << "<." << std::endl;
+    // All the disks are matched, only the known ones are reported
+    DiskMonitor &monitor = *static_cast<DiskMonitor *>(context);
+    const DeviceHandle handle = find_disk(monitor, disk);
+    if (!handle)
+        return;
+    monitor.batch.remove(monitor.disks.get(handle)->info.registryId);
+    queue_disk_event(monitor);
 }
 
 void got_rename(DADiskRef disk, CFArrayRef keys, void *context)
 {
+    DiskMonitor &monitor = *static_cast<DiskMonitor *>(context);
+    const DeviceHandle handle = find_disk(monitor, disk);
+    if (!handle)
+        return;
+    
     CFDictionaryRef dict = DADiskCopyDescription(disk);
-    CFURLRef fspath = (CFURLRef)CFDictionaryGetValue(dict, kDADiskDescriptionVolumePathKey);
+    CFURLRef fspath = dict ? (CFURLRef)CFDictionaryGetValue(dict, kDADiskDescriptionVolumePathKey) : NULL;
 
     char buf[MAXPATHLEN];
-    if (CFURLGetFileSystemRepresentation(fspath, false, (UInt8 *)buf, sizeof(buf))) {
+    if (fspath && CFURLGetFileSystemRepresentation(fspath, false, (UInt8 *)buf, sizeof(buf))) {
         std::cout << "Disk " << DADiskGetBSDName(disk) << " is now at " << buf << "\nChanged keys:" << std::endl;
         CFShow(keys);
     } else {
         /* Something is *really* wrong. */
     }
+    if (dict)
+        CFRelease(dict);
+    
+    // The new volume name is reported as a change of the disk
+    DeviceInfo info;
+    if (describe_disk(disk, info)) {
+        monitor.batch.add(std::move(info));
+        queue_disk_event(monitor);
+    }
 }
 
 DADissenterRef allow_mount(DADiskRef disk, void *context)
@@ -12,12 +12,17 @@
 #include <bsm/libbsm.h>
 #include <EndpointSecurity/EndpointSecurity.h>
 #include <iostream>
-#include <map>
+#include <string_view>
+#include <mutex>
 #include <signal.h>
 #include <sys/fcntl.h> // FREAD, FWRITE, FFLAGS
+#include <unistd.h>
 #include <vector>
 #import <Foundation/Foundation.h>
 
+#include "../../../Common/Tools/ContentHasher.hpp"
+#include "../../../Common/Tools/EventRecord.h"
+#include "../../../Common/Tools/InodePathCache.hpp"
 #include "../../../Common/Tools/Tools.hpp"
 #include "../../../Common/Tools/Tools-ES.hpp"
 
@@ -28,6 +33,12 @@
 
 es_client_t *g_client = nullptr;
 std::vector<const std::string> g_blockedPaths; // thread safe for reading
+EventRenderer::Format g_outputFormat = EventRenderer::Format::Text;
+evrec_writer_t g_recorder = EVREC_WRITER_INIT; // fd < 0 means disabled
+std::mutex g_recorderMutex;
+ThreadPool g_hashPool;
+ContentHasher g_hasher(g_hashPool); // SHA-256 and XXH64 of the files closed after a write
+InodePathCache g_inodePaths; // (device, inode) to path of the allowed create, rename and unlink operations
 
 const inline static es_event_type_t g_eventsOfInterest[] = {
     // Process
@@ -62,20 +73,146 @@ void notify_event_handler(const es_message_t *msg);
 uint32_t flags_event_handler(const es_message_t *msg);
 es_auth_result_t auth_event_handler(const es_message_t *msg);
 
+// Renders the whole message into a buffer and writes it with a single write() call
+void print_message(const es_message_t *msg)
+{
+    thread_local EventRenderer renderer(g_outputFormat);
+    render(renderer, msg);
+    renderer.flush(STDOUT_FILENO);
+}
+
+// Archives the normalized message in the binary record file (if enabled)
+void record_message(const es_message_t *msg)
+{
+    if (g_recorder.fd < 0)
+        return;
+
+    const std::vector<std::string> eventPaths = paths_from_event(msg);
+    evrec_event_t ev = {};
+    ev.source = EVREC_SOURCE_ESF;
+    ev.type = msg->event_type;
+    ev.pid = audit_token_to_pid(msg->process->audit_token);
+    ev.time_ns = evrec_timespec_ns(&msg->time);
+    ev.mach_time = msg->mach_time;
+    ev.flags = (msg->event_type == ES_EVENT_TYPE_AUTH_OPEN) ? msg->event.open.fflag : 0;
+    for (const auto &path : eventPaths)
+        evrec_event_add_path(&ev, path.data(), path.size());
+
+    std::lock_guard<std::mutex> lock(g_recorderMutex);
+    // The signal handler may have closed the recorder meanwhile
+    if (g_recorder.fd < 0)
+        return;
+    if (evrec_write(&g_recorder, &ev) < 0)
+        std::cerr << "evrec_write: " << strerror(errno) << std::endl;
+}
+
+static std::string_view to_string_view(const es_string_token_t &token)
+{
+    return std::string_view(token.data, token.length);
+}
+
+static std::string join_path(const es_file_t *dir, const es_string_token_t &filename)
+{
+    std::string path(to_string_view(dir->path));
+    path += '/';
+    path += to_string_view(filename);
+    return path;
+}
+
+// Follows the allowed file system operations. A new file has no inode before it is created,
+// only its directory is recorded then.
+void update_inode_paths(const es_message_t *msg)
+{
+    switch(msg->event_type) {
+        case ES_EVENT_TYPE_AUTH_CREATE:
+        {
+            const es_event_create_t &create = msg->event.create;
+            const es_file_t *file = (create.destination_type == ES_DESTINATION_TYPE_EXISTING_FILE)
+                                  ? create.destination.existing_file : create.destination.new_path.dir;
+            g_inodePaths.insert(file->stat.st_dev, file->stat.st_ino, to_string_view(file->path));
+            break;
+        }
+        case ES_EVENT_TYPE_AUTH_RENAME:
+        {
+            const es_event_rename_t &rename = msg->event.rename;
+            const es_file_t *source = rename.source;
+            const std::string destination = (rename.destination_type == ES_DESTINATION_TYPE_EXISTING_FILE)
+                                          ? std::string(to_string_view(rename.destination.existing_file->path))
+                                          : join_path(rename.destination.new_path.dir, rename.destination.new_path.filename);
+            g_inodePaths.rename(source->stat.st_dev, source->stat.st_ino, to_string_view(source->path), destination);
+            break;
+        }
+        case ES_EVENT_TYPE_AUTH_UNLINK:
+        {
+            const es_file_t *target = msg->event.unlink.target;
+            g_inodePaths.remove(target->stat.st_dev, target->stat.st_ino, to_string_view(target->path));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Queues a file closed after a write, prints the digests finished meanwhile
+void hash_modified_file(const es_message_t *msg)
+{
+    const es_file_t *target = msg->event.close.target;
+    // A new file gets its inode here (the create has only its directory)
+    g_inodePaths.insert(target->stat.st_dev, target->stat.st_ino, to_string_view(target->path));
+    if (g_hasher.submit(std::string(to_string_view(target->path)), FileVersion::of(target->stat)) == ContentHasher::Queued::Full)
+        std::cerr << "Content hash queue full, dropped: " << to_string_view(target->path) << std::endl;
+
+    g_hasher.drain([](const ContentDigest &digest) {
+        if (digest.error) {
+            std::cout << "CONTENT HASH: " << digest.path << " (" << strerror(digest.error) << ")" << std::endl;
+            return;
+        }
+        std::cout << "CONTENT HASH: " << digest.path << " sha256 " << hexDigest(digest.sha256, sizeof(digest.sha256))
+                  << " xxh64 " << std::hex << digest.xxh64 << std::dec;
+        // The file may have been renamed while it waited for the pool
+        std::string current;
+        if (g_inodePaths.resolve(digest.version.device, digest.version.inode, current) && current != digest.path)
+            std::cout << " (now " << current << ")";
+        std::cout << std::endl;
+    });
+}
+
 void signalHandler(int signum)
 {
     if(g_client) {
         es_unsubscribe_all(g_client);
         es_delete_client(g_client);
     }
+
+    if (g_recorder.fd >= 0) {
+        std::lock_guard<std::mutex> lock(g_recorderMutex);
+        evrec_writer_close(&g_recorder);
+    }
     
     // Not safe, but whatever
+    std::cerr << "Inode path cache: " << g_inodePaths.size() << " items, " << g_inodePaths.evictions() << " evicted, "
+              << g_inodePaths.hits() << " resolved, " << g_inodePaths.misses() << " unknown\n";
     std::cerr << "Interrupt signal (" << signum << ") received, exiting." << std::endl;
     exit(signum);
 }
 
 
-int main() {
+int main(int argc, const char * argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--json") {
+            g_outputFormat = EventRenderer::Format::NDJSON;
+        } else if (arg == "--record" && i + 1 < argc) {
+            if (evrec_writer_open(&g_recorder, argv[++i]) != 0) {
+                std::cerr << "Could not create the record file: " << strerror(errno) << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--json] [--record <file>]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     // No runloop, no problem
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
@@ -93,7 +230,8 @@ int main() {
         
         // Handler blocking file operations working with demoPath and monitoring mount operations
         es_handler_block_t handler = ^(es_client_t *clt, const es_message_t *msg) {
-            //std::cout << msg << std::endl;
+            //print_message(msg);
+            record_message(msg);
 
             // Handle subscribed AUTH events:
             if (msg->action_type == ES_ACTION_TYPE_AUTH) {
@@ -106,7 +244,7 @@ int main() {
                 }
 
                 if (res != ES_RESPOND_RESULT_SUCCESS)
-                    std::cerr << "es_respond_auth_result: " << g_respondResultToStrMap.at(res) << std::endl;
+                    std::cerr << "es_respond_auth_result: " << g_respondResultToStr[res] << std::endl;
             } else {
                 notify_event_handler(msg);
             }
@@ -174,8 +312,8 @@ void notify_event_handler(const es_message_t *msg)
         case ES_EVENT_TYPE_NOTIFY_KEXTUNLOAD:
         // File System
         case ES_EVENT_TYPE_NOTIFY_UNMOUNT:
-            std::cout << "NOTIFY OPERATION: " << g_eventTypeToStrMap.at(msg->event_type) << std::endl;
-            std::cout << msg << std::endl;
+            std::cout << "NOTIFY OPERATION: " << g_eventTypeToStr[msg->event_type] << std::endl;
+            print_message(msg);
             break;
         // File System
         case ES_EVENT_TYPE_NOTIFY_ACCESS:
@@ -183,19 +321,22 @@ void notify_event_handler(const es_message_t *msg)
         case ES_EVENT_TYPE_NOTIFY_EXCHANGEDATA:
         case ES_EVENT_TYPE_NOTIFY_WRITE:
         {
+            if (msg->event_type == ES_EVENT_TYPE_NOTIFY_CLOSE && msg->event.close.modified)
+                hash_modified_file(msg);
+
             const std::vector<std::string> eventPaths = paths_from_event(msg);
 
             // Block if path is in our blocked paths list
             if (std::any_of(eventPaths.cbegin(), eventPaths.cend(), find_occurence)) {
                 std::cout << "    " << (msg->action_type == ES_ACTION_TYPE_AUTH ? "BLOCKING: " : "NOTIFY: ")
-                          << g_eventTypeToStrMap.at(msg->event_type) << " at "
+                          << g_eventTypeToStr[msg->event_type] << " at "
                           << (long long) msg->mach_time << " of mach time." << std::endl;
-                std::cout << msg << std::endl;
+                print_message(msg);
             }
             break;
         }
         default:
-            std::cout << "DEFAULT: " << g_eventTypeToStrMap.at(msg->event_type) << std::endl;
+            std::cout << "DEFAULT: " << g_eventTypeToStr[msg->event_type] << std::endl;
             break;
     }
 }
@@ -212,15 +353,15 @@ uint32_t flags_event_handler(const es_message_t *msg)
             // Block if path is in our blocked paths list
             if (std::any_of(eventPaths.cbegin(), eventPaths.cend(), find_occurence)) {
                 std::cout << "    " << (msg->action_type == ES_ACTION_TYPE_AUTH ? "BLOCKING: " : "NOTIFY: ")
-                          << g_eventTypeToStrMap.at(msg->event_type) << " at "
+                          << g_eventTypeToStr[msg->event_type] << " at "
                           << (long long) msg->mach_time << " of mach time." << std::endl;
-                std::cout << msg << std::endl;
+                print_message(msg);
                 res = FFLAGS(O_RDONLY);
             }
             break;
         }
         default:
-            std::cout << "DEFAULT: " << g_eventTypeToStrMap.at(msg->event_type) << std::endl;
+            std::cout << "DEFAULT: " << g_eventTypeToStr[msg->event_type] << std::endl;
             break;
     }
 
@@ -238,8 +379,8 @@ es_auth_result_t auth_event_handler(const es_message_t *msg)
         // System
         // File System
         case ES_EVENT_TYPE_AUTH_MOUNT:
-            std::cout << "ALLOWING OPERATION: " << g_eventTypeToStrMap.at(msg->event_type) << std::endl;
-            std::cout << msg << std::endl;
+            std::cout << "ALLOWING OPERATION: " << g_eventTypeToStr[msg->event_type] << std::endl;
+            print_message(msg);
             break;
         // File System
         case ES_EVENT_TYPE_AUTH_CREATE:
@@ -258,16 +399,17 @@ es_auth_result_t auth_event_handler(const es_message_t *msg)
             // Block if path is in our blocked paths list
             if (std::any_of(eventPaths.cbegin(), eventPaths.cend(), find_occurence)) {
                 std::cout << "    " << (msg->action_type == ES_ACTION_TYPE_AUTH ? "BLOCKING: " : "NOTIFY: ")
-                          << g_eventTypeToStrMap.at(msg->event_type) << " at "
+                          << g_eventTypeToStr[msg->event_type] << " at "
                           << (long long) msg->mach_time << " of mach time." << std::endl;
-                std::cout << msg << std::endl;
+                print_message(msg);
 
                 return ES_AUTH_RESULT_DENY;
             }
+            update_inode_paths(msg);
             break;
         }
         default:
-            std::cout << "DEFAULT: " << g_eventTypeToStrMap.at(msg->event_type) << std::endl;
+            std::cout << "DEFAULT: " << g_eventTypeToStr[msg->event_type] << std::endl;
             break;
     }
 
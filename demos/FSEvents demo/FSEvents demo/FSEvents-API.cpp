@@ -7,12 +7,19 @@
 //
 
 #include <CoreServices/CoreServices.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <map>
+#include <string>
+#include <unistd.h>
 
 #include "../../../Common/SignalHandler.hpp"
+#include "../../../Common/Tools/FlagTable.hpp"
+#include "../../../Common/Tools/MerkleIndex.hpp"
 
-static inline const std::map<UInt32, const std::string> g_streamEventFlags = {
+static constexpr FlagName<UInt32> g_streamEventFlagNames[] = {
     {kFSEventStreamEventFlagNone,               "kFSEventStreamEventFlagNone"},
     {kFSEventStreamEventFlagMustScanSubDirs,    "kFSEventStreamEventFlagMustScanSubDirs"},
     {kFSEventStreamEventFlagUserDropped,        "kFSEventStreamEventFlagUserDropped"},
@@ -38,6 +45,29 @@ static inline const std::map<UInt32, const std::string> g_streamEventFlags = {
     {kFSEventStreamEventFlagItemIsLastHardlink, "kFSEventStreamEventFlagItemIsLastHardlink"},
     {kFSEventStreamEventFlagItemCloned,         "kFSEventStreamEventFlagItemCloned"},
 };
+static constexpr FlagTable g_streamEventFlags(g_streamEventFlagNames, ",");
+
+// Merkle index of the watched tree: kept current by the events, saved on exit with the last event
+// ID so the next run replays the events since then, and compared to the tree when events were lost
+struct RescanContext {
+    ThreadPool pool;
+    MerkleIndex index {pool};
+    std::string file;
+};
+
+static const char *g_rescanNames[] = {"Created", "Deleted", "Modified"};
+
+// Directory of the saved index: the user's cache directory, $TMPDIR otherwise (never a fixed name
+// in /tmp, which other users could plant). Empty if there is none, the index is not saved then.
+static std::string indexDirectory()
+{
+    char directory[PATH_MAX];
+    const size_t length = confstr(_CS_DARWIN_USER_CACHE_DIR, directory, sizeof(directory));
+    if (length > 0 && length <= sizeof(directory))
+        return directory;
+    const char *tmpdir = getenv("TMPDIR");
+    return tmpdir ? tmpdir : "";
+}
 
 void eventCallback(ConstFSEventStreamRef streamRef, void *clientCallBackInfo, size_t numEvents, void *eventPaths, const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[]);
 
@@ -54,8 +84,23 @@ int main()
     // Init source paths to watch
     CFStringRef path  = CFStringCreateWithCString(kCFAllocatorDefault, demoPath.c_str(), kCFStringEncodingUTF8);
     CFArrayRef pathsToWatch = CFArrayCreate(kCFAllocatorDefault, (const void **)&path, 1, NULL);
-    // Set context passed to the stream callback
-    FSEventStreamContext *ctx = nullptr;
+    // Set context passed to the stream callback, the events report the resolved paths (/private/tmp)
+    RescanContext rescan;
+    char resolved[PATH_MAX];
+    const std::string root = realpath(demoPath.c_str(), resolved) ? resolved : demoPath;
+    const std::string directory = indexDirectory();
+    if (!directory.empty())
+        rescan.file = directory + (directory.back() == '/' ? "" : "/") + demoName + ".merkle";
+    FSEventStreamEventId since = kFSEventStreamEventIdSinceNow;
+    if (!rescan.file.empty() && rescan.index.load(rescan.file) && rescan.index.root() == root && rescan.index.eventId() != 0) {
+        // The events since the last run are replayed into the index
+        since = rescan.index.eventId();
+        std::cout << "Index of " << root << " loaded, replaying the events since " << since << std::endl;
+    } else if (!rescan.index.build(root)) {
+        std::cerr << "Could not index " << root << ": " << strerror(errno) << std::endl;
+    }
+    FSEventStreamContext context = {0, &rescan, nullptr, nullptr, nullptr};
+    FSEventStreamContext *ctx = &context;
     // Set latency in seconds
     CFAbsoluteTime latency = 3.0;
 
@@ -63,7 +108,7 @@ int main()
                                                   eventCallback,
                                                   ctx,
                                                   pathsToWatch,
-                                                  kFSEventStreamEventIdSinceNow, // Or a previous event ID
+                                                  since,
                                                   latency,
                                                   kFSEventStreamCreateFlagIgnoreSelf | kFSEventStreamCreateFlagFileEvents);
 
@@ -83,6 +128,9 @@ int main()
     CFRelease(path);
     CFRelease(pathsToWatch);
 
+    if (!rescan.file.empty() && !rescan.index.root().empty() && !rescan.index.save(rescan.file))
+        std::cerr << "Could not save the index: " << strerror(errno) << std::endl;
+
     return 0;
 }
 
@@ -94,15 +142,44 @@ void eventCallback(ConstFSEventStreamRef streamRef, // The stream for which even
                    const FSEventStreamEventId eventIds[])
 {
     const char * const *paths = (char**)eventPaths;
+    std::string eventDesc;
     
     for (int i=0; i<numEvents; i++)
     {
-        std::string eventDesc = "{";
-        for (const auto &[key, desc] : g_streamEventFlags)
-            eventDesc += (eventFlags[i] & key) ? (desc + ",") : "";
+        eventDesc = "{";
+        g_streamEventFlags.format(eventFlags[i], eventDesc);
         eventDesc += "}";
 
         std::cout << "Change " << eventIds[i] << " in " << paths[i] << ", flags " << eventFlags[i] << ":" << eventDesc << std::endl;
+
+        if (clientCallBackInfo == nullptr)
+            continue;
+        MerkleIndex &index = static_cast<RescanContext *>(clientCallBackInfo)->index;
+        if (index.root().empty())
+            continue;
+        const auto report = [](MerkleIndex::Change change, const std::string &path, const DirectoryEntry &) {
+            std::cout << "Rescan: " << g_rescanNames[static_cast<int>(change)] << " " << path << std::endl;
+        };
+        std::string subtree = paths[i];
+        while (subtree.size() > 1 && subtree.back() == '/')
+            subtree.pop_back();
+
+        constexpr FSEventStreamEventFlags dropped = kFSEventStreamEventFlagUserDropped | kFSEventStreamEventFlagKernelDropped;
+        if (eventFlags[i] & kFSEventStreamEventFlagEventIdsWrapped) {
+            // The history can not be trusted, only the directories which changed are listed
+            const std::size_t listed = index.verify(report);
+            std::cout << "Verified " << index.root() << ", " << listed << " directories listed" << std::endl;
+        } else if (eventFlags[i] & (dropped | kFSEventStreamEventFlagMustScanSubDirs)) {
+            // The events of the subtree (or of the whole stream) were lost, compare it to the index
+            if ((eventFlags[i] & dropped) || !index.snapshot().directories.count(subtree))
+                subtree = index.root();
+            const DirectoryScanner::Stats stats = index.rescan(subtree, report);
+            std::cout << "Rescanned " << subtree << ": " << stats.entries << " entries, " << stats.changes << " changes" << std::endl;
+        } else if (!(eventFlags[i] & kFSEventStreamEventFlagHistoryDone)) {
+            index.update(subtree, [](MerkleIndex::Change, const std::string &, const DirectoryEntry &) {});
+        }
+        if (eventIds[i] != 0)
+            index.setEventId(eventIds[i]);
     }
 }
 
@@ -12,21 +12,30 @@
 
 
 #include <atomic>
+#include <cerrno>
+#include <climits>        // PATH_MAX
+#include <cstdlib>        // realpath
+#include <cstring>
 #include <fcntl.h>        // O_RDONLY
 #include <grp.h>
 #include <iostream>
-#include <map>
 #include <pwd.h>
 #include <sys/ioctl.h>    // for _IOW, a macro required by FSEVENTS_CLONE
 #include <sys/sysctl.h>   // for sysctl, KERN_PROC, etc.
 #include <unistd.h>       // geteuid, read, close
 #include "fsevents.h"     // copied from xnu/bsd/sys/fsevents.h
+#include "../../../Common/Tools/ContentHasher.hpp"
+#include "../../../Common/Tools/DirectoryScanner.hpp"
+#include "../../../Common/Tools/EventRecord.h"
+#include "../../../Common/Tools/EventRenderer.hpp"
+#include "../../../Common/Tools/InodePathCache.hpp"
+#include "../../../Common/Tools/Reflection.hpp"
 
 std::atomic<bool> g_shouldStop {false};
 
 #define BUFSIZE 1024*1024
 
-static inline const std::map<uint32_t, std::string> g_kfseNames = {
+static constexpr NamedValue<int32_t> g_kfseNameList[] = {
     {FSE_CREATE_FILE,         "FSE_CREATE_FILE"},
     {FSE_DELETE,              "FSE_DELETE"},
     {FSE_STAT_CHANGED,        "FSE_STAT_CHANGED"},
@@ -40,10 +49,12 @@ static inline const std::map<uint32_t, std::string> g_kfseNames = {
     {FSE_XATTR_REMOVED,       "FSE_XATTR_REMOVED"},
     {FSE_DOCID_CREATED,       "FSE_DOCID_CREATED"},
     {FSE_DOCID_CHANGED,       "FSE_DOCID_CHANGED"},
+    {FSE_UNMOUNT_PENDING,     "FSE_UNMOUNT_PENDING"},
+    {FSE_CLONE,               "FSE_CLONE"},
 };
+static constexpr NameTable<int32_t, FSE_MAX_EVENTS> g_kfseNames(g_kfseNameList);
 
-static inline const std::map<uint32_t, std::string> g_kfseArgNames = {
-    {0,                 "Unknown"},
+static constexpr NamedValue<uint16_t> g_kfseArgNameList[] = {
     {FSE_ARG_VNODE,     "FSE_ARG_VNODE"},
     {FSE_ARG_STRING,    "FSE_ARG_STRING"},
     {FSE_ARG_PATH,      "FSE_ARG_PATH"},
@@ -57,6 +68,7 @@ static inline const std::map<uint32_t, std::string> g_kfseArgNames = {
     {FSE_ARG_GID,       "FSE_ARG_GID"},
     {FSE_ARG_FINFO,     "FSE_ARG_FINFO"},
 };
+static constexpr NameTable<uint16_t, FSE_MAX_ARGS + 1> g_kfseArgNames(g_kfseArgNameList);
 
 struct kfs_event_arg_t {
     /* argument type */
@@ -98,6 +110,11 @@ enum vtype iftovt_tab[] = {
     VREG, VNON, VLNK, VNON, VSOCK, VNON, VNON, VBAD,
 };
 
+// Synthetic events of a rescan, indexed by DirectoryScanner::Change
+static const char *g_rescanNames[] = {
+    "RESCAN CREATED", "RESCAN DELETED", "RESCAN MODIFIED",
+};
+
 static const char *vtypeNames[] = {
     "VNON", "VREG", "VDIR", "VBLK", "VCHR", "VLNK",
     "VSOCK", "VFIFO", "VBAD", "VSTR", "VCPLX",
@@ -114,8 +131,25 @@ void signalHandler(int signum)
 }
 
 
-int main()
+int main(int argc, const char * argv[])
 {
+    EventRenderer::Format format = EventRenderer::Format::Text;
+    evrec_writer_t recorder = EVREC_WRITER_INIT; // fd < 0 means disabled
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--json") {
+            format = EventRenderer::Format::NDJSON;
+        } else if (arg == "--record" && i + 1 < argc) {
+            if (evrec_writer_open(&recorder, argv[++i]) != 0) {
+                std::cerr << "Could not create the record file: " << strerror(errno) << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--json] [--record <file>]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     // No runloop, no problem
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
@@ -170,81 +204,155 @@ int main()
         return EXIT_FAILURE;
     }
     
+    // Snapshot of the demo path (if it exists) for the rescans after dropped events
+    ThreadPool pool;
+    DirectoryScanner scanner(pool);
+    DirectorySnapshot snapshot;
+    char resolved[PATH_MAX];
+    const std::string rescanRoot = realpath(demoPath.c_str(), resolved) ? resolved : "";
+    if (!rescanRoot.empty())
+        scanner.scan(rescanRoot, snapshot, [](DirectoryScanner::Change, const std::string &, const DirectoryEntry &) {});
+
+    // (fsid, inode) to path of the created, renamed and deleted items
+    InodePathCache inodePaths;
+
+    // SHA-256 and XXH64 of the modified files, on a pool of its own so a rescan does not wait
+    // for the hashing
+    ThreadPool hashPool;
+    ContentHasher hasher(hashPool);
+
     u_int32_t is_fse_arg_vnode = 0;
     char buf[BUFSIZE];
+    // The whole batch returned by one read() is rendered into a buffer and written at once
+    EventRenderer out(format);
     // And now we simply read, ad infinitum (aut nauseam)
     while ((rc = read (cloned_fsed, buf, BUFSIZE)) > 0 && !g_shouldStop) { // event-processing loop
         // rc returns the count of bytes for one or more events:
         int off = 0;
+        // The device does not provide timestamps, all the events of the batch share one
+        const uint64_t batchTime = evrec_now_ns();
 
         while (off < rc) {
-            std::cout << "----" << off << "/" << rc << " bytes.\n";
-            
             kfs_event *kfse = (kfs_event *)((char*)buf + off);
+            out.beginRecord();
+            out.field("offset", off);
+            out.field("batch_size", rc);
             off += sizeof(kfse->type) + sizeof(kfse->pid);
-            
-            
+
             if (kfse->type == FSE_EVENTS_DROPPED) {
-                std::cout << "#Event\n" << "\ttype = " << "EVENTS DROPPED" << "\n\tpid = " << kfse->pid << std::endl;
+                out.field("type", "EVENTS DROPPED");
+                out.field("pid", kfse->pid);
+                out.endRecord();
                 off += sizeof(u_int16_t); // FSE_ARG_DONE: sizeof(type)
+                // What was lost under the demo path is recovered by comparing it to the snapshot
+                if (!rescanRoot.empty()) {
+                    scanner.scan(rescanRoot, snapshot, [&out, &inodePaths](DirectoryScanner::Change change, const std::string &path, const DirectoryEntry &entry) {
+                        if (change == DirectoryScanner::Change::Deleted)
+                            inodePaths.remove(entry.device, entry.inode, path);
+                        else
+                            inodePaths.insert(entry.device, entry.inode, path);
+                        out.beginRecord();
+                        out.field("type", g_rescanNames[static_cast<int>(change)]);
+                        out.field("path", path);
+                        out.field("ino", entry.inode);
+                        out.field("size", entry.size);
+                        out.endRecord();
+                    });
+                }
                 continue;
             }
-            
-            if (kfse->type < FSE_MAX_EVENTS && kfse->type >= -1) {
-                std::cout << "#Event\n" << "\ttype = " << g_kfseNames.at(kfse->type) << "\n\tpid = " << kfse->pid << " (" << (getProcName(kfse->pid) ? getProcName(kfse->pid) : "?") << ")" << std::endl;
-            }
-            
-            std::cout << "\t#Details\n\tType\t\tLength\tData" << std::endl;
+
+            out.field("type", (kfse->type < FSE_MAX_EVENTS && kfse->type >= -1) ? g_kfseNames.name(kfse->type, "FSE_INVALID") : "FSE_INVALID");
+            out.field("pid", kfse->pid);
+            out.field("proc", getProcName(kfse->pid));
+
+            evrec_event_t ev = {};
+            ev.source = EVREC_SOURCE_FSEVENTS;
+            ev.type = static_cast<uint32_t>(kfse->type);
+            ev.pid = kfse->pid;
+            ev.time_ns = batchTime;
+
+            out.beginArray("args");
             kfs_event_arg_t *kea = kfse->args;
-            
+            // The first path is followed by the fsid and the inode of its item, the second one
+            // is the destination of a rename
+            std::string_view paths[2];
+            int pathCount = 0;
+            uint64_t fsid = 0, ino = 0;
+            // Events without a path (FSE_DOCID_*) carry the fsid and inodes only, their paths
+            // come from the cache
+            std::string resolvedPaths[2];
+            int resolvedCount = 0;
+
             int i = 0;
             while ((off < rc) && (i <= FSE_MAX_ARGS)) { // process arguments
                 i++;
-                
+
                 if (kea->type == FSE_ARG_DONE) { // no more arguments
-                    std::cout << "\t" << "FSE_ARG_DONE\t" << kea->type << std::endl;
                     off += sizeof(kea->type);
                     break;
                 }
-                
+
                 int eoff = sizeof(kea->type) + sizeof(kea->len) + kea->len;
                 off += eoff;
-                
-                int32_t arg_id = (kea->type > FSE_MAX_ARGS) ? 0 : kea->type;
-                std::cout << "\t" << g_kfseArgNames.at(arg_id) << "\t\t" << kea->len << "\t";
-                
+
+                out.beginObject();
+                out.field("type", g_kfseArgNames.name(kea->type, "Unknown"));
+                out.field("len", kea->len);
+
                 switch (kea->type) { // handle based on argument type
                     case FSE_ARG_VNODE:     // a vnode (string) pointer
                         is_fse_arg_vnode = 1;
-                        std::cout << "path = " << (char*)&(kea->data.vp) << std::endl;
+                        out.field("path", (char*)&(kea->data.vp));
+                        if (pathCount < 2)
+                            paths[pathCount++] = std::string_view((char*)&(kea->data.vp), strnlen((char*)&(kea->data.vp), kea->len));
+                        evrec_event_add_path(&ev, (char*)&(kea->data.vp), strnlen((char*)&(kea->data.vp), kea->len));
                         break;
                     case FSE_ARG_STRING:    // a string pointer
-                        std::cout << "string = " << (char*)&(kea->data.str) << std::endl;
+                        out.field("string", (char*)&(kea->data.str));
+                        if (pathCount < 2)
+                            paths[pathCount++] = std::string_view((char*)&(kea->data.str), strnlen((char*)&(kea->data.str), kea->len));
+                        evrec_event_add_path(&ev, (char*)&(kea->data.str), strnlen((char*)&(kea->data.str), kea->len));
                         break;
                     case FSE_ARG_INT32:
-                        std::cout << "int32 = " << kea->data.int32 << std::endl;
+                        out.field("int32", kea->data.int32);
                         break;
                     case FSE_ARG_INT64:
-                        std::cout << "int64 = " << kea->data.int64 << std::endl;
+                        out.field("int64", kea->data.int64);
                         break;
                     case FSE_ARG_RAW:       // a void pointer
-                        std::cout << "ptr = " << std::hex << "0x" << (long)(kea->data.ptr) << std::dec << std::endl;
+                        out.hex("ptr", reinterpret_cast<uintptr_t>(kea->data.ptr));
                         break;
                     case FSE_ARG_INO:       // an inode number
-                        std::cout << "ino = " << kea->data.ino << std::endl;
+                        out.field("ino", kea->data.ino);
+                        if (pathCount == 1 && ino == 0)
+                            ino = kea->data.ino;
+                        if (pathCount == 0 && fsid != 0 && resolvedCount < 2
+                            && inodePaths.resolve(fsid, kea->data.ino, resolvedPaths[resolvedCount])) {
+                            const std::string &path = resolvedPaths[resolvedCount++];
+                            out.field("path", path);
+                            evrec_event_add_path(&ev, path.data(), path.size());
+                        }
                         break;
                     case FSE_ARG_UID:       // a user ID
                     {
                         struct passwd *p = getpwuid(kea->data.uid);
-                        std::cout << "uid = " << kea->data.uid << "(" << ((p) ? p->pw_name : "?") << ")" << std::endl;
+                        out.field("uid", kea->data.uid);
+                        out.field("user", (p) ? p->pw_name : "?");
                         break;
                     }
                     case FSE_ARG_DEV:       // a file system ID or a device number
+                        // The device delivers the paths as FSE_ARG_STRING, the fsid (st_dev of the
+                        // item) follows the first one whatever its type. FSE_DOCID_* start with it.
+                        if (pathCount <= 1 && fsid == 0)
+                            fsid = static_cast<uint64_t>(kea->data.dev);
                         if (is_fse_arg_vnode) {
-                            std::cout << "fsid = " << std::hex << kea->data.dev << std::dec << std::endl;
+                            out.hex("fsid", kea->data.dev);
                             is_fse_arg_vnode = 0;
                         } else {
-                            std::cout << "dev = " << std::hex << kea->data.dev << std::dec << "(major " << major(kea->data.dev) << " minor " << minor(kea->data.dev) << ")" << std::endl;
+                            out.hex("dev", kea->data.dev);
+                            out.field("major", major(kea->data.dev));
+                            out.field("minor", minor(kea->data.dev));
                         }
                         break;
                     case FSE_ARG_MODE:      // a combination of file mode and file type
@@ -252,22 +360,85 @@ int main()
                         mode_t va_mode = (kea->data.mode & 0x0000ffff);
                         u_int32_t va_type = (kea->data.mode & 0xfffff000);
                         char fileModeString[11+1];
-                        
+
                         strmode(va_mode, fileModeString);
                         va_type = iftovt_tab[(va_type * S_IFMT) >> 12];
-                        std::cout << "mode = " << fileModeString << "(" << std::hex << kea->data.mode << ", vnode type " << std::dec << ((va_type < VTYPE_MAX) ? vtypeNames[va_type] : "?") << ")" << std::endl;
+                        out.field("mode", fileModeString);
+                        out.hex("mode_raw", kea->data.mode);
+                        out.field("vnode_type", (va_type < VTYPE_MAX) ? vtypeNames[va_type] : "?");
+                        ev.flags = static_cast<uint32_t>(kea->data.mode);
                         break;
                     }
                     default:
-                        std::cout << "unknown" << std::endl;
+                        out.field("data", "unknown");
                         break;
                 }
+                out.endObject();
                 kea = (kfs_event_arg_t *) ((char *)kea + eoff); // next
             } // for each argument
+            out.endArray();
+
+            switch (kfse->type) {
+                case FSE_CREATE_FILE:
+                case FSE_CREATE_DIR:
+                    if (pathCount > 0 && ino != 0)
+                        inodePaths.insert(fsid, ino, paths[0]);
+                    break;
+                case FSE_RENAME:
+                    if (pathCount > 1)
+                        inodePaths.rename(fsid, ino, paths[0], paths[1]);
+                    break;
+                case FSE_DELETE:
+                    if (pathCount > 0)
+                        inodePaths.remove(fsid, ino, paths[0]);
+                    break;
+                case FSE_CONTENT_MODIFIED:
+                    if (pathCount > 0 && ino != 0)
+                        inodePaths.insert(fsid, ino, paths[0]);
+                    if (pathCount > 0)
+                        out.field("hash", hasher.submit(std::string(paths[0])) == ContentHasher::Queued::Full ? "dropped" : "queued");
+                    break;
+            }
+            out.endRecord();
+
+            if (recorder.fd >= 0 && evrec_write(&recorder, &ev) < 0)
+                std::cerr << "evrec_write: " << strerror(errno) << std::endl;
         } // for each event
+
+        // The digests finished meanwhile, the files of this batch come with the next ones
+        hasher.drain([&out, &inodePaths](const ContentDigest &digest) {
+            out.beginRecord();
+            out.field("type", "CONTENT HASH");
+            out.field("path", digest.path);
+            // The file may have been renamed while it waited for the pool
+            std::string current;
+            if (!digest.error && inodePaths.resolve(digest.version.device, digest.version.inode, current) && current != digest.path)
+                out.field("current_path", current);
+            if (digest.error) {
+                out.field("error", strerror(digest.error));
+            } else {
+                out.field("ino", digest.version.inode);
+                out.field("size", digest.version.size);
+                out.hexBytes("sha256", digest.sha256, sizeof(digest.sha256));
+                out.hex("xxh64", digest.xxh64);
+            }
+            out.endRecord();
+        });
+
+        if (!out.flush(STDOUT_FILENO)) {
+            std::cerr << "Could not write the events: " << strerror(errno) << std::endl;
+            break;
+        }
     } // forever
     
     close(cloned_fsed);
+    const ContentHasher::Stats hashStats = hasher.stats();
+    std::cerr << "Content hashes: " << hashStats.hashed << " files, " << hashStats.bytes << " bytes, "
+              << hashStats.duplicates << " duplicates, " << hashStats.dropped << " dropped\n";
+    std::cerr << "Inode path cache: " << inodePaths.size() << " items, " << inodePaths.evictions() << " evicted, "
+              << inodePaths.hits() << " resolved, " << inodePaths.misses() << " unknown\n";
+    if (recorder.fd >= 0 && evrec_writer_close(&recorder) != 0)
+        std::cerr << "Could not write the record file: " << strerror(errno) << std::endl;
     return EXIT_SUCCESS;
 }
 
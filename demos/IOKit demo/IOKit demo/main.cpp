@@ -11,9 +11,12 @@
 #include <iostream>
 #include <IOKit/IOKitLib.h>
 #include <IOKit/IOMessage.h>
+#include <algorithm>
 #include <utility>
+#include <vector>
 
 #include "../../../Common/SignalHandler.hpp"
+#include "../../../Common/Tools/DeviceRegistry.hpp"
 
 // Structure to describe a driver instance.
 struct MyDriverData {
@@ -38,6 +41,9 @@ class IOKitMonitor
     _Nullable IONotificationPortRef notification_port = NULL;
     /// A run loop source used for receiving device notifications
     _Nullable CFRunLoopSourceRef event_source = NULL;
+    /// Attached devices with their services and interest notifications. The notifications get the
+    /// monitor as their refCon and find the device by its registry ID, nothing is allocated per device.
+    DeviceRegistry<MyDriverData> devices;
     
 public:
     void DeviceAdded(void* _Nonnull context, io_iterator_t iterator);
@@ -60,14 +66,7 @@ void IOKitMonitorTrampoline::DeviceNotification(void* context, io_service_t serv
     if (context == nullptr)
         return;
     
-    // Context contains a pointer to pair of pointers to IOKit monitor class and driver data, respectively.
-    auto *data = static_cast<std::pair<IOKitMonitor*, MyDriverData*> *>(context);
-    IOKitMonitor * const iokit_monitor = data->first;
-    
-    if (iokit_monitor == nullptr)
-        return;
-    
-    iokit_monitor->DeviceNotification(data, service, messageType, messageArgument);
+    static_cast<IOKitMonitor*>(context)->DeviceNotification(context, service, messageType, messageArgument);
 }
 
     
@@ -93,6 +92,13 @@ void IOKitMonitor::Init()
     
 void IOKitMonitor::Uninit()
 {
+    // Release the devices which are still attached
+    devices.forEach([](DeviceHandle, DeviceRegistry<MyDriverData>::Entry &entry) {
+        IOObjectRelease(entry.data.notification);
+        IOObjectRelease(entry.data.service);
+    });
+    devices = DeviceRegistry<MyDriverData>();
+    
     // Release the iterator
     if (iter) {
         IOObjectRelease(iter);
@@ -129,64 +135,92 @@ void IOKitMonitor::Uninit()
  
 void IOKitMonitor::DeviceAdded(void* refCon, io_iterator_t iterator)
 {
+    // A hub or a dock brings its devices in one iterator, they are registered as one batch
+    DeviceBatch batch;
+    std::vector<std::pair<uint64_t, io_service_t>> arrived;
     io_service_t service = 0;
     // Iterate over all matching objects.
     while ((service = IOIteratorNext(iterator)) != 0)
     {
-        CFStringRef className;
         // List all IOUSBDevice objects, ignoring objects that subclass IOUSBDevice.
-        className = IOObjectCopyClass(service);
+        CFStringRef className = IOObjectCopyClass(service);
         
         // Because of calling this function during inicialization to arm notifications, devices which are not USBs
         // might appear here as well.
-        if (CFEqual(className, CFSTR("IOUSBDevice")) == true)
+        DeviceInfo info;
+        if (CFEqual(className, CFSTR("IOUSBDevice")) == true
+            && IORegistryEntryGetRegistryEntryID(service, &info.registryId) == KERN_SUCCESS)
         {
             io_name_t name;
             IORegistryEntryGetName(service, name);
-            std::cout << "Found device with name: " << name << std::endl;
-            
-            std::pair<IOKitMonitor*, std::unique_ptr<MyDriverData>> *data = new std::pair<IOKitMonitor*, std::unique_ptr<MyDriverData>>(this, std::make_unique<MyDriverData>());
-            // Save the io_service_t for this driver instance.
-            data->second->service = service;
-            // Install a callback to receive notification of driver state changes.
-            kern_return_t kr = IOServiceAddInterestNotification(notification_port,
-                                                  service, // driver object
-                                                  kIOGeneralInterest,
-                                                  IOKitMonitorTrampoline::DeviceNotification, // callback
-                                                  data, // refCon passed to callback
-                                                  &(data->second->notification));
-            if (kr != KERN_SUCCESS) {
-                delete data;
-                continue;
-            }
+            info.name = name;
+            arrived.emplace_back(info.registryId, service);
+            batch.add(std::move(info));
+        }
+        else
+        {
+            IOObjectRelease(service);
         }
         CFRelease(className);
     }
+    
+    std::sort(arrived.begin(), arrived.end());
+    std::vector<DeviceHandle> failed;
+    devices.apply(batch, [&](DeviceRegistry<MyDriverData>::Change change, DeviceHandle handle,
+                             DeviceRegistry<MyDriverData>::Entry &entry) {
+        if (change != DeviceRegistry<MyDriverData>::Change::Added)
+            return;
+        std::cout << "Found device with name: " << entry.info.name << std::endl;
+        
+        // Save the io_service_t for this driver instance, the reference is the registry's now.
+        auto it = std::lower_bound(arrived.begin(), arrived.end(), std::make_pair(entry.info.registryId, io_service_t(0)));
+        entry.data.service = it->second;
+        it->second = 0;
+        // Install a callback to receive notification of driver state changes.
+        kern_return_t kr = IOServiceAddInterestNotification(notification_port,
+                                              entry.data.service, // driver object
+                                              kIOGeneralInterest,
+                                              IOKitMonitorTrampoline::DeviceNotification, // callback
+                                              this, // refCon passed to callback
+                                              &entry.data.notification);
+        if (kr != KERN_SUCCESS)
+            failed.push_back(handle);
+    });
+    
+    // Devices which are known already, or without notifications
+    for (const auto &device : arrived) {
+        if (device.second != 0)
+            IOObjectRelease(device.second);
+    }
+    for (DeviceHandle handle : failed) {
+        IOObjectRelease(devices.get(handle)->data.service);
+        devices.remove(handle);
+    }
 }
 
 void IOKitMonitor::DeviceNotification(void* refCon, io_service_t service, natural_t messageType,
                          void* messageArgument)
 {
-    if (refCon == nullptr)
+    // Only handle driver termination notifications.
+    if (messageType != kIOMessageServiceIsTerminated)
         return;
     
-    auto *myDriverData = static_cast<std::pair<IOKitMonitor*, std::unique_ptr<MyDriverData>> *>(refCon);
-
-    // Only handle driver termination notifications.
-    if (messageType == kIOMessageServiceIsTerminated)
-    {
-        // Print the name of the removed device.
-        io_name_t  name;
-        IORegistryEntryGetName(service, name);
-        std::cout << "Device removed: " << name << std::endl;;
-        
-        // Remove the driver state change notification.
-        IOObjectRelease(myDriverData->second->notification);
-        // Release our reference to the driver object.
-        IOObjectRelease(myDriverData->second->service);
-        // Release our structure that holds the driver connection.
-        delete myDriverData;
-    }
+    uint64_t registryId = 0;
+    if (IORegistryEntryGetRegistryEntryID(service, &registryId) != KERN_SUCCESS)
+        return;
+    const DeviceHandle handle = devices.find(registryId);
+    DeviceRegistry<MyDriverData>::Entry *device = devices.get(handle);
+    if (device == nullptr)
+        return;
+    
+    // Print the name of the removed device.
+    std::cout << "Device removed: " << device->info.name << std::endl;
+    
+    // Remove the driver state change notification.
+    IOObjectRelease(device->data.notification);
+    // Release our reference to the driver object.
+    IOObjectRelease(device->data.service);
+    devices.remove(handle);
 }
 
 int main(int argc, const char * argv[])
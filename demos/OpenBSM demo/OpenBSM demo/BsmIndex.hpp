@@ -0,0 +1,264 @@
+//
+//  BsmIndex.hpp
+//  OpenBSM demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef BsmIndex_hpp
+#define BsmIndex_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BsmPrefilter.hpp"
+#include "BsmTrail.hpp"
+
+namespace bsm {
+
+// Sidecar index of a trail file (<trail>.idx). The trail is split into blocks of whole records
+// (kDefaultBlockSize bytes by default), every block stores its offset, time range and bitmaps
+// of the event types, users (audit and effective) and pids of its records. The bitmaps are
+// hashed, a set bit means "maybe", so a query reads only the blocks which may contain matching
+// records and checks the records themselves. Records are mostly, not strictly, in time order
+// so the time ranges of neighbouring blocks can overlap and every block is checked (the table
+// is small: 1 GB trail is ~1000 blocks).
+//
+// The index is in host byte order and is rebuilt when the trail changes (size or mtime).
+class TrailIndex
+{
+public:
+    static constexpr uint32_t kMagic = 0x49534d42; // "BMSI"
+    static constexpr uint16_t kVersion = 1;
+    static constexpr std::size_t kDefaultBlockSize = 1024 * 1024;
+
+    struct Block {
+        uint64_t offset;        // first record of the block
+        uint64_t length;        // up to the end of the last record
+        uint64_t minTimeNs;
+        uint64_t maxTimeNs;
+        uint32_t records;
+        uint32_t reserved;
+        uint64_t events[64];    // 4096 bits
+        uint64_t users[4];      // 256 bits
+        uint64_t pids[16];      // 1024 bits
+    };
+
+    struct QueryStats {
+        std::size_t blocksRead = 0;
+        std::size_t bytesRead = 0;
+        std::size_t matches = 0;
+    };
+
+    static std::string sidecarPath(const char *trailPath) { return std::string(trailPath) + ".idx"; }
+
+    const std::vector<Block> &blocks() const { return m_blocks; }
+
+    void build(const TrailFile &trail, std::size_t blockSize = kDefaultBlockSize)
+    {
+        m_blocks.clear();
+        m_trailSize = trail.size();
+        m_trailMtime = trail.mtime();
+
+        Block *block = nullptr;
+        TrailEvent event;
+        forEachRecord(trail.data(), trail.size(), 0, trail.size(), [&](const uint8_t *record, std::size_t length, std::size_t offset) {
+            if (block == nullptr || block->length >= blockSize) {
+                block = &m_blocks.emplace_back();
+                *block = Block();
+                block->offset = offset;
+                block->minTimeNs = UINT64_MAX;
+            }
+
+            summarize(record, length, offset, event);
+            block->length = offset + length - block->offset;
+            block->minTimeNs = std::min(block->minTimeNs, event.timeNs);
+            block->maxTimeNs = std::max(block->maxTimeNs, event.timeNs);
+            ++block->records;
+            set(block->events, event.eventType);
+            set(block->users, event.uid);
+            set(block->users, event.auid);
+            set(block->pids, static_cast<uint32_t>(event.pid));
+        });
+    }
+
+    // Returns false and sets errno if the index can not be written
+    bool save(const char *path) const
+    {
+        // Written next to the index and renamed, readers never see a partial index
+        const std::string temporary = std::string(path) + ".tmp";
+        const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        const FileHeader header = { kMagic, kVersion, sizeof(Block), m_trailSize, m_trailMtime,
+                                    static_cast<uint64_t>(m_blocks.size()) };
+        const bool written = writeAll(fd, &header, sizeof(header))
+            && writeAll(fd, m_blocks.data(), m_blocks.size() * sizeof(Block));
+        const int err = errno;
+        ::close(fd);
+
+        if (!written || rename(temporary.c_str(), path) != 0) {
+            const int renameErr = errno;
+            unlink(temporary.c_str());
+            errno = written ? renameErr : err;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns false if the index is missing, corrupted or does not describe the trail anymore
+    bool load(const char *path, const TrailFile &trail)
+    {
+        m_blocks.clear();
+
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        // The blocks have to fill the rest of the file exactly, a corrupted count is never
+        // allocated
+        struct stat st;
+        FileHeader header;
+        bool valid = fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) >= sizeof(header)
+            && readAll(fd, &header, sizeof(header))
+            && header.magic == kMagic && header.version == kVersion && header.blockSize == sizeof(Block)
+            && header.trailSize == trail.size() && header.trailMtime == trail.mtime()
+            && header.blocks == (static_cast<uint64_t>(st.st_size) - sizeof(header)) / sizeof(Block)
+            && sizeof(header) + header.blocks * sizeof(Block) == static_cast<uint64_t>(st.st_size);
+        if (valid) {
+            m_blocks.resize(header.blocks);
+            valid = readAll(fd, m_blocks.data(), m_blocks.size() * sizeof(Block));
+        }
+        ::close(fd);
+
+        for (const Block &block : m_blocks)
+            valid = valid && block.offset <= trail.size() && block.length <= trail.size() - block.offset;
+        if (!valid) {
+            m_blocks.clear();
+            return false;
+        }
+        m_trailSize = header.trailSize;
+        m_trailMtime = header.trailMtime;
+        return true;
+    }
+
+    // Calls f(const TrailEvent &) for every record in [fromNs, toNs] accepted by the filter
+    // (nullptr accepts everything). Records are visited in the file order.
+    template <typename F>
+    QueryStats query(const TrailFile &trail, const Prefilter *filter, uint64_t fromNs, uint64_t toNs, F &&f) const
+    {
+        QueryStats stats;
+        TrailEvent event;
+
+        for (const Block &block : m_blocks) {
+            if (block.maxTimeNs < fromNs || block.minTimeNs > toNs || (filter && !mayMatch(block, *filter)))
+                continue;
+
+            ++stats.blocksRead;
+            stats.bytesRead += block.length;
+            forEachRecord(trail.data(), trail.size(), block.offset, block.offset + block.length,
+                          [&](const uint8_t *record, std::size_t length, std::size_t offset) {
+                if (filter && !filter->matches(record, length))
+                    return;
+                summarize(record, length, offset, event);
+                if (event.timeNs < fromNs || event.timeNs > toNs)
+                    return;
+                ++stats.matches;
+                f(event);
+            });
+        }
+        return stats;
+    }
+
+private:
+    struct FileHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t blockSize;     // sizeof(Block)
+        uint64_t trailSize;
+        int64_t trailMtime;
+        uint64_t blocks;
+    };
+
+    std::vector<Block> m_blocks;
+    uint64_t m_trailSize = 0;
+    int64_t m_trailMtime = 0;
+
+    // Fibonacci hashing, IDs are often consecutive numbers
+    template <std::size_t N>
+    static std::size_t bit(uint32_t value)
+    {
+        constexpr unsigned bits = __builtin_ctzll(N * 64);
+        return (value * 0x9e3779b1u) >> (32 - bits);
+    }
+
+    template <std::size_t N>
+    static void set(uint64_t (&bitmap)[N], uint32_t value)
+    {
+        const std::size_t i = bit<N>(value);
+        bitmap[i / 64] |= 1ull << (i % 64);
+    }
+
+    template <std::size_t N>
+    static bool test(const uint64_t (&bitmap)[N], uint32_t value)
+    {
+        const std::size_t i = bit<N>(value);
+        return bitmap[i / 64] & (1ull << (i % 64));
+    }
+
+    template <std::size_t N, typename T>
+    static bool testAny(const uint64_t (&bitmap)[N], const std::vector<T> &values)
+    {
+        return values.empty() || std::any_of(values.begin(), values.end(), [&](T value) { return test(bitmap, value); });
+    }
+
+    static bool mayMatch(const Block &block, const Prefilter &filter)
+    {
+        if (!testAny(block.events, filter.eventTypes()))
+            return false;
+        return testAny(block.users, filter.uids()) && testAny(block.users, filter.auids())
+            && testAny(block.pids, filter.pids());
+    }
+
+    static bool writeAll(int fd, const void *data, std::size_t size)
+    {
+        const char *pos = static_cast<const char *>(data);
+        while (size) {
+            const ssize_t rc = ::write(fd, pos, size);
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc <= 0)
+                return false;
+            pos += rc;
+            size -= static_cast<std::size_t>(rc);
+        }
+        return true;
+    }
+
+    static bool readAll(int fd, void *data, std::size_t size)
+    {
+        char *pos = static_cast<char *>(data);
+        while (size) {
+            const ssize_t rc = ::read(fd, pos, size);
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc <= 0)
+                return false;
+            pos += rc;
+            size -= static_cast<std::size_t>(rc);
+        }
+        return true;
+    }
+};
+
+} // namespace bsm
+
+#endif /* BsmIndex_hpp */
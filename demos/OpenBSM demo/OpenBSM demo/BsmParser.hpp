@@ -0,0 +1,480 @@
+//
+//  BsmParser.hpp
+//  OpenBSM demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef BsmParser_hpp
+#define BsmParser_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Portable zero-copy parser of BSM audit records (no libbsm needed, builds on Linux as well).
+// Tokens are decoded into typed structures, variable length data (paths, texts, addresses)
+// are views into the record buffer, so the buffer has to outlive the tokens.
+// Token layouts follow OpenBSM bsm_token.c, all the numbers are big-endian.
+namespace bsm {
+
+// Token IDs (AUT_* in <bsm/audit_record.h>, renamed so they do not clash with the libbsm macros)
+namespace TokenId {
+constexpr uint8_t OtherFile32 = 0x11;
+constexpr uint8_t Trailer = 0x13;
+constexpr uint8_t Header32 = 0x14;
+constexpr uint8_t Header32Ex = 0x15;
+constexpr uint8_t Path = 0x23;
+constexpr uint8_t Subject32 = 0x24;
+constexpr uint8_t Process32 = 0x26;
+constexpr uint8_t Return32 = 0x27;
+constexpr uint8_t Text = 0x28;
+constexpr uint8_t Arg32 = 0x2d;
+constexpr uint8_t Seq = 0x2f;
+constexpr uint8_t Attr32 = 0x3e;
+constexpr uint8_t Exit = 0x52;
+constexpr uint8_t Arg64 = 0x71;
+constexpr uint8_t Return64 = 0x72;
+constexpr uint8_t Attr64 = 0x73;
+constexpr uint8_t Header64 = 0x74;
+constexpr uint8_t Subject64 = 0x75;
+constexpr uint8_t Process64 = 0x77;
+constexpr uint8_t Header64Ex = 0x79;
+constexpr uint8_t Subject32Ex = 0x7a;
+constexpr uint8_t Process32Ex = 0x7b;
+constexpr uint8_t Subject64Ex = 0x7c;
+constexpr uint8_t Process64Ex = 0x7d;
+} // namespace TokenId
+
+constexpr uint16_t kTrailerMagic = 0xb105;
+
+enum class Kind : uint8_t {
+    Unknown,
+    Header,     // header32, header64 and the _ex variants
+    Subject,    // subject32, subject64 and the _ex variants
+    Process,    // process tokens share the layout of the subject tokens
+    Path,
+    Attr,
+    Return,
+    Arg,
+    Text,
+    Exit,
+    Seq,
+    File,
+    Trailer,
+};
+
+enum class Error : uint8_t {
+    None,
+    Truncated,      // the token does not fit into the record
+    UnknownToken,   // unsupported token ID, the length of the token is unknown
+    BadAddress,     // address type is neither IPv4 nor IPv6
+};
+
+struct Header {
+    uint32_t size;          // length of the whole record
+    uint8_t  version;
+    uint16_t eventType;
+    uint16_t eventModifier;
+    uint32_t addressType;   // _ex only, 0 otherwise
+    std::string_view address;
+    uint64_t sec;
+    uint64_t msec;
+};
+
+struct Subject {
+    uint32_t auid;
+    uint32_t euid;
+    uint32_t egid;
+    uint32_t ruid;
+    uint32_t rgid;
+    uint32_t pid;
+    uint32_t sid;
+    uint64_t port;
+    uint32_t addressType;   // _ex only, 0 otherwise
+    std::string_view address;
+};
+
+struct Attr {
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t fsid;
+    uint64_t nid;
+    uint64_t dev;
+};
+
+struct Return {
+    uint8_t  status;
+    uint64_t value;
+};
+
+struct Arg {
+    uint8_t  no;
+    uint64_t value;
+    std::string_view text;
+};
+
+struct Exit {
+    uint32_t status;
+    uint32_t ret;
+};
+
+struct File {
+    uint32_t sec;
+    uint32_t msec;
+    std::string_view name;
+};
+
+struct Trailer {
+    uint16_t magic;
+    uint32_t count;
+};
+
+struct Token {
+    uint8_t id = 0;
+    Kind kind = Kind::Unknown;
+    uint32_t len = 0;               // length of the token including the ID
+    const uint8_t *data = nullptr;  // points at the ID
+    // Only the member(s) of the token kind are valid
+    Header header;
+    Subject subject;        // also used by the process tokens
+    std::string_view path;
+    Attr attr;
+    Return ret;
+    Arg arg;
+    std::string_view text;
+    Exit exit;
+    uint32_t seq;
+    File file;
+    Trailer trailer;
+};
+
+// Big-endian reader with bounds checking, once it runs out of data all reads return zeros
+class ByteReader
+{
+    const uint8_t *m_pos;
+    const uint8_t *m_end;
+    bool m_ok = true;
+
+public:
+    ByteReader(const uint8_t *data, std::size_t size) : m_pos(data), m_end(data + size) {}
+
+    bool ok() const { return m_ok; }
+    const uint8_t *position() const { return m_pos; }
+
+    bool skip(std::size_t n)
+    {
+        if (!m_ok || static_cast<std::size_t>(m_end - m_pos) < n)
+            return m_ok = false;
+        m_pos += n;
+        return true;
+    }
+
+    template <typename T>
+    T read()
+    {
+        const uint8_t *p = m_pos;
+        if (!skip(sizeof(T)))
+            return 0;
+        T value = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+            value = static_cast<T>((static_cast<uint64_t>(value) << 8) | p[i]);
+        return value;
+    }
+
+    std::string_view bytes(std::size_t n)
+    {
+        const uint8_t *p = m_pos;
+        if (!skip(n))
+            return {};
+        return std::string_view(reinterpret_cast<const char *>(p), n);
+    }
+
+    // Length prefixed string, the length includes the terminating null character which is not
+    // part of the view
+    std::string_view string()
+    {
+        const uint16_t len = read<uint16_t>();
+        std::string_view str = bytes(len);
+        if (!str.empty() && str.back() == '\0')
+            str.remove_suffix(1);
+        return str;
+    }
+};
+
+inline std::string_view tokenName(uint8_t id)
+{
+    switch (id) {
+        case TokenId::OtherFile32:  return "file";
+        case TokenId::Trailer:      return "trailer";
+        case TokenId::Header32:     return "header32";
+        case TokenId::Header32Ex:   return "header32_ex";
+        case TokenId::Path:         return "path";
+        case TokenId::Subject32:    return "subject32";
+        case TokenId::Process32:    return "process32";
+        case TokenId::Return32:     return "return32";
+        case TokenId::Text:         return "text";
+        case TokenId::Arg32:        return "arg32";
+        case TokenId::Seq:          return "seq";
+        case TokenId::Attr32:       return "attr32";
+        case TokenId::Exit:         return "exit";
+        case TokenId::Arg64:        return "arg64";
+        case TokenId::Return64:     return "return64";
+        case TokenId::Attr64:       return "attr64";
+        case TokenId::Header64:     return "header64";
+        case TokenId::Subject64:    return "subject64";
+        case TokenId::Process64:    return "process64";
+        case TokenId::Header64Ex:   return "header64_ex";
+        case TokenId::Subject32Ex:  return "subject32_ex";
+        case TokenId::Process32Ex:  return "process32_ex";
+        case TokenId::Subject64Ex:  return "subject64_ex";
+        case TokenId::Process64Ex:  return "process64_ex";
+        default:                    return "unknown";
+    }
+}
+
+inline std::string_view errorName(Error error)
+{
+    switch (error) {
+        case Error::None:           return "none";
+        case Error::Truncated:      return "truncated token";
+        case Error::UnknownToken:   return "unknown token";
+        case Error::BadAddress:     return "bad address type";
+    }
+    return "unknown error";
+}
+
+// Length of the record starting with a header token or 0 if data does not start with a header
+// token. At least 5 bytes (ID and size) are needed.
+inline uint32_t recordLength(const uint8_t *data, std::size_t size)
+{
+    if (size < 5)
+        return 0;
+    switch (data[0]) {
+        case TokenId::Header32:
+        case TokenId::Header32Ex:
+        case TokenId::Header64:
+        case TokenId::Header64Ex:
+            break;
+        default:
+            return 0;
+    }
+    ByteReader reader(data + 1, size - 1);
+    return reader.read<uint32_t>();
+}
+
+// Length of the token at data without decoding it (the layouts of TokenParser::next), or 0 if the
+// token is unknown, truncated or has a bad address type
+inline std::size_t tokenLength(const uint8_t *data, std::size_t size)
+{
+    if (size == 0)
+        return 0;
+    // Length prefixed string at offset, fixed part before it included
+    auto string = [data, size](std::size_t offset) -> std::size_t {
+        return (offset + 2 <= size) ? offset + 2 + (std::size_t(data[offset]) << 8 | data[offset + 1]) : 0;
+    };
+    // Address type at offset and the address, fixed part before it included
+    auto address = [data, size](std::size_t offset) -> std::size_t {
+        if (offset + 4 > size || data[offset] != 0 || data[offset + 1] != 0 || data[offset + 2] != 0)
+            return 0;
+        const uint8_t type = data[offset + 3];
+        return (type == 4 || type == 16) ? offset + 4 + type : 0;
+    };
+
+    std::size_t length;
+    switch (data[0]) {
+        case TokenId::Header32:     length = 18; break;
+        case TokenId::Header64:     length = 26; break;
+        case TokenId::Header32Ex:   length = address(10); length = length ? length + 8 : 0; break;
+        case TokenId::Header64Ex:   length = address(10); length = length ? length + 16 : 0; break;
+        case TokenId::Subject32:
+        case TokenId::Process32:    length = 37; break;
+        case TokenId::Subject64:
+        case TokenId::Process64:    length = 41; break;
+        case TokenId::Subject32Ex:
+        case TokenId::Process32Ex:  length = address(33); break;
+        case TokenId::Subject64Ex:
+        case TokenId::Process64Ex:  length = address(37); break;
+        case TokenId::Path:
+        case TokenId::Text:         length = string(1); break;
+        case TokenId::Attr32:       length = 29; break;
+        case TokenId::Attr64:       length = 33; break;
+        case TokenId::Return32:     length = 6; break;
+        case TokenId::Return64:     length = 10; break;
+        case TokenId::Arg32:        length = string(6); break;
+        case TokenId::Arg64:        length = string(10); break;
+        case TokenId::Exit:         length = 9; break;
+        case TokenId::Seq:          length = 5; break;
+        case TokenId::OtherFile32:  length = string(9); break;
+        case TokenId::Trailer:      length = 7; break;
+        default:                    return 0;
+    }
+    return (length <= size) ? length : 0;
+}
+
+// Iterates over the tokens of one record (or any buffer of whole tokens)
+class TokenParser
+{
+    const uint8_t *m_data;
+    std::size_t m_size;
+    std::size_t m_offset = 0;
+    Error m_error = Error::None;
+
+public:
+    TokenParser(const uint8_t *data, std::size_t size) : m_data(data), m_size(size) {}
+
+    Error error() const { return m_error; }
+    std::size_t offset() const { return m_offset; }
+
+    // Decodes the next token. Returns false at the end of the data or on error (see error()).
+    bool next(Token &token)
+    {
+        if (m_error != Error::None || m_offset >= m_size)
+            return false;
+
+        ByteReader r(m_data + m_offset, m_size - m_offset);
+        token.data = m_data + m_offset;
+        token.id = r.read<uint8_t>();
+        token.kind = Kind::Unknown;
+
+        switch (token.id) {
+            case TokenId::Header32:
+            case TokenId::Header64:
+            case TokenId::Header32Ex:
+            case TokenId::Header64Ex:
+            {
+                const bool is64 = (token.id == TokenId::Header64 || token.id == TokenId::Header64Ex);
+                const bool ex = (token.id == TokenId::Header32Ex || token.id == TokenId::Header64Ex);
+                Header &h = token.header;
+                token.kind = Kind::Header;
+                h.size = r.read<uint32_t>();
+                h.version = r.read<uint8_t>();
+                h.eventType = r.read<uint16_t>();
+                h.eventModifier = r.read<uint16_t>();
+                h.addressType = 0;
+                h.address = {};
+                if (ex && !readAddress(r, h.addressType, h.address))
+                    return false;
+                h.sec = is64 ? r.read<uint64_t>() : r.read<uint32_t>();
+                h.msec = is64 ? r.read<uint64_t>() : r.read<uint32_t>();
+                break;
+            }
+            case TokenId::Subject32:
+            case TokenId::Subject64:
+            case TokenId::Subject32Ex:
+            case TokenId::Subject64Ex:
+            case TokenId::Process32:
+            case TokenId::Process64:
+            case TokenId::Process32Ex:
+            case TokenId::Process64Ex:
+            {
+                const bool is64 = (token.id == TokenId::Subject64 || token.id == TokenId::Subject64Ex
+                                   || token.id == TokenId::Process64 || token.id == TokenId::Process64Ex);
+                const bool ex = (token.id == TokenId::Subject32Ex || token.id == TokenId::Subject64Ex
+                                 || token.id == TokenId::Process32Ex || token.id == TokenId::Process64Ex);
+                Subject &s = token.subject;
+                token.kind = (token.id == TokenId::Subject32 || token.id == TokenId::Subject64 || token.id == TokenId::Subject32Ex
+                              || token.id == TokenId::Subject64Ex) ? Kind::Subject : Kind::Process;
+                s.auid = r.read<uint32_t>();
+                s.euid = r.read<uint32_t>();
+                s.egid = r.read<uint32_t>();
+                s.ruid = r.read<uint32_t>();
+                s.rgid = r.read<uint32_t>();
+                s.pid = r.read<uint32_t>();
+                s.sid = r.read<uint32_t>();
+                s.port = is64 ? r.read<uint64_t>() : r.read<uint32_t>();
+                if (ex) {
+                    if (!readAddress(r, s.addressType, s.address))
+                        return false;
+                } else {
+                    s.addressType = 0;
+                    s.address = r.bytes(4);
+                }
+                break;
+            }
+            case TokenId::Path:
+                token.kind = Kind::Path;
+                token.path = r.string();
+                break;
+            case TokenId::Attr32:
+            case TokenId::Attr64:
+            {
+                Attr &a = token.attr;
+                token.kind = Kind::Attr;
+                a.mode = r.read<uint32_t>();
+                a.uid = r.read<uint32_t>();
+                a.gid = r.read<uint32_t>();
+                a.fsid = r.read<uint32_t>();
+                a.nid = r.read<uint64_t>();
+                a.dev = (token.id == TokenId::Attr64) ? r.read<uint64_t>() : r.read<uint32_t>();
+                break;
+            }
+            case TokenId::Return32:
+            case TokenId::Return64:
+                token.kind = Kind::Return;
+                token.ret.status = r.read<uint8_t>();
+                token.ret.value = (token.id == TokenId::Return64) ? r.read<uint64_t>() : r.read<uint32_t>();
+                break;
+            case TokenId::Arg32:
+            case TokenId::Arg64:
+                token.kind = Kind::Arg;
+                token.arg.no = r.read<uint8_t>();
+                token.arg.value = (token.id == TokenId::Arg64) ? r.read<uint64_t>() : r.read<uint32_t>();
+                token.arg.text = r.string();
+                break;
+            case TokenId::Text:
+                token.kind = Kind::Text;
+                token.text = r.string();
+                break;
+            case TokenId::Exit:
+                token.kind = Kind::Exit;
+                token.exit.status = r.read<uint32_t>();
+                token.exit.ret = r.read<uint32_t>();
+                break;
+            case TokenId::Seq:
+                token.kind = Kind::Seq;
+                token.seq = r.read<uint32_t>();
+                break;
+            case TokenId::OtherFile32:
+                token.kind = Kind::File;
+                token.file.sec = r.read<uint32_t>();
+                token.file.msec = r.read<uint32_t>();
+                token.file.name = r.string();
+                break;
+            case TokenId::Trailer:
+                token.kind = Kind::Trailer;
+                token.trailer.magic = r.read<uint16_t>();
+                token.trailer.count = r.read<uint32_t>();
+                break;
+            default:
+                m_error = Error::UnknownToken;
+                return false;
+        }
+
+        if (!r.ok()) {
+            m_error = Error::Truncated;
+            return false;
+        }
+
+        token.len = static_cast<uint32_t>(r.position() - token.data);
+        m_offset += token.len;
+        return true;
+    }
+
+private:
+    bool readAddress(ByteReader &r, uint32_t &type, std::string_view &address)
+    {
+        type = r.read<uint32_t>();
+        if (type != 4 && type != 16) {
+            m_error = r.ok() ? Error::BadAddress : Error::Truncated;
+            return false;
+        }
+        address = r.bytes(type);
+        return true;
+    }
+};
+
+} // namespace bsm
+
+#endif /* BsmParser_hpp */
@@ -0,0 +1,219 @@
+//
+//  BsmPrefilter.hpp
+//  OpenBSM demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef BsmPrefilter_hpp
+#define BsmPrefilter_hpp
+
+#include <algorithm>
+#include <bitset>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BsmParser.hpp"
+
+namespace bsm {
+
+// Userspace preselection finer than the kernel class masks. Only the event type of the header
+// token and the IDs of the subject token are inspected, the record is not tokenized: the tokens
+// before the subject are skipped by their lengths. Records with tokens the length walk does not
+// know fall back to a token walk.
+//
+// Config (one rule per line, values of a rule are OR-ed, rules are AND-ed, '#' starts a comment):
+//   event 23,72        # AUE_OPEN_R, AUE_OPEN_RC
+//   uid 501            # effective user
+//   auid 501           # audit user
+//   pid 1234
+class Prefilter
+{
+public:
+    // Returns nullopt and a description of the problem in error for malformed configs
+    static std::optional<Prefilter> compile(std::string_view config, std::string &error)
+    {
+        Prefilter filter;
+        std::size_t lineNumber = 0;
+
+        while (!config.empty()) {
+            const std::size_t eol = config.find('\n');
+            std::string_view line = config.substr(0, eol);
+            config.remove_prefix(eol == std::string_view::npos ? config.size() : eol + 1);
+            ++lineNumber;
+
+            line = line.substr(0, line.find('#'));
+            line = trim(line);
+            if (line.empty())
+                continue;
+
+            const std::size_t space = line.find_first_of(" \t");
+            const std::string_view key = line.substr(0, space);
+            std::string_view values = (space == std::string_view::npos) ? std::string_view() : trim(line.substr(space));
+
+            std::vector<uint32_t> *list = nullptr;
+            if (key == "uid")
+                list = &filter.m_uids;
+            else if (key == "auid")
+                list = &filter.m_auids;
+            else if (key == "pid")
+                list = &filter.m_pids;
+            else if (key != "event") {
+                error = "line " + std::to_string(lineNumber) + ": unknown rule '" + std::string(key) + "'";
+                return std::nullopt;
+            }
+
+            if (values.empty()) {
+                error = "line " + std::to_string(lineNumber) + ": missing values";
+                return std::nullopt;
+            }
+
+            while (!values.empty()) {
+                const std::size_t comma = values.find(',');
+                const std::string_view token = trim(values.substr(0, comma));
+                values.remove_prefix(comma == std::string_view::npos ? values.size() : comma + 1);
+
+                uint32_t value = 0;
+                const auto res = std::from_chars(token.data(), token.data() + token.size(), value);
+                if (res.ec != std::errc() || res.ptr != token.data() + token.size()
+                    || (list == nullptr && value > UINT16_MAX)) {
+                    error = "line " + std::to_string(lineNumber) + ": invalid value '" + std::string(token) + "'";
+                    return std::nullopt;
+                }
+
+                if (list) {
+                    list->push_back(value);
+                } else {
+                    filter.m_events.set(value);
+                    filter.m_eventTypes.push_back(static_cast<uint16_t>(value));
+                }
+            }
+        }
+
+        for (auto *list : {&filter.m_uids, &filter.m_auids, &filter.m_pids}) {
+            std::sort(list->begin(), list->end());
+            list->erase(std::unique(list->begin(), list->end()), list->end());
+        }
+        std::sort(filter.m_eventTypes.begin(), filter.m_eventTypes.end());
+        filter.m_eventTypes.erase(std::unique(filter.m_eventTypes.begin(), filter.m_eventTypes.end()), filter.m_eventTypes.end());
+        return filter;
+    }
+
+    static std::optional<Prefilter> load(const char *path, std::string &error)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            error = std::string("could not open ") + path;
+            return std::nullopt;
+        }
+        std::stringstream config;
+        config << file.rdbuf();
+        return compile(config.str(), error);
+    }
+
+    // Decides on the raw record, units which are not records (file tokens) never match
+    bool matches(const uint8_t *record, std::size_t length) const
+    {
+        // ID, record length, version, event type
+        if (length < 8)
+            return false;
+        switch (record[0]) {
+            case TokenId::Header32:
+            case TokenId::Header32Ex:
+            case TokenId::Header64:
+            case TokenId::Header64Ex:
+                break;
+            default:
+                return false;
+        }
+
+        if (!m_eventTypes.empty()) {
+            const uint16_t eventType = static_cast<uint16_t>((record[6] << 8) | record[7]);
+            if (!m_events.test(eventType))
+                return false;
+        }
+
+        if (m_uids.empty() && m_auids.empty() && m_pids.empty())
+            return true;
+
+        const uint8_t *subject = findSubject(record, length);
+        if (subject == nullptr)
+            return false;
+
+        ByteReader reader(subject + 1, 24);
+        const uint32_t auid = reader.read<uint32_t>();
+        const uint32_t euid = reader.read<uint32_t>();
+        reader.skip(12); // egid, ruid, rgid
+        const uint32_t pid = reader.read<uint32_t>();
+
+        return contains(m_auids, auid) && contains(m_uids, euid) && contains(m_pids, pid);
+    }
+
+    // Compiled rules, empty lists (and no event rule) accept everything
+    const std::vector<uint16_t> &eventTypes() const { return m_eventTypes; }
+    const std::vector<uint32_t> &uids() const { return m_uids; }
+    const std::vector<uint32_t> &auids() const { return m_auids; }
+    const std::vector<uint32_t> &pids() const { return m_pids; }
+
+private:
+    std::bitset<UINT16_MAX + 1> m_events;
+    std::vector<uint16_t> m_eventTypes;
+    std::vector<uint32_t> m_uids;
+    std::vector<uint32_t> m_auids;
+    std::vector<uint32_t> m_pids;
+
+    static std::string_view trim(std::string_view str)
+    {
+        const std::size_t begin = str.find_first_not_of(" \t\r");
+        if (begin == std::string_view::npos)
+            return {};
+        return str.substr(begin, str.find_last_not_of(" \t\r") - begin + 1);
+    }
+
+    // Empty list matches everything
+    static bool contains(const std::vector<uint32_t> &list, uint32_t value)
+    {
+        return list.empty() || std::binary_search(list.begin(), list.end(), value);
+    }
+
+    // Subject token of the record or nullptr. The tokens are skipped by their lengths only, which
+    // is much cheaper than decoding them; a token tokenLength does not know (or a damaged one) is
+    // left to the full parse.
+    static const uint8_t *findSubject(const uint8_t *record, std::size_t length)
+    {
+        std::size_t position = 0;
+        while (position < length) {
+            const std::size_t size = tokenLength(record + position, length - position);
+            if (size == 0)
+                break;
+            switch (record[position]) {
+                case TokenId::Subject32:
+                case TokenId::Subject64:
+                case TokenId::Subject32Ex:
+                case TokenId::Subject64Ex:
+                    return record + position;
+            }
+            position += size;
+        }
+        if (position == length)
+            return nullptr;
+
+        TokenParser parser(record, length);
+        Token token;
+        while (parser.next(token))
+            if (token.kind == Kind::Subject)
+                return token.data;
+        return nullptr;
+    }
+};
+
+} // namespace bsm
+
+#endif /* BsmPrefilter_hpp */
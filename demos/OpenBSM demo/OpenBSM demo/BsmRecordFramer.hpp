@@ -0,0 +1,168 @@
+//
+//  BsmRecordFramer.hpp
+//  OpenBSM demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef BsmRecordFramer_hpp
+#define BsmRecordFramer_hpp
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+
+#include "BsmParser.hpp"
+
+namespace bsm {
+
+// Splits a stream of BSM records (/dev/auditpipe or a trail file) into records without
+// au_read_rec()'s stdio buffering and per record malloc. Data is read with large read() calls
+// into one buffer which is reused for the whole stream. Records are returned as views into
+// the buffer (valid until the next call of next()), only the incomplete record at the end of
+// the buffer is moved to its beginning before the next read(). The buffer grows only when
+// a single record does not fit into it.
+//
+// Trail files start and end with a file token, these tokens are returned as separate units.
+class RecordFramer
+{
+public:
+    enum class Status {
+        Record,         // record (or file token) is available
+        End,            // end of the file
+        Interrupted,    // read() was interrupted by a signal, next() can be called again
+        Error,          // read() failed, see errno
+        Corrupted,      // the stream does not start with a header or file token
+    };
+
+    static constexpr std::size_t kDefaultBufferSize = 1024 * 1024;
+    static constexpr std::size_t kMaxRecordSize = 16 * 1024 * 1024;
+
+    explicit RecordFramer(int fd, std::size_t bufferSize = kDefaultBufferSize)
+        : m_fd(fd)
+    {
+        // Room for the ID and length of any record/file token
+        allocate(bufferSize < 64 ? 64 : bufferSize);
+    }
+
+    RecordFramer(const RecordFramer&) = delete;
+    RecordFramer &operator=(const RecordFramer&) = delete;
+
+    Status next(const uint8_t *&record, std::size_t &length)
+    {
+        for (;;) {
+            const std::size_t available = m_end - m_begin;
+            const std::size_t unit = unitLength(m_buffer.get() + m_begin, available);
+
+            if (unit == kCorrupted)
+                return Status::Corrupted;
+
+            if (unit != kNeedMore && unit <= available) {
+                record = m_buffer.get() + m_begin;
+                length = unit;
+                m_begin += unit;
+                ++m_records;
+                return Status::Record;
+            }
+
+            // The record is incomplete, make room for the rest of it and read more
+            if (unit != kNeedMore && unit > m_capacity)
+                allocate(unit);
+            else if (m_begin > 0)
+                compact();
+
+            const Status status = fill();
+            if (status != Status::Record)
+                return (status == Status::End && m_end != m_begin) ? Status::Corrupted : status;
+        }
+    }
+
+    std::size_t records() const { return m_records; }
+    std::size_t reads() const { return m_reads; }
+    std::size_t allocations() const { return m_allocations; }
+
+private:
+    static constexpr std::size_t kNeedMore = 0;
+    static constexpr std::size_t kCorrupted = SIZE_MAX;
+
+    int m_fd;
+    std::unique_ptr<uint8_t[]> m_buffer;
+    std::size_t m_capacity = 0;
+    std::size_t m_begin = 0;    // first unprocessed byte
+    std::size_t m_end = 0;      // end of the valid data
+    std::size_t m_records = 0;
+    std::size_t m_reads = 0;
+    std::size_t m_allocations = 0;
+
+    // Length of the unit starting at data, kNeedMore if more bytes are needed to tell
+    static std::size_t unitLength(const uint8_t *data, std::size_t available)
+    {
+        if (available == 0)
+            return kNeedMore;
+
+        switch (data[0]) {
+            case TokenId::Header32:
+            case TokenId::Header32Ex:
+            case TokenId::Header64:
+            case TokenId::Header64Ex:
+            {
+                // ID and the record length
+                if (available < 5)
+                    return kNeedMore;
+                const uint32_t length = recordLength(data, available);
+                return (length < 5 || length > kMaxRecordSize) ? kCorrupted : length;
+            }
+            case TokenId::OtherFile32:
+            {
+                // ID, seconds, milliseconds, name length and name
+                if (available < 11)
+                    return kNeedMore;
+                ByteReader reader(data + 9, 2);
+                return 11 + reader.read<uint16_t>();
+            }
+            default:
+                return kCorrupted;
+        }
+    }
+
+    void compact()
+    {
+        const std::size_t rest = m_end - m_begin;
+        if (rest)
+            std::memmove(m_buffer.get(), m_buffer.get() + m_begin, rest);
+        m_begin = 0;
+        m_end = rest;
+    }
+
+    void allocate(std::size_t capacity)
+    {
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[capacity]);
+        const std::size_t rest = m_end - m_begin;
+        if (rest)
+            std::memcpy(buffer.get(), m_buffer.get() + m_begin, rest);
+        m_buffer = std::move(buffer);
+        m_capacity = capacity;
+        m_begin = 0;
+        m_end = rest;
+        ++m_allocations;
+    }
+
+    Status fill()
+    {
+        const ssize_t rc = ::read(m_fd, m_buffer.get() + m_end, m_capacity - m_end);
+        ++m_reads;
+        if (rc < 0)
+            return (errno == EINTR) ? Status::Interrupted : Status::Error;
+        if (rc == 0)
+            return Status::End;
+        m_end += static_cast<std::size_t>(rc);
+        return Status::Record;
+    }
+};
+
+} // namespace bsm
+
+#endif /* BsmRecordFramer_hpp */
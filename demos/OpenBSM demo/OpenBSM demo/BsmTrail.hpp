@@ -0,0 +1,258 @@
+//
+//  BsmTrail.hpp
+//  OpenBSM demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef BsmTrail_hpp
+#define BsmTrail_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <queue>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BsmParser.hpp"
+#include "BsmPrefilter.hpp"
+#include "../../../Common/Tools/ThreadPool.hpp"
+
+namespace bsm {
+
+// Read-only mapping of a whole audit trail file (i.e. /var/audit/*)
+class TrailFile
+{
+public:
+    TrailFile() = default;
+    TrailFile(const TrailFile&) = delete;
+    TrailFile &operator=(const TrailFile&) = delete;
+    ~TrailFile() { close(); }
+
+    // Returns false and sets errno on failure
+    bool open(const char *path)
+    {
+        close();
+
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            return false;
+        }
+
+        m_size = static_cast<std::size_t>(st.st_size);
+        m_mtime = static_cast<int64_t>(st.st_mtime);
+        if (m_size) {
+            void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                const int err = errno;
+                ::close(fd);
+                m_size = 0;
+                errno = err;
+                return false;
+            }
+            m_data = static_cast<const uint8_t *>(data);
+        }
+        ::close(fd);
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data)
+            munmap(const_cast<uint8_t *>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const uint8_t *data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    int64_t mtime() const { return m_mtime; }
+
+private:
+    const uint8_t *m_data = nullptr;
+    std::size_t m_size = 0;
+    int64_t m_mtime = 0;
+};
+
+// Checks that a whole record starts at offset: a header token whose length points right behind
+// a trailer token with the same length. Used to find record boundaries at arbitrary offsets.
+inline bool isRecordAt(const uint8_t *data, std::size_t size, std::size_t offset)
+{
+    const uint32_t length = recordLength(data + offset, size - offset);
+    // header32 and trailer are the shortest possible record
+    if (length < 25 || length > size - offset)
+        return false;
+
+    ByteReader trailer(data + offset + length - 7, 7);
+    return trailer.read<uint8_t>() == TokenId::Trailer
+        && trailer.read<uint16_t>() == kTrailerMagic
+        && trailer.read<uint32_t>() == length;
+}
+
+// Offset of the first record starting at or after from, size if there is none
+inline std::size_t findRecordStart(const uint8_t *data, std::size_t size, std::size_t from)
+{
+    for (std::size_t offset = from; offset < size; ++offset) {
+        switch (data[offset]) {
+            case TokenId::Header32:
+            case TokenId::Header32Ex:
+            case TokenId::Header64:
+            case TokenId::Header64Ex:
+                if (isRecordAt(data, size, offset))
+                    return offset;
+                break;
+            default:
+                break;
+        }
+    }
+    return size;
+}
+
+// Normalized summary of one record, the path is a view into the trail file
+struct TrailEvent {
+    uint64_t timeNs = 0;
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    uint16_t eventType = 0;
+    uint32_t auid = 0;
+    uint32_t uid = 0;
+    int32_t pid = -1;
+    uint8_t status = 0;
+    uint64_t ret = 0;
+    std::string_view path;
+};
+
+inline bool summarize(const uint8_t *record, std::size_t length, uint64_t offset, TrailEvent &event)
+{
+    TokenParser parser(record, length);
+    Token token;
+
+    event = TrailEvent();
+    event.offset = offset;
+    event.length = static_cast<uint32_t>(length);
+    while (parser.next(token)) {
+        switch (token.kind) {
+            case Kind::Header:
+                event.eventType = token.header.eventType;
+                event.timeNs = token.header.sec * 1000000000ull + token.header.msec * 1000000ull;
+                break;
+            case Kind::Subject:
+                event.auid = token.subject.auid;
+                event.uid = token.subject.euid;
+                event.pid = static_cast<int32_t>(token.subject.pid);
+                break;
+            case Kind::Path:
+                if (event.path.empty())
+                    event.path = token.path;
+                break;
+            case Kind::Return:
+                event.status = token.ret.status;
+                event.ret = token.ret.value;
+                break;
+            default:
+                break;
+        }
+    }
+    return parser.error() == Error::None;
+}
+
+// Calls f(record, length, offset) for every record starting in [begin, end). Records which
+// start in the range are processed even if they end behind it, so consecutive ranges split
+// at findRecordStart() boundaries visit every record exactly once.
+template <typename F>
+void forEachRecord(const uint8_t *data, std::size_t size, std::size_t begin, std::size_t end, F &&f)
+{
+    std::size_t offset = findRecordStart(data, size, begin);
+    while (offset < end) {
+        const uint32_t length = recordLength(data + offset, size - offset);
+        if (length < 5 || length > size - offset) {
+            // Not a record (i.e. the file token at the end of the trail), resynchronize
+            offset = findRecordStart(data, size, offset + 1);
+            continue;
+        }
+        f(data + offset, length, offset);
+        offset += length;
+    }
+}
+
+// Parses the trail on the pool in chunks of chunkSize bytes. Chunk boundaries are moved to
+// record boundaries by every task independently, results are merged in timestamp order
+// (file offset breaks ties). Returns the number of records which failed to parse in failed.
+// Records rejected by the filter (if any) are skipped without being parsed.
+inline std::vector<TrailEvent> parseTrail(const TrailFile &trail, ThreadPool &pool,
+                                          std::size_t chunkSize, std::size_t &failed,
+                                          const Prefilter *filter = nullptr)
+{
+    const uint8_t * const data = trail.data();
+    const std::size_t size = trail.size();
+    const std::size_t chunks = size ? (size + chunkSize - 1) / chunkSize : 0;
+
+    std::vector<std::vector<TrailEvent>> results(chunks);
+    std::vector<std::size_t> errors(chunks, 0);
+    const auto before = [](const TrailEvent &a, const TrailEvent &b) {
+        return a.timeNs < b.timeNs || (a.timeNs == b.timeNs && a.offset < b.offset);
+    };
+
+    pool.parallelFor(chunks, [&](std::size_t i) {
+        const std::size_t begin = i * chunkSize;
+        const std::size_t end = std::min(size, begin + chunkSize);
+        std::vector<TrailEvent> &events = results[i];
+        events.reserve(chunkSize / 128);
+
+        forEachRecord(data, size, begin, end, [&](const uint8_t *record, std::size_t length, std::size_t offset) {
+            if (filter && !filter->matches(record, length))
+                return;
+            events.emplace_back();
+            if (!summarize(record, length, offset, events.back()))
+                ++errors[i];
+        });
+
+        // Records are mostly in time order already
+        if (!std::is_sorted(events.begin(), events.end(), before))
+            std::sort(events.begin(), events.end(), before);
+    });
+
+    // k-way merge of the sorted chunks
+    using Cursor = std::pair<std::size_t, std::size_t>; // chunk, index
+    const auto after = [&](const Cursor &a, const Cursor &b) {
+        return before(results[b.first][b.second], results[a.first][a.second]);
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(after)> heap(after);
+
+    std::size_t total = 0;
+    failed = 0;
+    for (std::size_t i = 0; i < chunks; ++i) {
+        total += results[i].size();
+        failed += errors[i];
+        if (!results[i].empty())
+            heap.emplace(i, 0);
+    }
+
+    std::vector<TrailEvent> merged;
+    merged.reserve(total);
+    while (!heap.empty()) {
+        const Cursor cursor = heap.top();
+        heap.pop();
+        merged.push_back(results[cursor.first][cursor.second]);
+        if (cursor.second + 1 < results[cursor.first].size())
+            heap.emplace(cursor.first, cursor.second + 1);
+    }
+    return merged;
+}
+
+} // namespace bsm
+
+#endif /* BsmTrail_hpp */
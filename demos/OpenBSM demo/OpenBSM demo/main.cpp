@@ -8,16 +8,33 @@
 // Source: https://github.com/meliot/filewatcher
 
 #include <atomic>
-#include <bsm/libbsm.h>
+#include <chrono>
+#include <bsm/audit.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <optional>
 #include <security/audit/audit_ioctl.h>
 #include <sys/ioctl.h>
 #include <unistd.h> // geteuid
+#include "../../../Common/Tools/EventRecord.h"
+#include "../../../Common/Tools/EventRenderer.hpp"
+#include "BsmIndex.hpp"
+#include "BsmParser.hpp"
+#include "BsmPrefilter.hpp"
+#include "BsmRecordFramer.hpp"
+#include "BsmTrail.hpp"
 
 std::atomic<bool> g_shouldStop {false};
 
-FILE *initPipe();
-void readPrintToken(FILE* auditFile);
+int initPipe();
+void printRecord(const uint8_t *record, std::size_t length, EventRenderer &out, evrec_writer_t *recorder);
+bool printEvent(const bsm::TrailEvent &event, EventRenderer &out, evrec_writer_t *recorder);
+int processTrail(const char *trailPath, unsigned jobs, const bsm::Prefilter *filter, EventRenderer &out, evrec_writer_t *recorder);
+int queryTrail(const char *trailPath, const bsm::Prefilter *filter, uint64_t fromNs, uint64_t toNs, EventRenderer &out, evrec_writer_t *recorder);
 
 void signalHandler(int signum)
 {
@@ -26,7 +43,7 @@ void signalHandler(int signum)
     g_shouldStop = true;
 }
 
-int main()
+int main(int argc, const char * argv[])
 {
     // No runloop, no problem
     signal(SIGINT, signalHandler);
@@ -39,29 +56,115 @@ int main()
     std::cout << "(" << demoName << ") Hello, World!\n";
     std::cout << "Point of interest: " << "All the events!" << std::endl << std::endl;
     
-    FILE *auditFile = initPipe();
-    
-    while(!g_shouldStop)
-        readPrintToken(auditFile);
-        
-    fclose(auditFile);
+    EventRenderer::Format format = EventRenderer::Format::Text;
+    evrec_writer_t recorder = EVREC_WRITER_INIT; // fd < 0 means disabled
+    const char *trailPath = nullptr;
+    unsigned jobs = 0;
+    std::optional<bsm::Prefilter> filter;
+    bool useIndex = false;
+    uint64_t fromNs = 0;
+    uint64_t toNs = UINT64_MAX;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--json") {
+            format = EventRenderer::Format::NDJSON;
+        } else if (arg == "--trail" && i + 1 < argc) {
+            trailPath = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--filter" && i + 1 < argc) {
+            std::string error;
+            filter = bsm::Prefilter::load(argv[++i], error);
+            if (!filter) {
+                std::cerr << "Invalid filter: " << error << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--index") {
+            useIndex = true;
+        } else if (arg == "--from" && i + 1 < argc) {
+            fromNs = std::strtoull(argv[++i], nullptr, 10) * 1000000000ull;
+        } else if (arg == "--to" && i + 1 < argc) {
+            toNs = std::strtoull(argv[++i], nullptr, 10) * 1000000000ull + 999999999ull;
+        } else if (arg == "--record" && i + 1 < argc) {
+            if (evrec_writer_open(&recorder, argv[++i]) != 0) {
+                std::cerr << "Could not create the record file: " << strerror(errno) << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--json] [--record <file>] [--filter <config>] [--trail <audit trail file> [--jobs <threads> | --index [--from <unix time>] [--to <unix time>]]]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Query through the sidecar index, only the blocks which may contain matches are read
+    if (trailPath && useIndex) {
+        EventRenderer out(format);
+        const int res = queryTrail(trailPath, filter ? &*filter : nullptr, fromNs, toNs, out, (recorder.fd >= 0) ? &recorder : nullptr);
+        if (recorder.fd >= 0 && evrec_writer_close(&recorder) != 0)
+            std::cerr << "Could not write the record file: " << strerror(errno) << std::endl;
+        return res;
+    }
+
+    // Forensic mode, the whole trail is parsed in parallel
+    if (trailPath && jobs > 0) {
+        EventRenderer out(format);
+        const int res = processTrail(trailPath, jobs, filter ? &*filter : nullptr, out, (recorder.fd >= 0) ? &recorder : nullptr);
+        if (recorder.fd >= 0 && evrec_writer_close(&recorder) != 0)
+            std::cerr << "Could not write the record file: " << strerror(errno) << std::endl;
+        return res;
+    }
+
+    // Either the live audit pipe or a recorded trail file (i.e. /var/audit/*)
+    const int auditFd = trailPath ? open(trailPath, O_RDONLY) : initPipe();
+    if (auditFd < 0) {
+        std::cerr << "Could not open the audit source: " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    EventRenderer out(format);
+    bsm::RecordFramer framer(auditFd);
+    const uint8_t *record;
+    std::size_t length;
+    std::size_t rejected = 0;
+
+    while(!g_shouldStop) {
+        const bsm::RecordFramer::Status status = framer.next(record, length);
+        if (status == bsm::RecordFramer::Status::Record && filter && !filter->matches(record, length))
+            ++rejected;
+        else if (status == bsm::RecordFramer::Status::Record)
+            printRecord(record, length, out, (recorder.fd >= 0) ? &recorder : nullptr);
+        else if (status == bsm::RecordFramer::Status::Interrupted)
+            continue;
+        else {
+            if (status == bsm::RecordFramer::Status::Error)
+                std::cerr << "Could not read the audit records: " << strerror(errno) << std::endl;
+            else if (status == bsm::RecordFramer::Status::Corrupted)
+                std::cerr << "Corrupted audit record stream after " << framer.records() << " records\n";
+            break;
+        }
+    }
+
+    std::cerr << framer.records() << " records, " << framer.reads() << " reads, "
+              << framer.allocations() << " buffer allocations, " << rejected << " rejected by the filter\n";
+    close(auditFd);
+    if (recorder.fd >= 0 && evrec_writer_close(&recorder) != 0)
+        std::cerr << "Could not write the record file: " << strerror(errno) << std::endl;
     return EXIT_SUCCESS;
 }
 
 
-FILE *initPipe()
+int initPipe()
 {
     // Open the device
-    FILE* auditFile = fopen("/dev/auditpipe", "r");
+    int auditFileDescriptor = open("/dev/auditpipe", O_RDONLY);
 
     if (geteuid())
         std::cerr << "Opening /dev/auditpipe requires root permissions\n";
 
-    if (auditFile == nullptr) {
+    if (auditFileDescriptor < 0) {
         std::cerr << "Could not open the device\n";
         exit(1);
     }
-    int auditFileDescriptor = fileno(auditFile);
 
 
 
@@ -73,7 +176,8 @@ FILE *initPipe()
     if (ioctlReturn == -1) {
         std::cerr << "Unable to set the audit pipe mode to local.\n";
         perror("Error ");
-        return nullptr;
+        close(auditFileDescriptor);
+        return -1;
     }
 
     int queueLength;
@@ -83,7 +187,8 @@ FILE *initPipe()
     if (ioctlReturn == -1) {
         std::cerr << "Unable to get the maximum queue length of the audit pipe.\n";
         perror("Error ");
-        return nullptr;
+        close(auditFileDescriptor);
+        return -1;
     }
 
     ioctlReturn = ioctl(auditFileDescriptor,
@@ -92,7 +197,8 @@ FILE *initPipe()
     if (ioctlReturn == -1) {
         std::cerr << "Unable to set the queue length of the audit pipe.\n";
         perror("Error ");
-        return nullptr;
+        close(auditFileDescriptor);
+        return -1;
     }
 
     // According with /etc/security/audit_class
@@ -123,7 +229,8 @@ FILE *initPipe()
     if (ioctlReturn == -1) {
         std::cerr << "Unable to set the attributable events preselection mask.\n";
         perror("Error ");
-        return nullptr;
+        close(auditFileDescriptor);
+        return -1;
     }
 
     u_int nonAttributableEventsMask = attributableEventsMask;
@@ -133,38 +240,228 @@ FILE *initPipe()
     if (ioctlReturn == -1) {
         std::cerr << "Unable to set the non-attributable events preselection mask.\n";
         perror("Error ");
-        return nullptr;
+        close(auditFileDescriptor);
+        return -1;
     }
 
-    return auditFile;
+    return auditFileDescriptor;
 }
 
-void readPrintToken(FILE* auditFile)
+static void renderToken(EventRenderer &out, const bsm::Token &token)
 {
-    u_char* buffer;
-    int recordLength = au_read_rec(auditFile, &buffer);
-    if (recordLength == -1)
-        return;
+    out.beginObject();
+    out.field("token", bsm::tokenName(token.id));
+    out.hex("id", token.id);
+    out.field("len", token.len);
 
-    int recordBalance = recordLength;
-    int processedLength = 0;
-    tokenstr_t token;
+    switch (token.kind) {
+        case bsm::Kind::Header:
+            out.field("size", token.header.size);
+            out.field("version", token.header.version);
+            out.field("event_type", token.header.eventType);
+            out.hex("event_modifier", token.header.eventModifier);
+            out.timestamp("time", static_cast<int64_t>(token.header.sec), static_cast<long>(token.header.msec) * 1000000L);
+            break;
+        case bsm::Kind::Subject:
+        case bsm::Kind::Process:
+            out.field("auid", token.subject.auid);
+            out.field("euid", token.subject.euid);
+            out.field("egid", token.subject.egid);
+            out.field("ruid", token.subject.ruid);
+            out.field("rgid", token.subject.rgid);
+            out.field("pid", token.subject.pid);
+            out.field("sid", token.subject.sid);
+            out.field("port", token.subject.port);
+            break;
+        case bsm::Kind::Path:
+            out.field("path", token.path);
+            break;
+        case bsm::Kind::Return:
+            out.field("status", token.ret.status);
+            out.field("return", token.ret.value);
+            break;
+        case bsm::Kind::Attr:
+            out.hex("mode", token.attr.mode);
+            out.field("uid", token.attr.uid);
+            out.field("gid", token.attr.gid);
+            out.field("fsid", token.attr.fsid);
+            out.field("nid", token.attr.nid);
+            out.field("dev", token.attr.dev);
+            break;
+        case bsm::Kind::Arg:
+            out.field("no", token.arg.no);
+            out.hex("value", token.arg.value);
+            out.field("text", token.arg.text);
+            break;
+        case bsm::Kind::Text:
+            out.field("text", token.text);
+            break;
+        case bsm::Kind::Exit:
+            out.field("status", token.exit.status);
+            out.field("return", token.exit.ret);
+            break;
+        case bsm::Kind::Seq:
+            out.field("seqno", token.seq);
+            break;
+        case bsm::Kind::File:
+            out.timestamp("time", token.file.sec, static_cast<long>(token.file.msec) * 1000000L);
+            out.field("name", token.file.name);
+            break;
+        case bsm::Kind::Trailer:
+            out.hex("magic", token.trailer.magic);
+            out.field("count", token.trailer.count);
+            break;
+        case bsm::Kind::Unknown:
+            break;
+    }
+    out.endObject();
+}
 
-    while (recordBalance) {
-        // Extract a token from the record
-        int fetchToken = au_fetch_tok(&token, buffer + processedLength, recordBalance);
-        if (fetchToken == -1) {
-            std::cerr << "Error fetching token.\n";
+// Normalizes the tokens of interest into the binary record
+static void recordToken(evrec_event_t &ev, const bsm::Token &token)
+{
+    switch (token.kind) {
+        case bsm::Kind::Header:
+            ev.type = token.header.eventType;
+            ev.time_ns = token.header.sec * 1000000000ull + token.header.msec * 1000000ull;
             break;
-        }
+        case bsm::Kind::Subject:
+            ev.pid = static_cast<int32_t>(token.subject.pid);
+            break;
+        case bsm::Kind::Path:
+            evrec_event_add_path(&ev, token.path.data(), token.path.size());
+            break;
+        case bsm::Kind::Return:
+            ev.flags = token.ret.status;
+            break;
+        default:
+            break;
+    }
+}
 
-        char* dlmtr = "\n";
-        au_print_flags_tok(stdout, &token, dlmtr, AU_OFLAG_XML);
-        std::cout << std::endl;
-        processedLength += token.len;
-        recordBalance -= token.len;
+// Renders the whole record and writes it with a single write() call
+void printRecord(const uint8_t *record, std::size_t length, EventRenderer &out, evrec_writer_t *recorder)
+{
+    bsm::TokenParser parser(record, length);
+    bsm::Token token;
+    evrec_event_t ev = {};
+    ev.source = EVREC_SOURCE_BSM;
+    ev.pid = -1;
+
+    out.beginRecord();
+    out.field("length", length);
+    out.beginArray("tokens");
+    while (parser.next(token)) {
+        renderToken(out, token);
+        recordToken(ev, token);
     }
-    std::cout << std::endl;
-    std::cout << std::endl;
-    free(buffer);
+    out.endArray();
+    out.endRecord();
+    out.flush(STDOUT_FILENO);
+
+    if (parser.error() != bsm::Error::None)
+        std::cerr << "Error parsing token at offset " << parser.offset() << ": " << bsm::errorName(parser.error()) << std::endl;
+
+    // Paths reference the framer's buffer, write the record before the next one is read.
+    // File tokens of trail files are not events.
+    if (recorder && record[0] != bsm::TokenId::OtherFile32 && evrec_write(recorder, &ev) < 0)
+        std::cerr << "evrec_write: " << strerror(errno) << std::endl;
+}
+
+// Renders one normalized event, the output is flushed in large batches. Returns false if the
+// output can not be written anymore.
+bool printEvent(const bsm::TrailEvent &event, EventRenderer &out, evrec_writer_t *recorder)
+{
+    constexpr std::size_t kFlushSize = 1024 * 1024;
+
+    out.beginRecord();
+    out.timestamp("time", static_cast<int64_t>(event.timeNs / 1000000000), static_cast<long>(event.timeNs % 1000000000));
+    out.field("offset", event.offset);
+    out.field("event_type", event.eventType);
+    out.field("auid", event.auid);
+    out.field("uid", event.uid);
+    out.field("pid", event.pid);
+    out.field("status", event.status);
+    out.field("return", event.ret);
+    out.field("path", event.path);
+    out.endRecord();
+    if (out.size() > kFlushSize && !out.flush(STDOUT_FILENO))
+        return false;
+
+    if (recorder) {
+        evrec_event_t ev = {};
+        ev.source = EVREC_SOURCE_BSM;
+        ev.type = event.eventType;
+        ev.pid = event.pid;
+        ev.time_ns = event.timeNs;
+        ev.flags = event.status;
+        if (!event.path.empty())
+            evrec_event_add_path(&ev, event.path.data(), event.path.size());
+        if (evrec_write(recorder, &ev) < 0)
+            std::cerr << "evrec_write: " << strerror(errno) << std::endl;
+    }
+    return true;
+}
+
+// Maps the trail, parses it on a thread pool and prints the normalized events in time order
+int processTrail(const char *trailPath, unsigned jobs, const bsm::Prefilter *filter, EventRenderer &out, evrec_writer_t *recorder)
+{
+    constexpr std::size_t kChunkSize = 8 * 1024 * 1024;
+
+    bsm::TrailFile trail;
+    if (!trail.open(trailPath)) {
+        std::cerr << "Could not map the trail file: " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool pool(jobs);
+    std::size_t failed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<bsm::TrailEvent> events = bsm::parseTrail(trail, pool, kChunkSize, failed, filter);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const bsm::TrailEvent &event : events)
+        if (!printEvent(event, out, recorder))
+            break;
+    out.flush(STDOUT_FILENO);
+
+    std::cerr << events.size() << " records (" << failed << " malformed) parsed by " << pool.size()
+              << " threads in " << elapsed.count() << " s, "
+              << (trail.size() / elapsed.count() / 1e9) << " GB/s\n";
+    return EXIT_SUCCESS;
+}
+
+// Answers the query from the sidecar index of the trail, the index is (re)built when it is
+// missing or older than the trail
+int queryTrail(const char *trailPath, const bsm::Prefilter *filter, uint64_t fromNs, uint64_t toNs, EventRenderer &out, evrec_writer_t *recorder)
+{
+    bsm::TrailFile trail;
+    if (!trail.open(trailPath)) {
+        std::cerr << "Could not map the trail file: " << strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string indexPath = bsm::TrailIndex::sidecarPath(trailPath);
+    bsm::TrailIndex index;
+    if (!index.load(indexPath.c_str(), trail)) {
+        const auto start = std::chrono::steady_clock::now();
+        index.build(trail);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cerr << "Indexed " << trail.size() << " bytes into " << index.blocks().size() << " blocks in "
+                  << elapsed.count() << " s\n";
+        if (!index.save(indexPath.c_str()))
+            std::cerr << "Could not write the index " << indexPath << ": " << strerror(errno) << std::endl;
+    }
+
+    bool writable = true;
+    const auto start = std::chrono::steady_clock::now();
+    const bsm::TrailIndex::QueryStats stats = index.query(trail, filter, fromNs, toNs, [&](const bsm::TrailEvent &event) {
+        writable = writable && printEvent(event, out, recorder);
+    });
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    out.flush(STDOUT_FILENO);
+
+    std::cerr << stats.matches << " records from " << stats.blocksRead << "/" << index.blocks().size()
+              << " blocks (" << stats.bytesRead << " of " << trail.size() << " bytes) in " << elapsed.count() << " s\n";
+    return EXIT_SUCCESS;
 }
@@ -16,21 +16,34 @@
 #pragma clang diagnostic ignored "-Wsign-conversion"
 
 #include <kern/assert.h>
+#include <kern/clock.h>
 #include <mach/mach_types.h>
 #include <libkern/libkern.h>
+#include <libkern/OSAtomic.h>
 #include <libkern/OSMalloc.h>
 #include <sys/sysctl.h>
 #include <sys/kauth.h>
+#include <sys/proc.h>
 #include <sys/vnode.h>
 
 #pragma clang diagnostic pop
 
+#include "kauth_pool.h"
+#include "kauth_ring.h"
+
+// <kern/cpu_number.h> keeps it private, it is exported by com.apple.kpi.unsupported
+extern int cpu_number(void);
+
 
 #pragma mark ***** Global Resources
 // These declarations are required to allocate memory and create locks.
 // They're created when we start and destroyed when we stop.
 static OSMallocTag  gMallocTag = NULL;
 
+// gActivationCount is the number of threads inside the listener.  kauth_unlisten_scope does
+// not wait for them, so the path pool and the event ring are only freed once it drops to 0.
+static SInt32       gActivationCount = 0;
+
 #define BUNDLE_NAME "com_test_kauth_demo"
 #define BUNDLE_ID "com.test.kauth-demo"
 const char* g_demoName = "kauth";
@@ -84,145 +97,145 @@ static const VnodeActionInfo kVnodeActionInfo[] = {
 
 #define kVnodeActionInfoCount (sizeof(kVnodeActionInfo) / sizeof(*kVnodeActionInfo))
 
+// kVnodeActionBitToInfo maps a bit of the action bitmap to the first kVnodeActionInfo
+// entry describing it, so that only the set bits have to be visited.  It is filled in
+// by InitVnodeActionInfo when the kext starts.
+
+static uint8_t kVnodeActionBitToInfo[32];
+
 enum {
-    kActionStringMaxLength = 16384
+    kVnodeActionNoInfo     = 0xff,
+    kActionStringMaxLength = 512        // all the names, separators and the hex remainder fit
 };
 
-static int CreateVnodeActionString(
+static void InitVnodeActionInfo(void)
+{
+    unsigned int    infoIndex;
+    kauth_action_t  bits;
+
+    memset(kVnodeActionBitToInfo, kVnodeActionNoInfo, sizeof(kVnodeActionBitToInfo));
+    for (infoIndex = 0; infoIndex < kVnodeActionInfoCount; infoIndex++) {
+        for (bits = kVnodeActionInfo[infoIndex].fMask; bits != 0; bits &= bits - 1) {
+            unsigned int bit = (unsigned int) __builtin_ctz(bits);
+            if (kVnodeActionBitToInfo[bit] == kVnodeActionNoInfo) {
+                kVnodeActionBitToInfo[bit] = (uint8_t) infoIndex;
+            }
+        }
+    }
+}
+
+static size_t FormatVnodeActionString(
     kauth_action_t  action,
     boolean_t       isDir,
-    char **         actionStrPtr,
-    size_t *        actionStrBufSizePtr
+    char *          actionStr,
+    size_t          actionStrSize
 )
     // Creates a human readable description of a vnode action bitmap.
     // action is the bitmap.  isDir is true if the action relates to a
     // directory, and false otherwise.  This allows the action name to
     // be context sensitive (KAUTH_VNODE_EXECUTE vs KAUTH_VNODE_SEARCH).
-    // actionStrPtr is a place to store the allocated string pointer.
-    // The caller is responsible for freeing this memory using OSFree.
-    // actionStrBufSizePtr is a place to store the size of the resulting
-    // allocation (because the annoying kernel memory allocator requires
-    // you to provide the size when you free).
+    // The string is written to the caller supplied actionStr buffer in a
+    // single pass; nothing is allocated.  Returns the length of the string
+    // (without the null terminator).  If the buffer is too small, the
+    // string is truncated.
 {
-    int             err;
-    enum { kCalcLen, kCreateString } pass;
     kauth_action_t  actionsLeft;
-    unsigned int    infoIndex;
-    size_t          actionStrLen = 0;
-    size_t          actionStrSize;
-    char *          actionStr;
-
-    assert( actionStrPtr != NULL);
-    assert(*actionStrPtr != NULL);
-    assert( actionStrBufSizePtr != NULL);
-
-    err = 0;
-
-    actionStr = NULL;
-    actionStrSize = 0;
-
-    // A two pass algorithm.  In the first pass, actionStr is NULL and we just
-    // calculate actionStrLen; at the end of the first pass we actually allocate
-    // actionStr.  In the second pass, actionStr is not NULL and we actually
-    // initialise the string in that buffer.
-
-    for (pass = kCalcLen; pass <= kCreateString; pass++) {
-        actionsLeft = action;
+    uint32_t        infos;
+    size_t          actionStrLen;
 
-        // Process action bits that are described in kVnodeActionInfo.
+    assert(actionStr != NULL);
+    assert(actionStrSize > 0);
 
-        infoIndex = 0;
-        actionStrLen = 0;
-        while ( (actionsLeft != 0) && (infoIndex < kVnodeActionInfoCount) ) {
-            if ( actionsLeft & kVnodeActionInfo[infoIndex].fMask ) {
-                const char * thisStr;
-                size_t       thisStrLen;
+    // Collect the kVnodeActionInfo entries describing the set bits.  Entries are
+    // tracked in a bitmap so that the names are printed in the table order.
 
-                // Increment the length of the acion string by the action name.
-
-                if ( isDir && (kVnodeActionInfo[infoIndex].fOpNameDir != NULL) ) {
-                    thisStr = kVnodeActionInfo[infoIndex].fOpNameDir;
-                } else {
-                    thisStr = kVnodeActionInfo[infoIndex].fOpNameFile;
-                }
-                thisStrLen = strlen(thisStr);
-
-                if (actionStr != NULL) {
-                    memcpy(&actionStr[actionStrLen], thisStr, thisStrLen);
-                }
-                actionStrLen += thisStrLen;
-
-                // Now clear the bit in actionsLeft, indicating that we've
-                // processed this one.
-
-                actionsLeft &= ~kVnodeActionInfo[infoIndex].fMask;
+    infos = 0;
+    actionsLeft = action;
+    for (; actionsLeft != 0; actionsLeft &= actionsLeft - 1) {
+        uint8_t infoIndex = kVnodeActionBitToInfo[__builtin_ctz(actionsLeft)];
+        if (infoIndex != kVnodeActionNoInfo) {
+            infos |= 1U << infoIndex;
+        }
+    }
 
-                // If there's any actions left, account for the intervening "|".
+    actionStrLen = 0;
+    actionsLeft = action;
+    for (; infos != 0; infos &= infos - 1) {
+        const VnodeActionInfo * info = &kVnodeActionInfo[__builtin_ctz(infos)];
+        const char *            thisStr;
+        size_t                  thisStrLen;
 
-                if (actionsLeft != 0) {
-                    if (actionStr != NULL) {
-                        actionStr[actionStrLen] = '|';
-                    }
-                    actionStrLen += 1;
-                }
-            }
-            infoIndex += 1;
+        if ( isDir && (info->fOpNameDir != NULL) ) {
+            thisStr = info->fOpNameDir;
+        } else {
+            thisStr = info->fOpNameFile;
         }
+        thisStrLen = strlen(thisStr);
 
-        // Now include any remaining actions as a hex number.
+        if (actionStrLen != 0 && actionStrLen + 1 < actionStrSize) {
+            actionStr[actionStrLen++] = '|';
+        }
+        if (actionStrLen + thisStrLen >= actionStrSize) {
+            thisStrLen = actionStrSize - 1 - actionStrLen;
+        }
+        memcpy(&actionStr[actionStrLen], thisStr, thisStrLen);
+        actionStrLen += thisStrLen;
 
-        if (actionsLeft != 0) {
-            if (actionStr != NULL) {
-                // This will write 11 bytes (10 bytes of string plus a null
-                // char), but that's OK because we know that we allocated
-                // space for the null.
+        actionsLeft &= ~info->fMask;
+    }
+    actionStr[actionStrLen] = 0;
 
-                snprintf(&actionStr[actionStrLen], actionStrSize - actionStrLen, "0x%08x", actionsLeft);
-            }
-            actionStrLen += 10;         // strlen("0x") + 8 chars of hex
-        }
+    // Now include any remaining actions as a hex number.
 
-        // If we're at the end of the first pass, allocate actionStr
-        // based on the size we just calculated.  Remember that actionStrLen
-        // is a string length, so we have to allocate an extra character to
-        // account for the null terminator.  If we're at the end of the
-        // second pass, just place the null terminator.
-
-        if (pass == kCalcLen) {
-            if (actionStrLen > kActionStringMaxLength) {
-                err = ENOBUFS;
-            } else {
-                actionStrSize = actionStrLen + 1;
-                actionStr = OSMalloc( (uint32_t) actionStrSize, gMallocTag);       // The cast won't truncate because of kActionStringMaxLength check.
-                if (actionStr == NULL) {
-                    err = ENOMEM;
-                }
-            }
-        } else {
-            actionStr[actionStrLen] = 0;
+    if (actionsLeft != 0) {
+        int written = snprintf(&actionStr[actionStrLen], actionStrSize - actionStrLen,
+                               (actionStrLen != 0) ? "|0x%08x" : "0x%08x", actionsLeft);
+        if (written > 0) {
+            actionStrLen += (size_t) written;
         }
-
-        if (err != 0) {
-            break;
+        if (actionStrLen >= actionStrSize) {
+            actionStrLen = actionStrSize - 1;
         }
     }
 
-    // Clean up.
+    return actionStrLen;
+}
 
-    *actionStrPtr        = actionStr;
-    *actionStrBufSizePtr = actionStrLen + 1;
+// The listener runs for every vnode authorization in the system, its path buffers come from a
+// preallocated pool with a group of buffers per CPU.  Every buffer holds both paths of a request
+// (2 x MAXPATHLEN), one buffer per request.  OSMalloc is the fallback once the pool is empty.
 
-    assert( (err == 0) == (*actionStrPtr != NULL) );
+enum {
+    kPathBufferSize     = 2 * MAXPATHLEN,
+    kPathPoolGroups     = 16,           // CPUs beyond that share the groups
+    kPathPoolGroupSize  = 4             // buffers per group
+};
 
-    return err;
+static kauth_pool_t gPathPool;
+static void *       gPathPoolMemory = NULL;
+
+static char *GetPathBuffer(void)
+{
+    char *buffer = (char *) kauth_pool_get(&gPathPool, (unsigned) cpu_number());
+
+    if (buffer == NULL) {
+        buffer = OSMalloc(kPathBufferSize, gMallocTag);
+    }
+    return buffer;
 }
 
-static int CreateVnodePath(vnode_t vp, char **vpPathPtr)
-    // Creates a full path for a vnode.  vp may be NULL, in which
-    // case the returned path is NULL (that is, no memory is allocated).
-    // vpPathPtr is a place to store the allocated path buffer.
-    // The caller is responsible for freeing this memory using OSFree
-    // (the size is always MAXPATHLEN).
+static void PutPathBuffer(char *buffer)
+{
+    if (kauth_pool_put(&gPathPool, buffer) != 0) {
+        OSFree(buffer, kPathBufferSize, gMallocTag);
+    }
+}
+
+static int CreateVnodePath(vnode_t vp, char *buffer, char **vpPathPtr)
+    // Creates a full path for a vnode in buffer (MAXPATHLEN bytes).
+    // vp may be NULL, in which case the returned path is NULL.
+    // vpPathPtr is a place to store the path, which points into
+    // buffer and lives as long as it.
 {
     int             err;
     int             pathLen;
@@ -232,13 +245,10 @@ static int CreateVnodePath(vnode_t vp, char **vpPathPtr)
 
     err = 0;
     if (vp != NULL) {
-        *vpPathPtr = OSMalloc(MAXPATHLEN, gMallocTag);
-        if (*vpPathPtr == NULL) {
-            err = ENOMEM;
-        }
+        pathLen = MAXPATHLEN;
+        err = vn_getpath(vp, buffer, &pathLen);
         if (err == 0) {
-            pathLen = MAXPATHLEN;
-            err = vn_getpath(vp, *vpPathPtr, &pathLen);
+            *vpPathPtr = buffer;
         }
     }
 
@@ -247,6 +257,86 @@ static int CreateVnodePath(vnode_t vp, char **vpPathPtr)
 
 
 
+#pragma mark ***** Event Ring
+
+// The listener reports the requests through a lock-free ring rather than printf, which formats
+// and serializes every message. User space drains the ring in batches through the sysctl
+// debug.kauth_demo_events: every read returns as many whole kauth_ring_record_t records as fit
+// in the buffer (sysctlbyname() with a NULL buffer returns the size of a full ring).
+// debug.kauth_demo_dropped counts the records lost to a full ring.  kauth_events.c next to
+// this file is that consumer (built by the Makefile of the demo), it prints the records.
+
+enum {
+    kRingCapacity = 512                 // records, a power of two
+};
+
+static kauth_ring_t         gRing;
+static kauth_ring_slot_t *  gRingSlots = NULL;
+static int                  gRingConsumer = 0;      // the ring has one consumer at a time
+static boolean_t            gRingSysctlRegistered = FALSE;
+
+struct RingCopyContext {
+    struct sysctl_req * req;
+    int                 err;
+};
+
+static int RingCopyOut(void *ctx, const kauth_ring_record_t *record)
+{
+    struct RingCopyContext *copy = (struct RingCopyContext *) ctx;
+
+    copy->err = SYSCTL_OUT(copy->req, record, sizeof(*record));
+    return copy->err;
+}
+
+static int RingSysctlHandler(struct sysctl_oid *oidp, void *arg1, int arg2, struct sysctl_req *req)
+{
+    #pragma unused(oidp)
+    #pragma unused(arg1)
+    #pragma unused(arg2)
+    struct RingCopyContext copy = { req, 0 };
+
+    if (req->oldptr == USER_ADDR_NULL) {
+        return SYSCTL_OUT(req, NULL, kRingCapacity * sizeof(kauth_ring_record_t));
+    }
+    if (gRingSlots == NULL) {
+        return ENOENT;
+    }
+    if (__atomic_exchange_n(&gRingConsumer, 1, __ATOMIC_ACQUIRE) != 0) {
+        return EBUSY;
+    }
+    (void) kauth_ring_consume(&gRing, (size_t) (req->oldlen / sizeof(kauth_ring_record_t)), RingCopyOut, &copy);
+    __atomic_store_n(&gRingConsumer, 0, __ATOMIC_RELEASE);
+    return copy.err;
+}
+
+SYSCTL_PROC(_debug, OID_AUTO, kauth_demo_events, CTLTYPE_OPAQUE | CTLFLAG_RD | CTLFLAG_LOCKED,
+            NULL, 0, RingSysctlHandler, "S,kauth_ring_record", "kauth demo events");
+SYSCTL_QUAD(_debug, OID_AUTO, kauth_demo_dropped, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &gRing.dropped, "kauth demo events lost to a full ring");
+
+static void RecordVnodeEvent(kauth_action_t action, boolean_t isDir, uid_t uid, const char *vpPath, const char *dvpPath)
+{
+    uint64_t                position;
+    kauth_ring_record_t *   record;
+
+    record = kauth_ring_claim(&gRing, &position);
+    if (record == NULL) {
+        return;             // counted by the ring
+    }
+    record->time   = mach_absolute_time();
+    record->pid    = proc_selfpid();
+    record->uid    = (uint32_t) uid;
+    record->action = (uint32_t) action;
+    record->flags  = KAUTH_RING_DENIED | (isDir ? KAUTH_RING_DIR : 0);
+    (void) FormatVnodeActionString(action, isDir, record->action_name, sizeof(record->action_name));
+    if (kauth_ring_copy_path(record->path, vpPath) | kauth_ring_copy_path(record->dir_path, dvpPath)) {
+        record->flags |= KAUTH_RING_TRUNCATED;
+    }
+    kauth_ring_publish(&gRing, position);
+}
+
+
+
 // A Kauth listener that's called to authorize an action in the vnode
 // scope (KAUTH_SCOPE_PROCESS).  See the Kauth documentation for a description
 // of the parameters.  In this case, we just dump out the parameters to the
@@ -261,50 +351,40 @@ VnodeScopeListener(kauth_cred_t credential, void *idata, kauth_action_t action,
     int err;
     int result = KAUTH_RESULT_DEFER;
     boolean_t isDir;
-    size_t actionStrBufSize = 0;
 
     vfs_context_t context = (vfs_context_t) arg0;
     vnode_t vp            = (vnode_t) arg1;
     vnode_t dvp           = (vnode_t) arg2;
 
+    char *pathBuffer;
     char *vpPath    = NULL;
     char *dvpPath   = NULL;
-    char *actionStr = NULL;
 
-    // Convert the vnode, if any, to a path.
-    err = CreateVnodePath(vp, &vpPath);
+    (void) OSIncrementAtomic(&gActivationCount);
 
-    // Convert the parent directory vnode, if any, to a path.
+    pathBuffer = GetPathBuffer();
+    err = (pathBuffer != NULL) ? 0 : ENOMEM;
+
+    // Convert the vnode, if any, to a path.
     if (err == 0) {
-        err = CreateVnodePath(dvp, &dvpPath);
+        err = CreateVnodePath(vp, pathBuffer, &vpPath);
     }
 
-    // Create actionStr as a human readable description of action.
+    // Convert the parent directory vnode, if any, to a path.
     if (err == 0) {
-        if (vp != NULL) {
-            isDir = (vnode_vtype(vp) == VDIR);
-        } else {
-            isDir = FALSE;
-        }
-        err = CreateVnodeActionString(action, isDir, &actionStr, &actionStrBufSize);
+        err = CreateVnodePath(dvp, pathBuffer + MAXPATHLEN, &dvpPath);
     }
 
     // Tell the user about this request.  Note that we filter requests
-    // based on gPrefix.  If gPrefix is set, only requests where one
-    // of the paths is prefixed by gPrefix will be printed.
+    // based on g_demoPath, only requests where one of the paths contains
+    // it are recorded.
 
     if (err == 0) {
         if ((vpPath != NULL && strstr(vpPath, g_demoPath))
             || (dvpPath != NULL && strstr(dvpPath, g_demoPath))
            ) {
-            printf(
-                "%s scope=" KAUTH_SCOPE_VNODE ", action=%s, uid=%ld, vp=%s, dvp=%s\n",
-                g_demoName,
-                actionStr,
-                (long) kauth_cred_getuid(vfs_context_ucred(context)),
-                (vpPath  != NULL) ? vpPath : "<null>",
-                (dvpPath != NULL) ? dvpPath : "<null>"
-            );
+            isDir = (vp != NULL) && (vnode_vtype(vp) == VDIR);
+            RecordVnodeEvent(action, isDir, kauth_cred_getuid(vfs_context_ucred(context)), vpPath, dvpPath);
             result = KAUTH_RESULT_DENY;
         }
     } else {
@@ -312,18 +392,12 @@ VnodeScopeListener(kauth_cred_t credential, void *idata, kauth_action_t action,
     }
 
     // Clean up.
-    if (actionStr != NULL) {
-        // In the following, the cast can't truncate because actionStrBufSize is returned by
-        // CreateVnodeActionString, which enforces a bound of kActionStringMaxLength.
-        OSFree(actionStr, (uint32_t) actionStrBufSize, gMallocTag);
-    }
-    if (vpPath != NULL) {
-        OSFree(vpPath, MAXPATHLEN, gMallocTag);
-    }
-    if (dvpPath != NULL) {
-        OSFree(dvpPath, MAXPATHLEN, gMallocTag);
+    if (pathBuffer != NULL) {
+        PutPathBuffer(pathBuffer);
     }
 
+    (void) OSDecrementAtomic(&gActivationCount);
+
     return result;
 }
 
@@ -331,14 +405,29 @@ VnodeScopeListener(kauth_cred_t credential, void *idata, kauth_action_t action,
 // keep it around so that we can remove the listener when we're done.
 static kauth_listener_t gListener = NULL;
 
-// Removes the installed scope listener, if any.
+// Removes the installed scope listener, if any, and waits for the threads inside it.
 static void RemoveListener(void)
 {
     // First prevent any more threads entering our listener.
-    if (gListener != NULL) {
-        kauth_unlisten_scope(gListener);
-        gListener = NULL;
+    if (gListener == NULL) {
+        return;
     }
+    kauth_unlisten_scope(gListener);
+    gListener = NULL;
+
+    // Then wait for any threads within our listener to stop, they may be sleeping in
+    // vn_getpath with a buffer of the pool.  There is still a window between the
+    // OSDecrementAtomic and the return from the listener which cannot be closed because of
+    // the weak guarantee of kauth_unlisten_scope, so the loop runs at least once to delay
+    // the teardown by a second.
+    do {
+        struct timespec oneSecond;
+
+        oneSecond.tv_sec  = 1;
+        oneSecond.tv_nsec = 0;
+
+        (void) msleep(&gActivationCount, NULL, PUSER, BUNDLE_NAME ".RemoveListener", &oneSecond);
+    } while (__atomic_load_n(&gActivationCount, __ATOMIC_ACQUIRE) > 0);
 }
 
 static void
@@ -376,7 +465,27 @@ kauth_demo_start(kmod_info_t * ki, void *d)
     printf("(%s)_start: Hello Cruel World!\n", g_demoName);
     printf("Point of interest: %s\n", g_demoPath);
 
-    InstallListener();
+    InitVnodeActionInfo();
+
+    if (err == KERN_SUCCESS) {
+        gPathPoolMemory = OSMalloc((uint32_t) kauth_pool_memory_size(kPathPoolGroups, kPathPoolGroupSize, kPathBufferSize), gMallocTag);
+        if (gPathPoolMemory == NULL
+            || kauth_pool_init(&gPathPool, gPathPoolMemory, kPathPoolGroups, kPathPoolGroupSize, kPathBufferSize) != 0) {
+            err = KERN_FAILURE;
+        }
+    }
+    if (err == KERN_SUCCESS) {
+        gRingSlots = OSMalloc((uint32_t) kauth_ring_slots_size(kRingCapacity), gMallocTag);
+        if (gRingSlots == NULL || kauth_ring_init(&gRing, gRingSlots, kRingCapacity) != 0) {
+            err = KERN_FAILURE;
+        }
+    }
+    if (err == KERN_SUCCESS) {
+        sysctl_register_oid(&sysctl__debug_kauth_demo_events);
+        sysctl_register_oid(&sysctl__debug_kauth_demo_dropped);
+        gRingSysctlRegistered = TRUE;
+        InstallListener();
+    }
     // If we failed, shut everything down.
     if (err != KERN_SUCCESS)
         (void) kauth_demo_stop(ki, d);
@@ -393,6 +502,23 @@ kauth_demo_stop(kmod_info_t *ki, void *d)
 
     RemoveListener();
 
+    if (gRingSysctlRegistered) {
+        sysctl_unregister_oid(&sysctl__debug_kauth_demo_events);
+        sysctl_unregister_oid(&sysctl__debug_kauth_demo_dropped);
+        gRingSysctlRegistered = FALSE;
+    }
+
+    if (gRingSlots != NULL) {
+        OSFree(gRingSlots, (uint32_t) kauth_ring_slots_size(kRingCapacity), gMallocTag);
+        gRingSlots = NULL;
+    }
+
+    if (gPathPoolMemory != NULL) {
+        printf("(%s)_stop: %llu path buffers allocated past the pool\n", g_demoName, (unsigned long long) kauth_pool_misses(&gPathPool));
+        OSFree(gPathPoolMemory, (uint32_t) kauth_pool_memory_size(kPathPoolGroups, kPathPoolGroupSize, kPathBufferSize), gMallocTag);
+        gPathPoolMemory = NULL;
+    }
+
     if (gMallocTag != NULL) {
         OSMalloc_Tagfree(gMallocTag);
         gMallocTag = NULL;
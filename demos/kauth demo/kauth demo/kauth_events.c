@@ -0,0 +1,105 @@
+//
+//  kauth_events.c
+//  kauth demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+// User space consumer of the event ring of the kext. Drains debug.kauth_demo_events in batches
+// of whole kauth_ring_record_t records, prints every record and reports debug.kauth_demo_dropped
+// whenever it grows. Runs until Ctrl-C, the kext has to be loaded.
+//
+//   cd "demos/kauth demo" && make && sudo "./kauth demo/kauth_events"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <mach/mach_time.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sysctl.h>
+#include <unistd.h>
+
+#include "kauth_ring.h"
+
+enum {
+    kBatchRecords = 64,                 // records of one read
+    kIdleMicroseconds = 100 * 1000      // sleep after a read which returned nothing
+};
+
+static volatile sig_atomic_t gStop = 0;
+
+static void HandleSignal(int sig)
+{
+    (void) sig;
+    gStop = 1;
+}
+
+static void PrintRecord(const kauth_ring_record_t *record, const mach_timebase_info_data_t *timebase, uint64_t start)
+{
+    const uint64_t ns = (record->time - start) * timebase->numer / timebase->denom;
+
+    printf("[%" PRIu64 ".%06" PRIu64 "] pid=%d uid=%u %s %s action=%s (0x%08x)%s\n",
+           ns / 1000000000, (ns / 1000) % 1000000,
+           record->pid, record->uid,
+           (record->flags & KAUTH_RING_DENIED) ? "denied" : "deferred",
+           (record->flags & KAUTH_RING_DIR) ? "dir" : "file",
+           record->action_name, record->action,
+           (record->flags & KAUTH_RING_TRUNCATED) ? " (truncated)" : "");
+    if (record->path[0] != '\0') {
+        printf("    vp=%s\n", record->path);
+    }
+    if (record->dir_path[0] != '\0') {
+        printf("    dvp=%s\n", record->dir_path);
+    }
+}
+
+int main(void)
+{
+    static kauth_ring_record_t records[kBatchRecords];
+    mach_timebase_info_data_t timebase;
+    uint64_t start = 0;
+    uint64_t dropped = 0;
+    uint64_t received = 0;
+
+    signal(SIGINT, HandleSignal);
+    signal(SIGTERM, HandleSignal);
+    mach_timebase_info(&timebase);
+
+    while (!gStop) {
+        size_t size = sizeof(records);
+        if (sysctlbyname("debug.kauth_demo_events", records, &size, NULL, 0) != 0) {
+            if (errno == EBUSY || errno == EINTR) {
+                usleep(kIdleMicroseconds);      // another consumer is draining
+                continue;
+            }
+            perror("sysctlbyname(debug.kauth_demo_events)");
+            return EXIT_FAILURE;
+        }
+
+        const size_t count = size / sizeof(*records);
+        for (size_t i = 0; i < count; i++) {
+            if (start == 0) {
+                start = records[i].time;
+            }
+            PrintRecord(&records[i], &timebase, start);
+        }
+        received += count;
+
+        uint64_t nowDropped = 0;
+        size_t droppedSize = sizeof(nowDropped);
+        if (sysctlbyname("debug.kauth_demo_dropped", &nowDropped, &droppedSize, NULL, 0) == 0 && nowDropped != dropped) {
+            printf("(%" PRIu64 " events dropped by the kext so far)\n", nowDropped);
+            dropped = nowDropped;
+        }
+        fflush(stdout);
+
+        // A full batch means there is more waiting
+        if (count < kBatchRecords) {
+            usleep(kIdleMicroseconds);
+        }
+    }
+
+    printf("%" PRIu64 " events received, %" PRIu64 " dropped\n", received, dropped);
+    return EXIT_SUCCESS;
+}
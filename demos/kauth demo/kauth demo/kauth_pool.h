@@ -0,0 +1,127 @@
+//
+//  kauth_pool.h
+//  kauth demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kauth_pool_h
+#define kauth_pool_h
+
+// Preallocated pool of fixed-size buffers (paths of the kauth listeners), so a listener does not
+// allocate for every authorization in the system (C99 with the __atomic builtins of Clang and
+// GCC, no kernel or libc dependencies, so it can be tested and measured in user space).
+//
+// The buffers are split into groups, one per CPU. A group is a bitmap of its free buffers on a
+// cache line of its own; a buffer is taken by clearing its bit with a CAS and given back by
+// setting it. The caller passes its CPU number as a hint: the group of the CPU is tried first,
+// then the others, so threads on different CPUs do not contend for the same line. The hint only
+// matters for the speed, a thread may sleep and move to another CPU while it holds a buffer.
+//
+// When all the buffers are taken kauth_pool_get() returns NULL and the caller falls back to its
+// allocator; kauth_pool_put() tells the buffers of the pool from the others.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KAUTH_POOL_CACHE_LINE   64
+#define KAUTH_POOL_MAX_GROUP    64      // buffers of a group, the bits of its bitmap
+
+typedef struct kauth_pool_group {
+    uint64_t free;                      // bit i set: buffer i of the group is free
+} __attribute__((aligned(KAUTH_POOL_CACHE_LINE))) kauth_pool_group_t;
+
+typedef struct kauth_pool {
+    kauth_pool_group_t *groups;
+    char *              buffers;        // group after group
+    uint32_t            group_count;
+    uint32_t            group_size;     // buffers per group
+    size_t              buffer_size;
+    uint64_t            misses;         // kauth_pool_get() calls which found no free buffer
+} kauth_pool_t;
+
+// Size of the memory of a pool, with the slack to align the groups
+static inline size_t kauth_pool_memory_size(uint32_t group_count, uint32_t group_size, size_t buffer_size)
+{
+    return KAUTH_POOL_CACHE_LINE + (size_t) group_count * sizeof(kauth_pool_group_t)
+         + (size_t) group_count * group_size * buffer_size;
+}
+
+// The memory is provided by the caller (kauth_pool_memory_size() bytes). The buffer size is a
+// multiple of 16 (the alignment of the buffers). Returns 0, or -1 if the parameters are not
+// usable.
+static inline int kauth_pool_init(kauth_pool_t *pool, void *memory, uint32_t group_count, uint32_t group_size, size_t buffer_size)
+{
+    uint32_t i;
+    uintptr_t base;
+
+    if (memory == NULL || group_count == 0 || group_size == 0 || group_size > KAUTH_POOL_MAX_GROUP
+        || buffer_size == 0 || buffer_size % 16 != 0) {
+        return -1;
+    }
+    base = ((uintptr_t) memory + KAUTH_POOL_CACHE_LINE - 1) & ~(uintptr_t) (KAUTH_POOL_CACHE_LINE - 1);
+    pool->groups = (kauth_pool_group_t *) base;
+    pool->buffers = (char *) (pool->groups + group_count);
+    pool->group_count = group_count;
+    pool->group_size = group_size;
+    pool->buffer_size = buffer_size;
+    pool->misses = 0;
+    for (i = 0; i < group_count; i++) {
+        pool->groups[i].free = (group_size == 64) ? UINT64_MAX : ((uint64_t) 1 << group_size) - 1;
+    }
+    return 0;
+}
+
+// A free buffer, the group of the hint (the CPU number) first. NULL if all are taken.
+static inline void *kauth_pool_get(kauth_pool_t *pool, unsigned hint)
+{
+    uint32_t group = hint % pool->group_count;
+    uint32_t tried;
+
+    for (tried = 0; tried < pool->group_count; tried++) {
+        kauth_pool_group_t *g = &pool->groups[group];
+        uint64_t free = __atomic_load_n(&g->free, __ATOMIC_RELAXED);
+        while (free != 0) {
+            const unsigned bit = (unsigned) __builtin_ctzll(free);
+            // A failed CAS reloads free
+            if (__atomic_compare_exchange_n(&g->free, &free, free & ~((uint64_t) 1 << bit), 1,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return pool->buffers + ((size_t) group * pool->group_size + bit) * pool->buffer_size;
+            }
+        }
+        if (++group == pool->group_count) {
+            group = 0;
+        }
+    }
+    __atomic_fetch_add(&pool->misses, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static inline int kauth_pool_owns(const kauth_pool_t *pool, const void *buffer)
+{
+    const char *p = (const char *) buffer;
+    return p >= pool->buffers
+        && p < pool->buffers + (size_t) pool->group_count * pool->group_size * pool->buffer_size;
+}
+
+// Returns a buffer to the pool. Returns 0, or -1 if the buffer is not from the pool (it is the
+// caller's to free then).
+static inline int kauth_pool_put(kauth_pool_t *pool, void *buffer)
+{
+    size_t index;
+
+    if (!kauth_pool_owns(pool, buffer)) {
+        return -1;
+    }
+    index = (size_t) ((char *) buffer - pool->buffers) / pool->buffer_size;
+    __atomic_fetch_or(&pool->groups[index / pool->group_size].free, (uint64_t) 1 << (index % pool->group_size),
+                      __ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline uint64_t kauth_pool_misses(const kauth_pool_t *pool)
+{
+    return __atomic_load_n(&pool->misses, __ATOMIC_RELAXED);
+}
+
+#endif /* kauth_pool_h */
@@ -0,0 +1,181 @@
+//
+//  kauth_ring.h
+//  kauth demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kauth_ring_h
+#define kauth_ring_h
+
+// Fixed-size lock-free ring of fixed-layout event records between the kauth listeners and a
+// consumer (C99 with the __atomic builtins of Clang and GCC, no kernel or libc dependencies),
+// so the algorithm can be stress tested with pthreads before it runs in the kext.
+//
+// Any number of producers, one consumer at a time (Vyukov's bounded queue). Every slot keeps a
+// sequence number next to its record:
+//   - a producer claims the position at the head with a CAS once the sequence of its slot says
+//     the slot is free (sequence == position), fills the record in place and publishes it by
+//     storing position + 1 into the sequence,
+//   - the consumer takes the records in order while their sequences say they are published and
+//     frees every slot by storing position + capacity (the position of its next lap).
+// A producer never waits: when the ring is full the record is dropped and counted. Producers
+// only share the head; a producer preempted between its claim and its publish holds back the
+// consumer at its slot, not the other producers.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef KAUTH_RING_PATH_SIZE
+#define KAUTH_RING_PATH_SIZE    1024    // MAXPATHLEN
+#endif
+#ifndef KAUTH_RING_ACTION_SIZE
+#define KAUTH_RING_ACTION_SIZE  512     // names of all the action bits
+#endif
+#define KAUTH_RING_CACHE_LINE   64
+
+// kauth_ring_record_t.flags
+enum {
+    KAUTH_RING_DIR       = 1u << 0,     // the vnode is a directory
+    KAUTH_RING_DENIED    = 1u << 1,     // the listener denied the action
+    KAUTH_RING_TRUNCATED = 1u << 2,     // a path did not fit
+};
+
+typedef struct kauth_ring_record {
+    uint64_t time;                          // producer clock (mach_absolute_time in the kext)
+    int32_t  pid;
+    uint32_t uid;
+    uint32_t action;                        // kauth_action_t
+    uint32_t flags;                         // KAUTH_RING_*
+    char     action_name[KAUTH_RING_ACTION_SIZE];
+    char     path[KAUTH_RING_PATH_SIZE];    // of the vnode, "" if none
+    char     dir_path[KAUTH_RING_PATH_SIZE];// of the parent directory vnode, "" if none
+} kauth_ring_record_t;
+
+typedef struct kauth_ring_slot {
+    uint64_t sequence;
+    kauth_ring_record_t record;
+} kauth_ring_slot_t;
+
+// The producers write the head, the consumer the tail, each on a cache line of its own
+typedef struct kauth_ring {
+    kauth_ring_slot_t *slots;
+    uint64_t mask;                                                  // capacity - 1
+    uint64_t head __attribute__((aligned(KAUTH_RING_CACHE_LINE)));  // next position to claim
+    uint64_t dropped;                                               // records lost to a full ring
+    uint64_t tail __attribute__((aligned(KAUTH_RING_CACHE_LINE)));  // next position to consume
+} kauth_ring_t;
+
+// Returns nonzero to stop the consumption, the record is left in the ring then
+typedef int (*kauth_ring_fn)(void *ctx, const kauth_ring_record_t *record);
+
+// Size of the slots of a ring of capacity records
+static inline size_t kauth_ring_slots_size(uint32_t capacity)
+{
+    return (size_t) capacity * sizeof(kauth_ring_slot_t);
+}
+
+// The slots are provided by the caller (kauth_ring_slots_size() bytes). The capacity is a power
+// of two. Called before the producers and the consumer start. Returns 0, or -1 if the capacity
+// is not usable.
+static inline int kauth_ring_init(kauth_ring_t *ring, kauth_ring_slot_t *slots, uint32_t capacity)
+{
+    uint32_t i;
+
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0 || slots == NULL) {
+        return -1;
+    }
+    for (i = 0; i < capacity; i++) {
+        slots[i].sequence = i;
+    }
+    ring->slots = slots;
+    ring->mask = capacity - 1;
+    ring->head = 0;
+    ring->dropped = 0;
+    ring->tail = 0;
+    return 0;
+}
+
+// Claims the next slot, NULL if the ring is full. The record must be filled and passed to
+// kauth_ring_publish() with the position, without sleeping in between.
+static inline kauth_ring_record_t *kauth_ring_claim(kauth_ring_t *ring, uint64_t *position)
+{
+    uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    kauth_ring_slot_t *slot;
+
+    for (;;) {
+        slot = &ring->slots[pos & ring->mask];
+        const uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        const int64_t diff = (int64_t) (sequence - pos);
+        if (diff == 0) {
+            // A failed CAS reloads pos
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The slot still holds the record of the previous lap
+            __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        } else {
+            // Another producer claimed it meanwhile
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+    *position = pos;
+    return &slot->record;
+}
+
+static inline void kauth_ring_publish(kauth_ring_t *ring, uint64_t position)
+{
+    __atomic_store_n(&ring->slots[position & ring->mask].sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+// Passes up to max published records in order to fn and frees their slots. Returns the number
+// of consumed records. Only one consumer may run at a time.
+static inline size_t kauth_ring_consume(kauth_ring_t *ring, size_t max, kauth_ring_fn fn, void *ctx)
+{
+    uint64_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    size_t count = 0;
+
+    while (count < max) {
+        kauth_ring_slot_t *slot = &ring->slots[pos & ring->mask];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;          // not published yet
+        }
+        if (fn(ctx, &slot->record) != 0) {
+            break;
+        }
+        __atomic_store_n(&slot->sequence, pos + ring->mask + 1, __ATOMIC_RELEASE);
+        pos++;
+        count++;
+    }
+    __atomic_store_n(&ring->tail, pos, __ATOMIC_RELAXED);
+    return count;
+}
+
+static inline uint64_t kauth_ring_dropped(const kauth_ring_t *ring)
+{
+    return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
+
+// Records claimed but not consumed yet (a snapshot)
+static inline uint64_t kauth_ring_count(const kauth_ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
+
+// Copies a string into a record field, returns nonzero if it was truncated
+static inline int kauth_ring_copy_path(char *field, const char *path)
+{
+    size_t i = 0;
+
+    if (path != NULL) {
+        for (; i < KAUTH_RING_PATH_SIZE - 1 && path[i] != '\0'; i++) {
+            field[i] = path[i];
+        }
+    }
+    field[i] = '\0';
+    return path != NULL && path[i] != '\0';
+}
+
+#endif /* kauth_ring_h */
@@ -0,0 +1,72 @@
+//
+//  kdbg_compat.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_compat_h
+#define kdbg_compat_h
+
+// kdebug types and constants for the components of the demo. On macOS they come from the
+// private xnu headers, elsewhere (Linux) the 64-bit layout of xnu-6153 is replicated so the
+// components can be driven by synthetic kd_buf sources.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__APPLE__)
+
+struct proc;
+
+#define PRIVATE
+#define KERNEL_PRIVATE
+#include <sys_private/kdebug_private.h>
+#undef KERNEL_PRIVATE
+#undef PRIVATE
+
+#else
+
+typedef struct {
+    uint64_t  timestamp;
+    uintptr_t arg1;
+    uintptr_t arg2;
+    uintptr_t arg3;
+    uintptr_t arg4;
+    uintptr_t arg5;     // thread ID
+    uint32_t  debugid;
+    uint32_t  cpuid;
+    uintptr_t unused;
+} kd_buf;
+
+typedef struct {
+    int nkdbufs;
+    int nolog;
+    unsigned int flags;
+    int nkdthreads;
+    int bufid;
+} kbufinfo_t;
+
+#define KDBG_TIMESTAMP_MASK     0x00ffffffffffffffULL
+#define KDBG_CLASS_MASK         0xff000000u
+#define KDBG_CSC_MASK           0xffff0000u
+#define KDBG_FUNC_MASK          0xfffffffcu
+#define KDBG_WRAPPED            0x008
+
+#define DBG_FUNC_START          1u
+#define DBG_FUNC_END            2u
+
+#define DBG_TRACE               7
+#define DBG_TRACE_DATA          0
+#define DBG_TRACE_STRING        1
+#define DBG_TRACE_INFO          2
+
+#define KDBG_CODE(Class, SubClass, code) \
+    ((((Class) & 0xff) << 24) | (((SubClass) & 0xff) << 16) | (((code) & 0x3fff) << 2))
+#define TRACEDBG_CODE(SubClass, code)   KDBG_CODE(DBG_TRACE, SubClass, code)
+
+#define TRACE_LOST_EVENTS       TRACEDBG_CODE(DBG_TRACE_INFO, 2)
+
+#endif /* __APPLE__ */
+
+#endif /* kdbg_compat_h */
@@ -0,0 +1,242 @@
+//
+//  kdbg_consumer.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_consumer_h
+#define kdbg_consumer_h
+
+// Streaming consumer of the kdebug trace buffer (C99).
+//
+// Every poll queries the buffer state, reads all the available entries into a user space buffer
+// and hands them to a callback as one batch. The poll interval and the buffer size follow the
+// observed event rate: the interval aims at reading the buffer when it is about half full, when
+// it can not be shortened anymore and the buffer still overflows the buffer is doubled. Wraps
+// (KDBG_WRAPPED) and TRACE_LOST_EVENTS markers are reported with the batch.
+//
+// The kernel is accessed through kdbg_source_t (sysctl on macOS), so synthetic sources can
+// drive the consumer elsewhere.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "kdbg_compat.h"
+
+// Functions return 0 on success, -1 and errno otherwise
+typedef struct kdbg_source {
+    void *ctx;
+    int (*get_info)(void *ctx, kbufinfo_t *info);
+    // count: capacity of events on input, number of read entries on output
+    int (*read)(void *ctx, kd_buf *events, size_t *count);
+    // Resizes the trace buffer (entries), NULL if the source can not be resized
+    int (*resize)(void *ctx, size_t entries);
+    // Monotonic time in nanoseconds, NULL for CLOCK_MONOTONIC
+    uint64_t (*now_ns)(void *ctx);
+} kdbg_source_t;
+
+typedef struct kdbg_batch_info {
+    uint64_t sequence;          // number of the batch
+    uint64_t first_event;       // number of the first event of the batch in the stream
+    int      wrapped;           // the trace buffer wrapped since the last poll, events were lost
+    size_t   lost_markers;      // TRACE_LOST_EVENTS entries in the batch
+    size_t   capacity;          // current buffer size (entries)
+    uint32_t interval_us;       // poll interval which preceded the batch
+} kdbg_batch_info_t;
+
+typedef void (*kdbg_batch_fn)(void *ctx, const kd_buf *events, size_t count, const kdbg_batch_info_t *info);
+
+typedef struct kdbg_consumer_config {
+    size_t   min_capacity;      // entries
+    size_t   max_capacity;
+    uint32_t min_interval_us;
+    uint32_t max_interval_us;
+} kdbg_consumer_config_t;
+
+#define KDBG_CONSUMER_CONFIG_DEFAULT { 16384, 4 * 1024 * 1024, 1000, 250000 }
+
+typedef struct kdbg_consumer {
+    kdbg_source_t source;
+    kdbg_consumer_config_t config;
+    kd_buf  *buffer;
+    size_t   capacity;
+    uint32_t interval_us;
+    double   rate;              // events per second, moving average
+    uint64_t last_poll_ns;
+    unsigned quiet_polls;       // consecutive polls which used less than 1/16 of the buffer
+
+    // Statistics
+    uint64_t events;
+    uint64_t batches;
+    uint64_t wraps;
+    uint64_t lost_markers;
+    uint64_t resizes;
+} kdbg_consumer_t;
+
+static inline uint64_t kdbg_consumer_now(const kdbg_consumer_t *c)
+{
+    struct timespec ts;
+
+    if (c->source.now_ns)
+        return c->source.now_ns(c->source.ctx);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Resizes the trace and the user space buffer. Returns 0 on success, -1 and errno otherwise
+// (the consumer keeps the old buffers then).
+static inline int kdbg_consumer_set_capacity(kdbg_consumer_t *c, size_t capacity)
+{
+    kd_buf *buffer;
+
+    if (capacity == c->capacity)
+        return 0;
+    if (c->source.resize && c->source.resize(c->source.ctx, capacity) != 0)
+        return -1;
+
+    buffer = (kd_buf *) realloc(c->buffer, capacity * sizeof(kd_buf));
+    if (buffer == NULL)
+        return -1;
+    c->buffer = buffer;
+    c->capacity = capacity;
+    c->resizes++;
+    return 0;
+}
+
+// The source is copied. Returns 0 on success, -1 and errno otherwise.
+static inline int kdbg_consumer_init(kdbg_consumer_t *c, const kdbg_source_t *source, const kdbg_consumer_config_t *config)
+{
+    const kdbg_consumer_config_t defaults = KDBG_CONSUMER_CONFIG_DEFAULT;
+
+    memset(c, 0, sizeof(*c));
+    c->source = *source;
+    c->config = config ? *config : defaults;
+    if (c->config.min_capacity == 0 || c->config.max_capacity < c->config.min_capacity
+        || c->config.min_interval_us == 0 || c->config.max_interval_us < c->config.min_interval_us) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    c->interval_us = c->config.min_interval_us;
+    if (kdbg_consumer_set_capacity(c, c->config.min_capacity) != 0)
+        return -1;
+    c->resizes = 0;
+    c->last_poll_ns = kdbg_consumer_now(c);
+    return 0;
+}
+
+static inline void kdbg_consumer_destroy(kdbg_consumer_t *c)
+{
+    free(c->buffer);
+    c->buffer = NULL;
+    c->capacity = 0;
+}
+
+// Updates the rate estimate, the poll interval and the buffer size after a poll
+static inline void kdbg_consumer_adapt(kdbg_consumer_t *c, size_t count, int wrapped, uint64_t elapsed_ns)
+{
+    const kdbg_consumer_config_t *cfg = &c->config;
+    double interval;
+
+    if (elapsed_ns == 0)
+        elapsed_ns = 1;
+    c->rate = (c->batches <= 1) ? count * 1e9 / elapsed_ns : 0.5 * c->rate + 0.5 * (count * 1e9 / elapsed_ns);
+
+    if (wrapped || count * 4 >= c->capacity * 3) {
+        // Overflowing: poll more often, grow the buffer once polling can not keep up
+        if (c->interval_us > cfg->min_interval_us && !wrapped) {
+            c->interval_us = (c->interval_us / 2 < cfg->min_interval_us) ? cfg->min_interval_us : c->interval_us / 2;
+            return;
+        }
+        c->interval_us = cfg->min_interval_us;
+        if (c->capacity < cfg->max_capacity)
+            kdbg_consumer_set_capacity(c, (c->capacity * 2 > cfg->max_capacity) ? cfg->max_capacity : c->capacity * 2);
+        c->quiet_polls = 0;
+        return;
+    }
+
+    // Read when the buffer is about half full
+    interval = (c->rate > 0) ? 0.5 * c->capacity / c->rate * 1e6 : cfg->max_interval_us;
+    if (interval < cfg->min_interval_us)
+        interval = cfg->min_interval_us;
+    if (interval > cfg->max_interval_us)
+        interval = cfg->max_interval_us;
+    c->interval_us = (uint32_t) interval;
+
+    // Give the memory back once the rate drops for a while
+    c->quiet_polls = (count * 16 < c->capacity) ? c->quiet_polls + 1 : 0;
+    if (c->quiet_polls >= 16 && c->capacity > cfg->min_capacity && c->interval_us == cfg->max_interval_us) {
+        kdbg_consumer_set_capacity(c, (c->capacity / 2 < cfg->min_capacity) ? cfg->min_capacity : c->capacity / 2);
+        c->quiet_polls = 0;
+    }
+}
+
+// Reads the available entries and passes them to fn (also empty batches, so the callback can
+// report wraps). Returns the number of entries or -1 and errno.
+static inline ssize_t kdbg_consumer_poll(kdbg_consumer_t *c, kdbg_batch_fn fn, void *ctx)
+{
+    kbufinfo_t info;
+    kdbg_batch_info_t batch;
+    size_t count = c->capacity;
+    uint64_t now;
+    int wrapped;
+
+    memset(&info, 0, sizeof(info));
+    if (c->source.get_info(c->source.ctx, &info) != 0)
+        return -1;
+    wrapped = (info.flags & KDBG_WRAPPED) != 0;
+
+    if (c->source.read(c->source.ctx, c->buffer, &count) != 0)
+        return -1;
+    if (count > c->capacity)
+        count = c->capacity;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.sequence = c->batches++;
+    batch.first_event = c->events;
+    batch.wrapped = wrapped;
+    for (size_t i = 0; i < count; i++)
+        if ((c->buffer[i].debugid & KDBG_FUNC_MASK) == TRACE_LOST_EVENTS)
+            batch.lost_markers++;
+
+    c->events += count;
+    c->wraps += wrapped ? 1 : 0;
+    c->lost_markers += batch.lost_markers;
+
+    // The batch is delivered before adapting, the buffer may be reallocated
+    now = kdbg_consumer_now(c);
+    batch.capacity = c->capacity;
+    batch.interval_us = c->interval_us;
+    fn(ctx, c->buffer, count, &batch);
+
+    kdbg_consumer_adapt(c, count, wrapped || batch.lost_markers, now - c->last_poll_ns);
+    c->last_poll_ns = now;
+    return (ssize_t) count;
+}
+
+// Polls until *stop is set (never if stop is NULL) or the source fails, a signal handler can set
+// it. Returns 0 when stopped, -1 and errno on failure.
+static inline int kdbg_consumer_run(kdbg_consumer_t *c, kdbg_batch_fn fn, void *ctx, volatile sig_atomic_t *stop)
+{
+    while (stop == NULL || !*stop) {
+        struct timespec interval;
+
+        if (kdbg_consumer_poll(c, fn, ctx) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        interval.tv_sec = c->interval_us / 1000000;
+        interval.tv_nsec = (long) (c->interval_us % 1000000) * 1000;
+        nanosleep(&interval, NULL);
+    }
+    return 0;
+}
+
+#endif /* kdbg_consumer_h */
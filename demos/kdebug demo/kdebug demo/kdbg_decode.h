@@ -0,0 +1,312 @@
+//
+//  kdbg_decode.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_decode_h
+#define kdbg_decode_h
+
+// Batch decoder of kd_buf arrays into columns (C99).
+//
+// Every entry is split into its timestamp, thread, first argument, event ID (debugid without the function
+// qualifier), class, subclass, qualifier (DBG_FUNC_START/END) and CPU. Entries whose class and
+// subclass are not in the filter bitmap are dropped in the same pass, the columns hold only the
+// accepted entries.
+//
+// x86-64 builds pick AVX2 (with BMI2 for the compaction) or SSE4.1 at run time, other
+// architectures use the scalar decoder. All the decoders produce identical columns.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kdbg_compat.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KDBG_DECODE_X86 1
+#include <immintrin.h>
+#endif
+
+// Decoders write whole vectors, the columns have room for this many entries behind capacity
+#define KDBG_COLUMNS_SLACK 8
+
+typedef struct kdbg_columns {
+    size_t    count;        // decoded entries
+    size_t    capacity;
+    uint64_t *timestamp;    // KDBG_TIMESTAMP_MASK applied
+    uint64_t *thread;       // arg5
+    uint64_t *arg1;
+    uint32_t *eventid;      // debugid & KDBG_FUNC_MASK
+    uint32_t *cpu;
+    uint8_t  *class_;
+    uint8_t  *subclass;
+    uint8_t  *qualifier;    // DBG_FUNC_START, DBG_FUNC_END, both or none
+} kdbg_columns_t;
+
+// Bit (class << 8 | subclass) is set for accepted entries
+typedef struct kdbg_class_filter {
+    uint64_t bits[65536 / 64];
+} kdbg_class_filter_t;
+
+static inline void kdbg_class_filter_clear(kdbg_class_filter_t *f)
+{
+    memset(f->bits, 0, sizeof(f->bits));
+}
+
+static inline void kdbg_class_filter_add_subclass(kdbg_class_filter_t *f, uint8_t class_, uint8_t subclass)
+{
+    const unsigned key = (unsigned) class_ << 8 | subclass;
+    f->bits[key / 64] |= 1ull << (key % 64);
+}
+
+static inline void kdbg_class_filter_add_class(kdbg_class_filter_t *f, uint8_t class_)
+{
+    // The 256 subclasses of a class are 4 whole words
+    memset(&f->bits[(unsigned) class_ * 4], 0xff, 4 * sizeof(uint64_t));
+}
+
+static inline int kdbg_class_filter_test(const kdbg_class_filter_t *f, uint32_t debugid)
+{
+    const uint32_t key = debugid >> 16;
+    return (int) ((f->bits[key / 64] >> (key % 64)) & 1);
+}
+
+static inline void kdbg_columns_init(kdbg_columns_t *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+static inline void kdbg_columns_destroy(kdbg_columns_t *c)
+{
+    free(c->timestamp);
+    free(c->thread);
+    free(c->arg1);
+    free(c->eventid);
+    free(c->cpu);
+    free(c->class_);
+    free(c->subclass);
+    free(c->qualifier);
+    kdbg_columns_init(c);
+}
+
+static inline void *kdbg_columns_grow(void *column, size_t entries, size_t size)
+{
+    return realloc(column, (entries + KDBG_COLUMNS_SLACK) * size);
+}
+
+// Makes room for capacity entries, the decoded entries are kept. Returns 0 on success, -1 otherwise.
+static inline int kdbg_columns_reserve(kdbg_columns_t *c, size_t capacity)
+{
+    void *p;
+
+    if (capacity <= c->capacity)
+        return 0;
+
+#define KDBG_COLUMNS_GROW(column) \
+    if ((p = kdbg_columns_grow(c->column, capacity, sizeof(*c->column))) == NULL) \
+        return -1; \
+    c->column = p;
+
+    KDBG_COLUMNS_GROW(timestamp)
+    KDBG_COLUMNS_GROW(thread)
+    KDBG_COLUMNS_GROW(arg1)
+    KDBG_COLUMNS_GROW(eventid)
+    KDBG_COLUMNS_GROW(cpu)
+    KDBG_COLUMNS_GROW(class_)
+    KDBG_COLUMNS_GROW(subclass)
+    KDBG_COLUMNS_GROW(qualifier)
+#undef KDBG_COLUMNS_GROW
+
+    c->capacity = capacity;
+    return 0;
+}
+
+// Decodes one entry to index j of the columns
+static inline void kdbg_decode_entry(const kd_buf *kd, kdbg_columns_t *out, size_t j)
+{
+    const uint32_t debugid = kd->debugid;
+    out->timestamp[j] = kd->timestamp & KDBG_TIMESTAMP_MASK;
+    out->thread[j] = kd->arg5;
+    out->arg1[j] = kd->arg1;
+    out->eventid[j] = debugid & KDBG_FUNC_MASK;
+    out->cpu[j] = kd->cpuid;
+    out->class_[j] = (uint8_t) (debugid >> 24);
+    out->subclass[j] = (uint8_t) (debugid >> 16);
+    out->qualifier[j] = (uint8_t) (debugid & (DBG_FUNC_START | DBG_FUNC_END));
+}
+
+// The decoders append the accepted entries of in[0, n) to out (filter NULL accepts all of them)
+// and return their number. out must have room for out->count + n entries.
+static inline size_t kdbg_decode_scalar(const kd_buf *in, size_t n, const kdbg_class_filter_t *filter, kdbg_columns_t *out)
+{
+    size_t j = out->count;
+
+    // Rejected entries are overwritten by the next one, no branch on the filter
+    for (size_t i = 0; i < n; i++) {
+        kdbg_decode_entry(&in[i], out, j);
+        j += filter ? (size_t) kdbg_class_filter_test(filter, in[i].debugid) : 1;
+    }
+
+    n = j - out->count;
+    out->count = j;
+    return n;
+}
+
+#if defined(KDBG_DECODE_X86)
+
+__attribute__((target("sse4.1")))
+static inline size_t kdbg_decode_sse41(const kd_buf *in, size_t n, const kdbg_class_filter_t *filter, kdbg_columns_t *out)
+{
+    // pshufb masks moving the 32-bit lanes selected by a 4-bit mask to the front
+    static const uint8_t compact[16][16] = {
+#define L(x) (4 * (x)), (4 * (x) + 1), (4 * (x) + 2), (4 * (x) + 3)
+        { L(0), L(0), L(0), L(0) }, { L(0), L(0), L(0), L(0) }, { L(1), L(0), L(0), L(0) }, { L(0), L(1), L(0), L(0) },
+        { L(2), L(0), L(0), L(0) }, { L(0), L(2), L(0), L(0) }, { L(1), L(2), L(0), L(0) }, { L(0), L(1), L(2), L(0) },
+        { L(3), L(0), L(0), L(0) }, { L(0), L(3), L(0), L(0) }, { L(1), L(3), L(0), L(0) }, { L(0), L(1), L(3), L(0) },
+        { L(2), L(3), L(0), L(0) }, { L(0), L(2), L(3), L(0) }, { L(1), L(2), L(3), L(0) }, { L(0), L(1), L(2), L(3) },
+#undef L
+    };
+    const __m128i funcMask = _mm_set1_epi32((int) KDBG_FUNC_MASK);
+    const __m128i qualifierMask = _mm_set1_epi32(DBG_FUNC_START | DBG_FUNC_END);
+    // Byte 3 (class), 2 (subclass) and 0 (qualifier) of the four lanes
+    const __m128i classBytes = _mm_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i subclassBytes = _mm_setr_epi8(2, 6, 10, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i qualifierBytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const size_t start = out->count;
+    size_t i = 0, j = start;
+
+    for (; i + 4 <= n; i += 4) {
+        const kd_buf *kd = in + i;
+        unsigned mask = 0xf;
+        __m128i debugid, cpu, shuffle;
+        int32_t bytes;
+
+        if (filter)
+            mask = (unsigned) kdbg_class_filter_test(filter, kd[0].debugid)
+                 | (unsigned) kdbg_class_filter_test(filter, kd[1].debugid) << 1
+                 | (unsigned) kdbg_class_filter_test(filter, kd[2].debugid) << 2
+                 | (unsigned) kdbg_class_filter_test(filter, kd[3].debugid) << 3;
+
+        shuffle = _mm_loadu_si128((const __m128i *) compact[mask]);
+        debugid = _mm_shuffle_epi8(_mm_setr_epi32((int) kd[0].debugid, (int) kd[1].debugid, (int) kd[2].debugid, (int) kd[3].debugid), shuffle);
+        cpu = _mm_shuffle_epi8(_mm_setr_epi32((int) kd[0].cpuid, (int) kd[1].cpuid, (int) kd[2].cpuid, (int) kd[3].cpuid), shuffle);
+
+        _mm_storeu_si128((__m128i *) &out->eventid[j], _mm_and_si128(debugid, funcMask));
+        _mm_storeu_si128((__m128i *) &out->cpu[j], cpu);
+        bytes = _mm_cvtsi128_si32(_mm_shuffle_epi8(debugid, classBytes));
+        memcpy(&out->class_[j], &bytes, 4);
+        bytes = _mm_cvtsi128_si32(_mm_shuffle_epi8(debugid, subclassBytes));
+        memcpy(&out->subclass[j], &bytes, 4);
+        bytes = _mm_cvtsi128_si32(_mm_shuffle_epi8(_mm_and_si128(debugid, qualifierMask), qualifierBytes));
+        memcpy(&out->qualifier[j], &bytes, 4);
+
+        // 64-bit columns, rejected entries are overwritten
+        for (size_t k = 0, m = j; k < 4; k++) {
+            out->timestamp[m] = kd[k].timestamp & KDBG_TIMESTAMP_MASK;
+            out->thread[m] = kd[k].arg5;
+            out->arg1[m] = kd[k].arg1;
+            m += (mask >> k) & 1;
+        }
+        j += (size_t) __builtin_popcount(mask);
+    }
+
+    out->count = j;
+    kdbg_decode_scalar(in + i, n - i, filter, out);
+    return out->count - start;
+}
+
+__attribute__((target("avx2,bmi2")))
+static inline size_t kdbg_decode_avx2(const kd_buf *in, size_t n, const kdbg_class_filter_t *filter, kdbg_columns_t *out)
+{
+    const __m256i stride = _mm256_setr_epi32(0, 64, 128, 192, 256, 320, 384, 448); // sizeof(kd_buf)
+    const __m256i funcMask = _mm256_set1_epi32((int) KDBG_FUNC_MASK);
+    const __m256i qualifierMask = _mm256_set1_epi32(DBG_FUNC_START | DBG_FUNC_END);
+    const __m256i timestampMask = _mm256_set1_epi64x((long long) KDBG_TIMESTAMP_MASK);
+    const __m256i bitMask = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lowDwords = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+    const __m256i classBytes = _mm256_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i subclassBytes = _mm256_setr_epi8(2, 6, 10, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                   2, 6, 10, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i qualifierBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                                    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const char *base = (const char *) in;
+    const size_t start = out->count;
+    size_t i = 0, j = start;
+
+    for (; i + 8 <= n; i += 8) {
+        const char *kd = base + i * sizeof(kd_buf);
+        __m256i debugid, offsets;
+        unsigned mask = 0xff;
+
+        debugid = _mm256_i32gather_epi32((const int *) (kd + offsetof(kd_buf, debugid)), stride, 1);
+        if (filter) {
+            // Bit (debugid >> 16) of the bitmap, read as 32-bit words
+            const __m256i key = _mm256_srli_epi32(debugid, 16);
+            const __m256i words = _mm256_i32gather_epi32((const int *) filter->bits, _mm256_srli_epi32(key, 5), 4);
+            const __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(key, bitMask)), one);
+            mask = (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, one)));
+        }
+
+        // Offsets of the accepted entries moved to the front: the indices of the set mask bits
+        // are extracted from 0x76543210 (one byte per lane)
+        {
+            const uint64_t expanded = _pdep_u64(mask, 0x0101010101010101ull) * 0xff;
+            const uint64_t lanes = _pext_u64(0x0706050403020100ull, expanded);
+            const __m256i permutation = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long) lanes));
+            debugid = _mm256_permutevar8x32_epi32(debugid, permutation);
+            offsets = _mm256_permutevar8x32_epi32(stride, permutation);
+        }
+
+        _mm256_storeu_si256((__m256i *) &out->eventid[j], _mm256_and_si256(debugid, funcMask));
+        _mm256_storeu_si256((__m256i *) &out->cpu[j],
+                            _mm256_i32gather_epi32((const int *) (kd + offsetof(kd_buf, cpuid)), offsets, 1));
+        _mm_storel_epi64((__m128i *) &out->class_[j],
+                         _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(debugid, classBytes), lowDwords)));
+        _mm_storel_epi64((__m128i *) &out->subclass[j],
+                         _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(debugid, subclassBytes), lowDwords)));
+        _mm_storel_epi64((__m128i *) &out->qualifier[j],
+                         _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(
+                             _mm256_shuffle_epi8(_mm256_and_si256(debugid, qualifierMask), qualifierBytes), lowDwords)));
+
+        {
+            const __m128i low = _mm256_castsi256_si128(offsets);
+            const __m128i high = _mm256_extracti128_si256(offsets, 1);
+            const long long *timestamp = (const long long *) (kd + offsetof(kd_buf, timestamp));
+            const long long *thread = (const long long *) (kd + offsetof(kd_buf, arg5));
+            const long long *arg1 = (const long long *) (kd + offsetof(kd_buf, arg1));
+
+            _mm256_storeu_si256((__m256i *) &out->timestamp[j], _mm256_and_si256(_mm256_i32gather_epi64(timestamp, low, 1), timestampMask));
+            _mm256_storeu_si256((__m256i *) &out->timestamp[j + 4], _mm256_and_si256(_mm256_i32gather_epi64(timestamp, high, 1), timestampMask));
+            _mm256_storeu_si256((__m256i *) &out->thread[j], _mm256_i32gather_epi64(thread, low, 1));
+            _mm256_storeu_si256((__m256i *) &out->thread[j + 4], _mm256_i32gather_epi64(thread, high, 1));
+            _mm256_storeu_si256((__m256i *) &out->arg1[j], _mm256_i32gather_epi64(arg1, low, 1));
+            _mm256_storeu_si256((__m256i *) &out->arg1[j + 4], _mm256_i32gather_epi64(arg1, high, 1));
+        }
+        j += (size_t) __builtin_popcount(mask);
+    }
+
+    out->count = j;
+    kdbg_decode_scalar(in + i, n - i, filter, out);
+    return out->count - start;
+}
+
+#endif /* KDBG_DECODE_X86 */
+
+// Decodes with the best decoder the CPU supports, see kdbg_decode_scalar()
+static inline size_t kdbg_decode(const kd_buf *in, size_t n, const kdbg_class_filter_t *filter, kdbg_columns_t *out)
+{
+#if defined(KDBG_DECODE_X86)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        return kdbg_decode_avx2(in, n, filter, out);
+    if (__builtin_cpu_supports("sse4.1"))
+        return kdbg_decode_sse41(in, n, filter, out);
+#endif
+    return kdbg_decode_scalar(in, n, filter, out);
+}
+
+#endif /* kdbg_decode_h */
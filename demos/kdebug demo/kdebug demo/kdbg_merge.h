@@ -0,0 +1,320 @@
+//
+//  kdbg_merge.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_merge_h
+#define kdbg_merge_h
+
+// Per-CPU ordered merge of kd_buf entries (C99).
+//
+// Entries are buffered per CPU (kd_buf.cpuid, the timestamp does not carry the CPU on 64-bit
+// kernels) and merged into one time-ordered stream by a loser tree of (timestamp, CPU) keys.
+// An entry is emitted only once the newest timestamp seen is more than the reorder window ahead
+// of it, so CPUs whose entries arrive later still get merged in order. Entries older than the
+// last emitted one arrived too late: they are counted and passed to the late callback (if any)
+// instead.
+//
+// The number of buffered entries is bounded: once max_buffered is reached, the oldest entries
+// are emitted regardless of the window (counted as forced).
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kdbg_compat.h"
+
+#define KDBG_MERGE_MAX_CPUS     256
+#define KDBG_MERGE_BATCH        4096
+
+typedef void (*kdbg_merge_fn)(void *ctx, const kd_buf *events, size_t count);
+
+// Key of a leaf of the loser tree: the timestamp of the head entry of a CPU and the CPU. Leaves
+// without entries are flagged instead of using a sentinel timestamp, every timestamp is valid.
+typedef struct kdbg_merge_key {
+    uint64_t time;
+    uint32_t leaf;
+    uint32_t empty;
+} kdbg_merge_key_t;
+
+typedef struct kdbg_merge_config {
+    unsigned cpus;              // initial number of CPUs, more are added when seen
+    uint64_t window;            // reorder window in timestamp units
+    size_t   max_buffered;      // entries
+} kdbg_merge_config_t;
+
+// 8 CPUs, 10 ms with nanosecond timestamps, 1Mi entries (64 MB)
+#define KDBG_MERGE_CONFIG_DEFAULT { 8, 10000000ull, 1024 * 1024 }
+
+typedef struct kdbg_merge_queue {
+    kd_buf *entries;            // ring buffer ordered by timestamp
+    size_t  head;
+    size_t  count;
+    size_t  mask;               // capacity - 1, 0 before the first entry
+} kdbg_merge_queue_t;
+
+typedef struct kdbg_merge {
+    kdbg_merge_config_t config;
+    kdbg_merge_queue_t *queues;
+    unsigned queue_count;
+    unsigned leaves;            // power of two >= queue_count
+    kdbg_merge_key_t *tree;     // tree[0] is the winner, tree[1, leaves) the losers
+    uint64_t newest;            // newest timestamp seen
+    uint64_t last_emitted;
+    size_t   buffered;
+    kd_buf  *out;               // output batch
+    size_t   out_count;
+
+    // Statistics
+    uint64_t emitted;
+    uint64_t late;
+    uint64_t forced;
+    uint64_t reordered;         // entries older than the previous entry of their CPU
+    size_t   peak_buffered;
+} kdbg_merge_t;
+
+static inline uint64_t kdbg_merge_time(const kd_buf *kd)
+{
+    return kd->timestamp & KDBG_TIMESTAMP_MASK;
+}
+
+// Leaves without entries lose to all others
+static inline kdbg_merge_key_t kdbg_merge_key(const kdbg_merge_t *m, unsigned leaf)
+{
+    kdbg_merge_key_t key;
+
+    key.leaf = leaf;
+    key.empty = !(leaf < m->queue_count && m->queues[leaf].count);
+    key.time = key.empty ? 0 : kdbg_merge_time(&m->queues[leaf].entries[m->queues[leaf].head]);
+    return key;
+}
+
+// Orders the keys by (empty, time, leaf), ties of the timestamps go to the lower CPU
+static inline int kdbg_merge_less(kdbg_merge_key_t a, kdbg_merge_key_t b)
+{
+    if (a.empty != b.empty)
+        return a.empty < b.empty;
+    if (a.time != b.time)
+        return a.time < b.time;
+    return a.leaf < b.leaf;
+}
+
+static inline void kdbg_merge_build(kdbg_merge_t *m)
+{
+    // winners[n] is the winner of the subtree n, leaves are nodes [leaves, 2 * leaves)
+    kdbg_merge_key_t winners[2 * KDBG_MERGE_MAX_CPUS];
+
+    for (unsigned i = 0; i < m->leaves; i++)
+        winners[m->leaves + i] = kdbg_merge_key(m, i);
+    for (unsigned n = m->leaves - 1; n >= 1; n--) {
+        const kdbg_merge_key_t a = winners[2 * n], b = winners[2 * n + 1];
+        const int a_wins = kdbg_merge_less(a, b);
+        winners[n] = a_wins ? a : b;
+        m->tree[n] = a_wins ? b : a;
+    }
+    m->tree[0] = winners[1];
+}
+
+// The key of the leaf changed, replays the matches on its path to the root
+static inline void kdbg_merge_replay(kdbg_merge_t *m, unsigned leaf, kdbg_merge_key_t key)
+{
+    for (unsigned n = (m->leaves + leaf) / 2; n >= 1; n /= 2) {
+        const kdbg_merge_key_t other = m->tree[n];
+        if (kdbg_merge_less(other, key)) {
+            m->tree[n] = key;
+            key = other;
+        }
+    }
+    m->tree[0] = key;
+}
+
+// Returns 0 on success, -1 if the memory can not be allocated
+static inline int kdbg_merge_resize(kdbg_merge_t *m, unsigned cpus)
+{
+    unsigned leaves = 2;
+    kdbg_merge_queue_t *queues;
+
+    while (leaves < cpus)
+        leaves *= 2;
+
+    queues = (kdbg_merge_queue_t *) realloc(m->queues, cpus * sizeof(*queues));
+    if (queues == NULL)
+        return -1;
+    memset(queues + m->queue_count, 0, (cpus - m->queue_count) * sizeof(*queues));
+    m->queues = queues;
+    m->queue_count = cpus;
+
+    if (leaves != m->leaves) {
+        kdbg_merge_key_t *tree = (kdbg_merge_key_t *) realloc(m->tree, leaves * sizeof(*tree));
+        if (tree == NULL)
+            return -1;
+        m->tree = tree;
+        m->leaves = leaves;
+    }
+    kdbg_merge_build(m);
+    return 0;
+}
+
+static inline int kdbg_merge_init(kdbg_merge_t *m, const kdbg_merge_config_t *config)
+{
+    const kdbg_merge_config_t defaults = KDBG_MERGE_CONFIG_DEFAULT;
+
+    memset(m, 0, sizeof(*m));
+    m->config = config ? *config : defaults;
+    if (m->config.cpus == 0)
+        m->config.cpus = 1;
+    if (m->config.cpus > KDBG_MERGE_MAX_CPUS)
+        m->config.cpus = KDBG_MERGE_MAX_CPUS;
+    if (m->config.max_buffered == 0)
+        m->config.max_buffered = 1;
+
+    m->out = (kd_buf *) malloc(KDBG_MERGE_BATCH * sizeof(kd_buf));
+    if (m->out == NULL || kdbg_merge_resize(m, m->config.cpus) != 0)
+        return -1;
+    return 0;
+}
+
+static inline void kdbg_merge_destroy(kdbg_merge_t *m)
+{
+    for (unsigned i = 0; i < m->queue_count; i++)
+        free(m->queues[i].entries);
+    free(m->queues);
+    free(m->tree);
+    free(m->out);
+    memset(m, 0, sizeof(*m));
+}
+
+static inline void kdbg_merge_output(kdbg_merge_t *m, kdbg_merge_fn fn, void *ctx)
+{
+    if (m->out_count) {
+        fn(ctx, m->out, m->out_count);
+        m->out_count = 0;
+    }
+}
+
+// Emits the entries up to the timestamp limit (inclusive) in time order
+static inline void kdbg_merge_emit(kdbg_merge_t *m, uint64_t limit, kdbg_merge_fn fn, void *ctx)
+{
+    kdbg_merge_build(m);
+    for (;;) {
+        const uint64_t time = m->tree[0].time;
+        const unsigned cpu = m->tree[0].leaf;
+        kdbg_merge_queue_t *q = &m->queues[cpu];
+
+        // The winner is empty only once all the queues are
+        if (m->tree[0].empty || time > limit)
+            break;
+
+        if (m->out_count == KDBG_MERGE_BATCH)
+            kdbg_merge_output(m, fn, ctx);
+        m->out[m->out_count++] = q->entries[q->head];
+        m->last_emitted = time;
+        m->emitted++;
+        m->buffered--;
+        q->head = (q->head + 1) & q->mask;
+        q->count--;
+#if defined(__GNUC__)
+        // The rings of many CPUs are read in turns, the hardware prefetcher does not keep up
+        __builtin_prefetch(&q->entries[(q->head + 2) & q->mask]);
+#endif
+
+        kdbg_merge_replay(m, cpu, kdbg_merge_key(m, cpu));
+    }
+    kdbg_merge_output(m, fn, ctx);
+}
+
+// Adds one entry to the queue of its CPU, returns 0 on success, -1 if the memory can not be allocated
+static inline int kdbg_merge_add(kdbg_merge_t *m, const kd_buf *kd)
+{
+    const unsigned cpu = kd->cpuid < KDBG_MERGE_MAX_CPUS ? kd->cpuid : KDBG_MERGE_MAX_CPUS - 1;
+    const uint64_t time = kdbg_merge_time(kd);
+    kdbg_merge_queue_t *q;
+    size_t i;
+
+    if (cpu >= m->queue_count && kdbg_merge_resize(m, cpu + 1) != 0)
+        return -1;
+    q = &m->queues[cpu];
+
+    if (q->count == q->mask + (q->entries != NULL)) {
+        // Full (or not allocated yet), double the ring and unwrap it
+        const size_t capacity = q->entries ? 2 * (q->mask + 1) : 1024;
+        kd_buf *entries = (kd_buf *) malloc(capacity * sizeof(kd_buf));
+        if (entries == NULL)
+            return -1;
+        for (i = 0; i < q->count; i++)
+            entries[i] = q->entries[(q->head + i) & q->mask];
+        free(q->entries);
+        q->entries = entries;
+        q->head = 0;
+        q->mask = capacity - 1;
+    }
+
+    // Entries of one CPU are mostly in order, insert from the back
+    i = q->count;
+    while (i > 0 && kdbg_merge_time(&q->entries[(q->head + i - 1) & q->mask]) > time) {
+        q->entries[(q->head + i) & q->mask] = q->entries[(q->head + i - 1) & q->mask];
+        i--;
+    }
+    if (i != q->count)
+        m->reordered++;
+    q->entries[(q->head + i) & q->mask] = *kd;
+    q->count++;
+
+    m->buffered++;
+    if (m->buffered > m->peak_buffered)
+        m->peak_buffered = m->buffered;
+    if (time > m->newest)
+        m->newest = time;
+    return 0;
+}
+
+// Buffers the entries and emits the ones which left the reorder window. Returns 0 on success,
+// -1 if the memory can not be allocated.
+static inline int kdbg_merge_push(kdbg_merge_t *m, const kd_buf *events, size_t count,
+                                  kdbg_merge_fn fn, kdbg_merge_fn late, void *ctx)
+{
+    size_t late_start = 0, late_count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (m->emitted && kdbg_merge_time(&events[i]) < m->last_emitted) {
+            // Consecutive late entries are passed as one run
+            if (late_count == 0)
+                late_start = i;
+            late_count++;
+            m->late++;
+            continue;
+        }
+        if (late_count) {
+            if (late)
+                late(ctx, &events[late_start], late_count);
+            late_count = 0;
+        }
+        if (kdbg_merge_add(m, &events[i]) != 0)
+            return -1;
+
+        if (m->buffered >= m->config.max_buffered) {
+            // Over the memory bound, emit the older half of the window
+            const uint64_t oldest = m->last_emitted;
+            m->forced++;
+            kdbg_merge_emit(m, oldest + (m->newest - oldest) / 2, fn, ctx);
+            if (m->buffered >= m->config.max_buffered)
+                kdbg_merge_emit(m, m->newest, fn, ctx);
+        }
+    }
+    if (late_count && late)
+        late(ctx, &events[late_start], late_count);
+
+    if (m->newest > m->config.window)
+        kdbg_merge_emit(m, m->newest - m->config.window, fn, ctx);
+    return 0;
+}
+
+// Emits everything which is buffered (end of the stream)
+static inline void kdbg_merge_flush(kdbg_merge_t *m, kdbg_merge_fn fn, void *ctx)
+{
+    kdbg_merge_emit(m, UINT64_MAX, fn, ctx);
+}
+
+#endif /* kdbg_merge_h */
@@ -0,0 +1,316 @@
+//
+//  kdbg_pairing.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_pairing_h
+#define kdbg_pairing_h
+
+// Pairing of DBG_FUNC_START and DBG_FUNC_END entries into intervals (C99).
+//
+// Open intervals are kept in a fixed size open-addressing table (linear probing, backward shift
+// deletion) keyed by (thread, event ID). Nested starts of the same key are stacked up to
+// KDBG_PAIRING_MAX_DEPTH levels, an end closes the innermost one. Ends without a start are
+// counted and dropped. Starts whose end was lost are dropped once they are older than the
+// timeout, either when the key is used again or when the table fills up, so the memory stays
+// bounded whatever is lost.
+//
+// Every closed interval goes to the log-linear latency histogram of its event ID (16 linear
+// sub-buckets per power of two, the relative error of a percentile is below 1/16).
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kdbg_compat.h"
+#include "kdbg_decode.h"
+
+#define KDBG_PAIRING_MAX_DEPTH      4
+#define KDBG_HISTOGRAM_SUB_BITS     4
+#define KDBG_HISTOGRAM_BUCKETS      ((64 - KDBG_HISTOGRAM_SUB_BITS + 1) << KDBG_HISTOGRAM_SUB_BITS)
+
+typedef struct kdbg_histogram {
+    uint32_t eventid;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[KDBG_HISTOGRAM_BUCKETS];
+} kdbg_histogram_t;
+
+typedef struct kdbg_open_interval {
+    uint64_t thread;
+    uint64_t start[KDBG_PAIRING_MAX_DEPTH]; // start[depth - 1] is the innermost one
+    uint32_t eventid;
+    uint32_t depth;                         // 0 for an empty slot
+} kdbg_open_interval_t;
+
+typedef struct kdbg_pairing_config {
+    size_t   open_intervals;    // table size, rounded up to a power of two
+    size_t   histograms;        // maximum number of event IDs
+    uint64_t timeout;           // in timestamp units (Mach ticks, convert with mach_timebase_info)
+} kdbg_pairing_config_t;
+
+// 64Ki open intervals, 1024 event IDs, 10 s only where a tick is a nanosecond (Intel Macs; on
+// Apple silicon the 24 MHz ticks make it about 7 minutes), set the timeout from the timebase
+#define KDBG_PAIRING_CONFIG_DEFAULT { 65536, 1024, 10000000000ull }
+
+typedef struct kdbg_pairing {
+    kdbg_pairing_config_t config;
+    kdbg_open_interval_t *open;
+    size_t open_mask;
+    size_t open_count;
+    kdbg_histogram_t **histograms;
+    size_t histogram_mask;
+    size_t histogram_count;
+
+    // Statistics
+    uint64_t intervals;         // closed intervals
+    uint64_t orphan_ends;       // ends without a start
+    uint64_t lost_ends;         // starts dropped after the timeout
+    uint64_t too_deep;          // starts nested deeper than KDBG_PAIRING_MAX_DEPTH
+    uint64_t table_full;        // starts dropped because the table was full
+    uint64_t untracked;         // intervals of event IDs over the histogram limit
+} kdbg_pairing_t;
+
+static inline size_t kdbg_pow2(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+static inline uint64_t kdbg_mix64(uint64_t x)
+{
+    // splitmix64 finalizer, thread IDs are pointers with few random bits
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline size_t kdbg_histogram_bucket(uint64_t value)
+{
+    unsigned msb, shift;
+
+    if (value < (1u << KDBG_HISTOGRAM_SUB_BITS))
+        return (size_t) value;
+    msb = 63u - (unsigned) __builtin_clzll(value);
+    shift = msb - KDBG_HISTOGRAM_SUB_BITS;
+    return ((size_t) (shift + 1) << KDBG_HISTOGRAM_SUB_BITS) + (size_t) ((value >> shift) - (1u << KDBG_HISTOGRAM_SUB_BITS));
+}
+
+// Smallest value of the bucket
+static inline uint64_t kdbg_histogram_bucket_value(size_t bucket)
+{
+    const size_t sub = bucket & ((1u << KDBG_HISTOGRAM_SUB_BITS) - 1);
+    const size_t exponent = bucket >> KDBG_HISTOGRAM_SUB_BITS;
+
+    if (exponent == 0)
+        return (uint64_t) sub;
+    return ((uint64_t) (1u << KDBG_HISTOGRAM_SUB_BITS) + sub) << (exponent - 1);
+}
+
+static inline void kdbg_histogram_add(kdbg_histogram_t *h, uint64_t value)
+{
+    if (h->count == 0 || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+    h->count++;
+    h->sum += value;
+    h->buckets[kdbg_histogram_bucket(value)]++;
+}
+
+// Value at quantile q (0 to 1), the middle of its bucket clamped to [min, max]
+static inline uint64_t kdbg_histogram_percentile(const kdbg_histogram_t *h, double q)
+{
+    uint64_t rank, seen = 0;
+
+    if (h->count == 0)
+        return 0;
+    rank = (uint64_t) (q * (double) (h->count - 1)) + 1;
+    for (size_t i = 0; i < KDBG_HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            const uint64_t low = kdbg_histogram_bucket_value(i);
+            const uint64_t high = (i + 1 < KDBG_HISTOGRAM_BUCKETS) ? kdbg_histogram_bucket_value(i + 1) - 1 : UINT64_MAX;
+            const uint64_t value = low + (high - low) / 2;
+            return value < h->min ? h->min : value > h->max ? h->max : value;
+        }
+    }
+    return h->max;
+}
+
+// Returns 0 on success, -1 if the memory can not be allocated
+static inline int kdbg_pairing_init(kdbg_pairing_t *p, const kdbg_pairing_config_t *config)
+{
+    const kdbg_pairing_config_t defaults = KDBG_PAIRING_CONFIG_DEFAULT;
+
+    memset(p, 0, sizeof(*p));
+    p->config = config ? *config : defaults;
+    p->config.open_intervals = kdbg_pow2(p->config.open_intervals < 16 ? 16 : p->config.open_intervals);
+    p->open_mask = p->config.open_intervals - 1;
+    // Histograms are never removed, their table is kept at most half full
+    p->histogram_mask = kdbg_pow2(2 * (p->config.histograms ? p->config.histograms : 1)) - 1;
+
+    p->open = (kdbg_open_interval_t *) calloc(p->config.open_intervals, sizeof(kdbg_open_interval_t));
+    p->histograms = (kdbg_histogram_t **) calloc(p->histogram_mask + 1, sizeof(kdbg_histogram_t *));
+    if (p->open == NULL || p->histograms == NULL) {
+        free(p->open);
+        free(p->histograms);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void kdbg_pairing_destroy(kdbg_pairing_t *p)
+{
+    if (p->histograms)
+        for (size_t i = 0; i <= p->histogram_mask; i++)
+            free(p->histograms[i]);
+    free(p->histograms);
+    free(p->open);
+    memset(p, 0, sizeof(*p));
+}
+
+// Histogram of the event ID, NULL if there is none
+static inline kdbg_histogram_t *kdbg_pairing_histogram(const kdbg_pairing_t *p, uint32_t eventid)
+{
+    for (size_t i = (size_t) kdbg_mix64(eventid) & p->histogram_mask; p->histograms[i]; i = (i + 1) & p->histogram_mask)
+        if (p->histograms[i]->eventid == eventid)
+            return p->histograms[i];
+    return NULL;
+}
+
+static inline void kdbg_pairing_record(kdbg_pairing_t *p, uint32_t eventid, uint64_t latency)
+{
+    size_t i = (size_t) kdbg_mix64(eventid) & p->histogram_mask;
+
+    for (; p->histograms[i]; i = (i + 1) & p->histogram_mask) {
+        if (p->histograms[i]->eventid == eventid) {
+            kdbg_histogram_add(p->histograms[i], latency);
+            return;
+        }
+    }
+
+    if (p->histogram_count >= p->config.histograms
+        || (p->histograms[i] = (kdbg_histogram_t *) calloc(1, sizeof(kdbg_histogram_t))) == NULL) {
+        p->untracked++;
+        return;
+    }
+    p->histogram_count++;
+    p->histograms[i]->eventid = eventid;
+    kdbg_histogram_add(p->histograms[i], latency);
+}
+
+static inline size_t kdbg_pairing_slot(const kdbg_pairing_t *p, uint64_t thread, uint32_t eventid)
+{
+    return (size_t) kdbg_mix64(thread ^ ((uint64_t) eventid << 32 | eventid)) & p->open_mask;
+}
+
+// Empties the occupied slot i and moves the following entries of the probe sequence back
+static inline void kdbg_pairing_remove(kdbg_pairing_t *p, size_t i)
+{
+    size_t j = i;
+
+    for (;;) {
+        j = (j + 1) & p->open_mask;
+        if (p->open[j].depth == 0)
+            break;
+        // An entry can move to i only if i is between its home slot and j (cyclically)
+        {
+            const size_t home = kdbg_pairing_slot(p, p->open[j].thread, p->open[j].eventid);
+            if (((j - home) & p->open_mask) >= ((j - i) & p->open_mask)) {
+                p->open[i] = p->open[j];
+                i = j;
+            }
+        }
+    }
+    p->open[i].depth = 0;
+    p->open_count--;
+}
+
+// Drops the open intervals whose innermost start is older than now - timeout
+static inline void kdbg_pairing_expire(kdbg_pairing_t *p, uint64_t now)
+{
+    for (size_t i = 0; i <= p->open_mask; ) {
+        kdbg_open_interval_t *o = &p->open[i];
+        if (o->depth && now - o->start[o->depth - 1] > p->config.timeout) {
+            p->lost_ends += o->depth;
+            kdbg_pairing_remove(p, i);
+            continue; // another entry may have moved to i
+        }
+        i++;
+    }
+}
+
+// Processes one entry, entries without a start or end qualifier are ignored
+static inline void kdbg_pairing_add(kdbg_pairing_t *p, uint64_t thread, uint32_t debugid, uint64_t timestamp)
+{
+    const uint32_t qualifier = debugid & (DBG_FUNC_START | DBG_FUNC_END);
+    const uint32_t eventid = debugid & KDBG_FUNC_MASK;
+    size_t i;
+
+    if (qualifier != DBG_FUNC_START && qualifier != DBG_FUNC_END)
+        return;
+
+    for (i = kdbg_pairing_slot(p, thread, eventid); p->open[i].depth; i = (i + 1) & p->open_mask)
+        if (p->open[i].thread == thread && p->open[i].eventid == eventid)
+            break;
+
+    if (qualifier == DBG_FUNC_END) {
+        kdbg_open_interval_t *o = &p->open[i];
+        if (o->depth == 0) {
+            p->orphan_ends++;
+            return;
+        }
+        kdbg_pairing_record(p, eventid, timestamp - o->start[--o->depth]);
+        p->intervals++;
+        if (o->depth == 0)
+            kdbg_pairing_remove(p, i);
+        return;
+    }
+
+    if (p->open[i].depth == 0) {
+        // Keep the table at most 3/4 full, the probe sequences stay short
+        if ((p->open_count + 1) * 4 > p->config.open_intervals * 3) {
+            kdbg_pairing_expire(p, timestamp);
+            if ((p->open_count + 1) * 4 > p->config.open_intervals * 3) {
+                p->table_full++;
+                return;
+            }
+            // Slots moved, find the free one again
+            for (i = kdbg_pairing_slot(p, thread, eventid); p->open[i].depth; i = (i + 1) & p->open_mask)
+                ;
+        }
+        p->open[i].thread = thread;
+        p->open[i].eventid = eventid;
+        p->open_count++;
+    } else {
+        kdbg_open_interval_t *o = &p->open[i];
+        // A start older than the timeout lost its end, the new start replaces the stack
+        if (timestamp - o->start[o->depth - 1] > p->config.timeout) {
+            p->lost_ends += o->depth;
+            o->depth = 0;
+        } else if (o->depth == KDBG_PAIRING_MAX_DEPTH) {
+            p->too_deep++;
+            return;
+        }
+    }
+    p->open[i].start[p->open[i].depth++] = timestamp;
+}
+
+// Processes the decoded entries (in time order)
+static inline void kdbg_pairing_add_columns(kdbg_pairing_t *p, const kdbg_columns_t *c)
+{
+    for (size_t i = 0; i < c->count; i++)
+        kdbg_pairing_add(p, c->thread[i], c->eventid[i] | c->qualifier[i], c->timestamp[i]);
+}
+
+#endif /* kdbg_pairing_h */
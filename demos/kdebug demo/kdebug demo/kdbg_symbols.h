@@ -0,0 +1,535 @@
+//
+//  kdbg_symbols.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_symbols_h
+#define kdbg_symbols_h
+
+// Debugid names from a trace.codes file (C99, POSIX).
+//
+// The file has one "<hex debugid> <name>" per line (/usr/share/misc/trace.codes on macOS). The
+// debugids are compiled into a minimal perfect hash (hash and displace: every key is hashed to
+// a bucket, every bucket has a pilot which moves its keys to free slots), so a lookup is two
+// hashes, three loads and a key check, without branches on the table contents or allocations.
+//
+// The table is one contiguous image (header, pilots, keys, name offsets, strings) which is
+// cached to disk and mapped as is by later runs. The cache is in host byte order and is
+// rebuilt when the source file changes (size or mtime). It should live in a directory only root
+// can write to (the demo runs as root), a cache owned by someone else or writable by the group or
+// others is not trusted.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "kdbg_compat.h"
+#include "kdbg_pairing.h"
+
+#define KDBG_SYMBOLS_MAGIC          0x4d59534bu    // "KSYM"
+#define KDBG_SYMBOLS_VERSION        1u
+#define KDBG_SYMBOLS_BUCKET_SIZE    3              // average keys per bucket
+#define KDBG_SYMBOLS_MAX_PILOT      (1u << 22)     // pilots tried before reseeding
+
+typedef struct kdbg_symbols_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    uint64_t seed;
+    uint32_t count;             // keys, also slots
+    uint32_t buckets;
+    uint32_t strings_size;
+    uint32_t reserved;
+} kdbg_symbols_header_t;
+
+typedef struct kdbg_symbols {
+    uint8_t *image;             // header followed by the tables, mapped or allocated
+    size_t   image_size;
+    int      mapped;
+
+    // Tables in the image
+    uint64_t seed;
+    uint32_t count;
+    uint32_t buckets;
+    const uint32_t *pilots;     // [buckets]
+    const uint32_t *keys;       // [count] debugid of every slot
+    const uint32_t *names;      // [count] offset of the name in strings
+    const char *strings;
+} kdbg_symbols_t;
+
+static inline size_t kdbg_symbols_image_size(uint32_t count, uint32_t buckets, uint32_t strings_size)
+{
+    return sizeof(kdbg_symbols_header_t) + (size_t) buckets * 4 + (size_t) count * 8 + strings_size;
+}
+
+static inline uint32_t kdbg_symbols_reduce(uint64_t hash, uint32_t range)
+{
+    return (uint32_t) (((hash >> 32) * range) >> 32);
+}
+
+static inline uint32_t kdbg_symbols_bucket(uint64_t hash, uint32_t buckets)
+{
+    return kdbg_symbols_reduce(hash, buckets);
+}
+
+static inline uint32_t kdbg_symbols_slot(uint64_t hash, uint32_t pilot, uint32_t count)
+{
+    return kdbg_symbols_reduce(kdbg_mix64(hash ^ kdbg_mix64(pilot)), count);
+}
+
+// Name of the debugid (the function qualifier is ignored), NULL if the debugid is unknown
+static inline const char *kdbg_symbols_lookup(const kdbg_symbols_t *s, uint32_t debugid)
+{
+    const uint32_t key = debugid & KDBG_FUNC_MASK;
+    uint64_t hash;
+    uint32_t slot;
+
+    if (s->count == 0)
+        return NULL;
+    hash = kdbg_mix64(key ^ s->seed);
+    slot = kdbg_symbols_slot(hash, s->pilots[kdbg_symbols_bucket(hash, s->buckets)], s->count);
+    return (s->keys[slot] == key) ? s->strings + s->names[slot] : NULL;
+}
+
+// Points the tables into the image, returns 0 if the image is consistent
+static inline int kdbg_symbols_attach(kdbg_symbols_t *s)
+{
+    kdbg_symbols_header_t header;
+
+    if (s->image_size < sizeof(header))
+        return -1;
+    memcpy(&header, s->image, sizeof(header));
+    if (header.magic != KDBG_SYMBOLS_MAGIC || header.version != KDBG_SYMBOLS_VERSION
+        || (header.count && header.buckets == 0)
+        || s->image_size != kdbg_symbols_image_size(header.count, header.buckets, header.strings_size))
+        return -1;
+
+    s->seed = header.seed;
+    s->count = header.count;
+    s->buckets = header.buckets;
+    s->pilots = (const uint32_t *) (const void *) (s->image + sizeof(header));
+    s->keys = s->pilots + header.buckets;
+    s->names = s->keys + header.count;
+    s->strings = (const char *) (s->names + header.count);
+
+    // The names are checked once, lookups trust them
+    for (uint32_t i = 0; i < s->count; i++)
+        if (s->names[i] >= header.strings_size)
+            return -1;
+    if (header.strings_size && s->strings[header.strings_size - 1] != '\0')
+        return -1;
+    return 0;
+}
+
+static inline void kdbg_symbols_destroy(kdbg_symbols_t *s)
+{
+    if (s->mapped)
+        munmap(s->image, s->image_size);
+    else
+        free(s->image);
+    memset(s, 0, sizeof(*s));
+}
+
+typedef struct kdbg_symbols_entry {
+    uint32_t key;
+    uint32_t bucket;
+    uint64_t hash;
+    uint32_t name;              // offset in the strings
+} kdbg_symbols_entry_t;
+
+// Finds the pilots of all the buckets, larger buckets first (they are the hardest to place).
+// Returns 0 on success, 1 if a bucket did not fit with this seed, -1 if out of memory.
+static inline int kdbg_symbols_place(const kdbg_symbols_entry_t *entries, uint32_t count, uint32_t buckets,
+                                     uint32_t *pilots, uint32_t *keys, uint32_t *names)
+{
+    uint32_t *start = (uint32_t *) calloc((size_t) buckets + 1, sizeof(uint32_t));
+    uint32_t *members = (uint32_t *) malloc((size_t) count * sizeof(uint32_t));
+    uint32_t *order = (uint32_t *) malloc((size_t) buckets * sizeof(uint32_t));
+    uint32_t *by_size = NULL;
+    uint8_t *taken = (uint8_t *) calloc(count, 1);
+    uint32_t max_size = 0;
+    int result = -1;
+
+    if (start == NULL || members == NULL || order == NULL || taken == NULL)
+        goto out;
+
+    // Members of the buckets (counting sort)
+    for (uint32_t i = 0; i < count; i++)
+        start[entries[i].bucket + 1]++;
+    for (uint32_t b = 0; b < buckets; b++) {
+        if (start[b + 1] > max_size)
+            max_size = start[b + 1];
+        start[b + 1] += start[b];
+    }
+    {
+        uint32_t *fill = (uint32_t *) malloc((size_t) buckets * sizeof(uint32_t));
+        if (fill == NULL)
+            goto out;
+        memcpy(fill, start, (size_t) buckets * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++)
+            members[fill[entries[i].bucket]++] = i;
+        free(fill);
+    }
+
+    // Buckets by decreasing size (counting sort)
+    by_size = (uint32_t *) calloc((size_t) max_size + 2, sizeof(uint32_t));
+    if (by_size == NULL)
+        goto out;
+    for (uint32_t b = 0; b < buckets; b++)
+        by_size[max_size - (start[b + 1] - start[b]) + 1]++;
+    for (uint32_t size = 0; size <= max_size; size++)
+        by_size[size + 1] += by_size[size];
+    for (uint32_t b = 0; b < buckets; b++)
+        order[by_size[max_size - (start[b + 1] - start[b])]++] = b;
+
+    result = 1;
+    for (uint32_t o = 0; o < buckets; o++) {
+        const uint32_t b = order[o], first = start[b], last = start[b + 1];
+        uint32_t pilot;
+
+        pilots[b] = 0;
+        if (first == last)
+            break;          // the rest is empty
+
+        for (pilot = 0; pilot < KDBG_SYMBOLS_MAX_PILOT; pilot++) {
+            uint32_t i;
+            // Slots are marked 2 while trying, so keys of the bucket do not collide either
+            for (i = first; i < last; i++) {
+                const uint32_t slot = kdbg_symbols_slot(entries[members[i]].hash, pilot, count);
+                if (taken[slot])
+                    break;
+                taken[slot] = 2;
+            }
+            if (i == last)
+                break;
+            while (i-- > first)
+                taken[kdbg_symbols_slot(entries[members[i]].hash, pilot, count)] = 0;
+        }
+        if (pilot == KDBG_SYMBOLS_MAX_PILOT)
+            goto out;
+
+        pilots[b] = pilot;
+        for (uint32_t i = first; i < last; i++) {
+            const kdbg_symbols_entry_t *e = &entries[members[i]];
+            const uint32_t slot = kdbg_symbols_slot(e->hash, pilot, count);
+            taken[slot] = 1;
+            keys[slot] = e->key;
+            names[slot] = e->name;
+        }
+    }
+    result = 0;
+
+out:
+    free(start);
+    free(members);
+    free(order);
+    free(by_size);
+    free(taken);
+    return result;
+}
+
+static inline int kdbg_symbols_compare_keys(const void *a, const void *b)
+{
+    const kdbg_symbols_entry_t *x = (const kdbg_symbols_entry_t *) a, *y = (const kdbg_symbols_entry_t *) b;
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+    return (x->name > y->name) - (x->name < y->name);
+}
+
+// Builds the table from the text of a trace.codes file into an allocated image. Lines which do
+// not start with a hex debugid are skipped, of duplicate debugids the first one is kept.
+// Returns 0 on success, -1 and errno otherwise.
+static inline int kdbg_symbols_build(kdbg_symbols_t *s, const char *text, size_t length)
+{
+    kdbg_symbols_entry_t *entries = NULL;
+    char *strings = NULL;
+    size_t capacity = 0, count = 0, strings_size = 0;
+    kdbg_symbols_header_t header;
+    uint32_t buckets;
+    int placed = 1;
+
+    memset(s, 0, sizeof(*s));
+    strings = (char *) malloc(length + 1);
+    if (strings == NULL)
+        return -1;
+
+    for (size_t pos = 0; pos < length; ) {
+        size_t end = pos, name, name_end;
+        unsigned long key = 0;
+        int digits = 0;
+
+        while (end < length && text[end] != '\n')
+            end++;
+
+        // "0x<hex>" (or bare hex), whitespace, name up to the end of the line
+        name = pos;
+        while (name < end && (text[name] == ' ' || text[name] == '\t'))
+            name++;
+        if (end - name > 2 && text[name] == '0' && (text[name + 1] == 'x' || text[name + 1] == 'X'))
+            name += 2;
+        for (; name < end; name++, digits++) {
+            const char c = text[name];
+            const int v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                        : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (v < 0)
+                break;
+            key = (key << 4) | (unsigned long) v;
+        }
+        while (name < end && (text[name] == ' ' || text[name] == '\t'))
+            name++;
+        name_end = end;
+        while (name_end > name && (text[name_end - 1] == ' ' || text[name_end - 1] == '\t' || text[name_end - 1] == '\r'))
+            name_end--;
+
+        if (digits > 0 && digits <= 8 && name_end > name && count < UINT32_MAX) {
+            if (count == capacity) {
+                kdbg_symbols_entry_t *grown;
+                capacity = capacity ? 2 * capacity : 1024;
+                grown = (kdbg_symbols_entry_t *) realloc(entries, capacity * sizeof(*entries));
+                if (grown == NULL)
+                    goto fail;
+                entries = grown;
+            }
+            entries[count].key = (uint32_t) key & KDBG_FUNC_MASK;
+            entries[count].name = (uint32_t) strings_size;
+            memcpy(strings + strings_size, text + name, name_end - name);
+            strings_size += name_end - name;
+            strings[strings_size++] = '\0';
+            count++;
+        }
+        pos = end + 1;
+    }
+
+    // Duplicates: the first name wins (names are in file order)
+    if (count) {
+        size_t unique = 1;
+        qsort(entries, count, sizeof(*entries), kdbg_symbols_compare_keys);
+        for (size_t i = 1; i < count; i++)
+            if (entries[i].key != entries[unique - 1].key)
+                entries[unique++] = entries[i];
+        count = unique;
+    }
+    if (strings_size > UINT32_MAX) {
+        errno = EFBIG;
+        goto fail;
+    }
+
+    buckets = (uint32_t) (count / KDBG_SYMBOLS_BUCKET_SIZE + 1);
+    s->image_size = kdbg_symbols_image_size((uint32_t) count, buckets, (uint32_t) strings_size);
+    s->image = (uint8_t *) calloc(1, s->image_size);
+    if (s->image == NULL)
+        goto fail;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = KDBG_SYMBOLS_MAGIC;
+    header.version = KDBG_SYMBOLS_VERSION;
+    header.seed = 0x9e3779b97f4a7c15ull;
+    header.count = (uint32_t) count;
+    header.buckets = buckets;
+    header.strings_size = (uint32_t) strings_size;
+
+    {
+        uint32_t *pilots = (uint32_t *) (void *) (s->image + sizeof(header));
+        uint32_t *keys = pilots + buckets;
+        uint32_t *names = keys + count;
+
+        // A seed rarely fails (a bucket whose keys can not be separated), another one is tried
+        for (int attempt = 0; placed == 1 && attempt < 16; attempt++) {
+            header.seed = kdbg_mix64(header.seed + (uint64_t) attempt);
+            for (size_t i = 0; i < count; i++) {
+                entries[i].hash = kdbg_mix64(entries[i].key ^ header.seed);
+                entries[i].bucket = kdbg_symbols_bucket(entries[i].hash, buckets);
+            }
+            placed = kdbg_symbols_place(entries, (uint32_t) count, buckets, pilots, keys, names);
+        }
+        if (placed != 0) {
+            errno = (placed < 0) ? ENOMEM : EINVAL;
+            goto fail;
+        }
+        memcpy(names + count, strings, strings_size);
+    }
+    memcpy(s->image, &header, sizeof(header));
+
+    free(entries);
+    free(strings);
+    if (kdbg_symbols_attach(s) != 0) {
+        kdbg_symbols_destroy(s);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+
+fail:
+    {
+        const int error = errno;
+        free(entries);
+        free(strings);
+        free(s->image);
+        memset(s, 0, sizeof(*s));
+        errno = error;
+    }
+    return -1;
+}
+
+// Writes the image to the cache file (a temporary file renamed over it, readers never see a
+// partial cache). The temporary file is created by mkstemp next to the cache, a planted file or
+// symlink is never written through. The source size and mtime are recorded for
+// kdbg_symbols_map. Returns 0 on success, -1 and errno otherwise.
+static inline int kdbg_symbols_save(kdbg_symbols_t *s, const char *path, const struct stat *source)
+{
+    kdbg_symbols_header_t header;
+    char temporary[4096];
+    size_t written = 0;
+    int fd, error;
+
+    if (snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path) >= (int) sizeof(temporary)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memcpy(&header, s->image, sizeof(header));
+    header.source_size = (uint64_t) source->st_size;
+    header.source_mtime = (int64_t) source->st_mtime;
+
+    if ((fd = mkstemp(temporary)) < 0)
+        return -1;
+    // mkstemp creates it 0600, the names are not secret
+    if (fchmod(fd, 0644) != 0) {
+        error = errno;
+        close(fd);
+        unlink(temporary);
+        errno = error;
+        return -1;
+    }
+    while (written < s->image_size) {
+        const uint8_t *from = written < sizeof(header) ? (const uint8_t *) &header + written : s->image + written;
+        const size_t length = written < sizeof(header) ? sizeof(header) - written : s->image_size - written;
+        const ssize_t n = write(fd, from, length);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        written += (size_t) n;
+    }
+    error = errno;
+    if (close(fd) != 0 && written == s->image_size) {
+        written = 0;
+        error = errno;
+    }
+    if (written != s->image_size || rename(temporary, path) != 0) {
+        if (written == s->image_size)
+            error = errno;
+        unlink(temporary);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+// Maps the cache file if it was built from the source as it is now. Returns 0 on success, -1
+// otherwise (errno ESTALE if the cache is out of date, EINVAL if it is damaged, EPERM if it is
+// not a regular file owned by root or the effective user, or others can write to it).
+static inline int kdbg_symbols_map(kdbg_symbols_t *s, const char *path, const struct stat *source)
+{
+    kdbg_symbols_header_t header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(s, 0, sizeof(*s));
+    if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+        return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode) || (st.st_uid != 0 && st.st_uid != geteuid()) || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    if ((size_t) st.st_size < sizeof(header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    s->image = (uint8_t *) map;
+    s->image_size = (size_t) st.st_size;
+    s->mapped = 1;
+    memcpy(&header, map, sizeof(header));
+    if (header.source_size != (uint64_t) source->st_size || header.source_mtime != (int64_t) source->st_mtime) {
+        kdbg_symbols_destroy(s);
+        errno = ESTALE;
+        return -1;
+    }
+    if (kdbg_symbols_attach(s) != 0) {
+        kdbg_symbols_destroy(s);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+// Loads the names of the trace.codes file, from the cache if it is up to date, otherwise the
+// file is parsed and the cache is rewritten (cache may be NULL, failing to write it is not an
+// error). Returns 0 on success, -1 and errno otherwise.
+static inline int kdbg_symbols_load(kdbg_symbols_t *s, const char *codes, const char *cache)
+{
+    struct stat st;
+    char *text;
+    ssize_t n = 0;
+    size_t length = 0;
+    int fd, result;
+
+    memset(s, 0, sizeof(*s));
+    if ((fd = open(codes, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (cache && kdbg_symbols_map(s, cache, &st) == 0) {
+        close(fd);
+        return 0;
+    }
+
+    text = (char *) malloc((size_t) st.st_size + 1);
+    if (text == NULL) {
+        close(fd);
+        return -1;
+    }
+    while (length < (size_t) st.st_size && (n = read(fd, text + length, (size_t) st.st_size - length)) != 0) {
+        if (n < 0 && errno != EINTR)
+            break;
+        if (n > 0)
+            length += (size_t) n;
+    }
+    close(fd);
+    if (n < 0) {
+        free(text);
+        return -1;
+    }
+
+    result = kdbg_symbols_build(s, text, length);
+    free(text);
+    if (result == 0 && cache)
+        kdbg_symbols_save(s, cache, &st);
+    return result;
+}
+
+#endif /* kdbg_symbols_h */
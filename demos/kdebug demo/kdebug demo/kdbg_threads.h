@@ -0,0 +1,287 @@
+//
+//  kdbg_threads.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_threads_h
+#define kdbg_threads_h
+
+// Thread to process map of a trace (C99).
+//
+// Maps thread IDs (kd_buf.arg5) to the pid and command of their process. The map is seeded from
+// a thread map snapshot (KERN_KDTHRMAP or the map of a trace file) and then follows the trace
+// itself, the way trace(1) and fs_usage(1) do:
+//
+//   TRACE_DATA_NEWTHREAD        arg1 new thread, arg2 pid, on the creating thread, followed by
+//   TRACE_STRING_NEWTHREAD      command in arg1-arg4, on the creating thread
+//   TRACE_DATA_EXEC             arg1 pid, followed by
+//   TRACE_STRING_EXEC           new command in arg1-arg4, on the exec'ing thread
+//   TRACE_DATA_THREAD_TERMINATE arg1 thread
+//
+// The map is a flat open-addressing table of 32-byte entries (two per cache line, the layout of
+// kd_threadmap) with linear probing and backward shift deletion; it grows at 3/4 load. The few
+// data/string pairs in flight are kept in a small array searched linearly.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kdbg_compat.h"
+#include "kdbg_pairing.h"
+#include "kdbg_trace.h"
+
+#ifndef TRACE_DATA_NEWTHREAD
+#define TRACE_DATA_NEWTHREAD        TRACEDBG_CODE(DBG_TRACE_DATA, 1)
+#define TRACE_DATA_EXEC             TRACEDBG_CODE(DBG_TRACE_DATA, 2)
+#define TRACE_DATA_THREAD_TERMINATE TRACEDBG_CODE(DBG_TRACE_DATA, 3)
+#define TRACE_STRING_NEWTHREAD      TRACEDBG_CODE(DBG_TRACE_STRING, 1)
+#define TRACE_STRING_EXEC           TRACEDBG_CODE(DBG_TRACE_STRING, 2)
+#endif
+
+#define KDBG_THREADS_COMMAND    20      // MAXCOMLEN + 1
+#define KDBG_THREADS_PENDING    16
+
+typedef struct kdbg_thread {
+    uint64_t thread;                    // 0 for an empty slot
+    int32_t  pid;
+    char     command[KDBG_THREADS_COMMAND];
+} kdbg_thread_t;
+
+// Data entry waiting for its string entry
+typedef struct kdbg_thread_pending {
+    uint64_t thread;                    // thread which logged the entries, 0 if unused
+    uint64_t target;                    // new thread, or the exec'ing thread
+    int32_t  pid;
+    uint32_t debugid;                   // TRACE_DATA_NEWTHREAD or TRACE_DATA_EXEC
+} kdbg_thread_pending_t;
+
+typedef struct kdbg_threads {
+    kdbg_thread_t *table;
+    size_t mask;
+    size_t count;
+    kdbg_thread_pending_t pending[KDBG_THREADS_PENDING];
+    unsigned pending_next;              // next pending slot to reuse
+
+    // Statistics
+    uint64_t created;
+    uint64_t execs;
+    uint64_t terminated;
+    uint64_t unmatched;                 // string entries without their data entry
+} kdbg_threads_t;
+
+static inline size_t kdbg_threads_home(const kdbg_threads_t *t, uint64_t thread)
+{
+    return (size_t) kdbg_mix64(thread) & t->mask;
+}
+
+// Returns 0 on success, -1 if the memory can not be allocated
+static inline int kdbg_threads_init(kdbg_threads_t *t, size_t capacity)
+{
+    memset(t, 0, sizeof(*t));
+    capacity = kdbg_pow2(capacity < 16 ? 16 : capacity);
+    t->table = (kdbg_thread_t *) calloc(capacity, sizeof(kdbg_thread_t));
+    if (t->table == NULL)
+        return -1;
+    t->mask = capacity - 1;
+    return 0;
+}
+
+static inline void kdbg_threads_destroy(kdbg_threads_t *t)
+{
+    free(t->table);
+    memset(t, 0, sizeof(*t));
+}
+
+// Entry of the thread, NULL if the thread is unknown
+static inline const kdbg_thread_t *kdbg_threads_lookup(const kdbg_threads_t *t, uint64_t thread)
+{
+    size_t i = kdbg_threads_home(t, thread);
+
+    if (thread == 0)
+        return NULL;
+    for (;;) {
+        const kdbg_thread_t *e = &t->table[i];
+        if (e->thread == thread)
+            return e;
+        if (e->thread == 0)
+            return NULL;
+        i = (i + 1) & t->mask;
+    }
+}
+
+// Slot of the thread, or the empty slot where it belongs
+static inline kdbg_thread_t *kdbg_threads_find(kdbg_threads_t *t, uint64_t thread)
+{
+    size_t i = kdbg_threads_home(t, thread);
+
+    while (t->table[i].thread != thread && t->table[i].thread != 0)
+        i = (i + 1) & t->mask;
+    return &t->table[i];
+}
+
+static inline int kdbg_threads_grow(kdbg_threads_t *t)
+{
+    kdbg_threads_t grown = *t;
+    const size_t capacity = 2 * (t->mask + 1);
+
+    grown.table = (kdbg_thread_t *) calloc(capacity, sizeof(kdbg_thread_t));
+    if (grown.table == NULL)
+        return -1;
+    grown.mask = capacity - 1;
+    for (size_t i = 0; i <= t->mask; i++)
+        if (t->table[i].thread)
+            *kdbg_threads_find(&grown, t->table[i].thread) = t->table[i];
+    free(t->table);
+    *t = grown;
+    return 0;
+}
+
+// Adds or updates the thread, command may be NULL (kept if the thread is known). Returns 0 on
+// success, -1 if the memory can not be allocated.
+static inline int kdbg_threads_set(kdbg_threads_t *t, uint64_t thread, int32_t pid, const char *command)
+{
+    kdbg_thread_t *e;
+
+    if (thread == 0)
+        return 0;
+    if ((t->count + 1) * 4 > (t->mask + 1) * 3 && kdbg_threads_grow(t) != 0)
+        return -1;
+
+    e = kdbg_threads_find(t, thread);
+    if (e->thread == 0) {
+        e->thread = thread;
+        e->command[0] = '\0';
+        t->count++;
+    }
+    e->pid = pid;
+    if (command) {
+        strncpy(e->command, command, KDBG_THREADS_COMMAND - 1);
+        e->command[KDBG_THREADS_COMMAND - 1] = '\0';
+    }
+    return 0;
+}
+
+static inline void kdbg_threads_remove(kdbg_threads_t *t, uint64_t thread)
+{
+    kdbg_thread_t *e = (thread == 0) ? NULL : kdbg_threads_find(t, thread);
+    size_t i, j;
+
+    if (e == NULL || e->thread == 0)
+        return;
+
+    // Backward shift: moves the following entries of the probe sequence into the hole
+    i = j = (size_t) (e - t->table);
+    for (;;) {
+        size_t home;
+        j = (j + 1) & t->mask;
+        if (t->table[j].thread == 0)
+            break;
+        home = kdbg_threads_home(t, t->table[j].thread);
+        if (((j - home) & t->mask) >= ((j - i) & t->mask)) {
+            t->table[i] = t->table[j];
+            i = j;
+        }
+    }
+    t->table[i].thread = 0;
+    t->count--;
+}
+
+// Replaces the map with a thread map snapshot (kd_threadmap entries of KERN_KDTHRMAP or of a
+// trace file). Returns 0 on success, -1 if the memory can not be allocated.
+static inline int kdbg_threads_load(kdbg_threads_t *t, const kdbg_trace_thread_t *snapshot, size_t count)
+{
+    memset(t->table, 0, (t->mask + 1) * sizeof(kdbg_thread_t));
+    t->count = 0;
+    for (size_t i = 0; i < count; i++) {
+        char command[KDBG_THREADS_COMMAND];
+        // The kernel does not always terminate the command
+        memcpy(command, snapshot[i].command, KDBG_THREADS_COMMAND);
+        command[KDBG_THREADS_COMMAND - 1] = '\0';
+        if (kdbg_threads_set(t, snapshot[i].thread, snapshot[i].valid, command) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static inline kdbg_thread_pending_t *kdbg_threads_pending(kdbg_threads_t *t, uint64_t thread, uint32_t debugid)
+{
+    for (unsigned i = 0; i < KDBG_THREADS_PENDING; i++)
+        if (t->pending[i].thread == thread && t->pending[i].debugid == debugid)
+            return &t->pending[i];
+    return NULL;
+}
+
+// Follows the thread lifecycle entries of the batch, the other entries are skipped after one
+// compare. Returns 0 on success, -1 if the memory can not be allocated.
+static inline int kdbg_threads_add(kdbg_threads_t *t, const kd_buf *kd, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t debugid = kd[i].debugid & KDBG_FUNC_MASK;
+        kdbg_thread_pending_t *p;
+
+        if ((debugid & KDBG_CLASS_MASK) != ((uint32_t) DBG_TRACE << 24))
+            continue;
+
+        switch (debugid) {
+        case TRACE_DATA_NEWTHREAD:
+        case TRACE_DATA_EXEC:
+            // The string entry follows on the same thread, a pending slot is reused otherwise
+            p = kdbg_threads_pending(t, kd[i].arg5, debugid);
+            if (p == NULL) {
+                p = &t->pending[t->pending_next];
+                t->pending_next = (t->pending_next + 1) % KDBG_THREADS_PENDING;
+            }
+            p->thread = kd[i].arg5;
+            p->debugid = debugid;
+            if (debugid == TRACE_DATA_NEWTHREAD) {
+                p->target = kd[i].arg1;
+                p->pid = (int32_t) kd[i].arg2;
+                // Known right away, the command comes with the string
+                if (kdbg_threads_set(t, p->target, p->pid, NULL) != 0)
+                    return -1;
+                t->created++;
+            } else {
+                p->target = kd[i].arg5;
+                p->pid = (int32_t) kd[i].arg1;
+            }
+            break;
+
+        case TRACE_STRING_NEWTHREAD:
+        case TRACE_STRING_EXEC: {
+            const uint32_t data = (debugid == TRACE_STRING_NEWTHREAD) ? TRACE_DATA_NEWTHREAD : TRACE_DATA_EXEC;
+            char command[KDBG_THREADS_COMMAND];
+            uintptr_t packed[4];
+
+            p = kdbg_threads_pending(t, kd[i].arg5, data);
+            if (p == NULL) {
+                t->unmatched++;
+                break;
+            }
+            // The command is packed in the arguments
+            packed[0] = kd[i].arg1;
+            packed[1] = kd[i].arg2;
+            packed[2] = kd[i].arg3;
+            packed[3] = kd[i].arg4;
+            memset(command, 0, sizeof(command));
+            memcpy(command, packed, sizeof(command) < sizeof(packed) ? sizeof(command) : sizeof(packed));
+            command[KDBG_THREADS_COMMAND - 1] = '\0';
+            if (kdbg_threads_set(t, p->target, p->pid, command) != 0)
+                return -1;
+            t->execs += (data == TRACE_DATA_EXEC);
+            p->thread = 0;
+            p->debugid = 0;
+            break;
+        }
+
+        case TRACE_DATA_THREAD_TERMINATE:
+            kdbg_threads_remove(t, kd[i].arg1);
+            t->terminated++;
+            break;
+        }
+    }
+    return 0;
+}
+
+#endif /* kdbg_threads_h */
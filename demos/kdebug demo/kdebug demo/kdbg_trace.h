@@ -0,0 +1,341 @@
+//
+//  kdbg_trace.h
+//  kdebug demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef kdbg_trace_h
+#define kdbg_trace_h
+
+// Reader of saved kdebug trace files (C99, POSIX).
+//
+// Supports RAW v1 (header, thread map, page aligned kd_buf entries) and the v3 chunked format
+// (header chunk followed by CPU map, thread map and raw event chunks) written by trace(1) and
+// ktrace(1) on 64-bit macOS. The file is mapped, the thread and CPU maps and the entries are
+// used in place and passed to the same kdbg_batch_fn as the live consumer, so the rest of the
+// pipeline does not know where the entries come from. Only misaligned event chunks are copied.
+//
+// The on-disk layout is little endian LP64, the reader expects the same on the host.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "kdbg_compat.h"
+#include "kdbg_consumer.h"
+
+#define KDBG_TRACE_RAW_VERSION1     0x55aa0101u
+#define KDBG_TRACE_RAW_VERSION3     0x00001000u
+
+// v3 chunk tags
+#define KDBG_TRACE_V3_CONFIG        0x00001b00u
+#define KDBG_TRACE_V3_CPU_MAP       0x00001c00u
+#define KDBG_TRACE_V3_THREAD_MAP    0x00001d00u
+#define KDBG_TRACE_V3_RAW_EVENTS    0x00001e00u
+#define KDBG_TRACE_V3_NULL_CHUNK    0x00002000u
+
+// Entries per batch passed to the callback
+#define KDBG_TRACE_BATCH            65536
+
+// RAW v1 header (RAW_header, 24 bytes with the tail padding)
+typedef struct kdbg_trace_v1_header {
+    int32_t  version_no;
+    int32_t  thread_count;
+    uint64_t TOD_secs;
+    uint32_t TOD_usecs;
+    uint32_t padding;
+} kdbg_trace_v1_header_t;
+
+// v3 chunk header (kd_chunk_header_v3), the payload of length bytes follows
+typedef struct kdbg_trace_chunk_header {
+    uint32_t tag;
+    uint32_t sub_tag;
+    uint64_t length;
+} kdbg_trace_chunk_header_t;
+
+// Payload of the v3 header chunk (kd_header_v3 without the chunk header)
+typedef struct kdbg_trace_v3_header {
+    uint32_t timebase_numer;
+    uint32_t timebase_denom;
+    uint64_t timestamp;
+    uint64_t walltime_secs;
+    uint32_t walltime_usecs;
+    uint32_t timezone_minuteswest;
+    uint32_t timezone_dst;
+    uint32_t flags;
+} kdbg_trace_v3_header_t;
+
+// Thread map entry (kd_threadmap)
+typedef struct kdbg_trace_thread {
+    uint64_t thread;
+    int32_t  valid;             // process ID
+    char     command[20];
+} kdbg_trace_thread_t;
+
+// CPU map entry (kd_cpumap), preceded by kd_cpumap_header in the CPU map chunk
+typedef struct kdbg_trace_cpu {
+    uint32_t cpu_id;
+    uint32_t flags;
+    char     name[8];
+} kdbg_trace_cpu_t;
+
+typedef struct kdbg_trace_chunk {
+    uint32_t tag;
+    uint32_t sub_tag;
+    const uint8_t *data;
+    size_t   length;
+    int      truncated;         // the file ends inside the chunk, length was cut
+} kdbg_trace_chunk_t;
+
+typedef struct kdbg_trace {
+    const uint8_t *map;
+    size_t   size;
+    uint32_t version;           // KDBG_TRACE_RAW_VERSION1 or KDBG_TRACE_RAW_VERSION3
+
+    // Maps, pointing into the file (NULL if the file has none)
+    const kdbg_trace_thread_t *threads;
+    size_t   thread_count;
+    const kdbg_trace_cpu_t *cpus;
+    size_t   cpu_count;
+
+    // Mach time units to nanoseconds, 0/0 if unknown (v1)
+    uint32_t timebase_numer;
+    uint32_t timebase_denom;
+
+    size_t   events_offset;     // v1: first entry, v3: first chunk after the header
+    int      truncated;         // set by kdbg_trace_read if the file ends inside an entry
+    kd_buf  *bounce;            // for misaligned event chunks
+} kdbg_trace_t;
+
+static inline int kdbg_trace_kd_buf_aligned(const void *p)
+{
+    const size_t alignment = offsetof(struct { char c; kd_buf kd; }, kd);
+    return ((uintptr_t) p % alignment) == 0;
+}
+
+// Reads the chunk at *offset and advances the offset. Returns 1 if a chunk was read and 0 at the
+// end of the file. A chunk cut by the end of the file (interrupted capture) is returned with
+// the rest of the file and the truncated flag.
+static inline int kdbg_trace_next_chunk(const kdbg_trace_t *t, size_t *offset, kdbg_trace_chunk_t *chunk)
+{
+    kdbg_trace_chunk_header_t header;
+    size_t rest;
+
+    if (*offset >= t->size || t->size - *offset < sizeof(header))
+        return 0;
+    memcpy(&header, t->map + *offset, sizeof(header));
+    rest = t->size - *offset - sizeof(header);
+
+    chunk->tag = header.tag;
+    chunk->sub_tag = header.sub_tag;
+    chunk->data = t->map + *offset + sizeof(header);
+    chunk->truncated = header.length > rest;
+    chunk->length = chunk->truncated ? rest : (size_t) header.length;
+    *offset += sizeof(header) + chunk->length;
+    return 1;
+}
+
+static inline int kdbg_trace_zero(const uint8_t *p, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        if (p[i])
+            return 0;
+    return 1;
+}
+
+static inline int kdbg_trace_open_v1(kdbg_trace_t *t)
+{
+    kdbg_trace_v1_header_t header;
+    size_t end, page;
+
+    memcpy(&header, t->map, sizeof(header));
+    if (header.thread_count < 0
+        || (size_t) header.thread_count > (t->size - sizeof(header)) / sizeof(kdbg_trace_thread_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+    t->threads = (const kdbg_trace_thread_t *) (t->map + sizeof(header));
+    t->thread_count = (size_t) header.thread_count;
+
+    // The entries start at the next page, which is 16 KiB on newer kernels and 4 KiB on older
+    // ones. The padding is zeroed, a timestamp is not.
+    end = sizeof(header) + t->thread_count * sizeof(kdbg_trace_thread_t);
+    page = (end + 16383) & ~(size_t) 16383;
+    if (page > t->size || !kdbg_trace_zero(t->map + end, page - end))
+        page = (end + 4095) & ~(size_t) 4095;
+    t->events_offset = (page > t->size) ? t->size : page;
+    return 0;
+}
+
+static inline int kdbg_trace_open_v3(kdbg_trace_t *t)
+{
+    size_t offset = 0;
+    kdbg_trace_chunk_t chunk;
+    kdbg_trace_v3_header_t header;
+
+    // Header chunk first, its length includes the padding to the next page
+    if (kdbg_trace_next_chunk(t, &offset, &chunk) != 1 || chunk.length < sizeof(header)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&header, chunk.data, sizeof(header));
+    t->timebase_numer = header.timebase_numer;
+    t->timebase_denom = header.timebase_denom;
+    t->events_offset = offset;
+
+    // The maps precede the events, they are looked up once
+    while (kdbg_trace_next_chunk(t, &offset, &chunk)) {
+        if (chunk.tag == KDBG_TRACE_V3_THREAD_MAP && t->threads == NULL) {
+            t->threads = (const kdbg_trace_thread_t *) chunk.data;
+            t->thread_count = chunk.length / sizeof(kdbg_trace_thread_t);
+        } else if (chunk.tag == KDBG_TRACE_V3_CPU_MAP && t->cpus == NULL && chunk.length >= 8) {
+            uint32_t cpu_count;
+            memcpy(&cpu_count, chunk.data + 4, sizeof(cpu_count));
+            if (cpu_count > (chunk.length - 8) / sizeof(kdbg_trace_cpu_t))
+                cpu_count = (uint32_t) ((chunk.length - 8) / sizeof(kdbg_trace_cpu_t));
+            t->cpus = (const kdbg_trace_cpu_t *) (chunk.data + 8);
+            t->cpu_count = cpu_count;
+        } else if (chunk.tag == KDBG_TRACE_V3_RAW_EVENTS) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Maps the trace file. Returns 0 on success, -1 and errno otherwise (EINVAL for files which
+// are not kdebug traces).
+static inline int kdbg_trace_open(kdbg_trace_t *t, const char *path)
+{
+    struct stat st;
+    uint32_t version;
+    void *map;
+    int fd, r;
+
+    memset(t, 0, sizeof(*t));
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t) st.st_size < sizeof(kdbg_trace_v1_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    t->map = (const uint8_t *) map;
+    t->size = (size_t) st.st_size;
+    posix_madvise(map, t->size, POSIX_MADV_SEQUENTIAL);
+
+    memcpy(&version, t->map, sizeof(version));
+    t->version = version;
+    if (version == KDBG_TRACE_RAW_VERSION1)
+        r = kdbg_trace_open_v1(t);
+    else if (version == KDBG_TRACE_RAW_VERSION3)
+        r = kdbg_trace_open_v3(t);
+    else {
+        errno = EINVAL;
+        r = -1;
+    }
+    if (r != 0) {
+        const int error = errno;
+        munmap(map, t->size);
+        memset(t, 0, sizeof(*t));
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+static inline void kdbg_trace_close(kdbg_trace_t *t)
+{
+    if (t->map)
+        munmap((void *) t->map, t->size);
+    free(t->bounce);
+    memset(t, 0, sizeof(*t));
+}
+
+// Passes the entries of the region to fn in batches of at most KDBG_TRACE_BATCH entries
+static inline int kdbg_trace_emit(kdbg_trace_t *t, const uint8_t *data, size_t count,
+                                  kdbg_batch_fn fn, void *ctx, kdbg_batch_info_t *info)
+{
+    const int aligned = kdbg_trace_kd_buf_aligned(data);
+
+    if (!aligned && t->bounce == NULL) {
+        t->bounce = (kd_buf *) malloc(KDBG_TRACE_BATCH * sizeof(kd_buf));
+        if (t->bounce == NULL)
+            return -1;
+    }
+
+    for (size_t i = 0; i < count; ) {
+        const size_t n = (count - i < KDBG_TRACE_BATCH) ? count - i : KDBG_TRACE_BATCH;
+        const kd_buf *kd = (const kd_buf *) (const void *) (data + i * sizeof(kd_buf));
+
+        if (!aligned) {
+            memcpy(t->bounce, data + i * sizeof(kd_buf), n * sizeof(kd_buf));
+            kd = t->bounce;
+        }
+
+        info->lost_markers = 0;
+        for (size_t j = 0; j < n; j++)
+            if ((kd[j].debugid & KDBG_FUNC_MASK) == TRACE_LOST_EVENTS)
+                info->lost_markers++;
+        info->capacity = n;
+        fn(ctx, kd, n, info);
+
+        info->sequence++;
+        info->first_event += n;
+        i += n;
+    }
+    return 0;
+}
+
+// Passes all the entries of the trace to fn, in file order. Returns the number of entries or -1
+// and errno. A partial entry at the end of the file is skipped and sets the truncated flag.
+static inline ssize_t kdbg_trace_read(kdbg_trace_t *t, kdbg_batch_fn fn, void *ctx)
+{
+    kdbg_batch_info_t info;
+
+    memset(&info, 0, sizeof(info));
+    if (t->version == KDBG_TRACE_RAW_VERSION1) {
+        const size_t count = (t->size - t->events_offset) / sizeof(kd_buf);
+        t->truncated = (t->size - t->events_offset) % sizeof(kd_buf) != 0;
+        if (kdbg_trace_emit(t, t->map + t->events_offset, count, fn, ctx, &info) != 0)
+            return -1;
+    } else {
+        size_t offset = t->events_offset;
+        kdbg_trace_chunk_t chunk;
+
+        while (kdbg_trace_next_chunk(t, &offset, &chunk)) {
+            if (chunk.tag != KDBG_TRACE_V3_RAW_EVENTS)
+                continue;
+            t->truncated |= chunk.truncated || chunk.length % sizeof(kd_buf) != 0;
+            if (kdbg_trace_emit(t, chunk.data, chunk.length / sizeof(kd_buf), fn, ctx, &info) != 0)
+                return -1;
+        }
+    }
+    return (ssize_t) info.first_event;
+}
+
+// Thread map lookup, NULL if the thread is not in the map
+static inline const kdbg_trace_thread_t *kdbg_trace_thread(const kdbg_trace_t *t, uint64_t thread)
+{
+    for (size_t i = 0; i < t->thread_count; i++)
+        if (t->threads[i].thread == thread)
+            return &t->threads[i];
+    return NULL;
+}
+
+#endif /* kdbg_trace_h */
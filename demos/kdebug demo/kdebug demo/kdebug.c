@@ -11,32 +11,38 @@
 #pragma message("Use attached makefile to build the project.")
 
 #define PROGNAME "kdebug"
+#define TRACE_CODES "/usr/share/misc/trace.codes"
+#define TRACE_CODES_CACHE "/var/db/kdebug.trace.codes.cache"  // root only directory
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/sysctl.h>
 #include <sys/ptrace.h>
 #include <sys/syscall.h>
+#include <mach/mach_time.h>
 
-struct proc;
+// Kernel Debug definitions (sys_private/kdebug_private.h)
+#include "kdbg_compat.h"
+#include "kdbg_consumer.h"
+#include "kdbg_decode.h"
+#include "kdbg_merge.h"
+#include "kdbg_pairing.h"
+#include "kdbg_symbols.h"
+#include "kdbg_threads.h"
+#include "kdbg_trace.h"
 
-// Kernel Debug definitions
-#define PRIVATE
-#define KERNEL_PRIVATE
-//#include <Kernel/sys/kdebug_private.h>
-#include <sys_private/kdebug_private.h>
-#undef KERNEL_PRIVATE
-#undef PRIVATE
+#include "../../../Common/Tools/EventRecord.h"
 
-#define KDBG_CPU_MASK            0x0f00000000000000ULL
-#define KDBG_CPU_SHIFT           56
-
-// Configurable parameters
+// Configurable parameters (the buffer size and the poll interval adapt to the event rate)
 enum {
     KDBG_BSD_SYSTEM_CALL_OF_INTEREST = SYS_chdir,
-    KDBG_SAMPLE_SIZE                 = 16384,
-    KDBG_SAMPLE_INTERVAL             = 100000 // in microseconds
+    KDBG_MIN_SAMPLE_SIZE             = 16384,
+    KDBG_MAX_SAMPLE_SIZE             = 1024 * 1024,
+    KDBG_MIN_SAMPLE_INTERVAL         = 1000,    // in microseconds
+    KDBG_MAX_SAMPLE_INTERVAL         = 100000   // in microseconds
 };
 // Useful constants
 enum {
@@ -44,38 +50,77 @@ enum {
     KDBG_CLASS_SHIFT = 24              // for extracting class type
 };
 
+// Decoded batch, columns are reused across batches
+typedef struct batch_decoder {
+    kdbg_columns_t columns;
+    kdbg_class_filter_t filter;
+} batch_decoder_t;
+
 // Global variables
 int     exiting = 0;    // avoid recursion in exit handlers
+volatile sig_atomic_t stopping = 0; // set by the signal handler, stops the consumer
 size_t  oldlen;         // used while calling sysctl()
 int     mib[8];         // used while calling sysctl()
 pid_t   pid = -1;       // process ID of the traced process
+evrec_writer_t recorder = EVREC_WRITER_INIT; // binary record file, disabled if fd < 0
+kdbg_pairing_t latencies;   // system call latencies, printed on exit
+kdbg_merge_t merge;         // orders the entries of the CPUs before they are decoded
+batch_decoder_t decoder;
+kdbg_trace_t trace;         // saved trace file (-f), the kernel buffer is not used then
+mach_timebase_info_data_t timebase;
+kdbg_symbols_t symbols;     // debugid names, empty if trace.codes can not be loaded
+kdbg_threads_t threads;     // thread to process map
 
 // Global flags
 int trace_enabled   = 0;
 int set_remove_flag = 1;
 
-// Mapping of kdebug class IDs to class names
-const char *KDBG_CLASS_NAMES[256] = {
-    NULL,           // 0
-    "DBG_MACH",     // 1
-    "DBG_NETWORK",  // 2
-    "DBG_FSYSTEM",  // 3
-    "DBG_BSD",      // 4
-    "DBG_IOKIT",    // 5
-    "DBG_DRIVERS",  // 6
-    "DBG_TRACE",    // 7
-    "DBG_DLIL",     // 8
-    "DBG_SECURITY", // 9
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    "DBG_MISC",
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    "DBG_DYLD",     // 31
-    "DBG_QT",       // 32
-    "DBG_APPS",     // 33
-    NULL,
+// Mapping of kdebug class IDs to class names (dense, indexed by the class ID)
+#define KDBG_CLASS(c) [c] = #c
+static const char *const KDBG_CLASS_NAMES[256] = {
+    KDBG_CLASS(DBG_MACH),
+    KDBG_CLASS(DBG_NETWORK),
+    KDBG_CLASS(DBG_FSYSTEM),
+    KDBG_CLASS(DBG_BSD),
+    KDBG_CLASS(DBG_IOKIT),
+    KDBG_CLASS(DBG_DRIVERS),
+    KDBG_CLASS(DBG_TRACE),
+    KDBG_CLASS(DBG_DLIL),
+    KDBG_CLASS(DBG_PTHREAD),
+    KDBG_CLASS(DBG_CORESTORAGE),
+    KDBG_CLASS(DBG_CG),
+    KDBG_CLASS(DBG_MONOTONIC),
+    KDBG_CLASS(DBG_MISC),
+    KDBG_CLASS(DBG_SECURITY),
+    KDBG_CLASS(DBG_DYLD),
+    KDBG_CLASS(DBG_QT),
+    KDBG_CLASS(DBG_APPS),
+    KDBG_CLASS(DBG_LAUNCHD),
+    KDBG_CLASS(DBG_PERF),
+    KDBG_CLASS(DBG_IMPORTANCE),
+    KDBG_CLASS(DBG_BANK),
+    KDBG_CLASS(DBG_XPC),
+    KDBG_CLASS(DBG_ATM),
+    KDBG_CLASS(DBG_ARIADNE),
+    KDBG_CLASS(DBG_DAEMON),
+    KDBG_CLASS(DBG_ENERGYTRACE),
+    KDBG_CLASS(DBG_DISPATCH),
+    KDBG_CLASS(DBG_IMG),
+    KDBG_CLASS(DBG_UMALLOC),
+    KDBG_CLASS(DBG_TURNSTILE),
+    KDBG_CLASS(DBG_MIG),
 };
+#undef KDBG_CLASS
+
+// Never fails, unknown classes are mapped to fallback
+static inline const char *kdbg_class_name(unsigned int class_, const char *fallback)
+{
+    const char *name = (class_ < 256) ? KDBG_CLASS_NAMES[class_] : NULL;
+    return name ? name : fallback;
+}
 
 // Functions that we implement (the 'u' in ukdbg represents user space)
+void ukdbg_stop_handler(int);
 void ukdbg_exit_handler(int);
 void ukdbg_exit(const char *);
 void ukdbg_setenable(int);
@@ -85,7 +130,21 @@ void ukdbg_setbuf(int);
 void ukdbg_getbuf(kbufinfo_t *);
 void ukdbg_setpidcheck(pid_t, int);
 void ukdbg_read(char *, size_t *);
+void ukdbg_readthrmap(kdbg_threads_t *);
 void ukdbg_setreg_valcheck(int val1, int val2, int val3, int val4);
+void ukdbg_start(int nbufs);
+void print_latencies(void);
+void print_summary(void);
+static void print_batch(void *ctx, const kd_buf *kd, size_t count);
+
+// Only sets the flag, the merge and the recorder may be in the middle of an update. main
+// reports and cleans up once the consumer returns.
+void ukdbg_stop_handler(int s)
+{
+    (void) s;
+    stopping = 1;
+}
+
 void ukdbg_exit_handler(int s)
 {
     exiting = 1;
@@ -98,6 +157,9 @@ void ukdbg_exit_handler(int s)
     if (set_remove_flag)
         ukdbg_clear();
 
+    if (recorder.fd >= 0 && evrec_writer_close(&recorder) != 0)
+        perror("evrec_writer_close");
+
     fprintf(stderr, "cleaning up...\n");
     exit(s);
 }
@@ -197,7 +259,7 @@ void ukdbg_setreg_valcheck(int val1, int val2, int val3, int val4)
 // Retrieve trace buffer information from the kernel
 void ukdbg_getbuf(kbufinfo_t *bufinfop)
 {
-    oldlen = sizeof(bufinfop);
+    oldlen = sizeof(*bufinfop);
     mib[0] = CTL_KERN;
     mib[1] = KERN_KDEBUG;
     mib[2] = KERN_KDGETBUF;
@@ -205,7 +267,8 @@ void ukdbg_getbuf(kbufinfo_t *bufinfop)
         ukdbg_exit("ukdbg_getbuf::sysctl");
 }
 
-// Retrieve some of the trace buffer from the kernel
+// Retrieve some of the trace buffer from the kernel, len is the size of buf in bytes on input
+// and the number of read kd_buf entries on output
 void ukdbg_read(char *buf, size_t *len)
 {
     mib[0] = CTL_KERN;
@@ -215,6 +278,168 @@ void ukdbg_read(char *buf, size_t *len)
         ukdbg_exit("ukdbg_read::sysctl");
 }
 
+// Retrieve the thread map the kernel took at setup
+void ukdbg_readthrmap(kdbg_threads_t *map)
+{
+    kbufinfo_t info;
+    kd_threadmap *entries;
+    size_t size;
+
+    ukdbg_getbuf(&info);
+    if (info.nkdthreads <= 0)
+        return;
+    size = (size_t) info.nkdthreads * sizeof(kd_threadmap);
+    if ((entries = (kd_threadmap *) malloc(size)) == NULL)
+        ukdbg_exit("ukdbg_readthrmap::malloc");
+
+    mib[0] = CTL_KERN;
+    mib[1] = KERN_KDEBUG;
+    mib[2] = KERN_KDTHRMAP;
+    if (sysctl(mib, 3, entries, &size, NULL, 0) < 0)
+        ukdbg_exit("ukdbg_readthrmap::sysctl");
+    // kd_threadmap and kdbg_trace_thread_t have the same layout
+    if (kdbg_threads_load(map, (const kdbg_trace_thread_t *) entries, size / sizeof(kd_threadmap)) != 0)
+        ukdbg_exit("kdbg_threads_load");
+    free(entries);
+}
+
+// (Re)starts tracing of the system call of interest with a trace buffer of nbufs entries
+void ukdbg_start(int nbufs)
+{
+    if (trace_enabled)
+        ukdbg_setenable(0);
+    ukdbg_clear();                  // Clean up related buffers
+    ukdbg_setbuf(nbufs);            // Set buffer for the desired # of entries
+    ukdbg_reinit();                 // Reinitialize the facility
+    if (pid > 0)
+        ukdbg_setpidcheck(pid, 1);  // We want this pid
+    // We want this particular BSD system call
+    ukdbg_setreg_valcheck(BSDDBG_CODE(DBG_BSD_EXCP_SC, KDBG_BSD_SYSTEM_CALL_OF_INTEREST), 0, 0, 0);
+    ukdbg_setenable(1);             // Enable tracing
+}
+
+// kdbg_source_t of the kernel trace buffer, the ukdbg functions exit on failure
+static int sysctl_source_get_info(void *ctx, kbufinfo_t *info)
+{
+    (void) ctx;
+    ukdbg_getbuf(info);
+    return 0;
+}
+
+static int sysctl_source_read(void *ctx, kd_buf *events, size_t *count)
+{
+    size_t bytes = *count * sizeof(kd_buf);
+
+    (void) ctx;
+    ukdbg_read((char *) events, &bytes);
+    *count = bytes;     // entries, not bytes
+    return 0;
+}
+
+static int sysctl_source_resize(void *ctx, size_t entries)
+{
+    (void) ctx;
+    ukdbg_start((int) entries);
+    return 0;
+}
+
+// Batches of the consumer, the entries are passed to print_batch in time order
+static void merge_batch(void *ctx, const kd_buf *kd, size_t count, const kdbg_batch_info_t *info)
+{
+    if (info->wrapped || info->lost_markers)
+        fprintf(stderr, "batch %llu: trace buffer wrapped, events were lost (%zu entries, poll interval %u us)\n",
+                (unsigned long long) info->sequence, info->capacity, info->interval_us);
+
+    if (kdbg_merge_push(&merge, kd, count, print_batch, NULL, ctx) != 0)
+        ukdbg_exit("kdbg_merge_push");
+}
+
+static void print_batch(void *ctx, const kd_buf *kd, size_t count)
+{
+    batch_decoder_t *decoder = (batch_decoder_t *) ctx;
+    kdbg_columns_t *c = &decoder->columns;
+
+    // Thread lifecycle entries, before they are filtered out
+    if (kdbg_threads_add(&threads, kd, count) != 0)
+        ukdbg_exit("kdbg_threads_add");
+
+    c->count = 0;
+    if (kdbg_columns_reserve(c, count) != 0)
+        ukdbg_exit("kdbg_columns_reserve");
+    kdbg_decode(kd, count, &decoder->filter, c);
+    kdbg_pairing_add_columns(&latencies, c);
+
+    for (size_t i = 0; i < c->count; i++) {
+        const char *qual = "";
+        if (c->qualifier[i] & DBG_FUNC_START)
+            qual = "DBG_FUNC_START";
+        else if (c->qualifier[i] & DBG_FUNC_END)
+            qual = "DBG_FUNC_END";
+
+        // Note that 'eventid' should be the system call we were looking for
+        // (eventid == BSDDBG_CODE(DBG_BSD_EXCP_SC, code) is true
+
+        const char *name = kdbg_symbols_lookup(&symbols, c->eventid[i]);
+        const kdbg_thread_t *thread = kdbg_threads_lookup(&threads, c->thread[i]);
+        printf("%llu: cpu %u %s code %#x %s thread %p %s[%d] %s\n",
+               (unsigned long long) c->timestamp[i],
+               c->cpu[i],
+               kdbg_class_name(c->class_[i], ""),
+               c->eventid[i],
+               name ? name : "",
+               (void *) (uintptr_t) c->thread[i],
+               thread ? thread->command : "?",
+               thread ? thread->pid : -1,
+               qual);
+
+        if (recorder.fd >= 0) {
+            evrec_event_t ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.source = EVREC_SOURCE_KDEBUG;
+            ev.type = c->eventid[i] | c->qualifier[i];
+            ev.pid = thread ? thread->pid : -1;     // -1 if the thread is not known
+            ev.tid = c->thread[i];
+            ev.mach_time = c->timestamp[i];
+            ev.flags = c->arg1[i];
+            if (evrec_write(&recorder, &ev) < 0)
+                perror("evrec_write");
+        }
+    }
+}
+
+// Emits the entries left in the reorder window and prints the statistics (end of the stream)
+void print_summary(void)
+{
+    if (merge.out) {
+        kdbg_merge_flush(&merge, print_batch, &decoder);
+        fprintf(stderr, "%llu entries arrived too late to be ordered (dropped), %llu forced out of the reorder window\n",
+                (unsigned long long) merge.late, (unsigned long long) merge.forced);
+    }
+    print_latencies();
+}
+
+// Latency percentiles of the traced system calls
+void print_latencies(void)
+{
+    if (latencies.histograms == NULL || timebase.denom == 0)
+        return;
+
+    fprintf(stderr, "%llu system calls, %llu without an end, %llu without a start\n",
+            (unsigned long long) latencies.intervals, (unsigned long long) latencies.lost_ends,
+            (unsigned long long) latencies.orphan_ends);
+    for (size_t i = 0; i <= latencies.histogram_mask; i++) {
+        const kdbg_histogram_t *h = latencies.histograms[i];
+        // Mach time units to microseconds
+        const double us = (double) timebase.numer / timebase.denom / 1000.0;
+        if (h == NULL)
+            continue;
+        fprintf(stderr, "code %#x: %llu calls, p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+                h->eventid, (unsigned long long) h->count,
+                kdbg_histogram_percentile(h, 0.50) * us, kdbg_histogram_percentile(h, 0.90) * us,
+                kdbg_histogram_percentile(h, 0.99) * us, h->max * us);
+    }
+}
+
 int main(int argc, char **argv)
 {
     const char* demoName = "kdebug";
@@ -222,78 +447,115 @@ int main(int argc, char **argv)
     printf("(%s) Hello, World!\n", demoName);
     printf("Point of interest: %s", "All the events!\n");
 
-    int i, count;
-    kd_buf *kd;
-    char *kd_buf_memory;
-    kbufinfo_t bufinfo = { 0, 0, 0, 0 };
-    unsigned short code;
-
-    KDBG_CLASS_NAMES[255] = "DBG_MIG";
+    const kdbg_source_t source = { NULL, sysctl_source_get_info, sysctl_source_read, sysctl_source_resize, NULL };
+    const kdbg_consumer_config_t config = {
+        KDBG_MIN_SAMPLE_SIZE, KDBG_MAX_SAMPLE_SIZE, KDBG_MIN_SAMPLE_INTERVAL, KDBG_MAX_SAMPLE_INTERVAL
+    };
+    kdbg_consumer_t consumer;
+    kdbg_merge_config_t merge_config = KDBG_MERGE_CONFIG_DEFAULT;
+    kdbg_pairing_config_t pairing_config = KDBG_PAIRING_CONFIG_DEFAULT;
+    const char *trace_path = NULL;
+    const char *codes_path = TRACE_CODES;
+
+    int arg = 1;
+    if (argc > arg + 1 && strcmp(argv[arg], "-r") == 0) {
+        if (evrec_writer_open(&recorder, argv[arg + 1]) != 0) {
+            perror("evrec_writer_open");
+            exit(1);
+        }
+        arg += 2;
+    }
+    if (argc > arg + 1 && strcmp(argv[arg], "-c") == 0) {
+        codes_path = argv[arg + 1];
+        arg += 2;
+    }
+    if (argc > arg + 1 && strcmp(argv[arg], "-f") == 0) {
+        trace_path = argv[arg + 1];
+        arg += 2;
+    }
 
-    if (argc > 2) {
-        fprintf(stderr, "usage: %s [<pid>]\n", PROGNAME); exit(1);
+    if (argc - arg > 1 || (trace_path && argc - arg > 0)) {
+        fprintf(stderr, "usage: %s [-r <record file>] [-c <trace.codes>] [-f <trace file> | <pid>]\n", PROGNAME); exit(1);
         exit(1);
     }
 
-    if (argc == 2)
-        pid = atoi(argv[1]);
-
-    code = KDBG_BSD_SYSTEM_CALL_OF_INTEREST;
+    if (argc - arg == 1)
+        pid = atoi(argv[arg]);
 
     // Arrange for cleanup
-    signal(SIGHUP, ukdbg_exit_handler);
-    signal(SIGINT, ukdbg_exit_handler);
-    signal(SIGQUIT, ukdbg_exit_handler);
-    signal(SIGTERM, ukdbg_exit_handler);
-
-    kd_buf_memory = malloc(KDBG_SAMPLE_SIZE * sizeof(kd_buf));
-    if (!kd_buf_memory) {
-        perror("malloc");
+    signal(SIGHUP, ukdbg_stop_handler);
+    signal(SIGINT, ukdbg_stop_handler);
+    signal(SIGQUIT, ukdbg_stop_handler);
+    signal(SIGTERM, ukdbg_stop_handler);
+
+    if (trace_path) {
+        // The trace is read instead of the kernel buffer, which is left alone
+        set_remove_flag = 0;
+        if (kdbg_trace_open(&trace, trace_path) != 0) {
+            perror(trace_path);
+            exit(1);
+        }
+        timebase.numer = trace.timebase_numer;
+        timebase.denom = trace.timebase_denom;
+    }
+    if (timebase.denom == 0 && mach_timebase_info(&timebase) != KERN_SUCCESS)
+        memset(&timebase, 0, sizeof(timebase));
+
+    // 10 ms reorder window in Mach time units
+    if (timebase.numer)
+        merge_config.window = 10000000ull * timebase.denom / timebase.numer;
+    if (kdbg_merge_init(&merge, &merge_config) != 0) {
+        perror("kdbg_merge_init");
         exit(1);
     }
 
-    ukdbg_clear();                  // Clean up related buffers
-    ukdbg_setbuf(KDBG_SAMPLE_SIZE); // Set buffer for the desired # of entries
-    ukdbg_reinit();                 // Reinitialize the facility
-    if (pid > 0)
-        ukdbg_setpidcheck(pid, 1);  // We want this pid
-    // We want this particular BSD system call
-    ukdbg_setreg_valcheck(BSDDBG_CODE(DBG_BSD_EXCP_SC, code), 0, 0, 0);
-    ukdbg_setenable(1);             // Enable tracing
-    while (1) {
-        ukdbg_getbuf(&bufinfo);                     // Query information
-        oldlen = bufinfo.nkdbufs * sizeof(kd_buf);  // How much to read?
-        ukdbg_read(kd_buf_memory, &oldlen);         // Read that much
-        count = oldlen;
-
-        kd = (kd_buf *)kd_buf_memory;
-        for (i = 0; i < count; i++) {
-            char *qual = "";
-            uint64_t cpu, now;
-            int debugid, thread, type, class_;
-
-            thread = kd[i].arg5;
-            debugid = kd[i].debugid;
-            type = debugid & KDBG_FUNC_MASK;
-            class_ = (debugid & KDBG_CLASS_MASK) >> KDBG_CLASS_SHIFT;
-            now = kd[i].timestamp & KDBG_TIMESTAMP_MASK;
-            cpu = (kd[i].timestamp & KDBG_CPU_MASK) >> KDBG_CPU_SHIFT;
-            if (debugid & DBG_FUNC_START)
-                qual = "DBG_FUNC_START";
-            else if (debugid & DBG_FUNC_END)
-                qual = "DBG_FUNC_END";
-
-            // Note that 'type' should be the system call we were looking for
-            // (type == BSDDBG_CODE(DBG_BSD_EXCP_SC, code) is true
-
-            printf("%lld: cpu %lld %s code %#x thread %p %s\n",
-                   now,
-                   cpu,
-                   (KDBG_CLASS_NAMES[class_]) ? KDBG_CLASS_NAMES[class_] : "",
-                   type,
-                   (void *)thread,
-                   qual);
-        }
-        usleep(KDBG_SAMPLE_INTERVAL);
+    // 10 s until a start without an end is dropped, in Mach time units
+    if (timebase.numer)
+        pairing_config.timeout = (uint64_t) (10e9 * timebase.denom / timebase.numer);
+    if (kdbg_pairing_init(&latencies, &pairing_config) != 0) {
+        perror("kdbg_pairing_init");
+        exit(1);
+    }
+
+    if (kdbg_threads_init(&threads, 4096) != 0) {
+        perror("kdbg_threads_init");
+        exit(1);
+    }
+
+    // The events are printed without names if the codes are missing
+    if (kdbg_symbols_load(&symbols, codes_path, TRACE_CODES_CACHE) != 0)
+        perror(codes_path);
+
+    // Only the BSD system calls are printed (the kernel is set up for one of them), trace
+    // infrastructure entries (i.e. TRACE_LOST_EVENTS) are dropped by the decoder
+    kdbg_columns_init(&decoder.columns);
+    kdbg_class_filter_clear(&decoder.filter);
+    kdbg_class_filter_add_subclass(&decoder.filter, DBG_BSD, DBG_BSD_EXCP_SC);
+
+    if (trace_path) {
+        if (kdbg_threads_load(&threads, trace.threads, trace.thread_count) != 0)
+            ukdbg_exit("kdbg_threads_load");
+        if (kdbg_trace_read(&trace, merge_batch, &decoder) < 0)
+            perror(trace_path);
+        else if (trace.truncated)
+            fprintf(stderr, "%s: the trace is truncated, the last entries are missing\n", trace_path);
+        kdbg_trace_close(&trace);
+        print_summary();
+        ukdbg_exit_handler(0);
     }
+
+    // Sets the trace buffer up and enables tracing (through sysctl_source_resize)
+    if (kdbg_consumer_init(&consumer, &source, &config) != 0) {
+        perror("kdbg_consumer_init");
+        exit(1);
+    }
+    ukdbg_readthrmap(&threads);
+
+    // Runs until a signal sets stopping
+    if (kdbg_consumer_run(&consumer, merge_batch, &decoder, &stopping) != 0)
+        ukdbg_exit("kdbg_consumer_run");
+    kdbg_consumer_destroy(&consumer);
+    print_summary();
+    kdbg_columns_destroy(&decoder.columns);
+    ukdbg_exit_handler(0);
 }
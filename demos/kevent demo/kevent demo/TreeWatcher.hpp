@@ -0,0 +1,487 @@
+//
+//  TreeWatcher.hpp
+//  kevent demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef TreeWatcher_hpp
+#define TreeWatcher_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "Watcher.hpp"
+
+namespace kev {
+
+struct TreeWatcherConfig {
+    std::size_t budget = 4096;                          // kernel watches
+    std::chrono::milliseconds scanInterval {2000};      // full pass over the cold directories
+    std::size_t scanSlice = 1024;                       // directories checked per step
+};
+
+// Watches every directory of a tree with at most `budget` kernel watches. EVFILT_VNODE needs an
+// open descriptor per watched node, so a large tree does not fit under RLIMIT_NOFILE (inotify
+// has max_user_watches). The directories are split in two sets:
+//
+//   hot   watched through the Watcher, kept in LRU order of their last change
+//   cold  checked by stat(2) against a snapshot of their ctime/mtime/inode, a full pass over
+//         the cold directories every scanInterval, spread over the polls in slices
+//
+// A cold directory which changed is promoted to hot; when the budget is used up the least
+// recently changed hot directory is demoted to cold to make room. A changed directory is read
+// again to follow subdirectories being created, removed and renamed.
+//
+// Directories are watched, not files: kqueue reports entries being added and removed (files
+// written in place are not reported), inotify also reports the files being written.
+class TreeWatcher
+{
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    using Config = TreeWatcherConfig;
+
+    struct Event {
+        const std::string *path;    // directory, nullptr for kWatchOverflow
+        uint32_t flags;             // kWatch* flags
+        bool scanned;               // found by the stat scan rather than a watch
+    };
+
+    explicit TreeWatcher(const Config &config = Config(),
+                         std::unique_ptr<WatchBackend> backend = std::make_unique<DefaultWatchBackend>())
+        : m_config(config), m_watcher(std::move(backend)), m_nextScan(Clock::now()) {}
+
+    // Walks the tree of root and watches its directories, the shallow ones first. Returns false
+    // and sets errno if root is not a readable directory.
+    bool add(const std::string &root)
+    {
+        struct stat st;
+        if (stat(root.c_str(), &st) != 0)
+            return false;
+        if (!S_ISDIR(st.st_mode)) {
+            errno = ENOTDIR;
+            return false;
+        }
+        const uint32_t top = allocate(root, kNone);
+        snapshot(m_dirs[top], st);
+        m_roots.push_back(top);
+
+        // Breadth first, so when the budget runs out the cold directories are the deep ones
+        std::vector<uint32_t> added {top};
+        for (std::size_t i = 0; i < added.size(); ++i)
+            list(added[i], &added);
+        std::vector<uint32_t> hot;
+        for (uint32_t index : added)
+            if (hot.size() < freeWatches())
+                hot.push_back(index);
+        watch(hot);
+        return true;
+    }
+
+    // Waits up to timeoutMs (-1 forever) for changes and passes them to f(const Event &). The
+    // wait is cut short when a scan step is due. Returns the number of events or -1 and errno.
+    template <typename F>
+    int poll(int timeoutMs, F &&f)
+    {
+        // Rounded up, a wait which ends before the step is due would poll again right away
+        const int untilScan = static_cast<int>(std::max<int64_t>(0,
+            std::chrono::ceil<std::chrono::milliseconds>(m_nextScan - Clock::now()).count()));
+        const int wait = (m_cold == 0) ? timeoutMs : (timeoutMs < 0) ? untilScan : std::min(timeoutMs, untilScan);
+
+        // Collected first: handling an event adds and removes watches, which reuses their slots
+        m_pending.clear();
+        const int n = m_watcher.poll(wait, [this](const Watcher::Event &e) {
+            m_pending.push_back(e);
+        });
+        if (n < 0)
+            return -1;
+
+        int delivered = 0;
+        for (const Watcher::Event &e : m_pending) {
+            if (e.watch == 0) {
+                // Events were lost, the snapshots of the hot directories tell which changed
+                f(Event {nullptr, e.flags, false});
+                ++delivered;
+                std::vector<uint32_t> hot;
+                for (uint32_t index = m_lruHead; index != kNone; index = m_dirs[index].lruNext)
+                    hot.push_back(index);
+                for (uint32_t index : hot)
+                    if (m_dirs[index].used && m_dirs[index].watch)
+                        delivered += check(index, f);
+                continue;
+            }
+            const uint32_t index = dirOf(e.watch);
+            if (index == kNone)
+                continue;
+            ++m_watchChanges;
+            touch(index);
+            f(Event {&m_dirs[index].path, e.flags, false});
+            ++delivered;
+            changed(index);
+        }
+        if (m_cold && Clock::now() >= m_nextScan)
+            delivered += scan(f);
+        return delivered;
+    }
+
+    std::size_t directories() const { return m_dirs.size() - m_free.size(); }
+    std::size_t hot() const { return m_hot; }
+    std::size_t cold() const { return m_cold; }
+    std::size_t descriptors() const { return m_watcher.descriptors(); }
+
+    // Statistics
+    uint64_t promotions() const { return m_promotions; }
+    uint64_t demotions() const { return m_demotions; }
+    uint64_t scanned() const { return m_scanned; }          // stat calls of the cold scan
+    uint64_t passes() const { return m_passes; }            // full passes over the cold set
+    uint64_t watchChanges() const { return m_watchChanges; }
+    uint64_t scanChanges() const { return m_scanChanges; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Dir {
+        std::string path;
+        uint32_t parent = kNone;
+        uint32_t child = kNone;     // first child
+        uint32_t sibling = kNone;   // next child of the parent
+        uint32_t lruPrev = kNone;   // hot directories, most recently changed first
+        uint32_t lruNext = kNone;
+        Watcher::Handle watch = 0;  // 0 if cold
+        uint64_t inode = 0;
+        int64_t mtime = 0;          // nanoseconds
+        int64_t ctime = 0;
+        bool used = false;
+    };
+
+    Config m_config;
+    Watcher m_watcher;
+    std::vector<Dir> m_dirs;
+    std::vector<uint32_t> m_free;
+    std::vector<uint32_t> m_roots;
+    std::vector<uint32_t> m_slotToDir;              // watcher slot to directory
+    std::vector<Watcher::Event> m_pending;
+    uint32_t m_lruHead = kNone;
+    uint32_t m_lruTail = kNone;
+    std::size_t m_hot = 0;
+    std::size_t m_cold = 0;
+    std::size_t m_cursor = 0;                       // next directory of the cold scan
+    Clock::time_point m_nextScan;
+
+    uint64_t m_promotions = 0;
+    uint64_t m_demotions = 0;
+    uint64_t m_scanned = 0;
+    uint64_t m_passes = 0;
+    uint64_t m_watchChanges = 0;
+    uint64_t m_scanChanges = 0;
+
+    static int64_t nanoseconds(const struct timespec &ts)
+    {
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static void snapshot(Dir &d, const struct stat &st)
+    {
+        d.inode = st.st_ino;
+#if defined(__APPLE__)
+        d.mtime = nanoseconds(st.st_mtimespec);
+        d.ctime = nanoseconds(st.st_ctimespec);
+#else
+        d.mtime = nanoseconds(st.st_mtim);
+        d.ctime = nanoseconds(st.st_ctim);
+#endif
+    }
+
+    std::size_t freeWatches() const
+    {
+        return (m_hot < m_config.budget) ? m_config.budget - m_hot : 0;
+    }
+
+    uint32_t allocate(const std::string &path, uint32_t parent)
+    {
+        uint32_t index;
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        } else {
+            index = static_cast<uint32_t>(m_dirs.size());
+            m_dirs.emplace_back();
+        }
+        Dir &d = m_dirs[index];
+        d = Dir();
+        d.path = path;
+        d.parent = parent;
+        d.used = true;
+        if (parent != kNone) {
+            d.sibling = m_dirs[parent].child;
+            m_dirs[parent].child = index;
+        }
+        ++m_cold;
+        return index;
+    }
+
+    uint32_t dirOf(Watcher::Handle h) const
+    {
+        const uint32_t slot = static_cast<uint32_t>(h);
+        if (slot >= m_slotToDir.size() || m_slotToDir[slot] == kNone)
+            return kNone;
+        const uint32_t index = m_slotToDir[slot];
+        return (m_dirs[index].watch == h) ? index : kNone;
+    }
+
+    // LRU list of the hot directories
+
+    void unlink(uint32_t index)
+    {
+        Dir &d = m_dirs[index];
+        (d.lruPrev != kNone ? m_dirs[d.lruPrev].lruNext : m_lruHead) = d.lruNext;
+        (d.lruNext != kNone ? m_dirs[d.lruNext].lruPrev : m_lruTail) = d.lruPrev;
+        d.lruPrev = d.lruNext = kNone;
+    }
+
+    void pushFront(uint32_t index)
+    {
+        Dir &d = m_dirs[index];
+        d.lruPrev = kNone;
+        d.lruNext = m_lruHead;
+        (m_lruHead != kNone ? m_dirs[m_lruHead].lruPrev : m_lruTail) = index;
+        m_lruHead = index;
+    }
+
+    void touch(uint32_t index)
+    {
+        if (m_lruHead != index) {
+            unlink(index);
+            pushFront(index);
+        }
+    }
+
+    // Watches the cold directories in one batch. The ones the kernel refuses (EMFILE, ENOSPC,
+    // gone) stay cold and are scanned instead.
+    void watch(const std::vector<uint32_t> &indexes)
+    {
+        std::vector<std::string> paths;
+        paths.reserve(indexes.size());
+        for (uint32_t index : indexes)
+            paths.push_back(m_dirs[index].path);
+        const std::vector<Watcher::Handle> handles = m_watcher.add(paths);
+        for (std::size_t i = 0; i < indexes.size(); ++i) {
+            if (handles[i] == 0)
+                continue;
+            const uint32_t slot = static_cast<uint32_t>(handles[i]);
+            if (slot >= m_slotToDir.size())
+                m_slotToDir.resize(slot + 1, kNone);
+            m_slotToDir[slot] = indexes[i];
+            m_dirs[indexes[i]].watch = handles[i];
+            pushFront(indexes[i]);
+            ++m_hot;
+            --m_cold;
+        }
+    }
+
+    void unwatch(uint32_t index)
+    {
+        Dir &d = m_dirs[index];
+        m_watcher.remove(d.watch);
+        m_slotToDir[static_cast<uint32_t>(d.watch)] = kNone;
+        d.watch = 0;
+        unlink(index);
+        --m_hot;
+        ++m_cold;
+    }
+
+    // Makes room for one more watch and watches the directory
+    void promote(uint32_t index)
+    {
+        if (freeWatches() == 0 && m_lruTail != kNone) {
+            // The snapshot of the demoted directory is current, it was taken on its last change
+            unwatch(m_lruTail);
+            ++m_demotions;
+        }
+        if (freeWatches() > 0) {
+            watch({index});
+            m_promotions += (m_dirs[index].watch != 0);
+        }
+    }
+
+    // Removes the directory and its subtree
+    void release(uint32_t index)
+    {
+        std::vector<uint32_t> stack {index};
+        const uint32_t parent = m_dirs[index].parent;
+        if (parent != kNone) {
+            uint32_t *link = &m_dirs[parent].child;
+            while (*link != index)
+                link = &m_dirs[*link].sibling;
+            *link = m_dirs[index].sibling;
+        } else {
+            m_roots.erase(std::find(m_roots.begin(), m_roots.end(), index));
+        }
+        while (!stack.empty()) {
+            const uint32_t i = stack.back();
+            stack.pop_back();
+            for (uint32_t c = m_dirs[i].child; c != kNone; c = m_dirs[c].sibling)
+                stack.push_back(c);
+            if (m_dirs[i].watch)
+                unwatch(i);
+            m_dirs[i].path.clear();
+            m_dirs[i].path.shrink_to_fit();
+            m_dirs[i].used = false;
+            m_dirs[i].child = kNone;
+            --m_cold;
+            m_free.push_back(i);
+        }
+    }
+
+    // Reads the directory and adds the subdirectories it does not know yet (appended to added,
+    // if any), removes the ones which are gone. Returns false if the directory can not be read.
+    bool list(uint32_t index, std::vector<uint32_t> *added)
+    {
+        DIR *dir = opendir(m_dirs[index].path.c_str());
+        if (dir == nullptr)
+            return false;
+
+        std::vector<std::string> names;
+        while (const struct dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0'
+                || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+                continue;
+            bool isDir = false;
+#if defined(DT_DIR)
+            if (entry->d_type != DT_UNKNOWN)
+                isDir = (entry->d_type == DT_DIR);
+            else
+#endif
+            {
+                struct stat st;
+                isDir = lstat((m_dirs[index].path + "/" + entry->d_name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+            }
+            if (isDir)
+                names.emplace_back(entry->d_name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+
+        // Known children which are not listed any more are gone (or renamed, then listed as new)
+        const std::size_t prefix = m_dirs[index].path.size() + 1;
+        std::vector<std::string> known;
+        for (uint32_t c = m_dirs[index].child; c != kNone; ) {
+            const uint32_t next = m_dirs[c].sibling;
+            std::string name = m_dirs[c].path.substr(prefix);
+            if (std::binary_search(names.begin(), names.end(), name))
+                known.push_back(std::move(name));
+            else
+                release(c);
+            c = next;
+        }
+        std::sort(known.begin(), known.end());
+
+        for (const std::string &name : names) {
+            if (std::binary_search(known.begin(), known.end(), name))
+                continue;
+            const uint32_t child = allocate(m_dirs[index].path + "/" + name, index);
+            struct stat st;
+            if (stat(m_dirs[child].path.c_str(), &st) == 0)
+                snapshot(m_dirs[child], st);
+            if (added)
+                added->push_back(child);
+        }
+        return true;
+    }
+
+    // The directory changed: follows its subdirectories and refreshes its snapshot
+    void changed(uint32_t index)
+    {
+        struct stat st;
+        if (stat(m_dirs[index].path.c_str(), &st) != 0 || st.st_ino != m_dirs[index].inode) {
+            // Removed or renamed, the parent lists it again under its new name
+            const uint32_t parent = m_dirs[index].parent;
+            release(index);
+            if (parent != kNone)
+                list(parent, nullptr);
+            return;
+        }
+        snapshot(m_dirs[index], st);
+
+        // New subtrees are walked; they are watched while the budget lasts
+        std::vector<uint32_t> added;
+        list(index, &added);
+        for (std::size_t i = 0; i < added.size(); ++i)
+            list(added[i], &added);
+        std::vector<uint32_t> hot;
+        for (uint32_t a : added)
+            if (hot.size() < freeWatches())
+                hot.push_back(a);
+        watch(hot);
+    }
+
+    // Compares the directory with its snapshot, reports and promotes it if it changed. Returns
+    // the number of events delivered.
+    template <typename F>
+    int check(uint32_t index, F &&f)
+    {
+        Dir &d = m_dirs[index];
+        struct stat st;
+        uint32_t flags = 0;
+        if (stat(d.path.c_str(), &st) != 0 || st.st_ino != d.inode) {
+            flags = kWatchDelete;
+        } else {
+            Dir now;
+            snapshot(now, st);
+            if (now.mtime != d.mtime)
+                flags |= kWatchWrite;
+            else if (now.ctime != d.ctime)
+                flags |= kWatchAttrib;
+        }
+        if (flags == 0)
+            return 0;
+
+        f(Event {&d.path, flags, true});
+        if (d.watch)
+            touch(index);
+        else if (!(flags & kWatchDelete))
+            promote(index);
+        changed(index);
+        return 1;
+    }
+
+    // One slice of the cold scan
+    template <typename F>
+    int scan(F &&f)
+    {
+        int delivered = 0;
+        std::size_t checked = 0;
+        while (checked < m_config.scanSlice && m_cold > 0) {
+            if (m_cursor >= m_dirs.size()) {
+                m_cursor = 0;
+                ++m_passes;
+            }
+            const uint32_t index = static_cast<uint32_t>(m_cursor++);
+            if (!m_dirs[index].used || m_dirs[index].watch)
+                continue;
+            ++checked;
+            ++m_scanned;
+            const int n = check(index, f);
+            m_scanChanges += static_cast<uint64_t>(n);
+            delivered += n;
+        }
+
+        // The slices are spaced so the cold set is covered once per interval
+        const std::size_t slices = std::max<std::size_t>(1, (m_cold + m_config.scanSlice - 1) / m_config.scanSlice);
+        m_nextScan = Clock::now() + m_config.scanInterval / static_cast<int64_t>(slices);
+        return delivered;
+    }
+};
+
+} // namespace kev
+
+#endif /* TreeWatcher_hpp */
@@ -0,0 +1,501 @@
+//
+//  Watcher.hpp
+//  kevent demo
+//
+//  Created by Jozef on 19/10/2026.
+//
+
+#ifndef Watcher_hpp
+#define Watcher_hpp
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <sys/event.h>
+#else
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#endif
+
+namespace kev {
+
+// Portable event flags, the NOTE_* vnode flags of kqueue
+enum WatchFlags : uint32_t {
+    kWatchDelete    = 1u << 0,
+    kWatchWrite     = 1u << 1,  // file content, or directory entries
+    kWatchExtend    = 1u << 2,
+    kWatchAttrib    = 1u << 3,
+    kWatchLink      = 1u << 4,  // link count, i.e. subdirectories
+    kWatchRename    = 1u << 5,
+    kWatchRevoke    = 1u << 6,  // unmounted or access revoked
+    kWatchOverflow  = 1u << 7,  // events were lost (not bound to a watch)
+};
+
+// Events reported by a backend, slot is the one the watch was added with
+struct BackendEvent {
+    uint32_t slot;
+    uint32_t flags;
+};
+
+// Kernel side of the watcher. Watches are identified by the slots of the watcher's record table,
+// so an event maps to its record by indexing. All the calls take batches.
+class WatchBackend
+{
+public:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    virtual ~WatchBackend() = default;
+
+    // Adds the watches, errors[i] is 0 or the errno of paths[i]
+    virtual void add(const uint32_t *slots, const char *const *paths, std::size_t count, int *errors) = 0;
+    virtual void remove(const uint32_t *slots, std::size_t count) = 0;
+    // Waits up to timeoutMs (-1 forever) for events and drains up to capacity of them. Returns
+    // the number of events or -1 and errno.
+    virtual int wait(BackendEvent *events, std::size_t capacity, int timeoutMs) = 0;
+    // Open file descriptors held by the watches
+    virtual std::size_t descriptors() const = 0;
+};
+
+#if defined(__APPLE__)
+
+// EVFILT_VNODE on one O_EVTONLY descriptor per watch. Registrations are submitted in changelists
+// of kChangeBatch with EV_RECEIPT (one kevent call returns the status of every change), udata is
+// the slot. Closing a descriptor removes its knote, so removal needs no kevent call.
+class KqueueBackend : public WatchBackend
+{
+public:
+    static constexpr std::size_t kChangeBatch = 1024;
+
+    KqueueBackend() : m_kq(kqueue()) {}
+    ~KqueueBackend() override
+    {
+        for (int fd : m_fds)
+            if (fd >= 0)
+                close(fd);
+        if (m_kq >= 0)
+            close(m_kq);
+    }
+    KqueueBackend(const KqueueBackend&) = delete;
+    KqueueBackend &operator=(const KqueueBackend&) = delete;
+
+    bool valid() const { return m_kq >= 0; }
+
+    void add(const uint32_t *slots, const char *const *paths, std::size_t count, int *errors) override
+    {
+        constexpr uint32_t notes = NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE;
+        struct kevent changes[kChangeBatch];
+        struct kevent receipts[kChangeBatch];
+        std::size_t indexes[kChangeBatch];
+
+        for (std::size_t i = 0; i < count; ) {
+            std::size_t n = 0;
+            for (; i < count && n < kChangeBatch; ++i) {
+                const int fd = open(paths[i], O_EVTONLY);
+                errors[i] = (fd < 0) ? errno : 0;
+                if (fd < 0)
+                    continue;
+                setDescriptor(slots[i], fd);
+                EV_SET(&changes[n], fd, EVFILT_VNODE, EV_ADD | EV_CLEAR | EV_RECEIPT, notes, 0,
+                       reinterpret_cast<void *>(static_cast<uintptr_t>(slots[i])));
+                indexes[n++] = i;
+            }
+            if (n == 0)
+                continue;
+
+            const int received = kevent(m_kq, changes, static_cast<int>(n), receipts, static_cast<int>(n), nullptr);
+            if (received < 0) {
+                const int error = errno;
+                for (std::size_t j = 0; j < n; ++j)
+                    fail(slots[indexes[j]], errors[indexes[j]], error);
+                continue;
+            }
+            for (int j = 0; j < received; ++j) {
+                if (!(receipts[j].flags & EV_ERROR) || receipts[j].data == 0)
+                    continue;
+                const uint32_t slot = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(receipts[j].udata));
+                for (std::size_t k = 0; k < n; ++k)
+                    if (slots[indexes[k]] == slot)
+                        fail(slot, errors[indexes[k]], static_cast<int>(receipts[j].data));
+            }
+        }
+    }
+
+    void remove(const uint32_t *slots, std::size_t count) override
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (slots[i] < m_fds.size() && m_fds[slots[i]] >= 0) {
+                close(m_fds[slots[i]]);
+                m_fds[slots[i]] = -1;
+                --m_open;
+            }
+        }
+    }
+
+    int wait(BackendEvent *events, std::size_t capacity, int timeoutMs) override
+    {
+        struct timespec timeout {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+        if (m_received.size() < capacity)
+            m_received.resize(capacity);
+        struct kevent *received = m_received.data();
+        const int n = kevent(m_kq, nullptr, 0, received, static_cast<int>(capacity),
+                             timeoutMs < 0 ? nullptr : &timeout);
+        if (n < 0)
+            return -1;
+
+        int count = 0;
+        for (int i = 0; i < n; ++i) {
+            if (received[i].filter != EVFILT_VNODE || (received[i].flags & EV_ERROR))
+                continue;
+            events[count].slot = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(received[i].udata));
+            events[count].flags = flags(received[i].fflags);
+            ++count;
+        }
+        return count;
+    }
+
+    std::size_t descriptors() const override { return m_open; }
+
+private:
+    int m_kq;
+    std::vector<int> m_fds;     // descriptor of every slot, -1 if none
+    std::vector<struct kevent> m_received;
+    std::size_t m_open = 0;
+
+    void setDescriptor(uint32_t slot, int fd)
+    {
+        if (slot >= m_fds.size())
+            m_fds.resize(slot + 1, -1);
+        m_fds[slot] = fd;
+        ++m_open;
+    }
+
+    void fail(uint32_t slot, int &error, int code)
+    {
+        error = code;
+        remove(&slot, 1);
+    }
+
+    static uint32_t flags(uint32_t notes)
+    {
+        uint32_t flags = 0;
+        flags |= (notes & NOTE_DELETE) ? kWatchDelete : 0;
+        flags |= (notes & NOTE_WRITE) ? kWatchWrite : 0;
+        flags |= (notes & NOTE_EXTEND) ? kWatchExtend : 0;
+        flags |= (notes & NOTE_ATTRIB) ? kWatchAttrib : 0;
+        flags |= (notes & NOTE_LINK) ? kWatchLink : 0;
+        flags |= (notes & NOTE_RENAME) ? kWatchRename : 0;
+        flags |= (notes & NOTE_REVOKE) ? kWatchRevoke : 0;
+        return flags;
+    }
+};
+
+using DefaultWatchBackend = KqueueBackend;
+
+#else
+
+// inotify watches drained through epoll (which can wait on other descriptors as well). The
+// kernel hands out increasing watch descriptors, they index the slot table directly. inotify has
+// one watch per inode, adding a path whose inode is already watched fails with EEXIST.
+class InotifyBackend : public WatchBackend
+{
+public:
+    static constexpr std::size_t kReadBuffer = 256 * 1024;
+
+    InotifyBackend()
+        : m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), m_epoll(epoll_create1(EPOLL_CLOEXEC)),
+          m_buffer(kReadBuffer)
+    {
+        if (m_fd >= 0 && m_epoll >= 0) {
+            struct epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.fd = m_fd;
+            if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_fd, &event) != 0) {
+                close(m_epoll);
+                m_epoll = -1;
+            }
+        }
+    }
+    ~InotifyBackend() override
+    {
+        if (m_epoll >= 0)
+            close(m_epoll);
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+    InotifyBackend(const InotifyBackend&) = delete;
+    InotifyBackend &operator=(const InotifyBackend&) = delete;
+
+    bool valid() const { return m_fd >= 0 && m_epoll >= 0; }
+
+    void add(const uint32_t *slots, const char *const *paths, std::size_t count, int *errors) override
+    {
+        constexpr uint32_t mask = IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                | IN_DELETE_SELF | IN_MOVE_SELF
+#ifdef IN_MASK_CREATE
+                                | IN_MASK_CREATE    // EEXIST instead of sharing the watch of the inode
+#endif
+                                ;
+        for (std::size_t i = 0; i < count; ++i) {
+            const int wd = inotify_add_watch(m_fd, paths[i], mask);
+            errors[i] = (wd < 0) ? errno : 0;
+            if (wd < 0)
+                continue;
+            if (static_cast<std::size_t>(wd) >= m_wdToSlot.size())
+                m_wdToSlot.resize(static_cast<std::size_t>(wd) * 2 + 1, kNoSlot);
+            if (slots[i] >= m_slotToWd.size())
+                m_slotToWd.resize(slots[i] + 1, -1);
+            m_wdToSlot[static_cast<std::size_t>(wd)] = slots[i];
+            m_slotToWd[slots[i]] = wd;
+            ++m_watches;
+        }
+    }
+
+    void remove(const uint32_t *slots, std::size_t count) override
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (slots[i] >= m_slotToWd.size() || m_slotToWd[slots[i]] < 0)
+                continue;
+            const int wd = m_slotToWd[slots[i]];
+            inotify_rm_watch(m_fd, wd);
+            m_wdToSlot[static_cast<std::size_t>(wd)] = kNoSlot;
+            m_slotToWd[slots[i]] = -1;
+            --m_watches;
+        }
+    }
+
+    int wait(BackendEvent *events, std::size_t capacity, int timeoutMs) override
+    {
+        // Events left over from the previous read first
+        if (m_bufferOffset >= m_bufferLength) {
+            struct epoll_event ready;
+            const int n = epoll_wait(m_epoll, &ready, 1, timeoutMs);
+            if (n <= 0)
+                return n;
+            const ssize_t length = read(m_fd, m_buffer.data(), m_buffer.size());
+            if (length < 0)
+                return (errno == EAGAIN) ? 0 : -1;
+            m_bufferOffset = 0;
+            m_bufferLength = static_cast<std::size_t>(length);
+        }
+
+        std::size_t count = 0;
+        while (m_bufferOffset < m_bufferLength && count < capacity) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(m_buffer.data() + m_bufferOffset);
+            m_bufferOffset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                events[count++] = {kNoSlot, kWatchOverflow};
+                continue;
+            }
+            if (event->wd < 0 || static_cast<std::size_t>(event->wd) >= m_wdToSlot.size())
+                continue;
+            const uint32_t slot = m_wdToSlot[static_cast<std::size_t>(event->wd)];
+            if (slot == kNoSlot)
+                continue;
+            if (event->mask & IN_IGNORED) {
+                // The kernel dropped the watch (deleted or unmounted), the slot keeps no watch
+                m_wdToSlot[static_cast<std::size_t>(event->wd)] = kNoSlot;
+                m_slotToWd[slot] = -1;
+                --m_watches;
+                continue;
+            }
+            const uint32_t flags = this->flags(event->mask);
+            // Consecutive events of one watch are folded, as kqueue does with EV_CLEAR
+            if (count && events[count - 1].slot == slot)
+                events[count - 1].flags |= flags;
+            else
+                events[count++] = {slot, flags};
+        }
+        return static_cast<int>(count);
+    }
+
+    std::size_t descriptors() const override { return 2; }
+
+    std::size_t watches() const { return m_watches; }
+
+private:
+    int m_fd;
+    int m_epoll;
+    std::vector<uint32_t> m_wdToSlot;
+    std::vector<int> m_slotToWd;
+    std::size_t m_watches = 0;
+    std::vector<char> m_buffer;
+    std::size_t m_bufferOffset = 0;
+    std::size_t m_bufferLength = 0;
+
+    static uint32_t flags(uint32_t mask)
+    {
+        uint32_t flags = 0;
+        flags |= (mask & IN_DELETE_SELF) ? uint32_t(kWatchDelete) : 0u;
+        flags |= (mask & (IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) ? uint32_t(kWatchWrite) : 0u;
+        flags |= (mask & IN_ATTRIB) ? uint32_t(kWatchAttrib) : 0u;
+        // A subdirectory created or removed changes the link count of the directory
+        flags |= ((mask & IN_ISDIR) && (mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) ? uint32_t(kWatchLink) : 0u;
+        flags |= (mask & IN_MOVE_SELF) ? uint32_t(kWatchRename) : 0u;
+        flags |= (mask & IN_UNMOUNT) ? uint32_t(kWatchRevoke) : 0u;
+        return flags;
+    }
+};
+
+using DefaultWatchBackend = InotifyBackend;
+
+#endif
+
+// Watches many paths through a WatchBackend. Every watch has a record in a slot table; the slot
+// index goes to the kernel (udata, watch descriptor) and comes back with the events, so an
+// event finds its record by indexing. Freed slots are reused, handles carry a generation so a
+// stale handle does not reach the new watch of its slot.
+class Watcher
+{
+public:
+    using Handle = uint64_t;    // generation << 32 | slot, 0 is invalid
+
+    static constexpr std::size_t kEventBatch = 4096;
+
+    struct Event {
+        Handle watch;           // 0 for kWatchOverflow
+        const std::string *path;
+        uint32_t flags;
+    };
+
+    explicit Watcher(std::unique_ptr<WatchBackend> backend = std::make_unique<DefaultWatchBackend>())
+        : m_backend(std::move(backend)), m_events(kEventBatch) {}
+
+    // Adds the paths in one batch, a failed path gets handle 0 and its errno in errors (if any)
+    std::vector<Handle> add(const std::vector<std::string> &paths, std::vector<int> *errors = nullptr)
+    {
+        std::vector<Handle> handles(paths.size(), 0);
+        std::vector<uint32_t> slots(paths.size());
+        std::vector<const char *> cpaths(paths.size());
+        std::vector<int> codes(paths.size(), 0);
+
+        // The records may move while slots are allocated, the paths are taken afterwards
+        for (std::size_t i = 0; i < paths.size(); ++i)
+            slots[i] = allocate(paths[i]);
+        for (std::size_t i = 0; i < paths.size(); ++i)
+            cpaths[i] = m_records[slots[i]].path.c_str();
+        m_backend->add(slots.data(), cpaths.data(), paths.size(), codes.data());
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            if (codes[i] == 0)
+                handles[i] = handle(slots[i]);
+            else
+                release(slots[i]);
+        }
+        if (errors)
+            *errors = std::move(codes);
+        return handles;
+    }
+
+    // Returns 0 and sets errno on failure
+    Handle add(const std::string &path)
+    {
+        std::vector<int> errors;
+        const Handle h = add(std::vector<std::string>{path}, &errors)[0];
+        if (h == 0)
+            errno = errors[0];
+        return h;
+    }
+
+    void remove(const std::vector<Handle> &handles)
+    {
+        std::vector<uint32_t> slots;
+        slots.reserve(handles.size());
+        for (Handle h : handles)
+            if (live(h))
+                slots.push_back(static_cast<uint32_t>(h));
+        m_backend->remove(slots.data(), slots.size());
+        for (uint32_t slot : slots)
+            release(slot);
+    }
+
+    void remove(Handle h) { remove(std::vector<Handle>{h}); }
+
+    // Path of a live watch, nullptr otherwise
+    const std::string *path(Handle h) const { return live(h) ? &m_records[static_cast<uint32_t>(h)].path : nullptr; }
+
+    std::size_t size() const { return m_records.size() - m_free.size(); }
+    std::size_t descriptors() const { return m_backend->descriptors(); }
+
+    // Waits up to timeoutMs (-1 forever) and passes the drained events to f(const Event &).
+    // Returns the number of events or -1 and errno.
+    template <typename F>
+    int poll(int timeoutMs, F &&f)
+    {
+        const int n = m_backend->wait(m_events.data(), m_events.size(), timeoutMs);
+        int delivered = 0;
+        for (int i = 0; i < n; ++i) {
+            const BackendEvent &e = m_events[static_cast<std::size_t>(i)];
+            if (e.slot == WatchBackend::kNoSlot) {
+                f(Event {0, nullptr, e.flags});
+                ++delivered;
+                continue;
+            }
+            // Events of watches removed while they were queued are dropped
+            if (e.slot >= m_records.size() || !m_records[e.slot].used)
+                continue;
+            f(Event {handle(e.slot), &m_records[e.slot].path, e.flags});
+            ++delivered;
+        }
+        return (n < 0) ? -1 : delivered;
+    }
+
+private:
+    struct Record {
+        std::string path;
+        uint32_t generation = 0;
+        bool used = false;
+    };
+
+    std::unique_ptr<WatchBackend> m_backend;
+    std::vector<Record> m_records;
+    std::vector<uint32_t> m_free;
+    std::vector<BackendEvent> m_events;
+
+    Handle handle(uint32_t slot) const
+    {
+        return static_cast<Handle>(m_records[slot].generation) << 32 | slot;
+    }
+
+    bool live(Handle h) const
+    {
+        const uint32_t slot = static_cast<uint32_t>(h);
+        return h != 0 && slot < m_records.size() && m_records[slot].used
+            && m_records[slot].generation == static_cast<uint32_t>(h >> 32);
+    }
+
+    uint32_t allocate(const std::string &path)
+    {
+        uint32_t slot;
+        if (!m_free.empty()) {
+            slot = m_free.back();
+            m_free.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(m_records.size());
+            m_records.emplace_back();
+        }
+        Record &r = m_records[slot];
+        r.path = path;
+        r.used = true;
+        // Generations start at 1, so no handle is 0
+        ++r.generation;
+        return slot;
+    }
+
+    void release(uint32_t slot)
+    {
+        m_records[slot].used = false;
+        m_records[slot].path.clear();
+        m_free.push_back(slot);
+    }
+};
+
+} // namespace kev
+
+#endif /* Watcher_hpp */
@@ -11,17 +11,32 @@
 // - https://developer.apple.com/library/archive/samplecode/FileNotification/Introduction/Intro.html
 
 #include <atomic>           // std::atomic,
+#include <chrono>           // std::chrono::steady_clock
 #include <cerrno>           // errno
-#include <fcntl.h>          // O_EVTONLY
+#include <csignal>          // signal
+#include <cstring>          // strerror
 #include <iostream>         // std::cout, std::cerr,...
-#include <sys/event.h>      // kqueue, kevent,...
-#include <unistd.h>         // close
+#include <string>
+#include <sys/resource.h>  // getrlimit
+#include <vector>
+
+#include "../../../Common/Tools/FlagTable.hpp"
+#include "TreeWatcher.hpp"
+#include "Watcher.hpp"
 
-#define NUM_EVENT_SLOTS 1
-#define NUM_EVENT_FDS 1
- 
 std::atomic<bool> g_shouldStop {false};
-char *flagstring(int flags);
+
+static constexpr FlagName<uint32_t> g_watchFlagNames[] = {
+    {kev::kWatchDelete,     "NOTE_DELETE"},
+    {kev::kWatchWrite,      "NOTE_WRITE"},
+    {kev::kWatchExtend,     "NOTE_EXTEND"},
+    {kev::kWatchAttrib,     "NOTE_ATTRIB"},
+    {kev::kWatchLink,       "NOTE_LINK"},
+    {kev::kWatchRename,     "NOTE_RENAME"},
+    {kev::kWatchRevoke,     "NOTE_REVOKE"},
+    {kev::kWatchOverflow,   "OVERFLOW"},
+};
+static constexpr FlagTable g_watchFlags(g_watchFlagNames, "|");
 
 void signalHandler(int signum)
 {
@@ -30,8 +45,45 @@ void signalHandler(int signum)
     g_shouldStop = true;
 }
 
+// Watches the whole tree of root, with half of the descriptor limit for the kernel watches
+static int watchTree(const std::string &root)
+{
+    kev::TreeWatcher::Config config;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        config.budget = static_cast<std::size_t>(limit.rlim_cur / 2);
+
+    kev::TreeWatcher watcher(config);
+    if (!watcher.add(root)) {
+        std::cerr << "The tree " << root << " could not be opened for monitoring.  Error was "
+                  << strerror(errno) << ".\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "Watching " << watcher.directories() << " directories, " << watcher.hot()
+              << " through kernel watches, " << watcher.cold() << " by scanning." << std::endl;
+
+    // The polls return for the scan steps too, monitor for twenty seconds
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    char flags[g_watchFlags.maxLength() + 1];
+    while (std::chrono::steady_clock::now() < end && !g_shouldStop) {
+        const int event_count = watcher.poll(5500, [&](const kev::TreeWatcher::Event &event) {
+            g_watchFlags.format(event.flags, flags, sizeof(flags));
+            std::cout << (event.scanned ? "Scan" : "Event") << " flags " << flags
+                      << ", path " << (event.path ? *event.path : std::string("-")) << std::endl;
+        });
+        if (event_count < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "An error occurred.  The error was " << strerror(errno) << ".\n";
+            break;
+        }
+    }
+    std::cout << "Promoted " << watcher.promotions() << ", demoted " << watcher.demotions()
+              << ", scanned " << watcher.scanned() << " directories." << std::endl;
+    return 0;
+}
 
-int main()
+int main(int argc, const char *argv[])
 {
     // No runloop, no problem
     signal(SIGINT, signalHandler);
@@ -43,94 +95,46 @@ int main()
 
     std::cout << "(" << demoName << ") Hello, World!\n";
     std::cout << "Point of interest: " << demoPath << std::endl << std::endl;
-    
-    /* Open a kernel queue. */
-    int kq = kqueue();
-    if (kq < 0) {
-        std::cerr << "Could not open kernel queue.  Error was " << strerror(errno) << ".\n";
-        return EXIT_FAILURE;
+
+    // -r <dir> watches the tree of the directory (the demo path by default)
+    if (argc > 1 && std::string(argv[1]) == "-r")
+        return watchTree(argc > 2 ? argv[2] : demoPath);
+
+    // The demo path and the paths given as arguments, registered in one batch
+    std::vector<std::string> paths {demoPath};
+    for (int i = 1; i < argc; ++i)
+        paths.emplace_back(argv[i]);
+
+    kev::Watcher watcher;
+    std::vector<int> errors;
+    const std::vector<kev::Watcher::Handle> handles = watcher.add(paths, &errors);
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        if (handles[i] == 0)
+            std::cerr << "The file " << paths[i] << " could not be opened for monitoring.  Error was "
+                      << strerror(errors[i]) << ".\n";
     }
- 
-    /*
-       Open a file descriptor for the file/directory that you
-       want to monitor.
-     */
-    int event_fd = open(demoPath.c_str(), O_EVTONLY);
-    if (event_fd <=0) {
-        std::cerr << "The file " << demoPath << " could not be opened for monitoring.  Error was "
-                  << strerror(errno) << ".\n";
+    if (watcher.size() == 0)
         return EXIT_FAILURE;
-    }
- 
-    /*
-       The address in user_data will be copied into a field in the
-       event.  If you are monitoring multiple files, you could,
-       for example, pass in different data structure for each file.
-       For this example, the path string is used.
-     */
-    void *user_data = (void *)demoPath.c_str();
- 
-    /* Set the timeout to wake us every 5 and half second. */
-    struct timespec timeout {
-        .tv_sec = 5,            // 5 seconds
-        .tv_nsec = 500000000    // 500 milliseconds
-    };
- 
-    /* Set up a list of events to monitor. */
-    unsigned int vnode_events;
-    struct kevent events_to_monitor[NUM_EVENT_FDS];
-    vnode_events = (NOTE_DELETE | NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE);
-    EV_SET(&events_to_monitor[0], event_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, vnode_events, 0, user_data);
- 
-    /* Handle events. */
-    int num_files = 1;
+
+    /* Handle events, wake up every 5 and half second. */
     int continue_loop = 40; /* Monitor for twenty seconds. */
-    struct kevent event_data[NUM_EVENT_SLOTS];
+    char flags[g_watchFlags.maxLength() + 1];
     while (--continue_loop && !g_shouldStop) {
-        int event_count = kevent(kq, events_to_monitor, NUM_EVENT_SLOTS, event_data, num_files, &timeout);
-        if ((event_count < 0) || (event_data[0].flags == EV_ERROR)) {
+        const int event_count = watcher.poll(5500, [&](const kev::Watcher::Event &event) {
+            g_watchFlags.format(event.flags, flags, sizeof(flags));
+            std::cout << "Event " << (event.watch & 0xffffffff) << " occurred."
+                      << " Filter flags " << flags
+                      << ", path " << (event.path ? *event.path : std::string("-")) << std::endl;
+        });
+        if (event_count < 0) {
+            if (errno == EINTR)
+                continue;
             /* An error occurred. */
-            std::cerr << "An error occurred (event count " << event_count << ").  The error was "
-                      << strerror(errno) << ".\n";
+            std::cerr << "An error occurred.  The error was " << strerror(errno) << ".\n";
             break;
         }
-        if (event_count) {
-            std::cout << "Event " << event_data[0].ident << " occurred."
-                      << " Filter " << event_data[0].filter
-                      << ", flags " << event_data[0].flags
-                      << ", filter flags " << flagstring(event_data[0].fflags)
-                      << ", filter data " << event_data[0].data
-                      << ", path " << (char *)event_data[0].udata << std::endl;
-                
-        } else {
+        if (event_count == 0)
             std::cout << "No event." << std::endl;
-        }
- 
-        /* Reset the timeout.  In case of a signal interrruption, the
-           values may change. */
-        timeout.tv_sec = 5;             // 5 seconds
-        timeout.tv_nsec = 500000000;    // 500 milliseconds
     }
-    close(event_fd);
     return 0;
 }
-
-
-/* A simple routine to return a string for a set of flags. */
-char *flagstring(int flags)
-{
-    static char ret[512];
-    char *s_or = "";
- 
-    ret[0]='\0'; // clear the string.
-    if (flags & NOTE_DELETE) {strcat(ret,s_or);strcat(ret,"NOTE_DELETE");s_or="|";}
-    if (flags & NOTE_WRITE) {strcat(ret,s_or);strcat(ret,"NOTE_WRITE");s_or="|";}
-    if (flags & NOTE_EXTEND) {strcat(ret,s_or);strcat(ret,"NOTE_EXTEND");s_or="|";}
-    if (flags & NOTE_ATTRIB) {strcat(ret,s_or);strcat(ret,"NOTE_ATTRIB");s_or="|";}
-    if (flags & NOTE_LINK) {strcat(ret,s_or);strcat(ret,"NOTE_LINK");s_or="|";}
-    if (flags & NOTE_RENAME) {strcat(ret,s_or);strcat(ret,"NOTE_RENAME");s_or="|";}
-    if (flags & NOTE_REVOKE) {strcat(ret,s_or);strcat(ret,"NOTE_REVOKE");s_or="|";}
- 
-    return ret;
-}
-